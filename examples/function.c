@@ -0,0 +1,142 @@
+#include "pdf/function.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "arena/arena.h"
+#include "err/error.h"
+#include "logger/log.h"
+#include "pdf/object.h"
+#include "pdf/resolver.h"
+#include "pdf/types.h"
+
+#define ITERATIONS 10000000
+
+/// A tint transform from a two-component DeviceN space to CMYK
+static const char* tint_transform =
+    "{ 2 copy 0.85 mul exch 0.1 mul add 3 1 roll "
+    "2 copy 0.25 mul exch 0.9 mul add 3 1 roll "
+    "1 exch sub 0.4 mul exch 0.2 mul }";
+
+static void log_timing(
+    const char* name,
+    struct timespec start,
+    struct timespec end,
+    double checksum
+) {
+    double elapsed_ns = (double)(end.tv_sec - start.tv_sec) * 1e9
+                      + (double)(end.tv_nsec - start.tv_nsec);
+    LOG_DIAG(
+        INFO,
+        EXAMPLE,
+        "%s: %d tint transform evaluations in %.0f ms (%.1f ns each, "
+        "checksum %f)",
+        name,
+        ITERATIONS,
+        elapsed_ns / 1e6,
+        elapsed_ns / ITERATIONS,
+        checksum
+    );
+}
+
+int main(void) {
+    Arena* arena = arena_new(4096);
+
+    const char* header = "%PDF-1.4\n";
+    char object[512];
+    int object_len = snprintf(
+        object,
+        sizeof(object),
+        "1 0 obj\n<< /FunctionType 4 /Domain [0 1 0 1] "
+        "/Range [0 1 0 1 0 1 0 1] /Length %zu >>\nstream\n%s\nendstream\n"
+        "endobj\n",
+        strlen(tint_transform),
+        tint_transform
+    );
+    RELEASE_ASSERT(object_len > 0 && (size_t)object_len < sizeof(object));
+
+    size_t doc_capacity = 1024;
+    char* doc = arena_alloc(arena, doc_capacity);
+    int doc_len = snprintf(
+        doc,
+        doc_capacity,
+        "%s%sxref\n0 2\n0000000000 65535 f \n%010zu 00000 n \n"
+        "trailer\n<< /Size 2 /Root 1 0 R >>\nstartxref\n%zu\n%%%%EOF\n",
+        header,
+        object,
+        strlen(header),
+        strlen(header) + (size_t)object_len
+    );
+    RELEASE_ASSERT(doc_len > 0 && (size_t)doc_len < doc_capacity);
+
+    PdfResolver* resolver;
+    REQUIRE(
+        pdf_resolver_new(arena, (uint8_t*)doc, (size_t)doc_len, &resolver)
+    );
+
+    PdfObject function_object;
+    REQUIRE(pdf_resolve_ref(
+        resolver,
+        (PdfIndirectRef) {.object_id = 1, .generation = 0},
+        &function_object
+    ));
+
+    PdfFunction function;
+    REQUIRE(pdf_deserde_function(&function_object, &function, resolver));
+    RELEASE_ASSERT(function.output_count == 4);
+
+    // Through the boxed PdfObject interface
+    PdfObjectVec* io = pdf_object_vec_new(arena);
+    double checksum = 0.0;
+
+    struct timespec start;
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t idx = 0; idx < ITERATIONS; idx++) {
+        double t = (double)idx / (double)ITERATIONS;
+
+        pdf_object_vec_clear(io);
+        pdf_object_vec_push(
+            io,
+            (PdfObject) {.type = PDF_OBJECT_TYPE_REAL, .data.real = t}
+        );
+        pdf_object_vec_push(
+            io,
+            (PdfObject) {.type = PDF_OBJECT_TYPE_REAL, .data.real = 1.0 - t}
+        );
+        REQUIRE(pdf_run_function(&function, arena, io));
+
+        for (size_t output_idx = 0; output_idx < pdf_object_vec_len(io);
+             output_idx++) {
+            PdfObject output;
+            RELEASE_ASSERT(pdf_object_vec_get(io, output_idx, &output));
+
+            PdfNumber number;
+            REQUIRE(pdf_deserde_number(&output, &number, NULL));
+            checksum += pdf_number_as_real(number);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    log_timing("pdf_run_function", start, end, checksum);
+
+    // Through the double interface
+    checksum = 0.0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t idx = 0; idx < ITERATIONS; idx++) {
+        double t = (double)idx / (double)ITERATIONS;
+        double inputs[2] = {t, 1.0 - t};
+        double outputs[4];
+        REQUIRE(pdf_eval_function(&function, inputs, outputs));
+
+        for (size_t output_idx = 0; output_idx < 4; output_idx++) {
+            checksum += outputs[output_idx];
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    log_timing("pdf_eval_function", start, end, checksum);
+
+    arena_free(arena);
+    return 0;
+}
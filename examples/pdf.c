@@ -34,6 +34,9 @@ int main(int argc, char** argv) {
     PdfPageIter* page_iter = NULL;
     REQUIRE(pdf_page_iter_new(resolver, catalog.pages, &page_iter));
 
+    RenderDocumentCache* cache =
+        render_document_cache_new(RENDER_DEFAULT_GLYPH_CACHE_BUDGET);
+
     bool iter_done = false;
     PdfPage page;
     while (true) {
@@ -46,6 +49,7 @@ int main(int argc, char** argv) {
         REQUIRE(render_page(
             arena,
             resolver,
+            cache,
             &page,
             RENDER_CANVAS_TYPE_SCALABLE,
             &canvas
@@ -53,6 +57,8 @@ int main(int argc, char** argv) {
         canvas_write_file(canvas, "test.svg");
     };
 
+    render_document_cache_free(cache);
+
     LOG_DIAG(INFO, EXAMPLE, "Finished");
 
     arena_free(arena);
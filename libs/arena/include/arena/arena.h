@@ -28,6 +28,10 @@ void* arena_alloc_align(
     size_t align
 ) RET_NONNULL_ATTR MALLOC_ALIGNED_ATTR(2, 3);
 
+/// Returns the total number of bytes reserved by the arena's blocks. This is
+/// the amount of memory released by `arena_free`.
+size_t arena_capacity(const Arena* arena);
+
 /// Resets the arena, invalidating everything previously allocated on it. Note
 /// that this does not free any memory.
 void arena_reset(Arena* arena);
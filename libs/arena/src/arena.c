@@ -198,6 +198,19 @@ void* arena_alloc_align(Arena* arena, size_t size, size_t align) {
     return (void*)aligned_ptr;
 }
 
+size_t arena_capacity(const Arena* arena) {
+    RELEASE_ASSERT(arena);
+    RELEASE_ASSERT(arena->blocks);
+
+    size_t capacity = 0;
+    for (size_t block_idx = 0; block_idx < arena->num_blocks; block_idx++) {
+        const ArenaBlock* block = &arena->blocks[block_idx];
+        capacity += (size_t)(block->end - block->start);
+    }
+
+    return capacity;
+}
+
 void arena_reset(Arena* arena) {
     RELEASE_ASSERT(arena);
     RELEASE_ASSERT(arena->blocks);
@@ -288,4 +301,17 @@ TEST_FUNC(test_arena_fill) {
     return TEST_RESULT_PASS;
 }
 
+TEST_FUNC(test_arena_capacity) {
+    Arena* arena = arena_new(256);
+    TEST_ASSERT_EQ(arena_capacity(arena), (size_t)256);
+
+    // Overflowing the first block adds a second one
+    arena_alloc(arena, 200);
+    arena_alloc(arena, 200);
+    TEST_ASSERT_EQ(arena_capacity(arena), (size_t)512);
+
+    arena_free(arena);
+    return TEST_RESULT_PASS;
+}
+
 #endif // TEST
@@ -5,6 +5,7 @@
 #include <stdint.h>
 
 #include "arena/arena.h"
+#include "arena/common.h"
 #include "canvas/path_builder.h"
 #include "color/rgb.h"
 
@@ -34,6 +35,49 @@ typedef struct CanvasBrush {
     double miter_limit;
 } CanvasBrush;
 
+/// An 8-bit coverage mask rasterized from a path. The top-left pixel of the
+/// mask sits at (`origin_x`, `origin_y`) relative to the path's origin.
+typedef struct CanvasMask {
+    int32_t origin_x;
+    int32_t origin_y;
+    uint32_t width;
+    uint32_t height;
+    Uint8Array* coverage;
+} CanvasMask;
+
+typedef enum CanvasGradientType {
+    CANVAS_GRADIENT_LINEAR,
+    CANVAS_GRADIENT_RADIAL
+} CanvasGradientType;
+
+typedef struct CanvasGradientStop {
+    double offset;
+    Rgba rgba;
+} CanvasGradientStop;
+
+/// A gradient whose color varies from offset 0 to offset 1. Linear gradients
+/// vary along the axis from `start` to `end`. Radial gradients vary over the
+/// circles interpolated between the circle of `start_radius` around `start`
+/// and the circle of `end_radius` around `end`, with later circles painted
+/// over earlier ones. The color beyond either end is the color at that end if
+/// it's extended, and nothing is painted there otherwise.
+typedef struct CanvasGradient {
+    CanvasGradientType type;
+    GeomVec2 start;
+    GeomVec2 end;
+    double start_radius;
+    double end_radius;
+    bool extend_start;
+    bool extend_end;
+
+    /// Stops in increasing order of offset, from 0 to 1.
+    const CanvasGradientStop* stops;
+    size_t stop_count;
+
+    /// Maps the space the gradient is given in onto the canvas.
+    GeomMat3 transform;
+} CanvasGradient;
+
 typedef struct Canvas Canvas;
 
 Canvas* canvas_new_raster(
@@ -43,6 +87,19 @@ Canvas* canvas_new_raster(
     Rgba rgba
 );
 
+/// Creates a `width` x `height` raster canvas which only holds and draws to
+/// rows `row_begin` to `row_end`, so a large canvas can be drawn a band of
+/// rows at a time. Those rows come out exactly as if the whole canvas were
+/// drawn.
+Canvas* canvas_new_raster_band(
+    Arena* arena,
+    uint32_t width,
+    uint32_t height,
+    uint32_t row_begin,
+    uint32_t row_end,
+    Rgba rgba
+);
+
 Canvas* canvas_new_scalable(
     Arena* arena,
     uint32_t width,
@@ -54,6 +111,14 @@ Canvas* canvas_new_scalable(
 bool canvas_is_raster(Canvas* canvas);
 double canvas_raster_res(Canvas* canvas);
 
+/// Finds the area drawing to `canvas` can still reach, limited to the current
+/// clip where the canvas tracks one. Returns false if nothing can be drawn.
+bool canvas_draw_bounds(Canvas* canvas, GeomRect* bounds_out);
+
+/// Gets row `y` of a raster canvas as premultiplied RGBA8 pixels, running
+/// left to right over the canvas's width.
+const uint8_t* canvas_raster_row(Canvas* canvas, uint32_t y);
+
 void canvas_draw_circle(
     Canvas* canvas,
     double x,
@@ -91,6 +156,34 @@ void canvas_draw_path(
     CanvasBrush brush
 );
 
+/// Rasterizes a flattened `path` into a standalone mask allocated on `arena`,
+/// so it can be drawn repeatedly with `canvas_draw_mask`. Returns `false` if
+/// the canvas can't draw masks or either dimension would exceed `max_size`.
+bool canvas_rasterize_mask(
+    Canvas* canvas,
+    Arena* arena,
+    const PathBuilder* path,
+    bool even_odd_rule,
+    uint32_t max_size,
+    CanvasMask* mask_out
+);
+
+/// Composites `rgba` through `mask`, with the mask's path origin placed at
+/// the integer pixel (`x`, `y`).
+void canvas_draw_mask(
+    Canvas* canvas,
+    const CanvasMask* mask,
+    int32_t x,
+    int32_t y,
+    Rgba rgba
+);
+
+/// Composites the premultiplied pixels of the raster canvas `source` over
+/// `canvas`, with the top-left pixel of `source` placed at the integer pixel
+/// (`x`, `y`). Recordings keep a reference to `source` rather than a copy, so
+/// it must outlive them.
+void canvas_draw_raster(Canvas* canvas, Canvas* source, int32_t x, int32_t y);
+
 void canvas_push_clip_path(
     Canvas* canvas,
     const PathBuilder* path,
@@ -101,5 +194,46 @@ void canvas_pop_clip_paths(Canvas* canvas, size_t count);
 
 void canvas_draw_pixel(Canvas* canvas, GeomVec2 position, Rgba rgba);
 
+/// Composites `count` premultiplied RGBA8 `pixels` source-over row `y` of the
+/// canvas, starting at column `x`, through the current clip. Pixels are
+/// `canvas_raster_res` units across, the same as those of `canvas_draw_pixel`.
+void canvas_draw_span(
+    Canvas* canvas,
+    int32_t x,
+    int32_t y,
+    size_t count,
+    const uint8_t* pixels
+);
+
+/// Paints everything `gradient` covers within the current clip as a single
+/// native gradient. Returns false without drawing anything if the canvas has
+/// no native gradient that can represent it, which is always the case for
+/// raster canvases and recordings.
+bool canvas_draw_gradient(Canvas* canvas, const CanvasGradient* gradient);
+
+/// Draws the pixels of the raster canvas `image` stretched over `rect`. Only
+/// scalable canvases draw images, since raster canvases composite other
+/// rasters with `canvas_draw_raster`.
+void canvas_draw_image(Canvas* canvas, Canvas* image, GeomRect rect);
+
+/// Draws content that can only be drawn once the transform to the final
+/// canvas is known, such as a shading sampled once per pixel. `transform`
+/// maps the space the content was submitted in onto `canvas`.
+typedef void (*CanvasDeferredDraw)(
+    const void* data,
+    GeomMat3 transform,
+    Canvas* canvas
+);
+
+/// Submits deferred content. Most canvases call `draw` straight away with the
+/// identity transform. Vector recordings instead keep a copy of the
+/// `data_size` bytes at `data`, and call `draw` when they're replayed.
+void canvas_draw_deferred(
+    Canvas* canvas,
+    CanvasDeferredDraw draw,
+    const void* data,
+    size_t data_size
+);
+
 /// Writes the canvas to a file. Returns `true` on success.
 bool canvas_write_file(Canvas* canvas, const char* path);
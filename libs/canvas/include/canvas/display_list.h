@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena/arena.h"
+#include "canvas/canvas.h"
+#include "geom/mat3.h"
+
+/// The drawing commands sent to a canvas, recorded so they can be replayed
+/// onto another canvas.
+typedef struct CanvasDisplayList CanvasDisplayList;
+
+/// Creates an empty display list for a `width` x `height` canvas. Raster
+/// display lists record commands the way a raster canvas expects them, with
+/// flattened paths and rasterized glyph masks, so they can only be replayed
+/// onto a canvas of the same size. Vector display lists keep curves, glyph
+/// outlines and deferred content, so they can be replayed at any transform.
+CanvasDisplayList* canvas_display_list_new(
+    Arena* arena,
+    uint32_t width,
+    uint32_t height,
+    bool is_raster
+);
+
+/// Creates a canvas that records every command drawn to it into `list`.
+Canvas* canvas_new_recording(Arena* arena, CanvasDisplayList* list);
+
+size_t canvas_display_list_len(const CanvasDisplayList* list);
+
+/// Draws every recorded command onto `target`, in order.
+void canvas_display_list_replay(const CanvasDisplayList* list, Canvas* target);
+
+/// Draws every command of a vector display list onto `target` after mapping
+/// it through `transform`. Curves are flattened for the target's resolution,
+/// and stroke widths are multiplied by `width_scale`.
+void canvas_display_list_replay_transformed(
+    const CanvasDisplayList* list,
+    Canvas* target,
+    GeomMat3 transform,
+    double width_scale
+);
+
+/// Draws a raster display list onto the raster canvas `target` using
+/// `thread_count` threads. The canvas is split into tiles of `tile_height`
+/// full-width rows, each command is binned into the tiles its bounds reach,
+/// and each tile replays its commands in order. The result is identical to
+/// `canvas_display_list_replay`.
+void canvas_display_list_rasterize_tiled(
+    const CanvasDisplayList* list,
+    Canvas* target,
+    uint32_t tile_height,
+    uint32_t thread_count
+);
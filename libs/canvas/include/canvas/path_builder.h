@@ -4,6 +4,7 @@
 
 #include "arena/arena.h"
 #include "geom/mat3.h"
+#include "geom/rect.h"
 #include "geom/vec2.h"
 
 typedef struct PathBuilder PathBuilder;
@@ -41,3 +42,17 @@ void path_builder_cubic_bezier_to(
 );
 
 void path_builder_apply_transform(PathBuilder* path, GeomMat3 transform);
+
+/// Finds the bounds of every point in the path, including curve control
+/// points, so the bounds contain the curves. Returns `false` if the path has
+/// no points.
+bool path_builder_bounds(const PathBuilder* path, GeomRect* bounds_out);
+
+/// Appends every contour of `src`, transformed by `transform`, to `dst`. Curves
+/// are flattened according to the options of `dst`, so a curved path can be
+/// reused at any scale.
+void path_builder_append_transformed(
+    PathBuilder* dst,
+    const PathBuilder* src,
+    GeomMat3 transform
+);
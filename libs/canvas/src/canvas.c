@@ -2,6 +2,9 @@
 
 #include "arena/arena.h"
 #include "canvas.h"
+#include "canvas/display_list.h"
+#include "geom/mat3.h"
+#include "display_list.h"
 #include "logger/log.h"
 #include "raster_canvas.h"
 #include "scalable_canvas.h"
@@ -10,9 +13,14 @@ struct Canvas {
     union {
         RasterCanvas* raster;
         ScalableCanvas* scalable;
+        CanvasDisplayList* recording;
     } data;
 
-    enum { CANVAS_TYPE_SCALABLE, CANVAS_TYPE_RASTER } type;
+    enum {
+        CANVAS_TYPE_SCALABLE,
+        CANVAS_TYPE_RASTER,
+        CANVAS_TYPE_RECORDING
+    } type;
 };
 
 Canvas* canvas_new_raster(
@@ -28,6 +36,28 @@ Canvas* canvas_new_raster(
     return canvas;
 }
 
+Canvas* canvas_new_raster_band(
+    Arena* arena,
+    uint32_t width,
+    uint32_t height,
+    uint32_t row_begin,
+    uint32_t row_end,
+    Rgba rgba
+) {
+    Canvas* canvas = arena_alloc(arena, sizeof(Canvas));
+    canvas->data.raster = raster_canvas_new_band(
+        arena,
+        width,
+        height,
+        row_begin,
+        row_end,
+        rgba
+    );
+    canvas->type = CANVAS_TYPE_RASTER;
+
+    return canvas;
+}
+
 Canvas* canvas_from_raster(Arena* arena, RasterCanvas* raster_canvas) {
     Canvas* canvas = arena_alloc(arena, sizeof(Canvas));
     canvas->data.raster = raster_canvas;
@@ -36,6 +66,32 @@ Canvas* canvas_from_raster(Arena* arena, RasterCanvas* raster_canvas) {
     return canvas;
 }
 
+RasterCanvas* canvas_get_raster(Canvas* canvas) {
+    RELEASE_ASSERT(canvas);
+    RELEASE_ASSERT(canvas->type == CANVAS_TYPE_RASTER);
+    return canvas->data.raster;
+}
+
+CanvasDisplayList* canvas_get_recording(Canvas* canvas) {
+    RELEASE_ASSERT(canvas);
+    if (canvas->type != CANVAS_TYPE_RECORDING) {
+        return NULL;
+    }
+
+    return canvas->data.recording;
+}
+
+Canvas* canvas_new_recording(Arena* arena, CanvasDisplayList* list) {
+    RELEASE_ASSERT(arena);
+    RELEASE_ASSERT(list);
+
+    Canvas* canvas = arena_alloc(arena, sizeof(Canvas));
+    canvas->data.recording = list;
+    canvas->type = CANVAS_TYPE_RECORDING;
+
+    return canvas;
+}
+
 Canvas* canvas_new_scalable(
     Arena* arena,
     uint32_t width,
@@ -53,18 +109,64 @@ Canvas* canvas_new_scalable(
 
 bool canvas_is_raster(Canvas* canvas) {
     RELEASE_ASSERT(canvas);
+    if (canvas->type == CANVAS_TYPE_RECORDING) {
+        return canvas_display_list_is_raster(canvas->data.recording);
+    }
+
     return canvas->type == CANVAS_TYPE_RASTER;
 }
 
 double canvas_raster_res(Canvas* canvas) {
     RELEASE_ASSERT(canvas);
-    if (canvas->type == CANVAS_TYPE_RASTER) {
-        return raster_canvas_raster_res(canvas->data.raster);
-    } else {
-        return scalable_canvas_raster_res(canvas->data.scalable);
+    switch (canvas->type) {
+        case CANVAS_TYPE_RASTER: {
+            return raster_canvas_raster_res(canvas->data.raster);
+        }
+        case CANVAS_TYPE_SCALABLE: {
+            return scalable_canvas_raster_res(canvas->data.scalable);
+        }
+        case CANVAS_TYPE_RECORDING: {
+            // Recorded commands are in device space
+            return 1.0;
+        }
+        default: {
+            LOG_PANIC("Unreachable");
+        }
+    }
+}
+
+bool canvas_draw_bounds(Canvas* canvas, GeomRect* bounds_out) {
+    RELEASE_ASSERT(canvas);
+    RELEASE_ASSERT(bounds_out);
+
+    switch (canvas->type) {
+        case CANVAS_TYPE_RASTER: {
+            return raster_canvas_draw_bounds(canvas->data.raster, bounds_out);
+        }
+        case CANVAS_TYPE_SCALABLE: {
+            return scalable_canvas_draw_bounds(
+                canvas->data.scalable,
+                bounds_out
+            );
+        }
+        case CANVAS_TYPE_RECORDING: {
+            return canvas_display_list_draw_bounds(
+                canvas->data.recording,
+                bounds_out
+            );
+        }
+        default: {
+            LOG_PANIC("Unreachable");
+        }
     }
 }
 
+const uint8_t* canvas_raster_row(Canvas* canvas, uint32_t y) {
+    RELEASE_ASSERT(canvas);
+    RELEASE_ASSERT(canvas->type == CANVAS_TYPE_RASTER);
+    return raster_canvas_row(canvas->data.raster, y);
+}
+
 void canvas_draw_circle(
     Canvas* canvas,
     double x,
@@ -87,6 +189,16 @@ void canvas_draw_circle(
             );
             break;
         }
+        case CANVAS_TYPE_RECORDING: {
+            canvas_display_list_draw_circle(
+                canvas->data.recording,
+                x,
+                y,
+                radius,
+                rgba
+            );
+            break;
+        }
         default: {
             LOG_PANIC("Unreachable");
         }
@@ -127,6 +239,18 @@ void canvas_draw_line(
             );
             break;
         }
+        case CANVAS_TYPE_RECORDING: {
+            canvas_display_list_draw_line(
+                canvas->data.recording,
+                x1,
+                y1,
+                x2,
+                y2,
+                radius,
+                rgba
+            );
+            break;
+        }
         default: {
             LOG_PANIC("Unreachable");
         }
@@ -175,6 +299,21 @@ void canvas_draw_bezier(
             );
             break;
         }
+        case CANVAS_TYPE_RECORDING: {
+            canvas_display_list_draw_bezier(
+                canvas->data.recording,
+                x1,
+                y1,
+                x2,
+                y2,
+                cx,
+                cy,
+                flatness,
+                radius,
+                rgba
+            );
+            break;
+        }
         default: {
             LOG_PANIC("Unreachable");
         }
@@ -198,6 +337,121 @@ void canvas_draw_path(
             scalable_canvas_draw_path(canvas->data.scalable, path, brush);
             break;
         }
+        case CANVAS_TYPE_RECORDING: {
+            canvas_display_list_draw_path(canvas->data.recording, path, brush);
+            break;
+        }
+        default: {
+            LOG_PANIC("Unreachable");
+        }
+    }
+}
+
+bool canvas_rasterize_mask(
+    Canvas* canvas,
+    Arena* arena,
+    const PathBuilder* path,
+    bool even_odd_rule,
+    uint32_t max_size,
+    CanvasMask* mask_out
+) {
+    RELEASE_ASSERT(canvas);
+    RELEASE_ASSERT(arena);
+    RELEASE_ASSERT(path);
+    RELEASE_ASSERT(mask_out);
+
+    switch (canvas->type) {
+        case CANVAS_TYPE_RASTER: {
+            return raster_canvas_rasterize_mask(
+                arena,
+                path,
+                even_odd_rule,
+                max_size,
+                mask_out
+            );
+        }
+        case CANVAS_TYPE_SCALABLE: {
+            return false;
+        }
+        case CANVAS_TYPE_RECORDING: {
+            if (!canvas_display_list_is_raster(canvas->data.recording)) {
+                return false;
+            }
+
+            return raster_canvas_rasterize_mask(
+                arena,
+                path,
+                even_odd_rule,
+                max_size,
+                mask_out
+            );
+        }
+        default: {
+            LOG_PANIC("Unreachable");
+        }
+    }
+}
+
+void canvas_draw_mask(
+    Canvas* canvas,
+    const CanvasMask* mask,
+    int32_t x,
+    int32_t y,
+    Rgba rgba
+) {
+    RELEASE_ASSERT(canvas);
+    RELEASE_ASSERT(mask);
+
+    switch (canvas->type) {
+        case CANVAS_TYPE_RASTER: {
+            raster_canvas_draw_mask(canvas->data.raster, mask, x, y, rgba);
+            break;
+        }
+        case CANVAS_TYPE_SCALABLE: {
+            LOG_PANIC("Masks can only be drawn on raster canvases");
+        }
+        case CANVAS_TYPE_RECORDING: {
+            canvas_display_list_draw_mask(
+                canvas->data.recording,
+                mask,
+                x,
+                y,
+                rgba
+            );
+            break;
+        }
+        default: {
+            LOG_PANIC("Unreachable");
+        }
+    }
+}
+
+void canvas_draw_raster(Canvas* canvas, Canvas* source, int32_t x, int32_t y) {
+    RELEASE_ASSERT(canvas);
+    RELEASE_ASSERT(source);
+
+    switch (canvas->type) {
+        case CANVAS_TYPE_RASTER: {
+            raster_canvas_draw_raster(
+                canvas->data.raster,
+                canvas_get_raster(source),
+                x,
+                y
+            );
+            break;
+        }
+        case CANVAS_TYPE_SCALABLE: {
+            LOG_PANIC("Rasters can only be drawn on raster canvases");
+        }
+        case CANVAS_TYPE_RECORDING: {
+            canvas_display_list_draw_raster(
+                canvas->data.recording,
+                source,
+                x,
+                y
+            );
+            break;
+        }
         default: {
             LOG_PANIC("Unreachable");
         }
@@ -229,6 +483,14 @@ void canvas_push_clip_path(
             );
             break;
         }
+        case CANVAS_TYPE_RECORDING: {
+            canvas_display_list_push_clip_path(
+                canvas->data.recording,
+                path,
+                even_odd_rule
+            );
+            break;
+        }
         default: {
             LOG_PANIC("Unreachable");
         }
@@ -247,6 +509,10 @@ void canvas_pop_clip_paths(Canvas* canvas, size_t count) {
             scalable_canvas_pop_clip_paths(canvas->data.scalable, count);
             break;
         }
+        case CANVAS_TYPE_RECORDING: {
+            canvas_display_list_pop_clip_paths(canvas->data.recording, count);
+            break;
+        }
         default: {
             LOG_PANIC("Unreachable");
         }
@@ -265,12 +531,129 @@ void canvas_draw_pixel(Canvas* canvas, GeomVec2 position, Rgba rgba) {
             scalable_canvas_draw_pixel(canvas->data.scalable, position, rgba);
             break;
         }
+        case CANVAS_TYPE_RECORDING: {
+            canvas_display_list_draw_pixel(
+                canvas->data.recording,
+                position,
+                rgba
+            );
+            break;
+        }
+        default: {
+            LOG_PANIC("Unreachable");
+        }
+    }
+}
+
+void canvas_draw_span(
+    Canvas* canvas,
+    int32_t x,
+    int32_t y,
+    size_t count,
+    const uint8_t* pixels
+) {
+    RELEASE_ASSERT(canvas);
+    RELEASE_ASSERT(pixels || count == 0);
+
+    switch (canvas->type) {
+        case CANVAS_TYPE_RASTER: {
+            raster_canvas_draw_span(canvas->data.raster, x, y, count, pixels);
+            break;
+        }
+        case CANVAS_TYPE_SCALABLE: {
+            scalable_canvas_draw_span(
+                canvas->data.scalable,
+                x,
+                y,
+                count,
+                pixels
+            );
+            break;
+        }
+        case CANVAS_TYPE_RECORDING: {
+            canvas_display_list_draw_span(
+                canvas->data.recording,
+                x,
+                y,
+                count,
+                pixels
+            );
+            break;
+        }
         default: {
             LOG_PANIC("Unreachable");
         }
     }
 }
 
+bool canvas_draw_gradient(Canvas* canvas, const CanvasGradient* gradient) {
+    RELEASE_ASSERT(canvas);
+    RELEASE_ASSERT(gradient);
+
+    switch (canvas->type) {
+        case CANVAS_TYPE_RASTER:
+        case CANVAS_TYPE_RECORDING: {
+            return false;
+        }
+        case CANVAS_TYPE_SCALABLE: {
+            return scalable_canvas_draw_gradient(
+                canvas->data.scalable,
+                gradient
+            );
+        }
+        default: {
+            LOG_PANIC("Unreachable");
+        }
+    }
+}
+
+void canvas_draw_image(Canvas* canvas, Canvas* image, GeomRect rect) {
+    RELEASE_ASSERT(canvas);
+    RELEASE_ASSERT(image);
+
+    switch (canvas->type) {
+        case CANVAS_TYPE_RASTER:
+        case CANVAS_TYPE_RECORDING: {
+            LOG_PANIC("Images can only be drawn on scalable canvases");
+        }
+        case CANVAS_TYPE_SCALABLE: {
+            scalable_canvas_draw_image(
+                canvas->data.scalable,
+                canvas_get_raster(image),
+                rect
+            );
+            break;
+        }
+        default: {
+            LOG_PANIC("Unreachable");
+        }
+    }
+}
+
+void canvas_draw_deferred(
+    Canvas* canvas,
+    CanvasDeferredDraw draw,
+    const void* data,
+    size_t data_size
+) {
+    RELEASE_ASSERT(canvas);
+    RELEASE_ASSERT(draw);
+
+    // Raster recordings are already in their final device space
+    if (canvas->type == CANVAS_TYPE_RECORDING
+        && !canvas_display_list_is_raster(canvas->data.recording)) {
+        canvas_display_list_draw_deferred(
+            canvas->data.recording,
+            draw,
+            data,
+            data_size
+        );
+        return;
+    }
+
+    draw(data, geom_mat3_identity(), canvas);
+}
+
 bool canvas_write_file(Canvas* canvas, const char* path) {
     switch (canvas->type) {
         case CANVAS_TYPE_RASTER: {
@@ -279,6 +662,9 @@ bool canvas_write_file(Canvas* canvas, const char* path) {
         case CANVAS_TYPE_SCALABLE: {
             return scalable_canvas_write_file(canvas->data.scalable, path);
         }
+        case CANVAS_TYPE_RECORDING: {
+            return false;
+        }
         default: {
             LOG_PANIC("Unreachable");
         }
@@ -2,6 +2,14 @@
 
 #include "arena/arena.h"
 #include "canvas/canvas.h"
+#include "canvas/display_list.h"
 #include "raster_canvas.h"
 
 Canvas* canvas_from_raster(Arena* arena, RasterCanvas* raster_canvas);
+
+/// Gets the raster canvas behind `canvas`, which must be a raster canvas.
+RasterCanvas* canvas_get_raster(Canvas* canvas);
+
+/// Gets the display list `canvas` records into, or NULL if it isn't a
+/// recording.
+CanvasDisplayList* canvas_get_recording(Canvas* canvas);
@@ -0,0 +1,516 @@
+#include "composite.h"
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "color/rgb.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+static uint8_t composite_quantize(double value) {
+    if (!(value > 0.0)) {
+        return 0;
+    }
+    if (value >= 1.0) {
+        return 255;
+    }
+
+    return (uint8_t)round(value * 255.0);
+}
+
+CompositeColor composite_color_from_rgba(Rgba rgba) {
+    double alpha = rgba.a < 0.0 ? 0.0 : (rgba.a > 1.0 ? 1.0 : rgba.a);
+
+    return (CompositeColor) {.r = composite_quantize(rgba.r * alpha),
+                             .g = composite_quantize(rgba.g * alpha),
+                             .b = composite_quantize(rgba.b * alpha),
+                             .a = composite_quantize(alpha)};
+}
+
+Rgba composite_color_to_rgba(CompositeColor color) {
+    if (color.a == 0) {
+        return rgba_new(0.0, 0.0, 0.0, 0.0);
+    }
+
+    double alpha = (double)color.a;
+    return rgba_new(
+        fmin((double)color.r / alpha, 1.0),
+        fmin((double)color.g / alpha, 1.0),
+        fmin((double)color.b / alpha, 1.0),
+        alpha / 255.0
+    );
+}
+
+/// Divides by 255, rounding to nearest. Exact for any product of two bytes.
+static uint8_t composite_div255(uint32_t value) {
+    value += 128;
+    return (uint8_t)((value + (value >> 8)) >> 8);
+}
+
+CompositeColor composite_color_scale(CompositeColor color, uint8_t coverage) {
+    return (CompositeColor) {
+        .r = composite_div255((uint32_t)color.r * coverage),
+        .g = composite_div255((uint32_t)color.g * coverage),
+        .b = composite_div255((uint32_t)color.b * coverage),
+        .a = composite_div255((uint32_t)color.a * coverage)
+    };
+}
+
+static void
+composite_pixel(uint8_t* pixel, CompositeColor color, uint8_t coverage) {
+    if (coverage == 0) {
+        return;
+    }
+
+    CompositeColor src = composite_color_scale(color, coverage);
+    uint32_t inverse_alpha = 255u - src.a;
+
+    pixel[0] = (uint8_t)(src.r + composite_div255(pixel[0] * inverse_alpha));
+    pixel[1] = (uint8_t)(src.g + composite_div255(pixel[1] * inverse_alpha));
+    pixel[2] = (uint8_t)(src.b + composite_div255(pixel[2] * inverse_alpha));
+    pixel[3] = (uint8_t)(src.a + composite_div255(pixel[3] * inverse_alpha));
+}
+
+#if defined(__SSE2__)
+
+// Pixels are widened to 16-bit lanes, two pixels per register
+
+static inline __m128i composite_div255_sse2(__m128i value) {
+    __m128i rounded = _mm_add_epi16(value, _mm_set1_epi16(128));
+    return _mm_srli_epi16(
+        _mm_add_epi16(rounded, _mm_srli_epi16(rounded, 8)),
+        8
+    );
+}
+
+static inline __m128i composite_over_sse2(__m128i dst, __m128i src) {
+    __m128i alpha = _mm_shufflehi_epi16(
+        _mm_shufflelo_epi16(src, _MM_SHUFFLE(3, 3, 3, 3)),
+        _MM_SHUFFLE(3, 3, 3, 3)
+    );
+    __m128i inverse_alpha = _mm_sub_epi16(_mm_set1_epi16(255), alpha);
+
+    return _mm_add_epi16(
+        src,
+        composite_div255_sse2(_mm_mullo_epi16(dst, inverse_alpha))
+    );
+}
+
+static inline __m128i composite_color_sse2(CompositeColor color) {
+    return _mm_set_epi16(
+        (short)color.a,
+        (short)color.b,
+        (short)color.g,
+        (short)color.r,
+        (short)color.a,
+        (short)color.b,
+        (short)color.g,
+        (short)color.r
+    );
+}
+
+/// Composites over four pixels, given their coverage in the low four 16-bit
+/// lanes of `coverage`.
+static inline void
+composite_block_sse2(uint8_t* pixels, __m128i color, __m128i coverage) {
+    __m128i zero = _mm_setzero_si128();
+
+    __m128i pairs = _mm_unpacklo_epi16(coverage, coverage);
+    __m128i coverage_lo = _mm_unpacklo_epi32(pairs, pairs);
+    __m128i coverage_hi = _mm_unpackhi_epi32(pairs, pairs);
+
+    __m128i src_lo =
+        composite_div255_sse2(_mm_mullo_epi16(color, coverage_lo));
+    __m128i src_hi =
+        composite_div255_sse2(_mm_mullo_epi16(color, coverage_hi));
+
+    __m128i dst = _mm_loadu_si128((const __m128i*)pixels);
+    __m128i out_lo = composite_over_sse2(_mm_unpacklo_epi8(dst, zero), src_lo);
+    __m128i out_hi = composite_over_sse2(_mm_unpackhi_epi8(dst, zero), src_hi);
+
+    _mm_storeu_si128((__m128i*)pixels, _mm_packus_epi16(out_lo, out_hi));
+}
+
+/// Composites four premultiplied pixels from `src` over four pixels, scaling
+/// them by the coverage in the low four 16-bit lanes of `coverage`.
+static inline void composite_block_pixels_sse2(
+    uint8_t* pixels,
+    const uint8_t* src,
+    __m128i coverage
+) {
+    __m128i zero = _mm_setzero_si128();
+
+    __m128i pairs = _mm_unpacklo_epi16(coverage, coverage);
+    __m128i coverage_lo = _mm_unpacklo_epi32(pairs, pairs);
+    __m128i coverage_hi = _mm_unpackhi_epi32(pairs, pairs);
+
+    __m128i src_pixels = _mm_loadu_si128((const __m128i*)src);
+    __m128i src_lo = composite_div255_sse2(
+        _mm_mullo_epi16(_mm_unpacklo_epi8(src_pixels, zero), coverage_lo)
+    );
+    __m128i src_hi = composite_div255_sse2(
+        _mm_mullo_epi16(_mm_unpackhi_epi8(src_pixels, zero), coverage_hi)
+    );
+
+    __m128i dst = _mm_loadu_si128((const __m128i*)pixels);
+    __m128i out_lo = composite_over_sse2(_mm_unpacklo_epi8(dst, zero), src_lo);
+    __m128i out_hi = composite_over_sse2(_mm_unpackhi_epi8(dst, zero), src_hi);
+
+    _mm_storeu_si128((__m128i*)pixels, _mm_packus_epi16(out_lo, out_hi));
+}
+
+static inline __m128i composite_load_coverage_sse2(const uint8_t* coverage) {
+    uint32_t packed;
+    memcpy(&packed, coverage, sizeof(packed));
+    return _mm_unpacklo_epi8(
+        _mm_cvtsi32_si128((int)packed),
+        _mm_setzero_si128()
+    );
+}
+
+#endif // __SSE2__
+
+#if defined(__AVX2__)
+
+// As with SSE2, but each 128-bit lane holds two of eight pixels
+
+static inline __m256i composite_div255_avx2(__m256i value) {
+    __m256i rounded = _mm256_add_epi16(value, _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(
+        _mm256_add_epi16(rounded, _mm256_srli_epi16(rounded, 8)),
+        8
+    );
+}
+
+static inline __m256i composite_over_avx2(__m256i dst, __m256i src) {
+    __m256i alpha = _mm256_shufflehi_epi16(
+        _mm256_shufflelo_epi16(src, _MM_SHUFFLE(3, 3, 3, 3)),
+        _MM_SHUFFLE(3, 3, 3, 3)
+    );
+    __m256i inverse_alpha = _mm256_sub_epi16(_mm256_set1_epi16(255), alpha);
+
+    return _mm256_add_epi16(
+        src,
+        composite_div255_avx2(_mm256_mullo_epi16(dst, inverse_alpha))
+    );
+}
+
+static inline __m256i composite_color_avx2(CompositeColor color) {
+    return _mm256_broadcastsi128_si256(composite_color_sse2(color));
+}
+
+/// Composites over eight pixels, given their coverage in the eight 16-bit
+/// lanes of `coverage`.
+static inline void
+composite_block_avx2(uint8_t* pixels, __m256i color, __m128i coverage) {
+    __m256i zero = _mm256_setzero_si256();
+
+    // Unpacking works within 128-bit lanes, so the low half of each lane
+    // holds pixels 0, 1, 4 and 5 and the high half pixels 2, 3, 6 and 7
+    __m256i words = _mm256_cvtepu16_epi32(coverage);
+    words = _mm256_or_si256(words, _mm256_slli_epi32(words, 16));
+    __m256i coverage_lo = _mm256_unpacklo_epi32(words, words);
+    __m256i coverage_hi = _mm256_unpackhi_epi32(words, words);
+
+    __m256i src_lo =
+        composite_div255_avx2(_mm256_mullo_epi16(color, coverage_lo));
+    __m256i src_hi =
+        composite_div255_avx2(_mm256_mullo_epi16(color, coverage_hi));
+
+    __m256i dst = _mm256_loadu_si256((const __m256i*)pixels);
+    __m256i out_lo =
+        composite_over_avx2(_mm256_unpacklo_epi8(dst, zero), src_lo);
+    __m256i out_hi =
+        composite_over_avx2(_mm256_unpackhi_epi8(dst, zero), src_hi);
+
+    _mm256_storeu_si256((__m256i*)pixels, _mm256_packus_epi16(out_lo, out_hi));
+}
+
+static inline __m128i composite_load_coverage_avx2(const uint8_t* coverage) {
+    return _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)coverage));
+}
+
+#endif // __AVX2__
+
+void composite_span_solid(uint8_t* pixels, size_t count, CompositeColor color) {
+    if (color.a == 0) {
+        return;
+    }
+
+    if (color.a == 255) {
+        // Opaque colors replace what is underneath
+        for (size_t idx = 0; idx < count; idx++) {
+            memcpy(pixels + idx * 4, &color, 4);
+        }
+        return;
+    }
+
+    size_t idx = 0;
+
+#if defined(__AVX2__)
+    __m256i color_avx2 = composite_color_avx2(color);
+    __m128i full_avx2 = _mm_set1_epi16(255);
+    for (; idx + 8 <= count; idx += 8) {
+        composite_block_avx2(pixels + idx * 4, color_avx2, full_avx2);
+    }
+#endif
+
+#if defined(__SSE2__)
+    __m128i color_sse2 = composite_color_sse2(color);
+    __m128i full_sse2 = _mm_set1_epi16(255);
+    for (; idx + 4 <= count; idx += 4) {
+        composite_block_sse2(pixels + idx * 4, color_sse2, full_sse2);
+    }
+#endif
+
+    for (; idx < count; idx++) {
+        composite_pixel(pixels + idx * 4, color, 255);
+    }
+}
+
+void composite_span_mask(
+    uint8_t* pixels,
+    size_t count,
+    CompositeColor color,
+    const uint8_t* mask
+) {
+    if (color.a == 0) {
+        return;
+    }
+
+    size_t idx = 0;
+
+#if defined(__AVX2__)
+    __m256i color_avx2 = composite_color_avx2(color);
+    for (; idx + 8 <= count; idx += 8) {
+        uint64_t packed;
+        memcpy(&packed, mask + idx, sizeof(packed));
+        if (packed == 0) {
+            continue;
+        }
+
+        composite_block_avx2(
+            pixels + idx * 4,
+            color_avx2,
+            composite_load_coverage_avx2(mask + idx)
+        );
+    }
+#endif
+
+#if defined(__SSE2__)
+    __m128i color_sse2 = composite_color_sse2(color);
+    for (; idx + 4 <= count; idx += 4) {
+        uint32_t packed;
+        memcpy(&packed, mask + idx, sizeof(packed));
+        if (packed == 0) {
+            continue;
+        }
+
+        composite_block_sse2(
+            pixels + idx * 4,
+            color_sse2,
+            composite_load_coverage_sse2(mask + idx)
+        );
+    }
+#endif
+
+    for (; idx < count; idx++) {
+        composite_pixel(pixels + idx * 4, color, mask[idx]);
+    }
+}
+
+void composite_span_mask_mask(
+    uint8_t* pixels,
+    size_t count,
+    CompositeColor color,
+    const uint8_t* mask,
+    const uint8_t* clip
+) {
+    if (color.a == 0) {
+        return;
+    }
+
+    size_t idx = 0;
+
+#if defined(__AVX2__)
+    __m256i color_avx2 = composite_color_avx2(color);
+    for (; idx + 8 <= count; idx += 8) {
+        __m128i coverage = composite_div255_sse2(_mm_mullo_epi16(
+            composite_load_coverage_avx2(mask + idx),
+            composite_load_coverage_avx2(clip + idx)
+        ));
+        composite_block_avx2(pixels + idx * 4, color_avx2, coverage);
+    }
+#endif
+
+#if defined(__SSE2__)
+    __m128i color_sse2 = composite_color_sse2(color);
+    for (; idx + 4 <= count; idx += 4) {
+        __m128i coverage = composite_div255_sse2(_mm_mullo_epi16(
+            composite_load_coverage_sse2(mask + idx),
+            composite_load_coverage_sse2(clip + idx)
+        ));
+        composite_block_sse2(pixels + idx * 4, color_sse2, coverage);
+    }
+#endif
+
+    for (; idx < count; idx++) {
+        composite_pixel(
+            pixels + idx * 4,
+            color,
+            composite_div255((uint32_t)mask[idx] * clip[idx])
+        );
+    }
+}
+
+void composite_span_pixels(
+    uint8_t* pixels,
+    size_t count,
+    const uint8_t* src,
+    const uint8_t* clip
+) {
+    size_t idx = 0;
+
+#if defined(__SSE2__)
+    __m128i full_sse2 = _mm_set1_epi16(255);
+    for (; idx + 4 <= count; idx += 4) {
+        uint64_t packed[2];
+        memcpy(packed, src + idx * 4, sizeof(packed));
+        if ((packed[0] | packed[1]) == 0) {
+            continue;
+        }
+
+        __m128i coverage = full_sse2;
+        if (clip) {
+            coverage = composite_load_coverage_sse2(clip + idx);
+        }
+        composite_block_pixels_sse2(pixels + idx * 4, src + idx * 4, coverage);
+    }
+#endif
+
+    for (; idx < count; idx++) {
+        CompositeColor color;
+        memcpy(&color, src + idx * 4, 4);
+        composite_pixel(pixels + idx * 4, color, clip ? clip[idx] : 255);
+    }
+}
+
+#ifdef TEST
+
+#include "test/test.h"
+
+#define COMPOSITE_TEST_LEN 29
+
+static void composite_test_fill(uint8_t* pixels, uint8_t* mask, uint8_t* clip) {
+    for (size_t idx = 0; idx < COMPOSITE_TEST_LEN; idx++) {
+        uint8_t alpha = (uint8_t)(idx * 37 % 256);
+        pixels[idx * 4 + 0] = (uint8_t)(alpha * (idx % 3) / 2);
+        pixels[idx * 4 + 1] = (uint8_t)(alpha / 3);
+        pixels[idx * 4 + 2] = alpha;
+        pixels[idx * 4 + 3] = alpha;
+        mask[idx] = (uint8_t)(idx * 91 % 256);
+        clip[idx] = (uint8_t)(255 - idx * 53 % 256);
+    }
+
+    // Runs of empty and full coverage take the early-outs
+    for (size_t idx = 8; idx < 16; idx++) {
+        mask[idx] = 0;
+    }
+    for (size_t idx = 16; idx < 20; idx++) {
+        mask[idx] = 255;
+    }
+}
+
+TEST_FUNC(test_composite_spans_match_per_pixel) {
+    CompositeColor color =
+        composite_color_from_rgba(rgba_new(0.2, 0.6, 0.9, 0.7));
+
+    uint8_t pixels[COMPOSITE_TEST_LEN * 4];
+    uint8_t expected[COMPOSITE_TEST_LEN * 4];
+    uint8_t mask[COMPOSITE_TEST_LEN];
+    uint8_t clip[COMPOSITE_TEST_LEN];
+
+    composite_test_fill(pixels, mask, clip);
+    memcpy(expected, pixels, sizeof(pixels));
+    composite_span_solid(pixels, COMPOSITE_TEST_LEN, color);
+    for (size_t idx = 0; idx < COMPOSITE_TEST_LEN; idx++) {
+        composite_pixel(expected + idx * 4, color, 255);
+    }
+    TEST_ASSERT_EQ(memcmp(pixels, expected, sizeof(pixels)), 0);
+
+    composite_test_fill(pixels, mask, clip);
+    memcpy(expected, pixels, sizeof(pixels));
+    composite_span_mask(pixels, COMPOSITE_TEST_LEN, color, mask);
+    for (size_t idx = 0; idx < COMPOSITE_TEST_LEN; idx++) {
+        composite_pixel(expected + idx * 4, color, mask[idx]);
+    }
+    TEST_ASSERT_EQ(memcmp(pixels, expected, sizeof(pixels)), 0);
+
+    // The source pixels are the destination pixels reversed, with a run of
+    // transparent pixels to take the early-out and a run of opaque ones
+    uint8_t src[COMPOSITE_TEST_LEN * 4];
+    composite_test_fill(pixels, mask, clip);
+    for (size_t idx = 0; idx < COMPOSITE_TEST_LEN; idx++) {
+        memcpy(src + idx * 4, pixels + (COMPOSITE_TEST_LEN - 1 - idx) * 4, 4);
+    }
+    memset(src + 4 * 4, 0, 4 * 4);
+    memset(src + 8 * 4, 255, 4 * 4);
+    memcpy(expected, pixels, sizeof(pixels));
+    composite_span_pixels(pixels, COMPOSITE_TEST_LEN, src, clip);
+    for (size_t idx = 0; idx < COMPOSITE_TEST_LEN; idx++) {
+        CompositeColor src_color;
+        memcpy(&src_color, src + idx * 4, 4);
+        composite_pixel(expected + idx * 4, src_color, clip[idx]);
+    }
+    TEST_ASSERT_EQ(memcmp(pixels, expected, sizeof(pixels)), 0);
+
+    composite_test_fill(pixels, mask, clip);
+    memcpy(expected, pixels, sizeof(pixels));
+    composite_span_pixels(pixels, COMPOSITE_TEST_LEN, src, NULL);
+    for (size_t idx = 0; idx < COMPOSITE_TEST_LEN; idx++) {
+        CompositeColor src_color;
+        memcpy(&src_color, src + idx * 4, 4);
+        composite_pixel(expected + idx * 4, src_color, 255);
+    }
+    TEST_ASSERT_EQ(memcmp(pixels, expected, sizeof(pixels)), 0);
+
+    composite_test_fill(pixels, mask, clip);
+    memcpy(expected, pixels, sizeof(pixels));
+    composite_span_mask_mask(pixels, COMPOSITE_TEST_LEN, color, mask, clip);
+    for (size_t idx = 0; idx < COMPOSITE_TEST_LEN; idx++) {
+        composite_pixel(
+            expected + idx * 4,
+            color,
+            composite_div255((uint32_t)mask[idx] * clip[idx])
+        );
+    }
+    TEST_ASSERT_EQ(memcmp(pixels, expected, sizeof(pixels)), 0);
+
+    return TEST_RESULT_PASS;
+}
+
+TEST_FUNC(test_composite_color_round_trip) {
+    Rgba rgba = rgba_new(0.5, 0.25, 1.0, 1.0);
+    Rgba round_trip = composite_color_to_rgba(composite_color_from_rgba(rgba));
+    TEST_ASSERT_EQ_EPS(round_trip.r, rgba.r, 1.0L / 255.0L);
+    TEST_ASSERT_EQ_EPS(round_trip.g, rgba.g, 1.0L / 255.0L);
+    TEST_ASSERT_EQ(round_trip.b, 1.0);
+    TEST_ASSERT_EQ(round_trip.a, 1.0);
+
+    CompositeColor transparent =
+        composite_color_from_rgba(rgba_new(1.0, 1.0, 1.0, 0.0));
+    TEST_ASSERT_EQ(transparent.r, (uint8_t)0);
+    TEST_ASSERT_EQ(transparent.a, (uint8_t)0);
+
+    return TEST_RESULT_PASS;
+}
+
+#endif // TEST
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "color/rgb.h"
+
+/// A premultiplied RGBA8 color, laid out as it is in pixel buffers.
+typedef struct {
+    uint8_t r;
+    uint8_t g;
+    uint8_t b;
+    uint8_t a;
+} CompositeColor;
+
+/// Premultiplies and quantizes a color.
+CompositeColor composite_color_from_rgba(Rgba rgba);
+
+/// Converts a premultiplied color back to straight alpha.
+Rgba composite_color_to_rgba(CompositeColor color);
+
+/// Scales every channel of a premultiplied color by `coverage` / 255.
+CompositeColor composite_color_scale(CompositeColor color, uint8_t coverage);
+
+/// Composites `color` source-over `count` premultiplied RGBA8 pixels.
+void composite_span_solid(uint8_t* pixels, size_t count, CompositeColor color);
+
+/// Composites `color` source-over `count` pixels, scaling it by one coverage
+/// value per pixel.
+void composite_span_mask(
+    uint8_t* pixels,
+    size_t count,
+    CompositeColor color,
+    const uint8_t* mask
+);
+
+/// Composites `color` source-over `count` pixels, scaling it by the product
+/// of two coverage values per pixel, such as a path's coverage and a clip's.
+void composite_span_mask_mask(
+    uint8_t* pixels,
+    size_t count,
+    CompositeColor color,
+    const uint8_t* mask,
+    const uint8_t* clip
+);
+
+/// Composites `count` premultiplied RGBA8 pixels from `src` source-over
+/// `pixels`, scaling each by one coverage value per pixel unless `clip` is
+/// NULL.
+void composite_span_pixels(
+    uint8_t* pixels,
+    size_t count,
+    const uint8_t* src,
+    const uint8_t* clip
+);
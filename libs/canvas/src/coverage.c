@@ -0,0 +1,545 @@
+#include "coverage.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "arena/arena.h"
+#include "arena/common.h"
+#include "canvas/path_builder.h"
+#include "dcel.h"
+#include "geom/vec2.h"
+#include "logger/log.h"
+#include "path_builder.h"
+
+/// Signed-area accumulation buffer. Each cell holds the change in coverage
+/// from the previous cell in its row, so a running sum along the row yields
+/// the winding-weighted area of every pixel. Only rows `row_begin` to
+/// `row_end` of the region are stored.
+typedef struct {
+    double* cells;
+    size_t stride;
+    uint32_t width;
+    uint32_t height;
+    uint32_t row_begin;
+    uint32_t row_end;
+} CoverageAccumulator;
+
+static double coverage_clamp(double value, double min, double max) {
+    return value < min ? min : (value > max ? max : value);
+}
+
+/// Accumulates a line whose x coordinates lie within [0, width].
+static void coverage_accumulate_line(
+    CoverageAccumulator* accumulator,
+    GeomVec2 from,
+    GeomVec2 to
+) {
+    if (from.y == to.y) {
+        return;
+    }
+
+    double direction = 1.0;
+    if (from.y > to.y) {
+        GeomVec2 tmp = from;
+        from = to;
+        to = tmp;
+        direction = -1.0;
+    }
+
+    double dxdy = (to.x - from.x) / (to.y - from.y);
+    double x = from.x;
+    double y0 = from.y;
+    if (y0 < 0.0) {
+        x -= y0 * dxdy;
+        y0 = 0.0;
+    }
+
+    double y1 = fmin(to.y, (double)accumulator->height);
+    if (y0 >= y1) {
+        return;
+    }
+
+    double max_x = (double)accumulator->width;
+    x = coverage_clamp(x, 0.0, max_x);
+
+    size_t row_end = (size_t)ceil(y1);
+    if (row_end > accumulator->row_end) {
+        row_end = accumulator->row_end;
+    }
+
+    for (size_t row = (size_t)y0; row < row_end; row++) {
+        double dy = fmin((double)row + 1.0, y1) - fmax((double)row, y0);
+        double x_next = coverage_clamp(x + dxdy * dy, 0.0, max_x);
+        double d = dy * direction;
+
+        // Rows above the stored ones are still stepped through one at a
+        // time, so the stored rows come out exactly as in a full pass
+        if (row < accumulator->row_begin) {
+            x = x_next;
+            continue;
+        }
+
+        double* line = accumulator->cells
+                     + (row - accumulator->row_begin) * accumulator->stride;
+
+        double x0 = fmin(x, x_next);
+        double x1 = fmax(x, x_next);
+        double x0_floor = floor(x0);
+        double x1_ceil = ceil(x1);
+        size_t x0_idx = (size_t)x0_floor;
+        size_t x1_idx = (size_t)x1_ceil;
+
+        if (x1_idx <= x0_idx + 1) {
+            // The line stays within one pixel of this row
+            double x_mid = 0.5 * (x + x_next) - x0_floor;
+            line[x0_idx] += d - d * x_mid;
+            line[x0_idx + 1] += d * x_mid;
+        } else {
+            // Spread the trapezoid under the line across the pixels it spans
+            double inv_span = 1.0 / (x1 - x0);
+            double x0_frac = x0 - x0_floor;
+            double area_first =
+                0.5 * inv_span * (1.0 - x0_frac) * (1.0 - x0_frac);
+            double x1_frac = x1 - x1_ceil + 1.0;
+            double area_last = 0.5 * inv_span * x1_frac * x1_frac;
+
+            line[x0_idx] += d * area_first;
+            if (x1_idx == x0_idx + 2) {
+                line[x0_idx + 1] += d * (1.0 - area_first - area_last);
+            } else {
+                double area_second = inv_span * (1.5 - x0_frac);
+                line[x0_idx + 1] += d * (area_second - area_first);
+                for (size_t idx = x0_idx + 2; idx + 1 < x1_idx; idx++) {
+                    line[idx] += d * inv_span;
+                }
+
+                double area_before_last =
+                    area_second + (double)(x1_idx - x0_idx - 3) * inv_span;
+                line[x1_idx - 1] += d * (1.0 - area_before_last - area_last);
+            }
+            line[x1_idx] += d * area_last;
+        }
+
+        x = x_next;
+    }
+}
+
+/// Accumulates a line in region coordinates. The parts of the line left of
+/// the region are projected onto its left edge, since they still cover every
+/// pixel to their right, and the parts right of it onto its right edge.
+static void coverage_add_line(
+    CoverageAccumulator* accumulator,
+    GeomVec2 from,
+    GeomVec2 to
+) {
+    double max_x = (double)accumulator->width;
+
+    double splits[4] = {0.0, 0.0, 0.0, 1.0};
+    size_t split_count = 1;
+    if (from.x != to.x) {
+        double edges[2] = {0.0, max_x};
+        for (size_t edge_idx = 0; edge_idx < 2; edge_idx++) {
+            double t = (edges[edge_idx] - from.x) / (to.x - from.x);
+            if (t > 0.0 && t < 1.0) {
+                splits[split_count++] = t;
+            }
+        }
+    }
+    if (split_count == 3 && splits[1] > splits[2]) {
+        double tmp = splits[1];
+        splits[1] = splits[2];
+        splits[2] = tmp;
+    }
+    splits[split_count++] = 1.0;
+
+    GeomVec2 piece_from = from;
+    for (size_t split_idx = 1; split_idx < split_count; split_idx++) {
+        double t = splits[split_idx];
+        GeomVec2 piece_to = split_idx + 1 == split_count
+                              ? to
+                              : geom_vec2_lerp(from, to, t);
+
+        coverage_accumulate_line(
+            accumulator,
+            geom_vec2_new(
+                coverage_clamp(piece_from.x, 0.0, max_x),
+                piece_from.y
+            ),
+            geom_vec2_new(coverage_clamp(piece_to.x, 0.0, max_x), piece_to.y)
+        );
+
+        piece_from = piece_to;
+    }
+}
+
+void coverage_rasterize_path(
+    Arena* arena,
+    const PathBuilder* path,
+    DcelFillRule fill_rule,
+    int32_t origin_x,
+    int32_t origin_y,
+    uint32_t width,
+    uint32_t height,
+    Uint8Array* out_coverage,
+    DcelMaskBounds* out_bounds
+) {
+    coverage_rasterize_path_rows(
+        arena,
+        path,
+        fill_rule,
+        origin_x,
+        origin_y,
+        width,
+        height,
+        0,
+        height,
+        out_coverage,
+        out_bounds
+    );
+}
+
+void coverage_rasterize_path_rows(
+    Arena* arena,
+    const PathBuilder* path,
+    DcelFillRule fill_rule,
+    int32_t origin_x,
+    int32_t origin_y,
+    uint32_t width,
+    uint32_t height,
+    uint32_t row_begin,
+    uint32_t row_end,
+    Uint8Array* out_coverage,
+    DcelMaskBounds* out_bounds
+) {
+    RELEASE_ASSERT(arena);
+    RELEASE_ASSERT(path);
+    RELEASE_ASSERT(row_begin <= row_end && row_end <= height);
+    RELEASE_ASSERT(out_coverage);
+
+    if (out_bounds) {
+        *out_bounds = (DcelMaskBounds) {.is_empty = true,
+                                        .min_x = 0,
+                                        .min_y = 0,
+                                        .max_x = 0,
+                                        .max_y = 0};
+    }
+
+    uint32_t row_count = row_end - row_begin;
+    size_t coverage_len = 0;
+    uint8_t* coverage = uint8_array_get_raw(out_coverage, &coverage_len);
+    RELEASE_ASSERT(coverage_len == (size_t)width * (size_t)row_count);
+    if (coverage_len == 0) {
+        return;
+    }
+
+    // Two extra cells per row catch the carries from lines on the right edge
+    CoverageAccumulator accumulator = {
+        .stride = (size_t)width + 2,
+        .width = width,
+        .height = height,
+        .row_begin = row_begin,
+        .row_end = row_end
+    };
+    size_t cell_count = accumulator.stride * (size_t)row_count;
+    accumulator.cells = arena_alloc(arena, cell_count * sizeof(double));
+    memset(accumulator.cells, 0, cell_count * sizeof(double));
+
+    GeomVec2 offset = geom_vec2_new((double)origin_x, (double)origin_y);
+    for (size_t contour_idx = 0;
+         contour_idx < path_contour_vec_len(path->contours);
+         contour_idx++) {
+        PathContour* contour = NULL;
+        RELEASE_ASSERT(
+            path_contour_vec_get(path->contours, contour_idx, &contour)
+        );
+
+        size_t segment_count = path_contour_len(contour);
+        if (segment_count < 2) {
+            continue;
+        }
+
+        GeomVec2 first = geom_vec2_new(0.0, 0.0);
+        GeomVec2 previous = geom_vec2_new(0.0, 0.0);
+        for (size_t segment_idx = 0; segment_idx < segment_count;
+             segment_idx++) {
+            PathContourSegment segment;
+            RELEASE_ASSERT(path_contour_get(contour, segment_idx, &segment));
+            GeomVec2 point =
+                geom_vec2_sub(path_contour_segment_end(segment), offset);
+
+            if (segment_idx == 0) {
+                first = point;
+            } else {
+                coverage_add_line(&accumulator, previous, point);
+            }
+            previous = point;
+        }
+
+        coverage_add_line(&accumulator, previous, first);
+    }
+
+    uint32_t min_x = width, min_y = height, max_x = 0, max_y = 0;
+    for (uint32_t y = row_begin; y < row_end; y++) {
+        const double* line =
+            accumulator.cells + (size_t)(y - row_begin) * accumulator.stride;
+        uint8_t* out_line = coverage + (size_t)(y - row_begin) * width;
+        double winding = 0.0;
+
+        for (uint32_t x = 0; x < width; x++) {
+            winding += line[x];
+
+            double value = fabs(winding);
+            if (fill_rule == DCEL_FILL_RULE_EVEN_ODD) {
+                value = fmod(value, 2.0);
+                if (value > 1.0) {
+                    value = 2.0 - value;
+                }
+            } else if (value > 1.0) {
+                value = 1.0;
+            }
+
+            uint8_t alpha = (uint8_t)(value * 255.0 + 0.5);
+            out_line[x] = alpha;
+
+            if (alpha != 0) {
+                min_x = x < min_x ? x : min_x;
+                max_x = x > max_x ? x : max_x;
+                min_y = y < min_y ? y : min_y;
+                max_y = y;
+            }
+        }
+    }
+
+    if (out_bounds && min_x <= max_x && min_y <= max_y) {
+        *out_bounds = (DcelMaskBounds) {.is_empty = false,
+                                        .min_x = min_x,
+                                        .min_y = min_y,
+                                        .max_x = max_x,
+                                        .max_y = max_y};
+    }
+}
+
+#ifdef TEST
+
+#include "test/test.h"
+
+static void coverage_test_add_rect(
+    PathBuilder* path,
+    double min_x,
+    double min_y,
+    double max_x,
+    double max_y
+) {
+    path_builder_new_contour(path, geom_vec2_new(min_x, min_y));
+    path_builder_line_to(path, geom_vec2_new(max_x, min_y));
+    path_builder_line_to(path, geom_vec2_new(max_x, max_y));
+    path_builder_line_to(path, geom_vec2_new(min_x, max_y));
+    path_builder_close_contour(path);
+}
+
+TEST_FUNC(test_coverage_rasterize_path_fractional_rect) {
+    Arena* arena = arena_new(4096);
+    PathBuilder* path = path_builder_new(arena);
+    coverage_test_add_rect(path, 0.5, 0.25, 2.5, 1.0);
+
+    Uint8Array* coverage = uint8_array_new(arena, 4);
+    DcelMaskBounds bounds;
+    coverage_rasterize_path(
+        arena,
+        path,
+        DCEL_FILL_RULE_NONZERO,
+        0,
+        0,
+        4,
+        1,
+        coverage,
+        &bounds
+    );
+
+    uint8_t expected[4] = {96, 191, 96, 0};
+    for (size_t idx = 0; idx < 4; idx++) {
+        uint8_t value = 0;
+        TEST_ASSERT(uint8_array_get(coverage, idx, &value));
+        TEST_ASSERT_EQ(value, expected[idx]);
+    }
+
+    TEST_ASSERT(!bounds.is_empty);
+    TEST_ASSERT_EQ(bounds.min_x, 0u);
+    TEST_ASSERT_EQ(bounds.max_x, 2u);
+
+    arena_free(arena);
+    return TEST_RESULT_PASS;
+}
+
+TEST_FUNC(test_coverage_rasterize_path_fill_rules) {
+    Arena* arena = arena_new(4096);
+
+    // Two copies of the same square wind twice around their interior
+    PathBuilder* path = path_builder_new(arena);
+    coverage_test_add_rect(path, 1.0, 1.0, 3.0, 3.0);
+    coverage_test_add_rect(path, 1.0, 1.0, 3.0, 3.0);
+
+    Uint8Array* nonzero = uint8_array_new(arena, 16);
+    Uint8Array* even_odd = uint8_array_new(arena, 16);
+    coverage_rasterize_path(
+        arena,
+        path,
+        DCEL_FILL_RULE_NONZERO,
+        0,
+        0,
+        4,
+        4,
+        nonzero,
+        NULL
+    );
+    coverage_rasterize_path(
+        arena,
+        path,
+        DCEL_FILL_RULE_EVEN_ODD,
+        0,
+        0,
+        4,
+        4,
+        even_odd,
+        NULL
+    );
+
+    uint8_t nonzero_value = 0;
+    uint8_t even_odd_value = 0;
+    TEST_ASSERT(uint8_array_get(nonzero, 1 * 4 + 2, &nonzero_value));
+    TEST_ASSERT(uint8_array_get(even_odd, 1 * 4 + 2, &even_odd_value));
+    TEST_ASSERT_EQ(nonzero_value, (uint8_t)255);
+    TEST_ASSERT_EQ(even_odd_value, (uint8_t)0);
+
+    arena_free(arena);
+    return TEST_RESULT_PASS;
+}
+
+TEST_FUNC(test_coverage_rasterize_path_region_offset_and_edges) {
+    Arena* arena = arena_new(4096);
+
+    // Extends past the left and right of the region, and is offset from it
+    PathBuilder* path = path_builder_new(arena);
+    path_builder_new_contour(path, geom_vec2_new(-10.0, 10.0));
+    path_builder_line_to(path, geom_vec2_new(30.0, 10.0));
+    path_builder_line_to(path, geom_vec2_new(30.0, 12.0));
+    path_builder_line_to(path, geom_vec2_new(-10.0, 13.0));
+    path_builder_close_contour(path);
+
+    Uint8Array* coverage = uint8_array_new(arena, 4 * 2);
+    coverage_rasterize_path(
+        arena,
+        path,
+        DCEL_FILL_RULE_NONZERO,
+        10,
+        10,
+        4,
+        2,
+        coverage,
+        NULL
+    );
+
+    for (size_t idx = 0; idx < 8; idx++) {
+        uint8_t value = 0;
+        TEST_ASSERT(uint8_array_get(coverage, idx, &value));
+        TEST_ASSERT_EQ(value, (uint8_t)255);
+    }
+
+    arena_free(arena);
+    return TEST_RESULT_PASS;
+}
+
+TEST_FUNC(test_coverage_rasterize_path_triangle_area) {
+    Arena* arena = arena_new(4096);
+    PathBuilder* path = path_builder_new(arena);
+    path_builder_new_contour(path, geom_vec2_new(1.3, 0.7));
+    path_builder_line_to(path, geom_vec2_new(14.1, 3.2));
+    path_builder_line_to(path, geom_vec2_new(5.6, 15.4));
+    path_builder_close_contour(path);
+
+    Uint8Array* coverage = uint8_array_new(arena, 16 * 16);
+    coverage_rasterize_path(
+        arena,
+        path,
+        DCEL_FILL_RULE_NONZERO,
+        0,
+        0,
+        16,
+        16,
+        coverage,
+        NULL
+    );
+
+    double total = 0.0;
+    for (size_t idx = 0; idx < 16 * 16; idx++) {
+        uint8_t value = 0;
+        TEST_ASSERT(uint8_array_get(coverage, idx, &value));
+        total += (double)value / 255.0;
+    }
+
+    double area =
+        0.5
+        * fabs((14.1 - 1.3) * (15.4 - 0.7) - (5.6 - 1.3) * (3.2 - 0.7));
+    TEST_ASSERT_EQ_EPS(total, area, 0.5L);
+
+    arena_free(arena);
+    return TEST_RESULT_PASS;
+}
+
+TEST_FUNC(test_coverage_rasterize_path_rows_match_full_pass) {
+    Arena* arena = arena_new(4096);
+    PathBuilder* path = path_builder_new(arena);
+    path_builder_new_contour(path, geom_vec2_new(-3.7, 0.3));
+    path_builder_line_to(path, geom_vec2_new(19.1, 4.6));
+    path_builder_line_to(path, geom_vec2_new(7.9, 21.2));
+    path_builder_close_contour(path);
+
+    Uint8Array* full = uint8_array_new(arena, 16 * 16);
+    coverage_rasterize_path(
+        arena,
+        path,
+        DCEL_FILL_RULE_NONZERO,
+        0,
+        0,
+        16,
+        16,
+        full,
+        NULL
+    );
+
+    Uint8Array* rows = uint8_array_new(arena, 16 * 5);
+    DcelMaskBounds bounds;
+    coverage_rasterize_path_rows(
+        arena,
+        path,
+        DCEL_FILL_RULE_NONZERO,
+        0,
+        0,
+        16,
+        16,
+        7,
+        12,
+        rows,
+        &bounds
+    );
+
+    for (size_t idx = 0; idx < 16 * 5; idx++) {
+        uint8_t expected = 0;
+        uint8_t value = 0;
+        TEST_ASSERT(uint8_array_get(full, 7 * 16 + idx, &expected));
+        TEST_ASSERT(uint8_array_get(rows, idx, &value));
+        TEST_ASSERT_EQ(value, expected);
+    }
+
+    TEST_ASSERT(!bounds.is_empty);
+    TEST_ASSERT_EQ(bounds.min_y, 7u);
+    TEST_ASSERT_EQ(bounds.max_y, 11u);
+
+    arena_free(arena);
+    return TEST_RESULT_PASS;
+}
+
+#endif // TEST
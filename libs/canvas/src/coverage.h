@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "arena/arena.h"
+#include "arena/common.h"
+#include "canvas/path_builder.h"
+#include "dcel.h"
+
+/// Rasterizes the contours of a flattened `path` into 8-bit anti-aliased
+/// coverage, over the `width` x `height` pixel region whose top-left corner is
+/// at (`origin_x`, `origin_y`). Contours are implicitly closed. Each pixel's
+/// coverage is the exact signed area of the path within it, accumulated over
+/// all contours and then folded by `fill_rule`, so both nonzero and even-odd
+/// fills are supported. `out_bounds` receives the pixels with nonzero
+/// coverage, relative to the region.
+void coverage_rasterize_path(
+    Arena* arena,
+    const PathBuilder* path,
+    DcelFillRule fill_rule,
+    int32_t origin_x,
+    int32_t origin_y,
+    uint32_t width,
+    uint32_t height,
+    Uint8Array* out_coverage,
+    DcelMaskBounds* out_bounds
+);
+
+/// Like `coverage_rasterize_path`, but only produces rows `row_begin` to
+/// `row_end` of the region into `out_coverage`. Those rows are identical to
+/// the same rows of a full pass, so a region can be rasterized in pieces.
+/// `out_bounds` is still relative to the whole region.
+void coverage_rasterize_path_rows(
+    Arena* arena,
+    const PathBuilder* path,
+    DcelFillRule fill_rule,
+    int32_t origin_x,
+    int32_t origin_y,
+    uint32_t width,
+    uint32_t height,
+    uint32_t row_begin,
+    uint32_t row_end,
+    Uint8Array* out_coverage,
+    DcelMaskBounds* out_bounds
+);
@@ -0,0 +1,1331 @@
+#include "display_list.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "arena/arena.h"
+#include "arena/common.h"
+#include "canvas.h"
+#include "canvas/canvas.h"
+#include "canvas/display_list.h"
+#include "canvas/path_builder.h"
+#include "geom/mat3.h"
+#include "geom/rect.h"
+#include "geom/vec2.h"
+#include "logger/log.h"
+#include "raster_canvas.h"
+
+typedef enum {
+    CANVAS_COMMAND_DRAW_CIRCLE,
+    CANVAS_COMMAND_DRAW_LINE,
+    CANVAS_COMMAND_DRAW_BEZIER,
+    CANVAS_COMMAND_DRAW_PATH,
+    CANVAS_COMMAND_DRAW_MASK,
+    CANVAS_COMMAND_DRAW_RASTER,
+    CANVAS_COMMAND_PUSH_CLIP_PATH,
+    CANVAS_COMMAND_POP_CLIP_PATHS,
+    CANVAS_COMMAND_DRAW_PIXEL,
+    CANVAS_COMMAND_DRAW_SPAN,
+    CANVAS_COMMAND_DRAW_DEFERRED
+} CanvasCommandType;
+
+typedef struct {
+    CanvasCommandType type;
+
+    /// The device-space bounds of every pixel the command can draw to. Clip
+    /// commands have none, since every later command depends on them.
+    bool has_bounds;
+    GeomRect bounds;
+
+    union {
+        struct {
+            double x;
+            double y;
+            double radius;
+            Rgba rgba;
+        } draw_circle;
+
+        struct {
+            double x1;
+            double y1;
+            double x2;
+            double y2;
+            double radius;
+            Rgba rgba;
+        } draw_line;
+
+        struct {
+            double x1;
+            double y1;
+            double x2;
+            double y2;
+            double cx;
+            double cy;
+            double flatness;
+            double radius;
+            Rgba rgba;
+        } draw_bezier;
+
+        struct {
+            PathBuilder* path;
+            CanvasBrush brush;
+        } draw_path;
+
+        struct {
+            CanvasMask mask;
+            int32_t x;
+            int32_t y;
+            Rgba rgba;
+        } draw_mask;
+
+        struct {
+            Canvas* source;
+            int32_t x;
+            int32_t y;
+        } draw_raster;
+
+        struct {
+            PathBuilder* path;
+            bool even_odd_rule;
+        } push_clip_path;
+
+        struct {
+            size_t count;
+        } pop_clip_paths;
+
+        struct {
+            GeomVec2 position;
+            Rgba rgba;
+        } draw_pixel;
+
+        struct {
+            int32_t x;
+            int32_t y;
+            size_t count;
+            const uint8_t* pixels;
+        } draw_span;
+
+        struct {
+            CanvasDeferredDraw draw;
+            const void* data;
+            size_t data_size;
+        } draw_deferred;
+    } data;
+} CanvasCommand;
+
+#define DVEC_NAME CanvasCommandVec
+#define DVEC_LOWERCASE_NAME canvas_command_vec
+#define DVEC_TYPE CanvasCommand
+#include "arena/dvec_impl.h"
+
+struct CanvasDisplayList {
+    Arena* arena;
+
+    uint32_t width;
+    uint32_t height;
+    bool is_raster;
+
+    CanvasCommandVec* commands;
+};
+
+CanvasDisplayList* canvas_display_list_new(
+    Arena* arena,
+    uint32_t width,
+    uint32_t height,
+    bool is_raster
+) {
+    RELEASE_ASSERT(arena);
+
+    CanvasDisplayList* list = arena_alloc(arena, sizeof(CanvasDisplayList));
+    list->arena = arena;
+    list->width = width;
+    list->height = height;
+    list->is_raster = is_raster;
+    list->commands = canvas_command_vec_new(arena);
+
+    return list;
+}
+
+size_t canvas_display_list_len(const CanvasDisplayList* list) {
+    RELEASE_ASSERT(list);
+    return canvas_command_vec_len(list->commands);
+}
+
+bool canvas_display_list_is_raster(const CanvasDisplayList* list) {
+    RELEASE_ASSERT(list);
+    return list->is_raster;
+}
+
+static GeomRect
+canvas_display_list_point_bounds(double x, double y, double radius) {
+    return geom_rect_new(
+        geom_vec2_new(x - radius, y - radius),
+        geom_vec2_new(x + radius, y + radius)
+    );
+}
+
+void canvas_display_list_draw_circle(
+    CanvasDisplayList* list,
+    double x,
+    double y,
+    double radius,
+    Rgba rgba
+) {
+    RELEASE_ASSERT(list);
+
+    canvas_command_vec_push(
+        list->commands,
+        (CanvasCommand) {
+            .type = CANVAS_COMMAND_DRAW_CIRCLE,
+            .has_bounds = true,
+            .bounds = canvas_display_list_point_bounds(x, y, radius),
+            .data.draw_circle = {.x = x, .y = y, .radius = radius, .rgba = rgba}
+        }
+    );
+}
+
+void canvas_display_list_draw_line(
+    CanvasDisplayList* list,
+    double x1,
+    double y1,
+    double x2,
+    double y2,
+    double radius,
+    Rgba rgba
+) {
+    RELEASE_ASSERT(list);
+
+    GeomRect bounds = geom_rect_new(
+        geom_vec2_new(fmin(x1, x2) - radius, fmin(y1, y2) - radius),
+        geom_vec2_new(fmax(x1, x2) + radius, fmax(y1, y2) + radius)
+    );
+    canvas_command_vec_push(
+        list->commands,
+        (CanvasCommand) {.type = CANVAS_COMMAND_DRAW_LINE,
+                         .has_bounds = true,
+                         .bounds = bounds,
+                         .data.draw_line = {
+                             .x1 = x1,
+                             .y1 = y1,
+                             .x2 = x2,
+                             .y2 = y2,
+                             .radius = radius,
+                             .rgba = rgba
+                         }}
+    );
+}
+
+void canvas_display_list_draw_bezier(
+    CanvasDisplayList* list,
+    double x1,
+    double y1,
+    double x2,
+    double y2,
+    double cx,
+    double cy,
+    double flatness,
+    double radius,
+    Rgba rgba
+) {
+    RELEASE_ASSERT(list);
+
+    // The curve lies within its control polygon, and its end points are
+    // marked with circles three times the line's radius
+    double margin = radius * 3.0;
+    GeomRect bounds = geom_rect_new(
+        geom_vec2_new(
+            fmin(fmin(x1, x2), cx) - margin,
+            fmin(fmin(y1, y2), cy) - margin
+        ),
+        geom_vec2_new(
+            fmax(fmax(x1, x2), cx) + margin,
+            fmax(fmax(y1, y2), cy) + margin
+        )
+    );
+    canvas_command_vec_push(
+        list->commands,
+        (CanvasCommand) {.type = CANVAS_COMMAND_DRAW_BEZIER,
+                         .has_bounds = true,
+                         .bounds = bounds,
+                         .data.draw_bezier = {
+                             .x1 = x1,
+                             .y1 = y1,
+                             .x2 = x2,
+                             .y2 = y2,
+                             .cx = cx,
+                             .cy = cy,
+                             .flatness = flatness,
+                             .radius = radius,
+                             .rgba = rgba
+                         }}
+    );
+}
+
+void canvas_display_list_draw_path(
+    CanvasDisplayList* list,
+    const PathBuilder* path,
+    CanvasBrush brush
+) {
+    RELEASE_ASSERT(list);
+    RELEASE_ASSERT(path);
+
+    GeomRect bounds;
+    if (!raster_canvas_brush_bounds(path, brush, &bounds)) {
+        return;
+    }
+
+    canvas_command_vec_push(
+        list->commands,
+        (CanvasCommand) {
+            .type = CANVAS_COMMAND_DRAW_PATH,
+            .has_bounds = true,
+            .bounds = bounds,
+            .data.draw_path = {.path = path_builder_clone(list->arena, path),
+                               .brush = brush}
+        }
+    );
+}
+
+void canvas_display_list_draw_mask(
+    CanvasDisplayList* list,
+    const CanvasMask* mask,
+    int32_t x,
+    int32_t y,
+    Rgba rgba
+) {
+    RELEASE_ASSERT(list);
+    RELEASE_ASSERT(mask);
+    if (mask->width == 0 || mask->height == 0) {
+        return;
+    }
+
+    size_t coverage_len = 0;
+    const uint8_t* coverage =
+        uint8_array_get_raw(mask->coverage, &coverage_len);
+
+    CanvasMask copy = *mask;
+    copy.coverage = uint8_array_new(list->arena, coverage_len);
+    memcpy(
+        uint8_array_get_raw(copy.coverage, &coverage_len),
+        coverage,
+        coverage_len
+    );
+
+    double left = (double)x + (double)mask->origin_x;
+    double top = (double)y + (double)mask->origin_y;
+    canvas_command_vec_push(
+        list->commands,
+        (CanvasCommand) {
+            .type = CANVAS_COMMAND_DRAW_MASK,
+            .has_bounds = true,
+            .bounds = geom_rect_new(
+                geom_vec2_new(left, top),
+                geom_vec2_new(
+                    left + (double)mask->width,
+                    top + (double)mask->height
+                )
+            ),
+            .data.draw_mask = {.mask = copy, .x = x, .y = y, .rgba = rgba}
+        }
+    );
+}
+
+void canvas_display_list_draw_raster(
+    CanvasDisplayList* list,
+    Canvas* source,
+    int32_t x,
+    int32_t y
+) {
+    RELEASE_ASSERT(list);
+    RELEASE_ASSERT(list->is_raster);
+    RELEASE_ASSERT(source);
+
+    RasterCanvas* raster = canvas_get_raster(source);
+    canvas_command_vec_push(
+        list->commands,
+        (CanvasCommand) {
+            .type = CANVAS_COMMAND_DRAW_RASTER,
+            .has_bounds = true,
+            .bounds = geom_rect_new(
+                geom_vec2_new((double)x, (double)y),
+                geom_vec2_new(
+                    (double)x + (double)raster_canvas_width(raster),
+                    (double)y + (double)raster_canvas_height(raster)
+                )
+            ),
+            .data.draw_raster = {.source = source, .x = x, .y = y}
+        }
+    );
+}
+
+void canvas_display_list_push_clip_path(
+    CanvasDisplayList* list,
+    const PathBuilder* path,
+    bool even_odd_rule
+) {
+    RELEASE_ASSERT(list);
+    RELEASE_ASSERT(path);
+
+    canvas_command_vec_push(
+        list->commands,
+        (CanvasCommand) {.type = CANVAS_COMMAND_PUSH_CLIP_PATH,
+                         .has_bounds = false,
+                         .data.push_clip_path = {
+                             .path = path_builder_clone(list->arena, path),
+                             .even_odd_rule = even_odd_rule
+                         }}
+    );
+}
+
+void canvas_display_list_pop_clip_paths(
+    CanvasDisplayList* list,
+    size_t count
+) {
+    RELEASE_ASSERT(list);
+
+    canvas_command_vec_push(
+        list->commands,
+        (CanvasCommand) {.type = CANVAS_COMMAND_POP_CLIP_PATHS,
+                         .has_bounds = false,
+                         .data.pop_clip_paths = {.count = count}}
+    );
+}
+
+void canvas_display_list_draw_pixel(
+    CanvasDisplayList* list,
+    GeomVec2 position,
+    Rgba rgba
+) {
+    RELEASE_ASSERT(list);
+
+    canvas_command_vec_push(
+        list->commands,
+        (CanvasCommand) {
+            .type = CANVAS_COMMAND_DRAW_PIXEL,
+            .has_bounds = true,
+            .bounds = geom_rect_new(
+                position,
+                geom_vec2_add(position, geom_vec2_new(1.0, 1.0))
+            ),
+            .data.draw_pixel = {.position = position, .rgba = rgba}
+        }
+    );
+}
+
+void canvas_display_list_draw_span(
+    CanvasDisplayList* list,
+    int32_t x,
+    int32_t y,
+    size_t count,
+    const uint8_t* pixels
+) {
+    RELEASE_ASSERT(list);
+    RELEASE_ASSERT(list->is_raster);
+    if (count == 0) {
+        return;
+    }
+
+    uint8_t* copy = arena_alloc(list->arena, count * 4);
+    memcpy(copy, pixels, count * 4);
+
+    canvas_command_vec_push(
+        list->commands,
+        (CanvasCommand) {
+            .type = CANVAS_COMMAND_DRAW_SPAN,
+            .has_bounds = true,
+            .bounds = geom_rect_new(
+                geom_vec2_new((double)x, (double)y),
+                geom_vec2_new((double)x + (double)count, (double)y + 1.0)
+            ),
+            .data.draw_span = {
+                .x = x,
+                .y = y,
+                .count = count,
+                .pixels = copy
+            }
+        }
+    );
+}
+
+bool canvas_display_list_draw_bounds(
+    const CanvasDisplayList* list,
+    GeomRect* bounds_out
+) {
+    RELEASE_ASSERT(list);
+    RELEASE_ASSERT(bounds_out);
+
+    // Clips are only applied on replay, so only the list's size limits drawing
+    *bounds_out = geom_rect_new(
+        geom_vec2_new(0.0, 0.0),
+        geom_vec2_new((double)list->width, (double)list->height)
+    );
+    return list->width != 0 && list->height != 0;
+}
+
+void canvas_display_list_draw_deferred(
+    CanvasDisplayList* list,
+    CanvasDeferredDraw draw,
+    const void* data,
+    size_t data_size
+) {
+    RELEASE_ASSERT(list);
+    RELEASE_ASSERT(!list->is_raster);
+    RELEASE_ASSERT(draw);
+
+    void* copy = NULL;
+    if (data_size != 0) {
+        RELEASE_ASSERT(data);
+        copy = arena_alloc(list->arena, data_size);
+        memcpy(copy, data, data_size);
+    }
+
+    canvas_command_vec_push(
+        list->commands,
+        (CanvasCommand) {.type = CANVAS_COMMAND_DRAW_DEFERRED,
+                         .has_bounds = false,
+                         .data.draw_deferred = {
+                             .draw = draw,
+                             .data = copy,
+                             .data_size = data_size
+                         }}
+    );
+}
+
+static void
+canvas_command_replay(const CanvasCommand* command, Canvas* target) {
+    switch (command->type) {
+        case CANVAS_COMMAND_DRAW_CIRCLE: {
+            canvas_draw_circle(
+                target,
+                command->data.draw_circle.x,
+                command->data.draw_circle.y,
+                command->data.draw_circle.radius,
+                command->data.draw_circle.rgba
+            );
+            break;
+        }
+        case CANVAS_COMMAND_DRAW_LINE: {
+            canvas_draw_line(
+                target,
+                command->data.draw_line.x1,
+                command->data.draw_line.y1,
+                command->data.draw_line.x2,
+                command->data.draw_line.y2,
+                command->data.draw_line.radius,
+                command->data.draw_line.rgba
+            );
+            break;
+        }
+        case CANVAS_COMMAND_DRAW_BEZIER: {
+            canvas_draw_bezier(
+                target,
+                command->data.draw_bezier.x1,
+                command->data.draw_bezier.y1,
+                command->data.draw_bezier.x2,
+                command->data.draw_bezier.y2,
+                command->data.draw_bezier.cx,
+                command->data.draw_bezier.cy,
+                command->data.draw_bezier.flatness,
+                command->data.draw_bezier.radius,
+                command->data.draw_bezier.rgba
+            );
+            break;
+        }
+        case CANVAS_COMMAND_DRAW_PATH: {
+            canvas_draw_path(
+                target,
+                command->data.draw_path.path,
+                command->data.draw_path.brush
+            );
+            break;
+        }
+        case CANVAS_COMMAND_DRAW_MASK: {
+            canvas_draw_mask(
+                target,
+                &command->data.draw_mask.mask,
+                command->data.draw_mask.x,
+                command->data.draw_mask.y,
+                command->data.draw_mask.rgba
+            );
+            break;
+        }
+        case CANVAS_COMMAND_DRAW_RASTER: {
+            canvas_draw_raster(
+                target,
+                command->data.draw_raster.source,
+                command->data.draw_raster.x,
+                command->data.draw_raster.y
+            );
+            break;
+        }
+        case CANVAS_COMMAND_PUSH_CLIP_PATH: {
+            canvas_push_clip_path(
+                target,
+                command->data.push_clip_path.path,
+                command->data.push_clip_path.even_odd_rule
+            );
+            break;
+        }
+        case CANVAS_COMMAND_POP_CLIP_PATHS: {
+            canvas_pop_clip_paths(target, command->data.pop_clip_paths.count);
+            break;
+        }
+        case CANVAS_COMMAND_DRAW_PIXEL: {
+            canvas_draw_pixel(
+                target,
+                command->data.draw_pixel.position,
+                command->data.draw_pixel.rgba
+            );
+            break;
+        }
+        case CANVAS_COMMAND_DRAW_SPAN: {
+            canvas_draw_span(
+                target,
+                command->data.draw_span.x,
+                command->data.draw_span.y,
+                command->data.draw_span.count,
+                command->data.draw_span.pixels
+            );
+            break;
+        }
+        case CANVAS_COMMAND_DRAW_DEFERRED: {
+            canvas_draw_deferred(
+                target,
+                command->data.draw_deferred.draw,
+                command->data.draw_deferred.data,
+                command->data.draw_deferred.data_size
+            );
+            break;
+        }
+    }
+}
+
+void canvas_display_list_replay(const CanvasDisplayList* list, Canvas* target) {
+    RELEASE_ASSERT(list);
+    RELEASE_ASSERT(target);
+
+    for (size_t idx = 0; idx < canvas_command_vec_len(list->commands); idx++) {
+        CanvasCommand* command = NULL;
+        RELEASE_ASSERT(canvas_command_vec_get_ptr(list->commands, idx, &command)
+        );
+        canvas_command_replay(command, target);
+    }
+}
+
+/// Maps a recorded path through `transform` into a new path on `arena`.
+static PathBuilder* canvas_transformed_path(
+    Arena* arena,
+    const PathBuilder* path,
+    GeomMat3 transform,
+    PathBuilderOptions options
+) {
+    PathBuilder* transformed = path_builder_new_with_options(arena, options);
+    path_builder_append_transformed(transformed, path, transform);
+    return transformed;
+}
+
+/// Deferred content replayed into another vector recording, to be drawn once
+/// that recording is replayed in turn.
+typedef struct {
+    CanvasDeferredDraw draw;
+    const void* data;
+    size_t data_size;
+
+    /// Maps the space the content was submitted in onto the recording.
+    GeomMat3 transform;
+} CanvasNestedDeferred;
+
+static void canvas_nested_deferred_draw(
+    const void* data,
+    GeomMat3 transform,
+    Canvas* canvas
+) {
+    const CanvasNestedDeferred* nested = data;
+    RELEASE_ASSERT(nested);
+
+    nested->draw(
+        nested->data,
+        geom_mat3_mul(nested->transform, transform),
+        canvas
+    );
+}
+
+static void canvas_command_replay_deferred(
+    const CanvasCommand* command,
+    Canvas* target,
+    GeomMat3 transform
+) {
+    CanvasDisplayList* recording = canvas_get_recording(target);
+    if (!recording || recording->is_raster) {
+        command->data.draw_deferred.draw(
+            command->data.draw_deferred.data,
+            transform,
+            target
+        );
+        return;
+    }
+
+    // The final transform isn't known yet, so defer the content again.
+    // Content which was already deferred again is unwrapped, so that its own
+    // data is copied rather than a pointer into the list it came from.
+    CanvasNestedDeferred nested = {
+        .draw = command->data.draw_deferred.draw,
+        .data = command->data.draw_deferred.data,
+        .data_size = command->data.draw_deferred.data_size,
+        .transform = transform
+    };
+    if (nested.draw == canvas_nested_deferred_draw) {
+        const CanvasNestedDeferred* inner = nested.data;
+        nested.draw = inner->draw;
+        nested.data = inner->data;
+        nested.data_size = inner->data_size;
+        nested.transform = geom_mat3_mul(inner->transform, transform);
+    }
+
+    if (nested.data_size != 0) {
+        void* copy = arena_alloc(recording->arena, nested.data_size);
+        memcpy(copy, nested.data, nested.data_size);
+        nested.data = copy;
+    }
+
+    canvas_display_list_draw_deferred(
+        recording,
+        canvas_nested_deferred_draw,
+        &nested,
+        sizeof(CanvasNestedDeferred)
+    );
+}
+
+static void canvas_command_replay_transformed(
+    Arena* arena,
+    const CanvasCommand* command,
+    Canvas* target,
+    GeomMat3 transform,
+    double scale,
+    double width_scale,
+    PathBuilderOptions path_options
+) {
+    switch (command->type) {
+        case CANVAS_COMMAND_DRAW_CIRCLE: {
+            GeomVec2 center = geom_vec2_transform(
+                geom_vec2_new(
+                    command->data.draw_circle.x,
+                    command->data.draw_circle.y
+                ),
+                transform
+            );
+            canvas_draw_circle(
+                target,
+                center.x,
+                center.y,
+                command->data.draw_circle.radius * scale,
+                command->data.draw_circle.rgba
+            );
+            break;
+        }
+        case CANVAS_COMMAND_DRAW_LINE: {
+            GeomVec2 start = geom_vec2_transform(
+                geom_vec2_new(
+                    command->data.draw_line.x1,
+                    command->data.draw_line.y1
+                ),
+                transform
+            );
+            GeomVec2 end = geom_vec2_transform(
+                geom_vec2_new(
+                    command->data.draw_line.x2,
+                    command->data.draw_line.y2
+                ),
+                transform
+            );
+            canvas_draw_line(
+                target,
+                start.x,
+                start.y,
+                end.x,
+                end.y,
+                command->data.draw_line.radius * width_scale,
+                command->data.draw_line.rgba
+            );
+            break;
+        }
+        case CANVAS_COMMAND_DRAW_BEZIER: {
+            GeomVec2 start = geom_vec2_transform(
+                geom_vec2_new(
+                    command->data.draw_bezier.x1,
+                    command->data.draw_bezier.y1
+                ),
+                transform
+            );
+            GeomVec2 end = geom_vec2_transform(
+                geom_vec2_new(
+                    command->data.draw_bezier.x2,
+                    command->data.draw_bezier.y2
+                ),
+                transform
+            );
+            GeomVec2 control = geom_vec2_transform(
+                geom_vec2_new(
+                    command->data.draw_bezier.cx,
+                    command->data.draw_bezier.cy
+                ),
+                transform
+            );
+            canvas_draw_bezier(
+                target,
+                start.x,
+                start.y,
+                end.x,
+                end.y,
+                control.x,
+                control.y,
+                command->data.draw_bezier.flatness * scale,
+                command->data.draw_bezier.radius * width_scale,
+                command->data.draw_bezier.rgba
+            );
+            break;
+        }
+        case CANVAS_COMMAND_DRAW_PATH: {
+            CanvasBrush brush = command->data.draw_path.brush;
+            brush.stroke_width *= width_scale;
+            canvas_draw_path(
+                target,
+                canvas_transformed_path(
+                    arena,
+                    command->data.draw_path.path,
+                    transform,
+                    path_options
+                ),
+                brush
+            );
+            break;
+        }
+        case CANVAS_COMMAND_DRAW_MASK:
+        case CANVAS_COMMAND_DRAW_RASTER:
+        case CANVAS_COMMAND_DRAW_SPAN: {
+            LOG_PANIC(
+                "Vector display lists don't record masks, rasters or spans"
+            );
+        }
+        case CANVAS_COMMAND_PUSH_CLIP_PATH: {
+            canvas_push_clip_path(
+                target,
+                canvas_transformed_path(
+                    arena,
+                    command->data.push_clip_path.path,
+                    transform,
+                    path_options
+                ),
+                command->data.push_clip_path.even_odd_rule
+            );
+            break;
+        }
+        case CANVAS_COMMAND_POP_CLIP_PATHS: {
+            canvas_pop_clip_paths(target, command->data.pop_clip_paths.count);
+            break;
+        }
+        case CANVAS_COMMAND_DRAW_PIXEL: {
+            canvas_draw_pixel(
+                target,
+                geom_vec2_transform(
+                    command->data.draw_pixel.position,
+                    transform
+                ),
+                command->data.draw_pixel.rgba
+            );
+            break;
+        }
+        case CANVAS_COMMAND_DRAW_DEFERRED: {
+            canvas_command_replay_deferred(command, target, transform);
+            break;
+        }
+    }
+}
+
+/// Checks whether a path command mapped through `transform` may draw within
+/// `bounds`. The recorded bounds include the stroke at its recorded width,
+/// so they're widened by the stroke at its replayed width too. Other commands
+/// are always drawn.
+static bool canvas_command_reaches(
+    const CanvasCommand* command,
+    GeomMat3 transform,
+    double width_scale,
+    GeomRect bounds
+) {
+    if (command->type != CANVAS_COMMAND_DRAW_PATH
+        || !geom_rect_positive(command->bounds)) {
+        return true;
+    }
+
+    GeomRect reach = geom_rect_transform(command->bounds, transform);
+    CanvasBrush brush = command->data.draw_path.brush;
+    if (brush.enable_stroke && brush.stroke_width > 0.0) {
+        double margin = 0.5 * brush.stroke_width * width_scale
+                      * fmax(brush.miter_limit, sqrt(2.0));
+        reach.min.x -= margin;
+        reach.min.y -= margin;
+        reach.max.x += margin;
+        reach.max.y += margin;
+    }
+
+    return reach.min.x <= bounds.max.x && reach.max.x >= bounds.min.x
+        && reach.min.y <= bounds.max.y && reach.max.y >= bounds.min.y;
+}
+
+void canvas_display_list_replay_transformed(
+    const CanvasDisplayList* list,
+    Canvas* target,
+    GeomMat3 transform,
+    double width_scale
+) {
+    RELEASE_ASSERT(list);
+    RELEASE_ASSERT(!list->is_raster);
+    RELEASE_ASSERT(target);
+
+    double scale = geom_mat3_max_scale(transform);
+    PathBuilderOptions path_options = path_builder_options_default();
+    if (canvas_is_raster(target)) {
+        path_options = path_builder_options_flattened();
+    }
+
+    // Paths which can't reach a raster target aren't transformed at all,
+    // which matters when a large page is replayed onto a small part of it.
+    // Scalable output keeps every command.
+    GeomRect target_bounds;
+    bool cull = canvas_is_raster(target);
+    if (cull && !canvas_draw_bounds(target, &target_bounds)) {
+        return;
+    }
+
+    Arena* scratch_arena = arena_new(4096);
+    for (size_t idx = 0; idx < canvas_command_vec_len(list->commands); idx++) {
+        CanvasCommand* command = NULL;
+        RELEASE_ASSERT(canvas_command_vec_get_ptr(list->commands, idx, &command)
+        );
+
+        if (cull
+            && !canvas_command_reaches(
+                command,
+                transform,
+                width_scale,
+                target_bounds
+            )) {
+            continue;
+        }
+
+        arena_reset(scratch_arena);
+        canvas_command_replay_transformed(
+            scratch_arena,
+            command,
+            target,
+            transform,
+            scale,
+            width_scale,
+            path_options
+        );
+    }
+    arena_free(scratch_arena);
+}
+
+/// The shared state of the threads rasterizing a tiled display list. Tiles
+/// are claimed in order through `next_tile`.
+typedef struct {
+    const CanvasDisplayList* list;
+    const RasterCanvas* target;
+    uint32_t tile_height;
+    size_t tile_count;
+
+    /// The indices of the commands drawn by each tile, in order.
+    Uint32Vec** bins;
+
+    atomic_size_t next_tile;
+} CanvasTileJob;
+
+static void* canvas_tile_worker(void* data) {
+    CanvasTileJob* job = data;
+
+    Arena* tile_arena = arena_new(65536);
+    while (true) {
+        size_t tile_idx = atomic_fetch_add(&job->next_tile, 1);
+        if (tile_idx >= job->tile_count) {
+            break;
+        }
+
+        uint32_t row_begin = (uint32_t)tile_idx * job->tile_height;
+        uint32_t row_end = job->list->height - row_begin < job->tile_height
+                             ? job->list->height
+                             : row_begin + job->tile_height;
+
+        arena_reset(tile_arena);
+        Canvas* tile = canvas_from_raster(
+            tile_arena,
+            raster_canvas_new_view(tile_arena, job->target, row_begin, row_end)
+        );
+
+        Uint32Vec* bin = job->bins[tile_idx];
+        for (size_t idx = 0; idx < uint32_vec_len(bin); idx++) {
+            uint32_t command_idx = 0;
+            RELEASE_ASSERT(uint32_vec_get(bin, idx, &command_idx));
+
+            CanvasCommand* command = NULL;
+            RELEASE_ASSERT(canvas_command_vec_get_ptr(
+                job->list->commands,
+                command_idx,
+                &command
+            ));
+            canvas_command_replay(command, tile);
+        }
+    }
+    arena_free(tile_arena);
+
+    return NULL;
+}
+
+void canvas_display_list_rasterize_tiled(
+    const CanvasDisplayList* list,
+    Canvas* target,
+    uint32_t tile_height,
+    uint32_t thread_count
+) {
+    RELEASE_ASSERT(list);
+    RELEASE_ASSERT(list->is_raster);
+    RELEASE_ASSERT(target);
+    RELEASE_ASSERT(tile_height != 0);
+
+    RasterCanvas* raster = canvas_get_raster(target);
+    RELEASE_ASSERT(
+        raster_canvas_width(raster) == list->width
+        && raster_canvas_height(raster) == list->height
+    );
+    RELEASE_ASSERT(
+        canvas_command_vec_len(list->commands) <= UINT32_MAX,
+        "Too many commands to bin"
+    );
+
+    size_t tile_count =
+        ((size_t)list->height + tile_height - 1) / (size_t)tile_height;
+    if (tile_count == 0) {
+        return;
+    }
+
+    Arena* bin_arena = arena_new(65536);
+    Uint32Vec** bins = arena_alloc(bin_arena, sizeof(Uint32Vec*) * tile_count);
+    for (size_t tile_idx = 0; tile_idx < tile_count; tile_idx++) {
+        bins[tile_idx] = uint32_vec_new(bin_arena);
+    }
+
+    // Commands go to every tile overlapping the rows of their bounds, and
+    // clip changes to every tile so each one sees the same clip stack
+    for (size_t idx = 0; idx < canvas_command_vec_len(list->commands); idx++) {
+        CanvasCommand* command = NULL;
+        RELEASE_ASSERT(canvas_command_vec_get_ptr(list->commands, idx, &command)
+        );
+
+        size_t first_tile = 0;
+        size_t last_tile = tile_count - 1;
+        if (command->has_bounds) {
+            double top = floor(command->bounds.min.y);
+            double bottom = ceil(command->bounds.max.y);
+            if (bottom <= 0.0 || top >= (double)list->height) {
+                continue;
+            }
+
+            if (top > 0.0) {
+                first_tile = (size_t)top / tile_height;
+            }
+            if (bottom < (double)list->height) {
+                last_tile = ((size_t)bottom - 1) / tile_height;
+            }
+        }
+
+        for (size_t tile_idx = first_tile; tile_idx <= last_tile; tile_idx++) {
+            uint32_vec_push(bins[tile_idx], (uint32_t)idx);
+        }
+    }
+
+    CanvasTileJob job = {
+        .list = list,
+        .target = raster,
+        .tile_height = tile_height,
+        .tile_count = tile_count,
+        .bins = bins
+    };
+    atomic_init(&job.next_tile, 0);
+
+    // The calling thread works through tiles alongside the others
+    size_t worker_count = thread_count > 1 ? (size_t)thread_count - 1 : 0;
+    if (worker_count > tile_count - 1) {
+        worker_count = tile_count - 1;
+    }
+
+    pthread_t* workers =
+        arena_alloc(bin_arena, sizeof(pthread_t) * worker_count);
+    for (size_t idx = 0; idx < worker_count; idx++) {
+        RELEASE_ASSERT(
+            pthread_create(&workers[idx], NULL, canvas_tile_worker, &job) == 0
+        );
+    }
+
+    canvas_tile_worker(&job);
+
+    for (size_t idx = 0; idx < worker_count; idx++) {
+        RELEASE_ASSERT(pthread_join(workers[idx], NULL) == 0);
+    }
+
+    arena_free(bin_arena);
+}
+
+#ifdef TEST
+
+#include "test/test.h"
+
+static void display_list_test_draw(Canvas* canvas, Arena* arena) {
+    Rgba red = rgba_new(1.0, 0.0, 0.0, 0.8);
+    Rgba blue = rgba_new(0.0, 0.0, 1.0, 1.0);
+
+    PathBuilder* blob =
+        path_builder_new_with_options(arena, path_builder_options_flattened());
+    path_builder_new_contour(blob, geom_vec2_new(3.3, 2.1));
+    path_builder_line_to(blob, geom_vec2_new(36.7, 9.4));
+    path_builder_line_to(blob, geom_vec2_new(21.2, 37.9));
+    path_builder_line_to(blob, geom_vec2_new(5.5, 28.3));
+    path_builder_close_contour(blob);
+    canvas_draw_path(
+        canvas,
+        blob,
+        (CanvasBrush) {.enable_fill = true, .fill_rgba = red}
+    );
+
+    PathBuilder* clip =
+        path_builder_new_with_options(arena, path_builder_options_flattened());
+    path_builder_new_contour(clip, geom_vec2_new(0.0, 19.5));
+    path_builder_line_to(clip, geom_vec2_new(40.0, 4.25));
+    path_builder_line_to(clip, geom_vec2_new(40.0, 40.0));
+    path_builder_close_contour(clip);
+    canvas_push_clip_path(canvas, clip, false);
+
+    PathBuilder* line =
+        path_builder_new_with_options(arena, path_builder_options_flattened());
+    path_builder_new_contour(line, geom_vec2_new(2.0, 38.0));
+    path_builder_line_to(line, geom_vec2_new(20.0, 3.0));
+    path_builder_line_to(line, geom_vec2_new(38.0, 30.0));
+    canvas_draw_path(
+        canvas,
+        line,
+        (CanvasBrush) {.enable_stroke = true,
+                       .stroke_rgba = blue,
+                       .stroke_width = 3.5,
+                       .line_cap = CANVAS_LINECAP_SQUARE,
+                       .line_join = CANVAS_LINEJOIN_MITER,
+                       .miter_limit = 10.0}
+    );
+    canvas_pop_clip_paths(canvas, 1);
+
+    canvas_draw_pixel(canvas, geom_vec2_new(30.5, 35.5), blue);
+}
+
+TEST_FUNC(test_canvas_display_list_tiled_matches_direct) {
+    Arena* arena = arena_new(4096);
+    Rgba white = rgba_new(1.0, 1.0, 1.0, 1.0);
+
+    Canvas* direct = canvas_new_raster(arena, 40, 40, white);
+    display_list_test_draw(direct, arena);
+
+    CanvasDisplayList* list = canvas_display_list_new(arena, 40, 40, true);
+    display_list_test_draw(canvas_new_recording(arena, list), arena);
+    TEST_ASSERT_EQ(canvas_display_list_len(list), (size_t)5);
+
+    Canvas* replayed = canvas_new_raster(arena, 40, 40, white);
+    canvas_display_list_replay(list, replayed);
+
+    // Tiles split the stroke, the clip and the fill at odd rows
+    Canvas* tiled = canvas_new_raster(arena, 40, 40, white);
+    canvas_display_list_rasterize_tiled(list, tiled, 7, 3);
+
+    for (uint32_t y = 0; y < 40; y++) {
+        const uint8_t* expected = canvas_raster_row(direct, y);
+        TEST_ASSERT(memcmp(canvas_raster_row(replayed, y), expected, 160) == 0);
+        TEST_ASSERT(memcmp(canvas_raster_row(tiled, y), expected, 160) == 0);
+    }
+
+    arena_free(arena);
+    return TEST_RESULT_PASS;
+}
+
+static void display_list_test_deferred_draw(
+    const void* data,
+    GeomMat3 transform,
+    Canvas* canvas
+) {
+    const GeomVec2* position = data;
+    canvas_draw_pixel(
+        canvas,
+        geom_vec2_transform(*position, transform),
+        rgba_new(0.0, 1.0, 0.0, 1.0)
+    );
+}
+
+TEST_FUNC(test_canvas_display_list_replay_transformed) {
+    Arena* arena = arena_new(4096);
+    Rgba white = rgba_new(1.0, 1.0, 1.0, 1.0);
+    Rgba red = rgba_new(1.0, 0.0, 0.0, 0.8);
+    GeomMat3 transform = geom_mat3_new_pdf(2.0, 0.0, 0.0, 2.0, 0.0, 0.0);
+
+    CanvasDisplayList* list = canvas_display_list_new(arena, 20, 20, false);
+    Canvas* recording = canvas_new_recording(arena, list);
+
+    PathBuilder* blob = path_builder_new(arena);
+    path_builder_new_contour(blob, geom_vec2_new(1.5, 1.0));
+    path_builder_line_to(blob, geom_vec2_new(18.0, 4.5));
+    path_builder_line_to(blob, geom_vec2_new(10.5, 19.0));
+    path_builder_close_contour(blob);
+    CanvasBrush brush = {.enable_fill = true, .fill_rgba = red};
+    canvas_draw_path(recording, blob, brush);
+
+    GeomVec2 position = geom_vec2_new(15.25, 15.25);
+    canvas_draw_deferred(
+        recording,
+        display_list_test_deferred_draw,
+        &position,
+        sizeof(position)
+    );
+    TEST_ASSERT_EQ(canvas_display_list_len(list), (size_t)2);
+
+    // The list owns a copy of the deferred content's data
+    position = geom_vec2_new(0.0, 0.0);
+
+    Canvas* replayed = canvas_new_raster(arena, 40, 40, white);
+    canvas_display_list_replay_transformed(list, replayed, transform, 2.0);
+
+    Canvas* direct = canvas_new_raster(arena, 40, 40, white);
+    PathBuilder* scaled =
+        path_builder_new_with_options(arena, path_builder_options_flattened());
+    path_builder_new_contour(scaled, geom_vec2_new(3.0, 2.0));
+    path_builder_line_to(scaled, geom_vec2_new(36.0, 9.0));
+    path_builder_line_to(scaled, geom_vec2_new(21.0, 38.0));
+    path_builder_close_contour(scaled);
+    canvas_draw_path(direct, scaled, brush);
+    canvas_draw_pixel(
+        direct,
+        geom_vec2_new(30.5, 30.5),
+        rgba_new(0.0, 1.0, 0.0, 1.0)
+    );
+
+    for (uint32_t y = 0; y < 40; y++) {
+        TEST_ASSERT(
+            memcmp(
+                canvas_raster_row(replayed, y),
+                canvas_raster_row(direct, y),
+                160
+            )
+            == 0
+        );
+    }
+
+    arena_free(arena);
+    return TEST_RESULT_PASS;
+}
+
+TEST_FUNC(test_canvas_display_list_nested_deferred_outlives_lists) {
+    Arena* arena = arena_new(4096);
+    Arena* inner_arena = arena_new(4096);
+    Arena* middle_arena = arena_new(4096);
+    GeomMat3 shift = geom_mat3_translate(2.0, 3.0);
+
+    CanvasDisplayList* inner =
+        canvas_display_list_new(inner_arena, 20, 20, false);
+    GeomVec2 position = geom_vec2_new(4.5, 5.5);
+    canvas_draw_deferred(
+        canvas_new_recording(inner_arena, inner),
+        display_list_test_deferred_draw,
+        &position,
+        sizeof(position)
+    );
+
+    // Deferred content replayed through two recordings is drawn after both
+    // of the lists it passed through are gone
+    CanvasDisplayList* middle =
+        canvas_display_list_new(middle_arena, 20, 20, false);
+    canvas_display_list_replay_transformed(
+        inner,
+        canvas_new_recording(middle_arena, middle),
+        shift,
+        1.0
+    );
+    CanvasDisplayList* outer = canvas_display_list_new(arena, 20, 20, false);
+    canvas_display_list_replay_transformed(
+        middle,
+        canvas_new_recording(arena, outer),
+        shift,
+        1.0
+    );
+    arena_free(inner_arena);
+    arena_free(middle_arena);
+
+    Canvas* replayed =
+        canvas_new_raster(arena, 20, 20, rgba_new(1.0, 1.0, 1.0, 1.0));
+    canvas_display_list_replay_transformed(
+        outer,
+        replayed,
+        geom_mat3_identity(),
+        1.0
+    );
+
+    const uint8_t* row = canvas_raster_row(replayed, 11);
+    TEST_ASSERT_EQ(row[8 * 4], (uint8_t)0);
+    TEST_ASSERT_EQ(row[8 * 4 + 1], (uint8_t)255);
+    TEST_ASSERT_EQ(row[8 * 4 + 2], (uint8_t)0);
+
+    arena_free(arena);
+    return TEST_RESULT_PASS;
+}
+
+TEST_FUNC(test_canvas_display_list_replay_transformed_bands) {
+    Arena* arena = arena_new(4096);
+    Rgba white = rgba_new(1.0, 1.0, 1.0, 1.0);
+
+    CanvasDisplayList* list = canvas_display_list_new(arena, 40, 40, false);
+    display_list_test_draw(canvas_new_recording(arena, list), arena);
+
+    Canvas* whole = canvas_new_raster(arena, 40, 40, white);
+    canvas_display_list_replay_transformed(
+        list,
+        whole,
+        geom_mat3_identity(),
+        1.0
+    );
+
+    // Bands cull the paths outside them, which mustn't change any pixel
+    for (uint32_t band_y = 0; band_y < 40; band_y += 7) {
+        uint32_t band_end = band_y + 7 < 40 ? band_y + 7 : 40;
+        Canvas* band =
+            canvas_new_raster_band(arena, 40, 40, band_y, band_end, white);
+        canvas_display_list_replay_transformed(
+            list,
+            band,
+            geom_mat3_identity(),
+            1.0
+        );
+
+        for (uint32_t row = band_y; row < band_end; row++) {
+            TEST_ASSERT(
+                memcmp(
+                    canvas_raster_row(band, row),
+                    canvas_raster_row(whole, row),
+                    160
+                )
+                == 0
+            );
+        }
+    }
+
+    arena_free(arena);
+    return TEST_RESULT_PASS;
+}
+
+#endif // TEST
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "canvas/canvas.h"
+#include "canvas/display_list.h"
+#include "canvas/path_builder.h"
+#include "geom/rect.h"
+#include "geom/vec2.h"
+
+bool canvas_display_list_is_raster(const CanvasDisplayList* list);
+
+void canvas_display_list_draw_circle(
+    CanvasDisplayList* list,
+    double x,
+    double y,
+    double radius,
+    Rgba rgba
+);
+
+void canvas_display_list_draw_line(
+    CanvasDisplayList* list,
+    double x1,
+    double y1,
+    double x2,
+    double y2,
+    double radius,
+    Rgba rgba
+);
+
+void canvas_display_list_draw_bezier(
+    CanvasDisplayList* list,
+    double x1,
+    double y1,
+    double x2,
+    double y2,
+    double cx,
+    double cy,
+    double flatness,
+    double radius,
+    Rgba rgba
+);
+
+void canvas_display_list_draw_path(
+    CanvasDisplayList* list,
+    const PathBuilder* path,
+    CanvasBrush brush
+);
+
+/// Records a mask, copying its coverage since masks are often owned by a
+/// cache that may evict them before the list is replayed.
+void canvas_display_list_draw_mask(
+    CanvasDisplayList* list,
+    const CanvasMask* mask,
+    int32_t x,
+    int32_t y,
+    Rgba rgba
+);
+
+/// Records a raster canvas drawn at an integer offset. The source canvas
+/// isn't copied. Only raster display lists record rasters.
+void canvas_display_list_draw_raster(
+    CanvasDisplayList* list,
+    Canvas* source,
+    int32_t x,
+    int32_t y
+);
+
+void canvas_display_list_push_clip_path(
+    CanvasDisplayList* list,
+    const PathBuilder* path,
+    bool even_odd_rule
+);
+
+void canvas_display_list_pop_clip_paths(CanvasDisplayList* list, size_t count);
+
+void canvas_display_list_draw_pixel(
+    CanvasDisplayList* list,
+    GeomVec2 position,
+    Rgba rgba
+);
+
+/// Records a span of premultiplied pixels, copying them. Only raster display
+/// lists record spans.
+void canvas_display_list_draw_span(
+    CanvasDisplayList* list,
+    int32_t x,
+    int32_t y,
+    size_t count,
+    const uint8_t* pixels
+);
+
+bool canvas_display_list_draw_bounds(
+    const CanvasDisplayList* list,
+    GeomRect* bounds_out
+);
+
+/// Records deferred content, copying `data_size` bytes of `data`. Only vector
+/// display lists record deferred content.
+void canvas_display_list_draw_deferred(
+    CanvasDisplayList* list,
+    CanvasDeferredDraw draw,
+    const void* data,
+    size_t data_size
+);
@@ -3,6 +3,7 @@
 #include <math.h>
 
 #include "arena/arena.h"
+#include "geom/rect.h"
 #include "geom/vec2.h"
 #include "logger/log.h"
 #include "path_builder.h"
@@ -489,6 +490,149 @@ void path_builder_apply_transform(PathBuilder* path, GeomMat3 transform) {
     }
 }
 
+static void
+path_builder_bounds_extend(GeomRect* bounds, bool* has_points, GeomVec2 point) {
+    if (!*has_points) {
+        *bounds = geom_rect_new(point, point);
+        *has_points = true;
+        return;
+    }
+
+    bounds->min = geom_vec2_min(bounds->min, point);
+    bounds->max = geom_vec2_max(bounds->max, point);
+}
+
+bool path_builder_bounds(const PathBuilder* path, GeomRect* bounds_out) {
+    RELEASE_ASSERT(path);
+    RELEASE_ASSERT(bounds_out);
+
+    bool has_points = false;
+    for (size_t contour_idx = 0;
+         contour_idx < path_contour_vec_len(path->contours);
+         contour_idx++) {
+        PathContour* contour = NULL;
+        RELEASE_ASSERT(
+            path_contour_vec_get(path->contours, contour_idx, &contour)
+        );
+
+        for (size_t segment_idx = 0; segment_idx < path_contour_len(contour);
+             segment_idx++) {
+            PathContourSegment segment;
+            RELEASE_ASSERT(path_contour_get(contour, segment_idx, &segment));
+
+            switch (segment.type) {
+                case PATH_CONTOUR_SEGMENT_TYPE_QUAD_BEZIER: {
+                    path_builder_bounds_extend(
+                        bounds_out,
+                        &has_points,
+                        segment.value.quad_bezier.control
+                    );
+                    break;
+                }
+                case PATH_CONTOUR_SEGMENT_TYPE_CUBIC_BEZIER: {
+                    path_builder_bounds_extend(
+                        bounds_out,
+                        &has_points,
+                        segment.value.cubic_bezier.control_a
+                    );
+                    path_builder_bounds_extend(
+                        bounds_out,
+                        &has_points,
+                        segment.value.cubic_bezier.control_b
+                    );
+                    break;
+                }
+                default: {
+                    break;
+                }
+            }
+
+            path_builder_bounds_extend(
+                bounds_out,
+                &has_points,
+                path_contour_segment_end(segment)
+            );
+        }
+    }
+
+    return has_points;
+}
+
+void path_builder_append_transformed(
+    PathBuilder* dst,
+    const PathBuilder* src,
+    GeomMat3 transform
+) {
+    RELEASE_ASSERT(dst);
+    RELEASE_ASSERT(src);
+
+    for (size_t contour_idx = 0;
+         contour_idx < path_contour_vec_len(src->contours);
+         contour_idx++) {
+        PathContour* contour = NULL;
+        RELEASE_ASSERT(
+            path_contour_vec_get(src->contours, contour_idx, &contour)
+        );
+
+        for (size_t segment_idx = 0; segment_idx < path_contour_len(contour);
+             segment_idx++) {
+            PathContourSegment* segment = NULL;
+            RELEASE_ASSERT(
+                path_contour_get_ptr(contour, segment_idx, &segment)
+            );
+
+            switch (segment->type) {
+                case PATH_CONTOUR_SEGMENT_TYPE_START: {
+                    path_builder_new_contour(
+                        dst,
+                        geom_vec2_transform(segment->value.start, transform)
+                    );
+                    break;
+                }
+                case PATH_CONTOUR_SEGMENT_TYPE_LINE: {
+                    path_builder_line_to(
+                        dst,
+                        geom_vec2_transform(segment->value.line, transform)
+                    );
+                    break;
+                }
+                case PATH_CONTOUR_SEGMENT_TYPE_QUAD_BEZIER: {
+                    path_builder_quad_bezier_to(
+                        dst,
+                        geom_vec2_transform(
+                            segment->value.quad_bezier.end,
+                            transform
+                        ),
+                        geom_vec2_transform(
+                            segment->value.quad_bezier.control,
+                            transform
+                        )
+                    );
+                    break;
+                }
+                case PATH_CONTOUR_SEGMENT_TYPE_CUBIC_BEZIER: {
+                    path_builder_cubic_bezier_to(
+                        dst,
+                        geom_vec2_transform(
+                            segment->value.cubic_bezier.end,
+                            transform
+                        ),
+                        geom_vec2_transform(
+                            segment->value.cubic_bezier.control_a,
+                            transform
+                        ),
+                        geom_vec2_transform(
+                            segment->value.cubic_bezier.control_b,
+                            transform
+                        )
+                    );
+                    break;
+                }
+            }
+        }
+    }
+}
+
 #ifdef TEST
 
 #include "test/test.h"
@@ -973,4 +1117,55 @@ TEST_FUNC(test_path_builder_options_flatten_enabled_cubic_depth_cap) {
     return TEST_RESULT_PASS;
 }
 
+TEST_FUNC(test_path_builder_append_transformed_flattens_in_target_space) {
+    Arena* arena = arena_new(1024);
+
+    PathBuilder* src =
+        path_builder_new_with_options(arena, path_builder_options_default());
+    path_builder_new_contour(src, geom_vec2_new(0.0, 0.0));
+    path_builder_quad_bezier_to(
+        src,
+        geom_vec2_new(1.0, 0.0),
+        geom_vec2_new(0.5, 1.0)
+    );
+
+    PathBuilder* dst =
+        path_builder_new_with_options(arena, path_builder_options_flattened());
+    path_builder_append_transformed(
+        dst,
+        src,
+        geom_mat3_new(100.0, 0.0, 0.0, 0.0, 100.0, 0.0, 10.0, 20.0, 1.0)
+    );
+
+    // Source is untouched
+    PathContour* src_contour = path_builder_test_first_contour(src);
+    TEST_ASSERT_EQ((unsigned long)path_contour_len(src_contour), 2UL);
+
+    PathContour* contour = path_builder_test_first_contour(dst);
+    TEST_ASSERT((unsigned long)path_contour_len(contour) > 2UL);
+
+    PathContourSegment start;
+    RELEASE_ASSERT(path_contour_get(contour, 0, &start));
+    TEST_ASSERT_EQ((int)start.type, (int)PATH_CONTOUR_SEGMENT_TYPE_START);
+    TEST_ASSERT(geom_vec2_equal_eps(
+        start.value.start,
+        geom_vec2_new(10.0, 20.0),
+        1e-9
+    ));
+
+    PathContourSegment end;
+    RELEASE_ASSERT(
+        path_contour_get(contour, path_contour_len(contour) - 1, &end)
+    );
+    TEST_ASSERT_EQ((int)end.type, (int)PATH_CONTOUR_SEGMENT_TYPE_LINE);
+    TEST_ASSERT(geom_vec2_equal_eps(
+        end.value.line,
+        geom_vec2_new(110.0, 20.0),
+        1e-9
+    ));
+
+    arena_free(arena);
+    return TEST_RESULT_PASS;
+}
+
 #endif
@@ -8,21 +8,43 @@
 
 #include "arena/common.h"
 #include "canvas/canvas.h"
+#include "codec/zlib.h"
+#include "composite.h"
+#include "coverage.h"
 #include "dcel.h"
+#include "geom/mat3.h"
+#include "geom/rect.h"
+#include "geom/vec2.h"
 #include "logger/log.h"
 #include "path_builder.h"
 
 #define BMP_HEADER_LEN 14
 #define BMP_INFO_HEADER_LEN 40
 
+/// A clip path rasterized over the pixels it can reach, already intersected
+/// with every clip path below it on the stack. Pixels outside the region are
+/// fully clipped.
 typedef struct {
-    const PathBuilder* path;
-    DcelFillRule fill_rule;
-} ClipPathEntry;
+    uint32_t origin_x;
+    uint32_t origin_y;
+    uint32_t width;
+    uint32_t height;
 
-#define DVEC_NAME ClipPathVec
-#define DVEC_LOWERCASE_NAME clip_path_vec
-#define DVEC_TYPE ClipPathEntry
+    /// Whether the whole region is fully covered, as for a pixel-aligned
+    /// rectangle, in which case `coverage` is unused.
+    bool is_opaque;
+
+    /// Coverage of the region's rows from `coverage_y` on, limited to the
+    /// canvas's own rows. The buffer is reused by later masks pushed at the
+    /// same depth once this one is popped.
+    uint8_t* coverage;
+    uint32_t coverage_y;
+    size_t capacity;
+} ClipMask;
+
+#define DVEC_NAME ClipMaskVec
+#define DVEC_LOWERCASE_NAME clip_mask_vec
+#define DVEC_TYPE ClipMask
 #include "arena/dvec_impl.h"
 
 #define DARRAY_NAME GeomVec2Array
@@ -35,10 +57,22 @@ struct RasterCanvas {
 
     uint32_t width;
     uint32_t height;
-    uint32_t file_size;
-    uint8_t* data;
 
-    ClipPathVec* clip_paths;
+    /// Premultiplied RGBA8 pixels, top row first, with rows `stride` bytes
+    /// apart. These are only converted to a BMP when written. The first row
+    /// held is `first_row`, since bands only hold the rows they draw to.
+    uint8_t* pixels;
+    size_t stride;
+    uint32_t first_row;
+
+    /// The rows this canvas draws to. A view shares the pixels of a larger
+    /// canvas and owns only some of its rows, but computes coverage over the
+    /// same regions, so its rows come out exactly as if drawn in full.
+    uint32_t row_begin;
+    uint32_t row_end;
+
+    ClipMaskVec* clip_masks;
+    size_t clip_depth;
 };
 
 static void write_u16(uint8_t* target, uint16_t value) {
@@ -92,47 +126,86 @@ RasterCanvas* raster_canvas_new(
     uint32_t height,
     Rgba rgba
 ) {
-    uint32_t file_size =
-        BMP_HEADER_LEN + BMP_INFO_HEADER_LEN + width * height * 4;
-    uint32_t packed_rgba = rgba_pack(rgba);
+    size_t stride = (size_t)width * 4;
+    CompositeColor color = composite_color_from_rgba(rgba);
 
     LOG_DIAG(
         INFO,
         CANVAS,
-        "Creating new %ux%u (%u bytes) canvas with initial color 0x%08" PRIx32,
+        "Creating new %ux%u (%zu bytes) canvas with initial color 0x%08" PRIx32,
         width,
         height,
-        file_size,
-        packed_rgba
+        stride * height,
+        rgba_pack(rgba)
     );
 
     RasterCanvas* canvas = arena_alloc(arena, sizeof(RasterCanvas));
     canvas->arena = arena;
     canvas->width = width;
     canvas->height = height;
-    canvas->file_size = file_size;
-    canvas->data = arena_alloc(arena, file_size);
-    memset(canvas->data, 0, file_size);
+    canvas->stride = stride;
+    canvas->pixels = arena_alloc(arena, stride * height);
+    canvas->first_row = 0;
+    canvas->row_begin = 0;
+    canvas->row_end = height;
 
-    canvas->clip_paths = clip_path_vec_new(arena);
+    canvas->clip_masks = clip_mask_vec_new(arena);
+    canvas->clip_depth = 0;
 
-    write_bmp_header(canvas->data, file_size);
-    write_bmp_info_header(canvas->data + BMP_HEADER_LEN, width, height);
-
-    uint8_t r = (uint8_t)((packed_rgba >> 24) & 0xff);
-    uint8_t g = (uint8_t)((packed_rgba >> 16) & 0xff);
-    uint8_t b = (uint8_t)((packed_rgba >> 8) & 0xff);
-    uint8_t a = (uint8_t)(packed_rgba & 0xff);
-    for (uint32_t idx = 0; idx < width * height; idx++) {
-        canvas->data[BMP_HEADER_LEN + BMP_INFO_HEADER_LEN + idx * 4] = b;
-        canvas->data[BMP_HEADER_LEN + BMP_INFO_HEADER_LEN + idx * 4 + 1] = g;
-        canvas->data[BMP_HEADER_LEN + BMP_INFO_HEADER_LEN + idx * 4 + 2] = r;
-        canvas->data[BMP_HEADER_LEN + BMP_INFO_HEADER_LEN + idx * 4 + 3] = a;
+    for (size_t idx = 0; idx < (size_t)width * height; idx++) {
+        memcpy(canvas->pixels + idx * 4, &color, 4);
     }
 
     return canvas;
 }
 
+RasterCanvas* raster_canvas_new_band(
+    Arena* arena,
+    uint32_t width,
+    uint32_t height,
+    uint32_t row_begin,
+    uint32_t row_end,
+    Rgba rgba
+) {
+    RELEASE_ASSERT(row_begin <= row_end && row_end <= height);
+
+    RasterCanvas* canvas =
+        raster_canvas_new(arena, width, row_end - row_begin, rgba);
+    canvas->height = height;
+    canvas->first_row = row_begin;
+    canvas->row_begin = row_begin;
+    canvas->row_end = row_end;
+
+    return canvas;
+}
+
+RasterCanvas* raster_canvas_new_view(
+    Arena* arena,
+    const RasterCanvas* target,
+    uint32_t row_begin,
+    uint32_t row_end
+) {
+    RELEASE_ASSERT(arena);
+    RELEASE_ASSERT(target);
+    RELEASE_ASSERT(
+        target->row_begin <= row_begin && row_begin <= row_end
+        && row_end <= target->row_end
+    );
+
+    RasterCanvas* canvas = arena_alloc(arena, sizeof(RasterCanvas));
+    *canvas = (RasterCanvas) {.arena = arena,
+                              .width = target->width,
+                              .height = target->height,
+                              .pixels = target->pixels,
+                              .stride = target->stride,
+                              .first_row = target->first_row,
+                              .row_begin = row_begin,
+                              .row_end = row_end,
+                              .clip_masks = clip_mask_vec_new(arena),
+                              .clip_depth = 0};
+    return canvas;
+}
+
 double raster_canvas_raster_res(const RasterCanvas* canvas) {
     RELEASE_ASSERT(canvas);
     return 1.0;
@@ -148,33 +221,55 @@ uint32_t raster_canvas_height(const RasterCanvas* canvas) {
     return canvas->height;
 }
 
-static bool raster_canvas_pixel_visible(
-    const RasterCanvas* canvas,
-    uint32_t x,
-    uint32_t y
-) {
-    RELEASE_ASSERT(canvas);
+/// Gets the innermost clip mask, or NULL if nothing is clipped.
+static const ClipMask* raster_canvas_clip_mask(const RasterCanvas* canvas) {
+    if (canvas->clip_depth == 0) {
+        return NULL;
+    }
 
-    if (clip_path_vec_len(canvas->clip_paths) == 0) {
-        return true;
+    ClipMask* mask = NULL;
+    RELEASE_ASSERT(
+        clip_mask_vec_get_ptr(canvas->clip_masks, canvas->clip_depth - 1, &mask)
+    );
+    return mask;
+}
+
+static uint8_t
+clip_mask_coverage(const ClipMask* mask, uint32_t x, uint32_t y) {
+    if (!mask) {
+        return 255;
     }
 
-    double sample_x = (double)x + 0.5;
-    double sample_y = (double)y + 0.5;
-    for (size_t idx = 0; idx < clip_path_vec_len(canvas->clip_paths); idx++) {
-        ClipPathEntry clip_path;
-        RELEASE_ASSERT(clip_path_vec_get(canvas->clip_paths, idx, &clip_path));
-        if (!dcel_path_contains_point(
-                clip_path.path,
-                clip_path.fill_rule,
-                sample_x,
-                sample_y
-            )) {
-            return false;
-        }
+    if (x < mask->origin_x || y < mask->origin_y) {
+        return 0;
     }
 
-    return true;
+    uint32_t mask_x = x - mask->origin_x;
+    uint32_t mask_y = y - mask->origin_y;
+    if (mask_x >= mask->width || mask_y >= mask->height) {
+        return 0;
+    }
+
+    if (mask->is_opaque) {
+        return 255;
+    }
+
+    RELEASE_ASSERT(y >= mask->coverage_y);
+    return mask->coverage
+        [(size_t)(y - mask->coverage_y) * mask->width + mask_x];
+}
+
+static uint8_t*
+raster_canvas_pixel(const RasterCanvas* canvas, uint32_t x, uint32_t y) {
+    return canvas->pixels + (size_t)(y - canvas->first_row) * canvas->stride
+         + (size_t)x * 4;
+}
+
+const uint8_t* raster_canvas_row(const RasterCanvas* canvas, uint32_t y) {
+    RELEASE_ASSERT(canvas);
+    RELEASE_ASSERT(y < canvas->height);
+    RELEASE_ASSERT(y >= canvas->row_begin && y < canvas->row_end);
+    return raster_canvas_pixel(canvas, 0, y);
 }
 
 Rgba raster_canvas_get_rgba(
@@ -185,16 +280,31 @@ Rgba raster_canvas_get_rgba(
     RELEASE_ASSERT(canvas);
     RELEASE_ASSERT(x < canvas->width);
     RELEASE_ASSERT(y < canvas->height);
+    RELEASE_ASSERT(y >= canvas->row_begin && y < canvas->row_end);
 
-    size_t pixel_offset = BMP_HEADER_LEN + BMP_INFO_HEADER_LEN
-                        + ((canvas->height - y - 1) * canvas->width + x) * 4;
+    CompositeColor color;
+    memcpy(&color, raster_canvas_pixel(canvas, x, y), 4);
+    return composite_color_to_rgba(color);
+}
 
-    return rgba_unpack(
-        ((uint32_t)canvas->data[pixel_offset + 2] << 24)
-        | ((uint32_t)canvas->data[pixel_offset + 1] << 16)
-        | ((uint32_t)canvas->data[pixel_offset + 0] << 8)
-        | ((uint32_t)canvas->data[pixel_offset + 3])
+/// Writes a pixel, ignoring the clip.
+static void raster_canvas_store_rgba(
+    RasterCanvas* canvas,
+    uint32_t x,
+    uint32_t y,
+    Rgba rgba
+) {
+    LOG_DIAG(
+        TRACE,
+        CANVAS,
+        "Setting canvas pixel (%u, %u) to 0x%08" PRIx32,
+        x,
+        y,
+        rgba_pack(rgba)
     );
+
+    CompositeColor color = composite_color_from_rgba(rgba);
+    memcpy(raster_canvas_pixel(canvas, x, y), &color, 4);
 }
 
 void raster_canvas_set_rgba(
@@ -206,28 +316,64 @@ void raster_canvas_set_rgba(
     RELEASE_ASSERT(canvas);
     RELEASE_ASSERT(x < canvas->width);
     RELEASE_ASSERT(y < canvas->height);
-    if (!raster_canvas_pixel_visible(canvas, x, y)) {
+    if (y < canvas->row_begin || y >= canvas->row_end) {
         return;
     }
 
-    uint32_t packed_rgba = rgba_pack(rgba);
+    uint8_t clip = clip_mask_coverage(raster_canvas_clip_mask(canvas), x, y);
+    if (clip == 0) {
+        return;
+    }
 
-    LOG_DIAG(
-        TRACE,
-        CANVAS,
-        "Setting canvas pixel (%u, %u) to 0x%08" PRIx32,
-        x,
-        y,
-        packed_rgba
-    );
+    if (clip != 255) {
+        // Partially clipped pixels keep a share of their old color
+        Rgba dst = raster_canvas_get_rgba(canvas, x, y);
+        double t = (double)clip / 255.0;
+        rgba = rgba_new(
+            dst.r + (rgba.r - dst.r) * t,
+            dst.g + (rgba.g - dst.g) * t,
+            dst.b + (rgba.b - dst.b) * t,
+            dst.a + (rgba.a - dst.a) * t
+        );
+    }
 
-    size_t pixel_offset = BMP_HEADER_LEN + BMP_INFO_HEADER_LEN
-                        + ((canvas->height - y - 1) * canvas->width + x) * 4;
+    raster_canvas_store_rgba(canvas, x, y, rgba);
+}
+
+/// Composites `color` over `count` pixels of row `y` starting at column `x`,
+/// scaled by `mask` unless it is NULL and by the clip mask. The span must lie
+/// within the region of the clip mask.
+static void raster_canvas_composite_span(
+    RasterCanvas* canvas,
+    const ClipMask* clip_mask,
+    uint32_t x,
+    uint32_t y,
+    size_t count,
+    CompositeColor color,
+    const uint8_t* mask
+) {
+    uint8_t* pixels = raster_canvas_pixel(canvas, x, y);
 
-    canvas->data[pixel_offset + 2] = (uint8_t)((packed_rgba >> 24) & 0xff);
-    canvas->data[pixel_offset + 1] = (uint8_t)((packed_rgba >> 16) & 0xff);
-    canvas->data[pixel_offset + 0] = (uint8_t)((packed_rgba >> 8) & 0xff);
-    canvas->data[pixel_offset + 3] = (uint8_t)(packed_rgba & 0xff);
+    const uint8_t* clip = NULL;
+    if (clip_mask && !clip_mask->is_opaque) {
+        RELEASE_ASSERT(x >= clip_mask->origin_x && y >= clip_mask->coverage_y);
+        uint32_t clip_x = x - clip_mask->origin_x;
+        RELEASE_ASSERT(
+            clip_x + count <= clip_mask->width
+            && y - clip_mask->origin_y < clip_mask->height
+        );
+
+        clip = clip_mask->coverage
+             + (size_t)(y - clip_mask->coverage_y) * clip_mask->width + clip_x;
+    }
+
+    if (mask && clip) {
+        composite_span_mask_mask(pixels, count, color, mask, clip);
+    } else if (mask || clip) {
+        composite_span_mask(pixels, count, color, mask ? mask : clip);
+    } else {
+        composite_span_solid(pixels, count, color);
+    }
 }
 
 static uint32_t clamp_and_floor(double value, uint32_t max) {
@@ -910,6 +1056,407 @@ static void raster_canvas_build_closed_stroke_outline(
     }
 }
 
+/// Checks whether a flattened path is a single axis-aligned rectangle, such as
+/// one from `re` under a transform without rotation or skew.
+static bool
+raster_canvas_path_is_rect(const PathBuilder* path, GeomRect* rect_out) {
+    GeomVec2 points[5];
+    size_t point_count = 0;
+    bool found_contour = false;
+
+    for (size_t contour_idx = 0;
+         contour_idx < path_contour_vec_len(path->contours);
+         contour_idx++) {
+        PathContour* contour = NULL;
+        RELEASE_ASSERT(
+            path_contour_vec_get(path->contours, contour_idx, &contour)
+        );
+
+        size_t segment_count = path_contour_len(contour);
+        if (segment_count < 2) {
+            continue;
+        }
+        if (found_contour) {
+            return false;
+        }
+        found_contour = true;
+
+        for (size_t segment_idx = 0; segment_idx < segment_count;
+             segment_idx++) {
+            PathContourSegment segment;
+            RELEASE_ASSERT(path_contour_get(contour, segment_idx, &segment));
+            GeomVec2 point = path_contour_segment_end(segment);
+
+            if (point_count != 0
+                && geom_vec2_equal_eps(point, points[point_count - 1], 1e-9)) {
+                continue;
+            }
+            if (point_count == 5) {
+                return false;
+            }
+            points[point_count++] = point;
+        }
+    }
+
+    // The contour may return to its start explicitly
+    if (point_count == 5 && geom_vec2_equal_eps(points[4], points[0], 1e-9)) {
+        point_count = 4;
+    }
+    if (point_count != 4) {
+        return false;
+    }
+
+    // Edges must alternate between horizontal and vertical, starting with
+    // either
+    for (size_t parity = 0; parity < 2; parity++) {
+        bool is_rect = true;
+        for (size_t idx = 0; idx < 4; idx++) {
+            GeomVec2 from = points[idx];
+            GeomVec2 to = points[(idx + 1) % 4];
+            double delta = (idx + parity) % 2 == 0 ? to.y - from.y
+                                                   : to.x - from.x;
+            is_rect &= fabs(delta) <= 1e-9;
+        }
+
+        if (is_rect) {
+            *rect_out = geom_rect_new(points[0], points[2]);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/// Gets the coverage of a pixel by an axis-aligned rectangle.
+static uint8_t
+raster_canvas_rect_coverage(GeomRect rect, uint32_t x, uint32_t y) {
+    double coverage_x = fmin(rect.max.x, (double)x + 1.0)
+                      - fmax(rect.min.x, (double)x);
+    double coverage_y = fmin(rect.max.y, (double)y + 1.0)
+                      - fmax(rect.min.y, (double)y);
+    if (coverage_x <= 0.0 || coverage_y <= 0.0) {
+        return 0;
+    }
+
+    return (uint8_t)(coverage_x * coverage_y * 255.0 + 0.5);
+}
+
+/// Finds the pixels overlapping `bounds`, the canvas and the region of the
+/// clip mask. Returns false if there are none.
+static bool raster_canvas_bounds_region(
+    const RasterCanvas* canvas,
+    GeomRect bounds,
+    GeomRect* region_out
+) {
+    GeomRect region = geom_rect_intersection(
+        geom_rect_round(bounds),
+        geom_rect_new(
+            geom_vec2_new(0.0, 0.0),
+            geom_vec2_new((double)canvas->width, (double)canvas->height)
+        )
+    );
+
+    const ClipMask* clip_mask = raster_canvas_clip_mask(canvas);
+    if (clip_mask) {
+        region = geom_rect_intersection(
+            region,
+            geom_rect_new(
+                geom_vec2_new(
+                    (double)clip_mask->origin_x,
+                    (double)clip_mask->origin_y
+                ),
+                geom_vec2_new(
+                    (double)clip_mask->origin_x + (double)clip_mask->width,
+                    (double)clip_mask->origin_y + (double)clip_mask->height
+                )
+            )
+        );
+    }
+
+    if (region.max.x - region.min.x < 1.0
+        || region.max.y - region.min.y < 1.0) {
+        return false;
+    }
+
+    *region_out = region;
+    return true;
+}
+
+/// Finds the rows of `region` this canvas draws to. Returns false if there
+/// are none.
+static bool raster_canvas_region_rows(
+    const RasterCanvas* canvas,
+    GeomRect region,
+    uint32_t* begin_out,
+    uint32_t* end_out
+) {
+    uint32_t begin = (uint32_t)region.min.y;
+    uint32_t end = (uint32_t)region.max.y;
+    *begin_out = begin > canvas->row_begin ? begin : canvas->row_begin;
+    *end_out = end < canvas->row_end ? end : canvas->row_end;
+    return *begin_out < *end_out;
+}
+
+/// Finds the pixels `path` could draw to. Returns false if there are none.
+static bool raster_canvas_draw_region(
+    const RasterCanvas* canvas,
+    const PathBuilder* path,
+    GeomRect* region_out
+) {
+    GeomRect path_bounds;
+    if (!path_builder_bounds(path, &path_bounds)) {
+        return false;
+    }
+
+    return raster_canvas_bounds_region(canvas, path_bounds, region_out);
+}
+
+/// Fills an axis-aligned rectangle directly, with exact coverage along its
+/// fractional edges.
+static void
+raster_canvas_fill_rect(RasterCanvas* canvas, GeomRect rect, Rgba rgba) {
+    GeomRect region;
+    uint32_t row_begin = 0;
+    uint32_t row_end = 0;
+    if (!raster_canvas_bounds_region(canvas, rect, &region)
+        || !raster_canvas_region_rows(canvas, region, &row_begin, &row_end)) {
+        return;
+    }
+
+    const ClipMask* clip_mask = raster_canvas_clip_mask(canvas);
+    CompositeColor color = composite_color_from_rgba(rgba);
+    uint32_t left = (uint32_t)region.min.x;
+    uint32_t right = (uint32_t)region.max.x - 1;
+
+    for (uint32_t y = row_begin; y < row_end; y++) {
+        // Only the first and last columns can be partially covered
+        raster_canvas_composite_span(
+            canvas,
+            clip_mask,
+            left,
+            y,
+            1,
+            composite_color_scale(
+                color,
+                raster_canvas_rect_coverage(rect, left, y)
+            ),
+            NULL
+        );
+        if (right == left) {
+            continue;
+        }
+
+        raster_canvas_composite_span(
+            canvas,
+            clip_mask,
+            right,
+            y,
+            1,
+            composite_color_scale(
+                color,
+                raster_canvas_rect_coverage(rect, right, y)
+            ),
+            NULL
+        );
+        if (right == left + 1) {
+            continue;
+        }
+
+        raster_canvas_composite_span(
+            canvas,
+            clip_mask,
+            left + 1,
+            y,
+            right - left - 1,
+            composite_color_scale(
+                color,
+                raster_canvas_rect_coverage(rect, left + 1, y)
+            ),
+            NULL
+        );
+    }
+}
+
+/// Fills `path` with `rgba`, scaling its alpha by the anti-aliased coverage
+/// of each pixel. Coverage is only computed over the pixels the path can
+/// reach, further limited to `limit` unless it is NULL.
+static void raster_canvas_fill_coverage(
+    RasterCanvas* canvas,
+    const PathBuilder* path,
+    DcelFillRule fill_rule,
+    Rgba rgba,
+    const GeomRect* limit
+) {
+    GeomRect path_bounds;
+    if (!path_builder_bounds(path, &path_bounds)) {
+        return;
+    }
+    if (limit) {
+        path_bounds = geom_rect_intersection(path_bounds, *limit);
+    }
+
+    GeomRect region;
+    uint32_t row_begin = 0;
+    uint32_t row_end = 0;
+    if (!raster_canvas_bounds_region(canvas, path_bounds, &region)
+        || !raster_canvas_region_rows(canvas, region, &row_begin, &row_end)) {
+        return;
+    }
+
+    uint32_t origin_x = (uint32_t)region.min.x;
+    uint32_t origin_y = (uint32_t)region.min.y;
+    uint32_t width = (uint32_t)(region.max.x - region.min.x);
+    uint32_t height = (uint32_t)(region.max.y - region.min.y);
+
+    Arena* local_arena = arena_new(4096);
+    Uint8Array* coverage = uint8_array_new(
+        local_arena,
+        (size_t)width * (size_t)(row_end - row_begin)
+    );
+    DcelMaskBounds bounds;
+
+    coverage_rasterize_path_rows(
+        local_arena,
+        path,
+        fill_rule,
+        (int32_t)origin_x,
+        (int32_t)origin_y,
+        width,
+        height,
+        row_begin - origin_y,
+        row_end - origin_y,
+        coverage,
+        &bounds
+    );
+
+    if (!bounds.is_empty) {
+        size_t coverage_len = 0;
+        const uint8_t* values = uint8_array_get_raw(coverage, &coverage_len);
+        const ClipMask* clip_mask = raster_canvas_clip_mask(canvas);
+        CompositeColor color = composite_color_from_rgba(rgba);
+
+        for (uint32_t y = bounds.min_y; y <= bounds.max_y; y++) {
+            raster_canvas_composite_span(
+                canvas,
+                clip_mask,
+                origin_x + bounds.min_x,
+                origin_y + y,
+                bounds.max_x - bounds.min_x + 1,
+                color,
+                values
+                    + (size_t)(origin_y + y - row_begin) * width
+                    + bounds.min_x
+            );
+        }
+    }
+
+    arena_free(local_arena);
+}
+
+/// Computes the signed area enclosed by a flattened contour, which is positive
+/// for counterclockwise contours in a y-up space.
+static double raster_canvas_contour_signed_area(const PathContour* contour) {
+    size_t segment_count = path_contour_len(contour);
+    if (segment_count < 2) {
+        return 0.0;
+    }
+
+    PathContourSegment segment;
+    RELEASE_ASSERT(path_contour_get(contour, segment_count - 1, &segment));
+    GeomVec2 previous = path_contour_segment_end(segment);
+
+    double signed_area = 0.0;
+    for (size_t idx = 0; idx < segment_count; idx++) {
+        RELEASE_ASSERT(path_contour_get(contour, idx, &segment));
+        GeomVec2 point = path_contour_segment_end(segment);
+        signed_area += previous.x * point.y - point.x * previous.y;
+        previous = point;
+    }
+
+    return signed_area / 2.0;
+}
+
+/// Appends the rings of one contour's stroke outline to `stroke`, oriented so
+/// the area they enclose has a winding number of one. The largest ring is the
+/// outer edge, and any others are the holes left inside closed contours.
+static void raster_canvas_append_stroke_outline(
+    PathBuilder* stroke,
+    const PathBuilder* outline
+) {
+    size_t contour_count = path_contour_vec_len(outline->contours);
+    size_t outer_idx = 0;
+    double outer_area = -1.0;
+    for (size_t contour_idx = 0; contour_idx < contour_count; contour_idx++) {
+        PathContour* contour = NULL;
+        RELEASE_ASSERT(
+            path_contour_vec_get(outline->contours, contour_idx, &contour)
+        );
+
+        double area = fabs(raster_canvas_contour_signed_area(contour));
+        if (area > outer_area) {
+            outer_idx = contour_idx;
+            outer_area = area;
+        }
+    }
+
+    for (size_t contour_idx = 0; contour_idx < contour_count; contour_idx++) {
+        PathContour* contour = NULL;
+        RELEASE_ASSERT(
+            path_contour_vec_get(outline->contours, contour_idx, &contour)
+        );
+
+        size_t segment_count = path_contour_len(contour);
+        if (segment_count < 2) {
+            continue;
+        }
+
+        bool is_positive = raster_canvas_contour_signed_area(contour) >= 0.0;
+        bool reverse = is_positive != (contour_idx == outer_idx);
+        for (size_t idx = 0; idx < segment_count; idx++) {
+            PathContourSegment segment;
+            RELEASE_ASSERT(path_contour_get(
+                contour,
+                reverse ? segment_count - 1 - idx : idx,
+                &segment
+            ));
+            GeomVec2 point = path_contour_segment_end(segment);
+
+            if (idx == 0) {
+                path_builder_new_contour(stroke, point);
+            } else {
+                path_builder_line_to(stroke, point);
+            }
+        }
+        path_builder_close_contour(stroke);
+    }
+}
+
+bool raster_canvas_brush_bounds(
+    const PathBuilder* path,
+    CanvasBrush brush,
+    GeomRect* bounds_out
+) {
+    RELEASE_ASSERT(path);
+    RELEASE_ASSERT(bounds_out);
+
+    if (!path_builder_bounds(path, bounds_out)) {
+        return false;
+    }
+
+    if (brush.enable_stroke && brush.stroke_width > 0.0) {
+        // Miters reach at most `miter_limit` half-widths from their vertex,
+        // and square caps half a diagonal
+        double margin =
+            0.5 * brush.stroke_width * fmax(brush.miter_limit, sqrt(2.0));
+        bounds_out->min.x -= margin;
+        bounds_out->min.y -= margin;
+        bounds_out->max.x += margin;
+        bounds_out->max.y += margin;
+    }
+
+    return true;
+}
+
 void raster_canvas_draw_path(
     RasterCanvas* canvas,
     const PathBuilder* path,
@@ -921,59 +1468,35 @@ void raster_canvas_draw_path(
         return;
     }
 
-    if (brush.enable_fill) {
-        Arena* local_arena = arena_new(4096);
-        size_t pixel_count = (size_t)canvas->width * (size_t)canvas->height;
-        Uint8Array* mask = uint8_array_new(local_arena, pixel_count);
-        DcelMaskBounds bounds;
-
-        dcel_rasterize_path_mask(
-            local_arena,
+    GeomRect rect;
+    if (brush.enable_fill && raster_canvas_path_is_rect(path, &rect)) {
+        raster_canvas_fill_rect(canvas, rect, brush.fill_rgba);
+    } else if (brush.enable_fill) {
+        raster_canvas_fill_coverage(
+            canvas,
             path,
             brush.even_odd_fill ? DCEL_FILL_RULE_EVEN_ODD
                                 : DCEL_FILL_RULE_NONZERO,
-            canvas->width,
-            canvas->height,
-            1.0,
-            mask,
-            &bounds
+            brush.fill_rgba,
+            NULL
         );
-
-        if (!bounds.is_empty) {
-            for (uint32_t y = bounds.min_y;; y++) {
-                for (uint32_t x = bounds.min_x;; x++) {
-                    size_t mask_idx =
-                        (size_t)y * (size_t)canvas->width + (size_t)x;
-                    uint8_t mask_value = 0;
-                    RELEASE_ASSERT(
-                        uint8_array_get(mask, mask_idx, &mask_value)
-                    );
-                    if (mask_value != 0) {
-                        Rgba dst = raster_canvas_get_rgba(canvas, x, y);
-                        Rgba out = rgba_blend_src_over(dst, brush.fill_rgba);
-                        raster_canvas_set_rgba(canvas, x, y, out);
-                    }
-
-                    if (x == bounds.max_x) {
-                        break;
-                    }
-                }
-
-                if (y == bounds.max_y) {
-                    break;
-                }
-            }
-        }
-
-        arena_free(local_arena);
     }
 
-    if (!brush.enable_stroke || brush.stroke_width <= 0.0) {
+    GeomRect stroke_bounds;
+    if (!brush.enable_stroke || brush.stroke_width <= 0.0
+        || !raster_canvas_brush_bounds(path, brush, &stroke_bounds)) {
         return;
     }
 
     double stroke_radius = brush.stroke_width * 0.5;
 
+    // Every contour's outline goes into one path, rasterized in a single pass
+    Arena* stroke_arena = arena_new(4096);
+    PathBuilder* stroke = path_builder_new_with_options(
+        stroke_arena,
+        path_builder_options_flattened()
+    );
+
     for (size_t contour_idx = 0;
          contour_idx < path_contour_vec_len(path->contours);
          contour_idx++) {
@@ -986,8 +1509,6 @@ void raster_canvas_draw_path(
             continue;
         }
 
-        Arena* stroke_arena = arena_new(4096);
-
         size_t max_point_count = path_contour_len(contour);
         GeomVec2Array* points =
             geom_vec2_array_new(stroke_arena, max_point_count);
@@ -1060,50 +1581,198 @@ void raster_canvas_draw_path(
                 );
             }
 
-            size_t pixel_count = (size_t)canvas->width * (size_t)canvas->height;
-            Uint8Array* mask = uint8_array_new(stroke_arena, pixel_count);
-            DcelMaskBounds bounds;
+            raster_canvas_append_stroke_outline(stroke, stroke_outline);
+        }
+    }
 
-            dcel_rasterize_path_mask(
-                stroke_arena,
-                stroke_outline,
-                DCEL_FILL_RULE_EVEN_ODD,
-                canvas->width,
-                canvas->height,
-                1.0,
-                mask,
-                &bounds
-            );
+    // Inner joins between nearly parallel segments can reach further than
+    // any join or cap, so the outline is kept to the bounds the brush promises
+    raster_canvas_fill_coverage(
+        canvas,
+        stroke,
+        DCEL_FILL_RULE_NONZERO,
+        brush.stroke_rgba,
+        &stroke_bounds
+    );
+    arena_free(stroke_arena);
+}
 
-            if (!bounds.is_empty) {
-                for (uint32_t y = bounds.min_y;; y++) {
-                    for (uint32_t x = bounds.min_x;; x++) {
-                        size_t mask_idx =
-                            (size_t)y * (size_t)canvas->width + (size_t)x;
-                        uint8_t mask_value = 0;
-                        RELEASE_ASSERT(
-                            uint8_array_get(mask, mask_idx, &mask_value)
-                        );
-                        if (mask_value != 0) {
-                            Rgba dst = raster_canvas_get_rgba(canvas, x, y);
-                            Rgba out =
-                                rgba_blend_src_over(dst, brush.stroke_rgba);
-                            raster_canvas_set_rgba(canvas, x, y, out);
-                        }
-
-                        if (x == bounds.max_x) {
-                            break;
-                        }
-                    }
-
-                    if (y == bounds.max_y) {
-                        break;
-                    }
-                }
-            }
+bool raster_canvas_rasterize_mask(
+    Arena* arena,
+    const PathBuilder* path,
+    bool even_odd_rule,
+    uint32_t max_size,
+    CanvasMask* mask_out
+) {
+    RELEASE_ASSERT(arena);
+    RELEASE_ASSERT(path);
+    RELEASE_ASSERT(mask_out);
+
+    *mask_out = (CanvasMask) {.origin_x = 0,
+                              .origin_y = 0,
+                              .width = 0,
+                              .height = 0,
+                              .coverage = NULL};
+
+    GeomRect bounds;
+    if (!path_builder_bounds(path, &bounds)) {
+        return true;
+    }
+
+    // Only pixels overlapping the bounds can be covered
+    GeomRect rounded = geom_rect_round(bounds);
+    double origin_x = rounded.min.x;
+    double origin_y = rounded.min.y;
+    double width = rounded.max.x - origin_x;
+    double height = rounded.max.y - origin_y;
+    if (!(width <= (double)max_size && height <= (double)max_size)
+        || fabs(origin_x) > (double)INT32_MAX / 2
+        || fabs(origin_y) > (double)INT32_MAX / 2) {
+        return false;
+    }
+
+    mask_out->origin_x = (int32_t)origin_x;
+    mask_out->origin_y = (int32_t)origin_y;
+    if (width < 1.0 || height < 1.0) {
+        return true;
+    }
+
+    mask_out->width = (uint32_t)width;
+    mask_out->height = (uint32_t)height;
+    size_t pixel_count = (size_t)mask_out->width * (size_t)mask_out->height;
+    mask_out->coverage = uint8_array_new(arena, pixel_count);
+
+    coverage_rasterize_path(
+        arena,
+        path,
+        even_odd_rule ? DCEL_FILL_RULE_EVEN_ODD : DCEL_FILL_RULE_NONZERO,
+        mask_out->origin_x,
+        mask_out->origin_y,
+        mask_out->width,
+        mask_out->height,
+        mask_out->coverage,
+        NULL
+    );
+
+    return true;
+}
+
+void raster_canvas_draw_mask(
+    RasterCanvas* canvas,
+    const CanvasMask* mask,
+    int32_t x,
+    int32_t y,
+    Rgba rgba
+) {
+    RELEASE_ASSERT(canvas);
+    RELEASE_ASSERT(mask);
+    if (mask->width == 0 || mask->height == 0) {
+        return;
+    }
+
+    size_t coverage_len = 0;
+    const uint8_t* coverage =
+        uint8_array_get_raw(mask->coverage, &coverage_len);
+    RELEASE_ASSERT(
+        coverage_len == (size_t)mask->width * (size_t)mask->height
+    );
+    int64_t left = (int64_t)x + (int64_t)mask->origin_x;
+    int64_t top = (int64_t)y + (int64_t)mask->origin_y;
+
+    GeomRect region;
+    if (!raster_canvas_bounds_region(
+            canvas,
+            geom_rect_new(
+                geom_vec2_new((double)left, (double)top),
+                geom_vec2_new(
+                    (double)left + (double)mask->width,
+                    (double)top + (double)mask->height
+                )
+            ),
+            &region
+        )) {
+        return;
+    }
+
+    uint32_t row_begin = 0;
+    uint32_t row_end = 0;
+    if (!raster_canvas_region_rows(canvas, region, &row_begin, &row_end)) {
+        return;
+    }
+
+    const ClipMask* clip_mask = raster_canvas_clip_mask(canvas);
+    CompositeColor color = composite_color_from_rgba(rgba);
+    uint32_t min_x = (uint32_t)region.min.x;
+    size_t mask_x = (size_t)((int64_t)min_x - left);
+
+    for (uint32_t canvas_y = row_begin; canvas_y < row_end; canvas_y++) {
+        size_t mask_y = (size_t)((int64_t)canvas_y - top);
+        raster_canvas_composite_span(
+            canvas,
+            clip_mask,
+            min_x,
+            canvas_y,
+            (size_t)(region.max.x - region.min.x),
+            color,
+            coverage + mask_y * mask->width + mask_x
+        );
+    }
+}
+
+void raster_canvas_draw_raster(
+    RasterCanvas* canvas,
+    const RasterCanvas* source,
+    int32_t x,
+    int32_t y
+) {
+    RELEASE_ASSERT(canvas);
+    RELEASE_ASSERT(source);
+
+    GeomRect region;
+    if (!raster_canvas_bounds_region(
+            canvas,
+            geom_rect_new(
+                geom_vec2_new((double)x, (double)y),
+                geom_vec2_new(
+                    (double)x + (double)source->width,
+                    (double)y + (double)source->height
+                )
+            ),
+            &region
+        )) {
+        return;
+    }
+
+    uint32_t row_begin = 0;
+    uint32_t row_end = 0;
+    if (!raster_canvas_region_rows(canvas, region, &row_begin, &row_end)) {
+        return;
+    }
+
+    const ClipMask* clip_mask = raster_canvas_clip_mask(canvas);
+    uint32_t min_x = (uint32_t)region.min.x;
+    size_t count = (size_t)(region.max.x - region.min.x);
+    uint32_t source_x = (uint32_t)((int64_t)min_x - x);
+
+    for (uint32_t canvas_y = row_begin; canvas_y < row_end; canvas_y++) {
+        const uint8_t* clip = NULL;
+        if (clip_mask && !clip_mask->is_opaque) {
+            clip = clip_mask->coverage
+                 + (size_t)(canvas_y - clip_mask->coverage_y)
+                       * clip_mask->width
+                 + (min_x - clip_mask->origin_x);
         }
 
-        arena_free(stroke_arena);
+        composite_span_pixels(
+            raster_canvas_pixel(canvas, min_x, canvas_y),
+            count,
+            raster_canvas_pixel(
+                source,
+                source_x,
+                (uint32_t)((int64_t)canvas_y - y)
+            ),
+            clip
+        );
     }
 }
 
@@ -1115,22 +1784,116 @@ void raster_canvas_push_clip_path(
     RELEASE_ASSERT(canvas);
     RELEASE_ASSERT(path);
 
-    clip_path_vec_push(
-        canvas->clip_paths,
-        (ClipPathEntry) {.path = path,
-                         .fill_rule = even_odd_rule ? DCEL_FILL_RULE_EVEN_ODD
-                                                    : DCEL_FILL_RULE_NONZERO}
-    );
+    // The region is limited by the parent mask, so find it before pushing
+    const ClipMask* parent = raster_canvas_clip_mask(canvas);
+    GeomRect region;
+    bool has_region = raster_canvas_draw_region(canvas, path, &region);
+
+    ClipMask* mask = NULL;
+    if (canvas->clip_depth < clip_mask_vec_len(canvas->clip_masks)) {
+        RELEASE_ASSERT(
+            clip_mask_vec_get_ptr(canvas->clip_masks, canvas->clip_depth, &mask)
+        );
+    } else {
+        mask = clip_mask_vec_push(
+            canvas->clip_masks,
+            (ClipMask) {.coverage = NULL, .capacity = 0}
+        );
+    }
+    canvas->clip_depth++;
+
+    mask->origin_x = 0;
+    mask->origin_y = 0;
+    mask->width = 0;
+    mask->height = 0;
+    mask->is_opaque = false;
+    mask->coverage_y = 0;
+    if (!has_region) {
+        return;
+    }
+
+    mask->origin_x = (uint32_t)region.min.x;
+    mask->origin_y = (uint32_t)region.min.y;
+    mask->width = (uint32_t)(region.max.x - region.min.x);
+    mask->height = (uint32_t)(region.max.y - region.min.y);
+
+    // Pixel-aligned rectangles act as scissors, needing no coverage at all
+    GeomRect rect;
+    bool is_rect = raster_canvas_path_is_rect(path, &rect);
+    GeomRect rounded = geom_rect_round(rect);
+    if (is_rect && (!parent || parent->is_opaque)
+        && geom_vec2_equal_eps(rounded.min, rect.min, 1e-9)
+        && geom_vec2_equal_eps(rounded.max, rect.max, 1e-9)) {
+        mask->is_opaque = true;
+        return;
+    }
+
+    // Coverage is only kept for the rows this canvas draws to, but the
+    // region stays whole so nested clips see the same region regardless
+    uint32_t row_begin = 0;
+    uint32_t row_end = 0;
+    if (!raster_canvas_region_rows(canvas, region, &row_begin, &row_end)) {
+        return;
+    }
+    mask->coverage_y = row_begin;
+
+    size_t pixel_count = (size_t)mask->width * (size_t)(row_end - row_begin);
+    if (pixel_count > mask->capacity) {
+        mask->coverage = arena_alloc(canvas->arena, pixel_count);
+        mask->capacity = pixel_count;
+    }
+
+    // Other rectangles have their coverage computed directly
+    Arena* local_arena = NULL;
+    const uint8_t* values = NULL;
+    if (!is_rect) {
+        local_arena = arena_new(4096);
+        Uint8Array* coverage = uint8_array_new(local_arena, pixel_count);
+        coverage_rasterize_path_rows(
+            local_arena,
+            path,
+            even_odd_rule ? DCEL_FILL_RULE_EVEN_ODD : DCEL_FILL_RULE_NONZERO,
+            (int32_t)mask->origin_x,
+            (int32_t)mask->origin_y,
+            mask->width,
+            mask->height,
+            row_begin - mask->origin_y,
+            row_end - mask->origin_y,
+            coverage,
+            NULL
+        );
+
+        size_t coverage_len = 0;
+        values = uint8_array_get_raw(coverage, &coverage_len);
+    }
+
+    for (uint32_t y = 0; y < row_end - row_begin; y++) {
+        for (uint32_t x = 0; x < mask->width; x++) {
+            size_t idx = (size_t)y * mask->width + x;
+            uint32_t canvas_x = mask->origin_x + x;
+            uint32_t canvas_y = row_begin + y;
+
+            uint32_t value =
+                values ? values[idx]
+                       : raster_canvas_rect_coverage(rect, canvas_x, canvas_y);
+            uint32_t parent_value =
+                clip_mask_coverage(parent, canvas_x, canvas_y);
+            mask->coverage[idx] =
+                (uint8_t)((value * parent_value + 127) / 255);
+        }
+    }
+
+    if (local_arena) {
+        arena_free(local_arena);
+    }
 }
 
 void raster_canvas_pop_clip_paths(RasterCanvas* canvas, size_t count) {
     RELEASE_ASSERT(canvas);
-    RELEASE_ASSERT(count <= clip_path_vec_len(canvas->clip_paths));
+    RELEASE_ASSERT(count <= canvas->clip_depth);
 
-    for (size_t idx = 0; idx < count; idx++) {
-        ClipPathEntry removed_path;
-        RELEASE_ASSERT(clip_path_vec_pop(canvas->clip_paths, &removed_path));
-    }
+    // The masks' buffers are kept for the next pushes at their depth
+    canvas->clip_depth -= count;
 }
 
 void raster_canvas_draw_pixel(
@@ -1142,20 +1905,119 @@ void raster_canvas_draw_pixel(
 
     int64_t x = (int64_t)floor(position.x);
     int64_t y = (int64_t)floor(position.y);
-    if (x < 0 || y < 0 || x >= (int64_t)canvas->width
-        || y >= (int64_t)canvas->height) {
+    if (x < 0 || y < (int64_t)canvas->row_begin || x >= (int64_t)canvas->width
+        || y >= (int64_t)canvas->row_end) {
+        return;
+    }
+
+    const ClipMask* clip_mask = raster_canvas_clip_mask(canvas);
+    if (clip_mask_coverage(clip_mask, (uint32_t)x, (uint32_t)y) == 0) {
+        return;
+    }
+
+    raster_canvas_composite_span(
+        canvas,
+        clip_mask,
+        (uint32_t)x,
+        (uint32_t)y,
+        1,
+        composite_color_from_rgba(rgba),
+        NULL
+    );
+}
+
+void raster_canvas_draw_span(
+    RasterCanvas* canvas,
+    int32_t x,
+    int32_t y,
+    size_t count,
+    const uint8_t* pixels
+) {
+    RELEASE_ASSERT(canvas);
+    RELEASE_ASSERT(pixels || count == 0);
+
+    GeomRect region;
+    if (!raster_canvas_bounds_region(
+            canvas,
+            geom_rect_new(
+                geom_vec2_new((double)x, (double)y),
+                geom_vec2_new((double)x + (double)count, (double)y + 1.0)
+            ),
+            &region
+        )) {
+        return;
+    }
+
+    uint32_t row_begin = 0;
+    uint32_t row_end = 0;
+    if (!raster_canvas_region_rows(canvas, region, &row_begin, &row_end)) {
         return;
     }
 
-    uint32_t px = (uint32_t)x;
-    uint32_t py = (uint32_t)y;
-    Rgba dst = raster_canvas_get_rgba(canvas, px, py);
-    raster_canvas_set_rgba(canvas, px, py, rgba_blend_src_over(dst, rgba));
+    uint32_t min_x = (uint32_t)region.min.x;
+    const ClipMask* clip_mask = raster_canvas_clip_mask(canvas);
+    const uint8_t* clip = NULL;
+    if (clip_mask && !clip_mask->is_opaque) {
+        clip = clip_mask->coverage
+             + (size_t)(row_begin - clip_mask->coverage_y) * clip_mask->width
+             + (min_x - clip_mask->origin_x);
+    }
+
+    composite_span_pixels(
+        raster_canvas_pixel(canvas, min_x, row_begin),
+        (size_t)(region.max.x - region.min.x),
+        pixels + (size_t)((int64_t)min_x - x) * 4,
+        clip
+    );
+}
+
+bool raster_canvas_draw_bounds(
+    const RasterCanvas* canvas,
+    GeomRect* bounds_out
+) {
+    RELEASE_ASSERT(canvas);
+    RELEASE_ASSERT(bounds_out);
+
+    GeomRect region;
+    uint32_t row_begin = 0;
+    uint32_t row_end = 0;
+    if (!raster_canvas_bounds_region(
+            canvas,
+            geom_rect_new(
+                geom_vec2_new(0.0, 0.0),
+                geom_vec2_new((double)canvas->width, (double)canvas->height)
+            ),
+            &region
+        )
+        || !raster_canvas_region_rows(canvas, region, &row_begin, &row_end)) {
+        return false;
+    }
+
+    region.min.y = (double)row_begin;
+    region.max.y = (double)row_end;
+    *bounds_out = region;
+    return true;
+}
+
+/// Gets a pixel with straight alpha, packed as by `rgba_pack`.
+static uint32_t raster_canvas_straight_pixel(
+    const RasterCanvas* canvas,
+    uint32_t x,
+    uint32_t y
+) {
+    const uint8_t* pixel = raster_canvas_pixel(canvas, x, y);
+    if (pixel[3] == 255) {
+        return ((uint32_t)pixel[0] << 24) | ((uint32_t)pixel[1] << 16)
+             | ((uint32_t)pixel[2] << 8) | 255;
+    }
+
+    return rgba_pack(raster_canvas_get_rgba(canvas, x, y));
 }
 
 bool raster_canvas_write_file(RasterCanvas* canvas, const char* path) {
     RELEASE_ASSERT(canvas);
     RELEASE_ASSERT(path);
+    RELEASE_ASSERT(canvas->row_begin == 0 && canvas->row_end == canvas->height);
 
     LOG_DIAG(INFO, CANVAS, "Writing canvas to `%s`", path);
 
@@ -1164,9 +2026,469 @@ bool raster_canvas_write_file(RasterCanvas* canvas, const char* path) {
         return false;
     }
 
-    unsigned long written =
-        (unsigned long)fwrite(canvas->data, 1, canvas->file_size, file);
+    uint32_t file_size = BMP_HEADER_LEN + BMP_INFO_HEADER_LEN
+                       + canvas->width * canvas->height * 4;
+    uint8_t headers[BMP_HEADER_LEN + BMP_INFO_HEADER_LEN] = {0};
+    write_bmp_header(headers, file_size);
+    write_bmp_info_header(
+        headers + BMP_HEADER_LEN,
+        canvas->width,
+        canvas->height
+    );
+    bool success = fwrite(headers, 1, sizeof(headers), file) == sizeof(headers);
+
+    // BMP rows are stored bottom-up as straight-alpha BGRA
+    Arena* local_arena = arena_new(4096);
+    uint8_t* row = arena_alloc(local_arena, canvas->stride);
+    for (uint32_t y = canvas->height; y-- > 0 && success;) {
+        for (uint32_t x = 0; x < canvas->width; x++) {
+            uint32_t packed_rgba = raster_canvas_straight_pixel(canvas, x, y);
+            uint8_t* target = row + (size_t)x * 4;
+            target[0] = (uint8_t)((packed_rgba >> 8) & 0xff);
+            target[1] = (uint8_t)((packed_rgba >> 16) & 0xff);
+            target[2] = (uint8_t)((packed_rgba >> 24) & 0xff);
+            target[3] = (uint8_t)(packed_rgba & 0xff);
+        }
+
+        success = fwrite(row, 1, canvas->stride, file) == canvas->stride;
+    }
+
+    arena_free(local_arena);
     fclose(file);
 
-    return written == canvas->file_size;
+    return success;
+}
+
+static uint32_t png_crc32(const uint8_t* data, size_t len, uint32_t crc) {
+    crc = ~crc;
+    for (size_t idx = 0; idx < len; idx++) {
+        crc ^= data[idx];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xedb88320u & (0u - (crc & 1u)));
+        }
+    }
+
+    return ~crc;
+}
+
+static void write_u32_be(uint8_t* target, uint32_t value) {
+    target[0] = (uint8_t)((value >> 24) & 0xff);
+    target[1] = (uint8_t)((value >> 16) & 0xff);
+    target[2] = (uint8_t)((value >> 8) & 0xff);
+    target[3] = (uint8_t)(value & 0xff);
+}
+
+/// Writes a PNG chunk whose `len` bytes of data are already in place after
+/// its length and type. Returns the end of the chunk.
+static uint8_t*
+write_png_chunk(uint8_t* target, const char type[4], uint32_t len) {
+    write_u32_be(target, len);
+    memcpy(target + 4, type, 4);
+    write_u32_be(target + 8 + len, png_crc32(target + 4, (size_t)len + 4, 0));
+    return target + 12 + len;
+}
+
+Uint8Array* raster_canvas_encode_png(const RasterCanvas* canvas, Arena* arena) {
+    RELEASE_ASSERT(canvas);
+    RELEASE_ASSERT(arena);
+
+    // Each row starts with its filter type, which is always none
+    Arena* local_arena = arena_new(4096);
+    size_t row_len = 1 + (size_t)canvas->width * 4;
+    size_t raw_len = row_len * canvas->height;
+    uint8_t* raw = arena_alloc(local_arena, raw_len == 0 ? 1 : raw_len);
+    for (uint32_t y = 0; y < canvas->height; y++) {
+        uint8_t* row = raw + row_len * y;
+        row[0] = 0;
+        for (uint32_t x = 0; x < canvas->width; x++) {
+            write_u32_be(
+                row + 1 + (size_t)x * 4,
+                raster_canvas_straight_pixel(canvas, x, y)
+            );
+        }
+    }
+
+    Uint8Array* compressed =
+        encode_zlib_data_stored(local_arena, raw, raw_len);
+    size_t compressed_len = 0;
+    const uint8_t* compressed_data =
+        uint8_array_get_raw(compressed, &compressed_len);
+    RELEASE_ASSERT(compressed_len <= UINT32_MAX);
+
+    size_t png_len = 8 + (12 + 13) + (12 + compressed_len) + 12;
+    Uint8Array* png = uint8_array_new(arena, png_len);
+    uint8_t* out = uint8_array_get_raw(png, &png_len);
+
+    static const uint8_t signature[8] =
+        {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    memcpy(out, signature, sizeof(signature));
+    out += sizeof(signature);
+
+    // 8-bit straight-alpha RGBA, without interlacing
+    write_u32_be(out + 8, canvas->width);
+    write_u32_be(out + 12, canvas->height);
+    out[16] = 8;
+    out[17] = 6;
+    out[18] = 0;
+    out[19] = 0;
+    out[20] = 0;
+    out = write_png_chunk(out, "IHDR", 13);
+
+    memcpy(out + 8, compressed_data, compressed_len);
+    out = write_png_chunk(out, "IDAT", (uint32_t)compressed_len);
+    write_png_chunk(out, "IEND", 0);
+
+    arena_free(local_arena);
+    return png;
+}
+
+#ifdef TEST
+
+#include "test/test.h"
+
+TEST_FUNC(test_raster_canvas_mask_matches_draw_path) {
+    Arena* arena = arena_new(4096);
+    Rgba white = rgba_new(1.0, 1.0, 1.0, 1.0);
+    Rgba black = rgba_new(0.0, 0.0, 0.0, 1.0);
+
+    PathBuilder* path = path_builder_new(arena);
+    path_builder_new_contour(path, geom_vec2_new(0.25, 0.5));
+    path_builder_line_to(path, geom_vec2_new(5.75, 1.25));
+    path_builder_line_to(path, geom_vec2_new(2.5, 6.5));
+    path_builder_close_contour(path);
+
+    CanvasMask mask;
+    TEST_ASSERT(raster_canvas_rasterize_mask(arena, path, false, 16, &mask));
+    TEST_ASSERT_EQ(mask.origin_x, 0);
+    TEST_ASSERT_EQ(mask.origin_y, 0);
+    TEST_ASSERT_EQ(mask.width, 6u);
+    TEST_ASSERT_EQ(mask.height, 7u);
+    TEST_ASSERT(!raster_canvas_rasterize_mask(arena, path, false, 4, &mask));
+    TEST_ASSERT(raster_canvas_rasterize_mask(arena, path, false, 16, &mask));
+
+    RasterCanvas* expected = raster_canvas_new(arena, 16, 16, white);
+    RasterCanvas* actual = raster_canvas_new(arena, 16, 16, white);
+
+    // Drawing the mask at an integer offset must match drawing the path
+    // translated by the same offset
+    path_builder_apply_transform(path, geom_mat3_translate(3.0, 4.0));
+    raster_canvas_draw_path(
+        expected,
+        path,
+        (CanvasBrush) {.enable_fill = true, .fill_rgba = black}
+    );
+    raster_canvas_draw_mask(actual, &mask, 3, 4, black);
+
+    TEST_ASSERT_EQ(
+        memcmp(
+            expected->pixels,
+            actual->pixels,
+            expected->stride * expected->height
+        ),
+        0
+    );
+
+    arena_free(arena);
+    return TEST_RESULT_PASS;
+}
+
+TEST_FUNC(test_raster_canvas_draw_raster_matches_draw_path) {
+    Arena* arena = arena_new(4096);
+    Rgba white = rgba_new(1.0, 1.0, 1.0, 1.0);
+    Rgba red = rgba_new(1.0, 0.0, 0.0, 0.75);
+
+    PathBuilder* path = path_builder_new(arena);
+    path_builder_new_contour(path, geom_vec2_new(0.25, 0.5));
+    path_builder_line_to(path, geom_vec2_new(5.75, 1.25));
+    path_builder_line_to(path, geom_vec2_new(2.5, 6.5));
+    path_builder_close_contour(path);
+
+    RasterCanvas* source =
+        raster_canvas_new(arena, 6, 7, rgba_new(0.0, 0.0, 0.0, 0.0));
+    raster_canvas_draw_path(
+        source,
+        path,
+        (CanvasBrush) {.enable_fill = true, .fill_rgba = red}
+    );
+
+    RasterCanvas* expected = raster_canvas_new(arena, 16, 16, white);
+    RasterCanvas* actual = raster_canvas_new(arena, 16, 16, white);
+
+    // Compositing the source at an integer offset must match drawing the
+    // path translated by the same offset, including where it's cut off
+    path_builder_apply_transform(path, geom_mat3_translate(12.0, 4.0));
+    raster_canvas_draw_path(
+        expected,
+        path,
+        (CanvasBrush) {.enable_fill = true, .fill_rgba = red}
+    );
+    raster_canvas_draw_raster(actual, source, 12, 4);
+
+    TEST_ASSERT_EQ(
+        memcmp(
+            expected->pixels,
+            actual->pixels,
+            expected->stride * expected->height
+        ),
+        0
+    );
+
+    arena_free(arena);
+    return TEST_RESULT_PASS;
 }
+
+TEST_FUNC(test_raster_canvas_draw_span_matches_draw_pixel) {
+    Arena* arena = arena_new(4096);
+    Rgba white = rgba_new(1.0, 1.0, 1.0, 1.0);
+
+    PathBuilder* clip = path_builder_new(arena);
+    path_builder_new_contour(clip, geom_vec2_new(1.5, 0.25));
+    path_builder_line_to(clip, geom_vec2_new(14.75, 3.5));
+    path_builder_line_to(clip, geom_vec2_new(4.25, 11.5));
+    path_builder_close_contour(clip);
+
+    RasterCanvas* expected = raster_canvas_new(arena, 16, 12, white);
+    RasterCanvas* actual = raster_canvas_new(arena, 16, 12, white);
+    raster_canvas_push_clip_path(expected, clip, false);
+    raster_canvas_push_clip_path(actual, clip, false);
+
+    // Spans run off both sides of the canvas, and rows past its bottom
+    uint8_t pixels[22 * 4];
+    for (int32_t y = 0; y < 14; y++) {
+        for (int32_t idx = 0; idx < 22; idx++) {
+            Rgba rgba = rgba_new(
+                (double)idx / 21.0,
+                (double)y / 13.0,
+                0.5,
+                idx % 5 == 0 ? 1.0 : 0.25 + (double)(idx % 5) * 0.15
+            );
+            CompositeColor color = composite_color_from_rgba(rgba);
+            memcpy(pixels + idx * 4, &color, 4);
+
+            raster_canvas_draw_pixel(
+                expected,
+                geom_vec2_new((double)(idx - 3), (double)y),
+                rgba
+            );
+        }
+
+        raster_canvas_draw_span(actual, -3, y, 22, pixels);
+    }
+
+    TEST_ASSERT_EQ(
+        memcmp(
+            expected->pixels,
+            actual->pixels,
+            expected->stride * expected->height
+        ),
+        0
+    );
+
+    arena_free(arena);
+    return TEST_RESULT_PASS;
+}
+
+TEST_FUNC(test_raster_canvas_encode_png) {
+    Arena* arena = arena_new(4096);
+
+    RasterCanvas* canvas =
+        raster_canvas_new(arena, 3, 2, rgba_new(0.0, 0.0, 0.0, 0.0));
+    raster_canvas_set_rgba(canvas, 0, 0, rgba_new(1.0, 0.0, 0.0, 1.0));
+    raster_canvas_set_rgba(canvas, 2, 1, rgba_new(0.0, 0.0, 1.0, 0.6));
+
+    Uint8Array* png = raster_canvas_encode_png(canvas, arena);
+    size_t png_len = 0;
+    const uint8_t* data = uint8_array_get_raw(png, &png_len);
+
+    static const uint8_t signature[8] =
+        {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    TEST_ASSERT_EQ(memcmp(data, signature, 8), 0);
+    TEST_ASSERT_EQ(memcmp(data + 12, "IHDR", 4), 0);
+    TEST_ASSERT_EQ(data[19], (uint8_t)3);
+    TEST_ASSERT_EQ(data[23], (uint8_t)2);
+
+    // The image data follows the 25 byte header chunk
+    const uint8_t* idat = data + 8 + 25;
+    TEST_ASSERT_EQ(memcmp(idat + 4, "IDAT", 4), 0);
+    size_t idat_len = ((size_t)idat[0] << 24) | ((size_t)idat[1] << 16)
+                    | ((size_t)idat[2] << 8) | idat[3];
+
+    Uint8Array* decoded = NULL;
+    TEST_REQUIRE(decode_zlib_data(arena, idat + 8, idat_len, &decoded));
+    size_t decoded_len = 0;
+    const uint8_t* rows = uint8_array_get_raw(decoded, &decoded_len);
+    TEST_ASSERT_EQ(decoded_len, (size_t)2 * (1 + 3 * 4));
+
+    uint32_t expected_blue = rgba_pack(raster_canvas_get_rgba(canvas, 2, 1));
+    const uint8_t expected[] = {
+        0, 255, 0, 0, 255, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0,
+        (uint8_t)(expected_blue >> 24), (uint8_t)(expected_blue >> 16),
+        (uint8_t)(expected_blue >> 8), (uint8_t)expected_blue
+    };
+    TEST_ASSERT_EQ(memcmp(rows, expected, sizeof(expected)), 0);
+
+    // IEND's CRC is fixed
+    const uint8_t iend[] =
+        {0, 0, 0, 0, 'I', 'E', 'N', 'D', 0xae, 0x42, 0x60, 0x82};
+    TEST_ASSERT_EQ(png_len, 8 + 25 + 12 + idat_len + 12);
+    TEST_ASSERT_EQ(memcmp(data + png_len - 12, iend, 12), 0);
+
+    arena_free(arena);
+    return TEST_RESULT_PASS;
+}
+
+static void raster_canvas_test_add_rect(
+    PathBuilder* path,
+    double min_x,
+    double min_y,
+    double max_x,
+    double max_y
+) {
+    path_builder_new_contour(path, geom_vec2_new(min_x, min_y));
+    path_builder_line_to(path, geom_vec2_new(max_x, min_y));
+    path_builder_line_to(path, geom_vec2_new(max_x, max_y));
+    path_builder_line_to(path, geom_vec2_new(min_x, max_y));
+    path_builder_close_contour(path);
+}
+
+TEST_FUNC(test_raster_canvas_clip_masks) {
+    Arena* arena = arena_new(4096);
+    Rgba white = rgba_new(1.0, 1.0, 1.0, 1.0);
+    Rgba black = rgba_new(0.0, 0.0, 0.0, 1.0);
+    RasterCanvas* canvas = raster_canvas_new(arena, 8, 8, white);
+
+    PathBuilder* full = path_builder_new(arena);
+    raster_canvas_test_add_rect(full, 0.0, 0.0, 8.0, 8.0);
+    PathBuilder* outer = path_builder_new(arena);
+    raster_canvas_test_add_rect(outer, 1.5, 1.0, 6.0, 6.0);
+    PathBuilder* inner = path_builder_new(arena);
+    raster_canvas_test_add_rect(inner, 4.0, 0.0, 8.0, 8.0);
+
+    // Nested clips intersect, and fractional clip edges blend partially
+    raster_canvas_push_clip_path(canvas, outer, false);
+    raster_canvas_push_clip_path(canvas, inner, false);
+    raster_canvas_draw_path(
+        canvas,
+        full,
+        (CanvasBrush) {.enable_fill = true, .fill_rgba = black}
+    );
+
+    TEST_ASSERT_EQ(raster_canvas_get_rgba(canvas, 4, 3).r, 0.0);
+    TEST_ASSERT_EQ(raster_canvas_get_rgba(canvas, 3, 3).r, 1.0);
+    TEST_ASSERT_EQ(raster_canvas_get_rgba(canvas, 6, 3).r, 1.0);
+
+    raster_canvas_pop_clip_paths(canvas, 1);
+    raster_canvas_draw_path(
+        canvas,
+        full,
+        (CanvasBrush) {.enable_fill = true, .fill_rgba = black}
+    );
+
+    Rgba edge = raster_canvas_get_rgba(canvas, 1, 3);
+    TEST_ASSERT(edge.r > 0.4 && edge.r < 0.6);
+    TEST_ASSERT_EQ(raster_canvas_get_rgba(canvas, 3, 3).r, 0.0);
+    TEST_ASSERT_EQ(raster_canvas_get_rgba(canvas, 3, 7).r, 1.0);
+
+    // Popping the last clip releases the whole canvas
+    raster_canvas_pop_clip_paths(canvas, 1);
+    raster_canvas_draw_path(
+        canvas,
+        full,
+        (CanvasBrush) {.enable_fill = true, .fill_rgba = black}
+    );
+    TEST_ASSERT_EQ(raster_canvas_get_rgba(canvas, 7, 7).r, 0.0);
+
+    arena_free(arena);
+    return TEST_RESULT_PASS;
+}
+
+TEST_FUNC(test_raster_canvas_rect_fast_path) {
+    Arena* arena = arena_new(4096);
+    Rgba white = rgba_new(1.0, 1.0, 1.0, 1.0);
+    Rgba black = rgba_new(0.0, 0.0, 0.0, 1.0);
+
+    PathBuilder* rect_path = path_builder_new(arena);
+    raster_canvas_test_add_rect(rect_path, 1.25, 2.5, 6.75, 5.0);
+
+    GeomRect rect;
+    TEST_ASSERT(raster_canvas_path_is_rect(rect_path, &rect));
+    TEST_ASSERT_EQ(rect.min.x, 1.25);
+    TEST_ASSERT_EQ(rect.max.y, 5.0);
+
+    // A midpoint on one edge keeps the same shape off the fast path
+    PathBuilder* general_path = path_builder_new(arena);
+    path_builder_new_contour(general_path, geom_vec2_new(1.25, 2.5));
+    path_builder_line_to(general_path, geom_vec2_new(4.0, 2.5));
+    path_builder_line_to(general_path, geom_vec2_new(6.75, 2.5));
+    path_builder_line_to(general_path, geom_vec2_new(6.75, 5.0));
+    path_builder_line_to(general_path, geom_vec2_new(1.25, 5.0));
+    path_builder_close_contour(general_path);
+    TEST_ASSERT(!raster_canvas_path_is_rect(general_path, &rect));
+
+    PathBuilder* diamond = path_builder_new(arena);
+    path_builder_new_contour(diamond, geom_vec2_new(4.0, 0.0));
+    path_builder_line_to(diamond, geom_vec2_new(8.0, 4.0));
+    path_builder_line_to(diamond, geom_vec2_new(4.0, 8.0));
+    path_builder_line_to(diamond, geom_vec2_new(0.0, 4.0));
+    path_builder_close_contour(diamond);
+    TEST_ASSERT(!raster_canvas_path_is_rect(diamond, &rect));
+
+    RasterCanvas* expected = raster_canvas_new(arena, 8, 8, white);
+    RasterCanvas* actual = raster_canvas_new(arena, 8, 8, white);
+    CanvasBrush brush = {.enable_fill = true, .fill_rgba = black};
+    raster_canvas_draw_path(expected, general_path, brush);
+    raster_canvas_draw_path(actual, rect_path, brush);
+
+    for (uint32_t y = 0; y < 8; y++) {
+        for (uint32_t x = 0; x < 8; x++) {
+            double difference = raster_canvas_get_rgba(expected, x, y).r
+                              - raster_canvas_get_rgba(actual, x, y).r;
+            TEST_ASSERT(fabs(difference) <= 1.0 / 255.0 + 1e-9);
+        }
+    }
+
+    arena_free(arena);
+    return TEST_RESULT_PASS;
+}
+
+TEST_FUNC(test_raster_canvas_stroke_contours_single_pass) {
+    Arena* arena = arena_new(4096);
+    Rgba white = rgba_new(1.0, 1.0, 1.0, 1.0);
+    Rgba black = rgba_new(0.0, 0.0, 0.0, 1.0);
+    RasterCanvas* canvas = raster_canvas_new(arena, 16, 16, white);
+
+    // A closed square keeps its hole, and crossing open lines stay solid
+    PathBuilder* path = path_builder_new_with_options(
+        arena,
+        path_builder_options_flattened()
+    );
+    raster_canvas_test_add_rect(path, 2.0, 2.0, 8.0, 8.0);
+    path_builder_new_contour(path, geom_vec2_new(12.0, 0.0));
+    path_builder_line_to(path, geom_vec2_new(12.0, 16.0));
+    path_builder_new_contour(path, geom_vec2_new(8.0, 12.0));
+    path_builder_line_to(path, geom_vec2_new(16.0, 12.0));
+
+    raster_canvas_draw_path(
+        canvas,
+        path,
+        (CanvasBrush) {.enable_stroke = true,
+                       .stroke_rgba = black,
+                       .stroke_width = 2.0,
+                       .line_cap = CANVAS_LINECAP_BUTT,
+                       .line_join = CANVAS_LINEJOIN_MITER,
+                       .miter_limit = 10.0}
+    );
+
+    TEST_ASSERT_EQ(raster_canvas_get_rgba(canvas, 5, 5).r, 1.0);
+    TEST_ASSERT_EQ(raster_canvas_get_rgba(canvas, 1, 5).r, 0.0);
+    TEST_ASSERT_EQ(raster_canvas_get_rgba(canvas, 7, 5).r, 0.0);
+    TEST_ASSERT_EQ(raster_canvas_get_rgba(canvas, 11, 11).r, 0.0);
+    TEST_ASSERT_EQ(raster_canvas_get_rgba(canvas, 12, 12).r, 0.0);
+    TEST_ASSERT_EQ(raster_canvas_get_rgba(canvas, 14, 14).r, 1.0);
+
+    arena_free(arena);
+    return TEST_RESULT_PASS;
+}
+
+#endif // TEST
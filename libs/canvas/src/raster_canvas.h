@@ -5,8 +5,10 @@
 #include <stdint.h>
 
 #include "arena/arena.h"
+#include "arena/common.h"
 #include "canvas/canvas.h"
 #include "canvas/path_builder.h"
+#include "geom/rect.h"
 
 typedef struct RasterCanvas RasterCanvas;
 
@@ -17,10 +19,36 @@ RasterCanvas* raster_canvas_new(
     Rgba rgba
 );
 
+/// Backs `canvas_new_raster_band`. Rows keep their coordinates in the whole
+/// canvas, so coverage is computed over the same regions as it would be for
+/// it, like a view's.
+RasterCanvas* raster_canvas_new_band(
+    Arena* arena,
+    uint32_t width,
+    uint32_t height,
+    uint32_t row_begin,
+    uint32_t row_end,
+    Rgba rgba
+);
+
+/// Creates a canvas drawing to rows `row_begin` to `row_end` of `target`'s
+/// pixels, with its own clip stack. Views over disjoint rows can be drawn to
+/// from different threads, and produce the same pixels as drawing the same
+/// commands to `target` itself.
+RasterCanvas* raster_canvas_new_view(
+    Arena* arena,
+    const RasterCanvas* target,
+    uint32_t row_begin,
+    uint32_t row_end
+);
+
 double raster_canvas_raster_res(const RasterCanvas* canvas);
 uint32_t raster_canvas_width(const RasterCanvas* canvas);
 uint32_t raster_canvas_height(const RasterCanvas* canvas);
 
+/// Gets row `y` of the canvas as `width` premultiplied RGBA8 pixels.
+const uint8_t* raster_canvas_row(const RasterCanvas* canvas, uint32_t y);
+
 Rgba raster_canvas_get_rgba(const RasterCanvas* canvas, uint32_t x, uint32_t y);
 
 void raster_canvas_set_rgba(
@@ -72,12 +100,46 @@ void raster_canvas_draw_bezier(
     Rgba rgba
 );
 
+/// Finds the bounds of every pixel drawing `path` with `brush` can touch,
+/// widened for strokes by the furthest their joins and caps reach. Returns
+/// false if the path is empty.
+bool raster_canvas_brush_bounds(
+    const PathBuilder* path,
+    CanvasBrush brush,
+    GeomRect* bounds_out
+);
+
 void raster_canvas_draw_path(
     RasterCanvas* canvas,
     const PathBuilder* path,
     CanvasBrush brush
 );
 
+bool raster_canvas_rasterize_mask(
+    Arena* arena,
+    const PathBuilder* path,
+    bool even_odd_rule,
+    uint32_t max_size,
+    CanvasMask* mask_out
+);
+
+void raster_canvas_draw_mask(
+    RasterCanvas* canvas,
+    const CanvasMask* mask,
+    int32_t x,
+    int32_t y,
+    Rgba rgba
+);
+
+/// Composites the pixels of `source` over the canvas, with the top-left pixel
+/// of `source` placed at (`x`, `y`).
+void raster_canvas_draw_raster(
+    RasterCanvas* canvas,
+    const RasterCanvas* source,
+    int32_t x,
+    int32_t y
+);
+
 void raster_canvas_push_clip_path(
     RasterCanvas* canvas,
     const PathBuilder* path,
@@ -92,4 +154,24 @@ void raster_canvas_draw_pixel(
     Rgba rgba
 );
 
+/// Composites a span of premultiplied RGBA8 pixels over row `y`, starting at
+/// column `x`.
+void raster_canvas_draw_span(
+    RasterCanvas* canvas,
+    int32_t x,
+    int32_t y,
+    size_t count,
+    const uint8_t* pixels
+);
+
+/// Finds the pixels this canvas draws to that aren't fully clipped. Returns
+/// false if there are none.
+bool raster_canvas_draw_bounds(
+    const RasterCanvas* canvas,
+    GeomRect* bounds_out
+);
+
 bool raster_canvas_write_file(RasterCanvas* canvas, const char* path);
+
+/// Encodes the canvas as an uncompressed PNG with straight alpha.
+Uint8Array* raster_canvas_encode_png(const RasterCanvas* canvas, Arena* arena);
@@ -1,10 +1,15 @@
 #include "scalable_canvas.h"
 
+#include <math.h>
 #include <stdio.h>
 #include <string.h>
 
 #include "arena/arena.h"
 #include "canvas/canvas.h"
+#include "composite.h"
+#include "geom/mat3.h"
+#include "geom/rect.h"
+#include "geom/vec2.h"
 #include "logger/log.h"
 #include "path_builder.h"
 #include "str/alloc_str.h"
@@ -14,6 +19,11 @@
 #define DVEC_TYPE Str*
 #include "arena/dvec_impl.h"
 
+#define DVEC_NAME ScalableClipBoundsVec
+#define DVEC_LOWERCASE_NAME scalable_clip_bounds_vec
+#define DVEC_TYPE GeomRect
+#include "arena/dvec_impl.h"
+
 struct ScalableCanvas {
     Arena* arena;
 
@@ -23,7 +33,11 @@ struct ScalableCanvas {
 
     SvgPartsVec* parts;
     size_t next_clip_id;
-    size_t active_clip_depth;
+
+    /// The bounds of the intersection of each active clip path with those
+    /// pushed before it.
+    ScalableClipBoundsVec* clip_bounds;
+    size_t next_gradient_id;
 };
 
 ScalableCanvas* scalable_canvas_new(
@@ -43,7 +57,8 @@ ScalableCanvas* scalable_canvas_new(
     canvas->raster_res = raster_res;
     canvas->parts = svg_parts_vec_new(arena);
     canvas->next_clip_id = 0;
-    canvas->active_clip_depth = 0;
+    canvas->clip_bounds = scalable_clip_bounds_vec_new(arena);
+    canvas->next_gradient_id = 0;
 
     uint32_t packed_rgba = rgba_pack(rgba);
 
@@ -360,18 +375,34 @@ void scalable_canvas_push_clip_path(
         str_new_fmt(canvas->arena, "<g clip-path=\"url(#clip-%zu)\">", clip_id)
     );
 
-    canvas->active_clip_depth++;
+    GeomRect bounds;
+    if (!path_builder_bounds(path, &bounds)) {
+        bounds =
+            geom_rect_new(geom_vec2_new(0.0, 0.0), geom_vec2_new(0.0, 0.0));
+    }
+    GeomRect outer_bounds;
+    size_t depth = scalable_clip_bounds_vec_len(canvas->clip_bounds);
+    if (depth != 0
+        && scalable_clip_bounds_vec_get(
+            canvas->clip_bounds,
+            depth - 1,
+            &outer_bounds
+        )) {
+        bounds = geom_rect_intersection(bounds, outer_bounds);
+    }
+    scalable_clip_bounds_vec_push(canvas->clip_bounds, bounds);
 }
 
 void scalable_canvas_pop_clip_paths(ScalableCanvas* canvas, size_t count) {
     RELEASE_ASSERT(canvas);
-    RELEASE_ASSERT(count <= canvas->active_clip_depth);
+    RELEASE_ASSERT(
+        count <= scalable_clip_bounds_vec_len(canvas->clip_bounds)
+    );
 
     for (size_t idx = 0; idx < count; idx++) {
         svg_parts_vec_push(canvas->parts, str_new_fmt(canvas->arena, "</g>"));
+        RELEASE_ASSERT(scalable_clip_bounds_vec_pop(canvas->clip_bounds, NULL));
     }
-
-    canvas->active_clip_depth -= count;
 }
 
 void scalable_canvas_draw_pixel(
@@ -396,6 +427,422 @@ void scalable_canvas_draw_pixel(
     );
 }
 
+void scalable_canvas_draw_span(
+    ScalableCanvas* canvas,
+    int32_t x,
+    int32_t y,
+    size_t count,
+    const uint8_t* pixels
+) {
+    RELEASE_ASSERT(canvas);
+    RELEASE_ASSERT(pixels || count == 0);
+
+    // Runs of identical pixels share one rectangle
+    size_t run_start = 0;
+    while (run_start < count) {
+        size_t run_end = run_start + 1;
+        while (run_end < count
+               && memcmp(pixels + run_start * 4, pixels + run_end * 4, 4)
+                      == 0) {
+            run_end++;
+        }
+
+        CompositeColor color;
+        memcpy(&color, pixels + run_start * 4, 4);
+        if (color.a != 0) {
+            svg_parts_vec_push(
+                canvas->parts,
+                str_new_fmt(
+                    canvas->arena,
+                    "<rect x=\"%f\" y=\"%f\" width=\"%f\" height=\"%f\" fill=\"#%08x\" />",
+                    ((double)x + (double)run_start) * canvas->raster_res,
+                    (double)y * canvas->raster_res,
+                    (double)(run_end - run_start) * canvas->raster_res,
+                    canvas->raster_res,
+                    rgba_pack(composite_color_to_rgba(color))
+                )
+            );
+        }
+
+        run_start = run_end;
+    }
+}
+
+bool scalable_canvas_draw_bounds(
+    const ScalableCanvas* canvas,
+    GeomRect* bounds_out
+) {
+    RELEASE_ASSERT(canvas);
+    RELEASE_ASSERT(bounds_out);
+
+    // Clip paths are left to the SVG renderer, so only their bounds limit
+    // drawing
+    GeomRect bounds = geom_rect_new(
+        geom_vec2_new(0.0, 0.0),
+        geom_vec2_new((double)canvas->width, (double)canvas->height)
+    );
+    GeomRect clip_bounds;
+    size_t depth = scalable_clip_bounds_vec_len(canvas->clip_bounds);
+    if (depth != 0
+        && scalable_clip_bounds_vec_get(
+            canvas->clip_bounds,
+            depth - 1,
+            &clip_bounds
+        )) {
+        bounds = geom_rect_intersection(bounds, clip_bounds);
+    }
+
+    *bounds_out = bounds;
+    return bounds.min.x < bounds.max.x && bounds.min.y < bounds.max.y;
+}
+
+/// Adds a circle as a contour of four cubic curves.
+static void scalable_canvas_circle_contour(
+    PathBuilder* path,
+    GeomVec2 center,
+    double radius
+) {
+    // The distance of the control points which best approximates a quarter
+    // circle
+    double k = radius * 0.5522847498;
+    double x = center.x;
+    double y = center.y;
+
+    path_builder_new_contour(path, geom_vec2_new(x + radius, y));
+    path_builder_cubic_bezier_to(
+        path,
+        geom_vec2_new(x, y + radius),
+        geom_vec2_new(x + radius, y + k),
+        geom_vec2_new(x + k, y + radius)
+    );
+    path_builder_cubic_bezier_to(
+        path,
+        geom_vec2_new(x - radius, y),
+        geom_vec2_new(x - k, y + radius),
+        geom_vec2_new(x - radius, y + k)
+    );
+    path_builder_cubic_bezier_to(
+        path,
+        geom_vec2_new(x, y - radius),
+        geom_vec2_new(x - radius, y - k),
+        geom_vec2_new(x - k, y - radius)
+    );
+    path_builder_cubic_bezier_to(
+        path,
+        geom_vec2_new(x + radius, y),
+        geom_vec2_new(x + k, y - radius),
+        geom_vec2_new(x + radius, y - k)
+    );
+    path_builder_close_contour(path);
+}
+
+/// Adds the canvas's bounds, mapped through `inverse`, as a contour.
+static void scalable_canvas_bounds_contour(
+    const ScalableCanvas* canvas,
+    PathBuilder* path,
+    GeomMat3 inverse
+) {
+    double width = (double)canvas->width;
+    double height = (double)canvas->height;
+
+    path_builder_new_contour(
+        path,
+        geom_vec2_transform(geom_vec2_new(0.0, 0.0), inverse)
+    );
+    path_builder_line_to(
+        path,
+        geom_vec2_transform(geom_vec2_new(width, 0.0), inverse)
+    );
+    path_builder_line_to(
+        path,
+        geom_vec2_transform(geom_vec2_new(width, height), inverse)
+    );
+    path_builder_line_to(
+        path,
+        geom_vec2_transform(geom_vec2_new(0.0, height), inverse)
+    );
+    path_builder_close_contour(path);
+}
+
+/// Finds the area a linear gradient paints over the canvas, as a rectangle
+/// aligned with its axis. Returns false if it paints nothing.
+static bool scalable_canvas_linear_gradient_shape(
+    const ScalableCanvas* canvas,
+    const CanvasGradient* gradient,
+    GeomMat3 inverse,
+    PathBuilder* shape
+) {
+    GeomVec2 axis = geom_vec2_sub(gradient->end, gradient->start);
+    GeomVec2 normal = geom_vec2_new(-axis.y, axis.x);
+    double inv_len_sq = 1.0 / geom_vec2_len_sq(axis);
+
+    // Project the canvas's corners onto the axis and its normal
+    double min_t = INFINITY;
+    double max_t = -INFINITY;
+    double min_s = INFINITY;
+    double max_s = -INFINITY;
+    for (int corner = 0; corner < 4; corner++) {
+        GeomVec2 point = geom_vec2_transform(
+            geom_vec2_new(
+                corner & 1 ? (double)canvas->width : 0.0,
+                corner & 2 ? (double)canvas->height : 0.0
+            ),
+            inverse
+        );
+        GeomVec2 offset = geom_vec2_sub(point, gradient->start);
+        double t = geom_vec2_dot(offset, axis) * inv_len_sq;
+        double s = geom_vec2_dot(offset, normal) * inv_len_sq;
+        min_t = fmin(min_t, t);
+        max_t = fmax(max_t, t);
+        min_s = fmin(min_s, s);
+        max_s = fmax(max_s, s);
+    }
+
+    if (!gradient->extend_start) {
+        min_t = fmax(min_t, 0.0);
+    }
+    if (!gradient->extend_end) {
+        max_t = fmin(max_t, 1.0);
+    }
+    if (!(min_t < max_t)) {
+        return false;
+    }
+
+    double corners[4][2] = {
+        {min_t, min_s},
+        {max_t, min_s},
+        {max_t, max_s},
+        {min_t, max_s}
+    };
+    for (int corner = 0; corner < 4; corner++) {
+        GeomVec2 point = geom_vec2_add(
+            gradient->start,
+            geom_vec2_add(
+                geom_vec2_scale(axis, corners[corner][0]),
+                geom_vec2_scale(normal, corners[corner][1])
+            )
+        );
+        if (corner == 0) {
+            path_builder_new_contour(shape, point);
+        } else {
+            path_builder_line_to(shape, point);
+        }
+    }
+    path_builder_close_contour(shape);
+
+    return true;
+}
+
+bool scalable_canvas_draw_gradient(
+    ScalableCanvas* canvas,
+    const CanvasGradient* gradient
+) {
+    RELEASE_ASSERT(canvas);
+    RELEASE_ASSERT(gradient);
+    RELEASE_ASSERT(gradient->stops && gradient->stop_count != 0);
+
+    if (fabs(geom_mat3_det(gradient->transform)) < 1e-12) {
+        return false;
+    }
+
+    GeomMat3 inverse = geom_mat3_inverse(gradient->transform);
+    size_t gradient_id = canvas->next_gradient_id;
+    bool is_reversed = false;
+    Str* definition = NULL;
+
+    Arena* local_arena = arena_new(1024);
+    PathBuilder* shape = path_builder_new(local_arena);
+
+    switch (gradient->type) {
+        case CANVAS_GRADIENT_LINEAR: {
+            if (geom_vec2_len_sq(geom_vec2_sub(gradient->end, gradient->start))
+                < 1e-12) {
+                arena_free(local_arena);
+                return false;
+            }
+
+            if (!scalable_canvas_linear_gradient_shape(
+                    canvas,
+                    gradient,
+                    inverse,
+                    shape
+                )) {
+                arena_free(local_arena);
+                return true;
+            }
+
+            definition = str_new_fmt(
+                canvas->arena,
+                "<defs><linearGradient id=\"gradient-%zu\" gradientUnits=\"userSpaceOnUse\" x1=\"%f\" y1=\"%f\" x2=\"%f\" y2=\"%f\">",
+                gradient_id,
+                gradient->start.x,
+                gradient->start.y,
+                gradient->end.x,
+                gradient->end.y
+            );
+            break;
+        }
+        case CANVAS_GRADIENT_RADIAL: {
+            // SVG needs the focal circle inside the end circle, so gradients
+            // which shrink are drawn reversed
+            GeomVec2 inner = gradient->start;
+            GeomVec2 outer = gradient->end;
+            double inner_radius = gradient->start_radius;
+            double outer_radius = gradient->end_radius;
+            bool extend_inner = gradient->extend_start;
+            bool extend_outer = gradient->extend_end;
+            if (inner_radius > outer_radius) {
+                is_reversed = true;
+                inner = gradient->end;
+                outer = gradient->start;
+                inner_radius = gradient->end_radius;
+                outer_radius = gradient->start_radius;
+                extend_inner = gradient->extend_end;
+                extend_outer = gradient->extend_start;
+            }
+
+            double center_distance =
+                sqrt(geom_vec2_len_sq(geom_vec2_sub(outer, inner)));
+            if (center_distance + inner_radius > outer_radius + 1e-9
+                || outer_radius <= 0.0) {
+                arena_free(local_arena);
+                return false;
+            }
+
+            // SVG pads both ends, so unextended ends are cut out of the shape
+            if (extend_outer) {
+                scalable_canvas_bounds_contour(canvas, shape, inverse);
+            } else {
+                scalable_canvas_circle_contour(shape, outer, outer_radius);
+            }
+            if (!extend_inner && inner_radius > 0.0) {
+                scalable_canvas_circle_contour(shape, inner, inner_radius);
+            }
+
+            definition = str_new_fmt(
+                canvas->arena,
+                "<defs><radialGradient id=\"gradient-%zu\" gradientUnits=\"userSpaceOnUse\" cx=\"%f\" cy=\"%f\" r=\"%f\" fx=\"%f\" fy=\"%f\" fr=\"%f\">",
+                gradient_id,
+                outer.x,
+                outer.y,
+                outer_radius,
+                inner.x,
+                inner.y,
+                inner_radius
+            );
+            break;
+        }
+        default: {
+            LOG_PANIC("Unreachable");
+        }
+    }
+
+    canvas->next_gradient_id++;
+    svg_parts_vec_push(canvas->parts, definition);
+
+    for (size_t idx = 0; idx < gradient->stop_count; idx++) {
+        CanvasGradientStop stop = gradient->stops
+            [is_reversed ? gradient->stop_count - 1 - idx : idx];
+        double offset = is_reversed ? 1.0 - stop.offset : stop.offset;
+
+        svg_parts_vec_push(
+            canvas->parts,
+            str_new_fmt(
+                canvas->arena,
+                "<stop offset=\"%f\" stop-color=\"#%06x\" stop-opacity=\"%f\" />",
+                offset,
+                rgba_pack(stop.rgba) >> 8,
+                stop.rgba.a
+            )
+        );
+    }
+
+    GeomMat3 transform = gradient->transform;
+    svg_parts_vec_push(
+        canvas->parts,
+        str_new_fmt(
+            canvas->arena,
+            "</%s></defs><path transform=\"matrix(%f %f %f %f %f %f)\" d=\"",
+            gradient->type == CANVAS_GRADIENT_LINEAR ? "linearGradient"
+                                                     : "radialGradient",
+            transform.mat[0][0],
+            transform.mat[0][1],
+            transform.mat[1][0],
+            transform.mat[1][1],
+            transform.mat[2][0],
+            transform.mat[2][1]
+        )
+    );
+    scalable_canvas_append_path_data(canvas, shape);
+    svg_parts_vec_push(
+        canvas->parts,
+        str_new_fmt(
+            canvas->arena,
+            "\" fill=\"url(#gradient-%zu)\" fill-rule=\"evenodd\" />",
+            gradient_id
+        )
+    );
+
+    arena_free(local_arena);
+    return true;
+}
+
+/// Encodes `len` bytes of `data` as base64 into a null-terminated string.
+static char*
+scalable_canvas_base64(Arena* arena, const uint8_t* data, size_t len) {
+    static const char alphabet[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    char* encoded = arena_alloc(arena, (len + 2) / 3 * 4 + 1);
+    char* out = encoded;
+    for (size_t idx = 0; idx < len; idx += 3) {
+        uint32_t group = (uint32_t)data[idx] << 16;
+        if (idx + 1 < len) {
+            group |= (uint32_t)data[idx + 1] << 8;
+        }
+        if (idx + 2 < len) {
+            group |= data[idx + 2];
+        }
+
+        *out++ = alphabet[(group >> 18) & 0x3f];
+        *out++ = alphabet[(group >> 12) & 0x3f];
+        *out++ = idx + 1 < len ? alphabet[(group >> 6) & 0x3f] : '=';
+        *out++ = idx + 2 < len ? alphabet[group & 0x3f] : '=';
+    }
+    *out = '\0';
+
+    return encoded;
+}
+
+void scalable_canvas_draw_image(
+    ScalableCanvas* canvas,
+    const RasterCanvas* image,
+    GeomRect rect
+) {
+    RELEASE_ASSERT(canvas);
+    RELEASE_ASSERT(image);
+
+    Arena* local_arena = arena_new(4096);
+    Uint8Array* png = raster_canvas_encode_png(image, local_arena);
+    size_t png_len = 0;
+    const uint8_t* png_data = uint8_array_get_raw(png, &png_len);
+
+    svg_parts_vec_push(
+        canvas->parts,
+        str_new_fmt(
+            canvas->arena,
+            "<image x=\"%f\" y=\"%f\" width=\"%f\" height=\"%f\" preserveAspectRatio=\"none\" href=\"data:image/png;base64,%s\" />",
+            rect.min.x,
+            rect.min.y,
+            rect.max.x - rect.min.x,
+            rect.max.y - rect.min.y,
+            scalable_canvas_base64(local_arena, png_data, png_len)
+        )
+    );
+
+    arena_free(local_arena);
+}
+
 bool scalable_canvas_write_file(ScalableCanvas* canvas, const char* path) {
     FILE* file = fopen(path, "w");
     if (!file) {
@@ -429,7 +876,9 @@ bool scalable_canvas_write_file(ScalableCanvas* canvas, const char* path) {
         }
     }
 
-    for (size_t idx = 0; idx < canvas->active_clip_depth; idx++) {
+    for (size_t idx = 0;
+         idx < scalable_clip_bounds_vec_len(canvas->clip_bounds);
+         idx++) {
         if (fputs("</g>", file) == EOF) {
             fclose(file);
             return false;
@@ -7,7 +7,9 @@
 #include "arena/arena.h"
 #include "canvas/canvas.h"
 #include "canvas/path_builder.h"
+#include "geom/rect.h"
 #include "geom/vec2.h"
+#include "raster_canvas.h"
 
 typedef struct ScalableCanvas ScalableCanvas;
 
@@ -71,4 +73,28 @@ void scalable_canvas_draw_pixel(
     Rgba rgba
 );
 
+void scalable_canvas_draw_span(
+    ScalableCanvas* canvas,
+    int32_t x,
+    int32_t y,
+    size_t count,
+    const uint8_t* pixels
+);
+
+bool scalable_canvas_draw_bounds(
+    const ScalableCanvas* canvas,
+    GeomRect* bounds_out
+);
+
+bool scalable_canvas_draw_gradient(
+    ScalableCanvas* canvas,
+    const CanvasGradient* gradient
+);
+
+void scalable_canvas_draw_image(
+    ScalableCanvas* canvas,
+    const RasterCanvas* image,
+    GeomRect rect
+);
+
 bool scalable_canvas_write_file(ScalableCanvas* canvas, const char* path);
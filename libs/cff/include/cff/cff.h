@@ -4,6 +4,7 @@
 
 #include "arena/arena.h"
 #include "canvas/canvas.h"
+#include "canvas/path_builder.h"
 #include "err/error.h"
 #include "geom/mat3.h"
 #include "parse_ctx/ctx.h"
@@ -15,6 +16,14 @@ typedef struct CffFontSet CffFontSet;
 Error*
 cff_parse_fontset(Arena* arena, ParseCtx ctx, CffFontSet** cff_fontset_out);
 
+/// Copies `fontset` onto `arena`, sharing its parsed tables. Reading glyphs
+/// moves the FontSet's cursor, so threads reading the same FontSet at once
+/// each need their own copy.
+CffFontSet* cff_fontset_copy(Arena* arena, const CffFontSet* fontset);
+
+/// Append the outline of a glyph, in font units, to `path`.
+Error* cff_glyph_outline(CffFontSet* fontset, uint32_t gid, PathBuilder* path);
+
 /// Render a glyph with a given transformation.
 Error* cff_render_glyph(
     CffFontSet* fontset,
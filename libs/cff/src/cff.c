@@ -130,6 +130,45 @@ Error* cff_parse_fontset(Arena* arena, ParseCtx ctx, CffFontSet** out) {
     return NULL;
 }
 
+CffFontSet* cff_fontset_copy(Arena* arena, const CffFontSet* fontset) {
+    RELEASE_ASSERT(arena);
+    RELEASE_ASSERT(fontset);
+
+    CffFontSet* copy = arena_alloc(arena, sizeof(CffFontSet));
+    *copy = *fontset;
+    return copy;
+}
+
+Error* cff_glyph_outline(CffFontSet* fontset, uint32_t gid, PathBuilder* path) {
+    RELEASE_ASSERT(fontset);
+    RELEASE_ASSERT(path);
+
+    if (cff_font_array_len(fontset->fonts) != 1) {
+        LOG_TODO("Fontsets");
+    }
+
+    CffFont font;
+    RELEASE_ASSERT(cff_font_array_get(fontset->fonts, 0, &font));
+
+    size_t charstr_len;
+    TRY(cff_index_seek_object(
+        &font.charstr_index,
+        &fontset->ctx,
+        (uint16_t)gid,
+        &charstr_len
+    ));
+
+    TRY(cff_charstr2_outline(
+        &fontset->ctx,
+        fontset->global_subr_index,
+        font.subrs_index,
+        charstr_len,
+        path
+    ));
+
+    return NULL;
+}
+
 Error* cff_render_glyph(
     CffFontSet* fontset,
     uint32_t gid,
@@ -828,29 +828,22 @@ static Error* cff_charstr2_subr(
     return NULL;
 }
 
-Error* cff_charstr2_render(
+Error* cff_charstr2_outline(
     ParseCtx* ctx,
     CffIndex global_subr_index,
     CffIndex local_subr_index,
     size_t length,
-    Canvas* canvas,
-    GeomMat3 transform,
-    CanvasBrush brush
+    PathBuilder* path
 ) {
     RELEASE_ASSERT(ctx);
-    RELEASE_ASSERT(canvas);
+    RELEASE_ASSERT(path);
 
-    Arena* temp_arena = arena_new(4096);
-    PathBuilderOptions path_options = path_builder_options_default();
-    if (canvas_is_raster(canvas)) {
-        path_options = path_builder_options_flattened();
-    }
     CharstrState state = (CharstrState) {
         .operand_count = 0,
         .stack_bottom = 0,
         .width_set = false,
         .width = 0.0,
-        .path_builder = path_builder_new_with_options(temp_arena, path_options),
+        .path_builder = path,
         .current_point = geom_vec2_new(0.0, 0.0)
     };
 
@@ -865,8 +858,42 @@ Error* cff_charstr2_render(
         &endchar
     ));
 
-    path_builder_apply_transform(state.path_builder, transform);
-    canvas_draw_path(canvas, state.path_builder, brush);
+    return NULL;
+}
+
+Error* cff_charstr2_render(
+    ParseCtx* ctx,
+    CffIndex global_subr_index,
+    CffIndex local_subr_index,
+    size_t length,
+    Canvas* canvas,
+    GeomMat3 transform,
+    CanvasBrush brush
+) {
+    RELEASE_ASSERT(ctx);
+    RELEASE_ASSERT(canvas);
+
+    Arena* temp_arena = arena_new(4096);
+    PathBuilderOptions path_options = path_builder_options_default();
+    if (canvas_is_raster(canvas)) {
+        path_options = path_builder_options_flattened();
+    }
+    PathBuilder* path = path_builder_new_with_options(temp_arena, path_options);
+
+    Error* outline_error = cff_charstr2_outline(
+        ctx,
+        global_subr_index,
+        local_subr_index,
+        length,
+        path
+    );
+    if (outline_error) {
+        arena_free(temp_arena);
+        return outline_error;
+    }
+
+    path_builder_apply_transform(path, transform);
+    canvas_draw_path(canvas, path, brush);
     arena_free(temp_arena);
 
     return NULL;
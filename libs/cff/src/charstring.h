@@ -1,11 +1,22 @@
 #pragma once
 
 #include "canvas/canvas.h"
+#include "canvas/path_builder.h"
 #include "err/error.h"
 #include "geom/mat3.h"
 #include "index.h"
 #include "parse_ctx/ctx.h"
 
+/// Interprets a Type 2 charstring, appending its outline in font units to
+/// `path`.
+Error* cff_charstr2_outline(
+    ParseCtx* ctx,
+    CffIndex global_subr_index,
+    CffIndex local_subr_index,
+    size_t length,
+    PathBuilder* path
+);
+
 Error* cff_charstr2_render(
     ParseCtx* ctx,
     CffIndex global_subr_index,
@@ -15,3 +15,11 @@ Error* decode_zlib_data(
     size_t data_len,
     Uint8Array** decoded_bytes
 );
+
+/// Encodes data into a zlib stream of uncompressed deflate blocks, for
+/// formats that require zlib framing, such as PNG.
+Uint8Array* encode_zlib_data_stored(
+    Arena* arena,
+    const uint8_t* data,
+    size_t data_len
+);
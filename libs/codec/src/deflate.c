@@ -1,5 +1,6 @@
 #include "deflate.h"
 
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -426,39 +427,43 @@ static Error* decode_dyn_huffman_table_luts(
     return NULL;
 }
 
-static DeflateHuffmanLut get_fixed_huffman_lut(void) {
-    static bool initialized = false;
-    static DeflateHuffmanLut lut;
-    static uint8_t arena_backing[4096];
+static DeflateHuffmanLut fixed_huffman_lut;
+static pthread_once_t fixed_huffman_lut_once = PTHREAD_ONCE_INIT;
 
-    if (!initialized) {
-        LOG_DIAG(DEBUG, CODEC, "Initializing fixed deflate huffman lut");
+static void init_fixed_huffman_lut(void) {
+    static uint8_t arena_backing[4096];
 
-        initialized = true;
+    LOG_DIAG(DEBUG, CODEC, "Initializing fixed deflate huffman lut");
 
-        uint8_t bit_lens[288];
+    uint8_t bit_lens[288];
 
-        for (size_t i = 0; i < 144; i++) {
-            bit_lens[i] = 8;
-        }
-        for (size_t i = 144; i < 256; i++) {
-            bit_lens[i] = 9;
-        }
-        for (size_t i = 256; i < 280; i++) {
-            bit_lens[i] = 7;
-        }
-        for (size_t i = 280; i < 288; i++) {
-            bit_lens[i] = 8;
-        }
-
-        Arena* arena = arena_new_in_buffer(
-            arena_backing,
-            sizeof(arena_backing) / sizeof(uint8_t)
-        );
-        lut = build_deflate_huffman_lut(arena, bit_lens, 288);
+    for (size_t i = 0; i < 144; i++) {
+        bit_lens[i] = 8;
+    }
+    for (size_t i = 144; i < 256; i++) {
+        bit_lens[i] = 9;
+    }
+    for (size_t i = 256; i < 280; i++) {
+        bit_lens[i] = 7;
+    }
+    for (size_t i = 280; i < 288; i++) {
+        bit_lens[i] = 8;
     }
 
-    return lut;
+    Arena* arena = arena_new_in_buffer(
+        arena_backing,
+        sizeof(arena_backing) / sizeof(uint8_t)
+    );
+    fixed_huffman_lut = build_deflate_huffman_lut(arena, bit_lens, 288);
+}
+
+/// Streams may be decoded on several threads at once, so the shared lut is
+/// built exactly once.
+static DeflateHuffmanLut get_fixed_huffman_lut(void) {
+    RELEASE_ASSERT(
+        pthread_once(&fixed_huffman_lut_once, init_fixed_huffman_lut) == 0
+    );
+    return fixed_huffman_lut;
 }
 
 static Error* deflate_decode_length_code(
@@ -1,7 +1,9 @@
 #include "codec/zlib.h"
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "adler32.h"
 #include "arena/common.h"
@@ -123,3 +125,92 @@ Error* decode_zlib_data(
 
     return NULL;
 }
+
+/// The most bytes a stored deflate block holds.
+#define ZLIB_STORED_BLOCK_MAX 65535
+
+Uint8Array* encode_zlib_data_stored(
+    Arena* arena,
+    const uint8_t* data,
+    size_t data_len
+) {
+    RELEASE_ASSERT(arena);
+    RELEASE_ASSERT(data || data_len == 0);
+
+    size_t block_count = (data_len + ZLIB_STORED_BLOCK_MAX - 1)
+                       / ZLIB_STORED_BLOCK_MAX;
+    if (block_count == 0) {
+        block_count = 1;
+    }
+
+    // Header, then a 5 byte header per block, then the checksum
+    size_t encoded_len = 2 + block_count * 5 + data_len + 4;
+    Uint8Array* encoded = uint8_array_new(arena, encoded_len);
+    uint8_t* out = uint8_array_get_raw(encoded, &encoded_len);
+
+    // Deflate with a 32K window and no preset dictionary, with FCHECK making
+    // the header a multiple of 31
+    *out++ = 0x78;
+    *out++ = 0x01;
+
+    size_t offset = 0;
+    for (size_t block = 0; block < block_count; block++) {
+        size_t len = data_len - offset < ZLIB_STORED_BLOCK_MAX
+                       ? data_len - offset
+                       : ZLIB_STORED_BLOCK_MAX;
+        bool is_final = block + 1 == block_count;
+
+        *out++ = is_final ? 1 : 0;
+        *out++ = (uint8_t)(len & 0xff);
+        *out++ = (uint8_t)(len >> 8);
+        *out++ = (uint8_t)(~len & 0xff);
+        *out++ = (uint8_t)((~len >> 8) & 0xff);
+        if (len != 0) {
+            memcpy(out, data + offset, len);
+        }
+
+        out += len;
+        offset += len;
+    }
+
+    Adler32Sum checksum =
+        data_len == 0 ? 1 : adler32_compute_checksum(data, data_len);
+    *out++ = (uint8_t)(checksum >> 24);
+    *out++ = (uint8_t)(checksum >> 16);
+    *out++ = (uint8_t)(checksum >> 8);
+    *out++ = (uint8_t)checksum;
+
+    return encoded;
+}
+
+#ifdef TEST
+
+#include "test/test.h"
+
+TEST_FUNC(test_zlib_stored_round_trip) {
+    Arena* arena = arena_new(4096);
+
+    // Spans more than one stored block
+    size_t data_len = ZLIB_STORED_BLOCK_MAX + 1000;
+    uint8_t* data = arena_alloc(arena, data_len);
+    for (size_t idx = 0; idx < data_len; idx++) {
+        data[idx] = (uint8_t)((idx * 31) ^ (idx >> 8));
+    }
+
+    Uint8Array* encoded = encode_zlib_data_stored(arena, data, data_len);
+    size_t encoded_len = 0;
+    const uint8_t* raw_encoded = uint8_array_get_raw(encoded, &encoded_len);
+
+    Uint8Array* decoded = NULL;
+    TEST_REQUIRE(decode_zlib_data(arena, raw_encoded, encoded_len, &decoded));
+
+    size_t decoded_len = 0;
+    const uint8_t* raw_decoded = uint8_array_get_raw(decoded, &decoded_len);
+    TEST_ASSERT_EQ(decoded_len, data_len);
+    TEST_ASSERT_EQ(memcmp(raw_decoded, data, data_len), 0);
+
+    arena_free(arena);
+    return TEST_RESULT_PASS;
+}
+
+#endif
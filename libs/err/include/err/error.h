@@ -59,6 +59,7 @@ typedef enum {
     PDF_ERR_INVALID_NUMBER,
     PDF_ERR_INVALID_OBJECT,
     PDF_ERR_INVALID_OPERAND_DESCRIPTOR,
+    PDF_ERR_INVALID_PAGE_TREE,
     PDF_ERR_INVALID_STARTXREF,
     PDF_ERR_INVALID_SUBTYPE,
     PDF_ERR_INVALID_TRAILER,
@@ -72,6 +73,7 @@ typedef enum {
     PDF_ERR_NO_PAGES,
     PDF_ERR_NUMBER_LIMIT,
     PDF_ERR_OBJECT_NOT_DICT,
+    PDF_ERR_PAGE_OUT_OF_RANGE,
     PDF_ERR_STREAM_INVALID_LENGTH,
     PDF_ERR_UNBALANCED_STR,
     PDF_ERR_UNIMPLEMENTED_KEY,
@@ -90,10 +92,13 @@ typedef enum {
     PS_ERR_OPERAND_TYPE,
     PS_ERR_POP_STANDARD_DICT,
     PS_ERR_RESOURCE_DEFINED,
+    PS_ERR_UNDEFINED_RESULT,
     PS_ERR_UNKNOWN_RESOURCE,
     PS_ERR_USER_DATA_INVALID,
     RENDER_ERR_FONT_NOT_SET,
+    RENDER_ERR_FONT_UNAVAILABLE,
     RENDER_ERR_GSTATE_CANNOT_RESTORE,
+    RENDER_ERR_INVALID_PAGE_BOX,
     SFNT_ERR_BAD_HEAD,
     SFNT_ERR_BAD_MAGIC,
     SFNT_ERR_EOF,
@@ -40,3 +40,7 @@ double geom_mat3_det(GeomMat3 mat);
 
 /// Get the inverse of a matrix
 GeomMat3 geom_mat3_inverse(GeomMat3 mat);
+
+/// Finds the largest factor by which the linear part of an affine transform
+/// stretches any vector, which is its largest singular value
+double geom_mat3_max_scale(GeomMat3 mat);
@@ -87,6 +87,27 @@ GeomMat3 geom_mat3_inverse(GeomMat3 mat) {
     );
 }
 
+double geom_mat3_max_scale(GeomMat3 mat) {
+    double a = mat.mat[0][0];
+    double b = mat.mat[0][1];
+    double c = mat.mat[1][0];
+    double d = mat.mat[1][1];
+
+    double trace = a * a + b * b + c * c + d * d;
+    double det = a * d - b * c;
+    double disc = trace * trace - 4.0 * det * det;
+    if (disc < 0.0) {
+        disc = 0.0;
+    }
+
+    double sigma_max = sqrt(0.5 * (trace + sqrt(disc)));
+    if (sigma_max < 1e-9) {
+        return 1e-9;
+    }
+
+    return sigma_max;
+}
+
 #ifdef TEST
 
 #include "test/test.h"
@@ -193,4 +214,27 @@ TEST_FUNC(test_geom_mat3_inverse) {
     return TEST_RESULT_PASS;
 }
 
+TEST_FUNC(test_geom_mat3_max_scale) {
+    TEST_ASSERT_EQ(
+        geom_mat3_max_scale(geom_mat3_new_pdf(2.0, 0.0, 0.0, -3.0, 5.0, 7.0)),
+        3.0
+    );
+
+    // A rotation stretches nothing
+    double angle = 0.5;
+    TEST_ASSERT_EQ(
+        geom_mat3_max_scale(geom_mat3_new_pdf(
+            cos(angle),
+            sin(angle),
+            -sin(angle),
+            cos(angle),
+            0.0,
+            0.0
+        )),
+        1.0
+    );
+
+    return TEST_RESULT_PASS;
+}
+
 #endif
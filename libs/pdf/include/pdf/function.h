@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 
 #include "arena/arena.h"
@@ -8,9 +9,13 @@
 #include "pdf/object.h"
 #include "pdf/resolver.h"
 #include "pdf/types.h"
-#include "postscript/object.h"
+
+/// The most input and output values a function may have. DeviceN color
+/// spaces, which have the most components, have at most 32 colorants.
+#define PDF_FUNCTION_MAX_IO 32
 
 typedef struct PdfFunction PdfFunction;
+typedef struct PdfCalculator PdfCalculator;
 
 PDF_DECL_FIELD(PdfFunction, function)
 
@@ -21,6 +26,50 @@ PDF_DECL_FIELD(PdfFunction, function)
 
 PDF_DECL_ARRAY_FIELD(PdfFunctionVec, function_vec)
 PDF_DECL_AS_ARRAY_FIELD(PdfFunctionVec, function_vec)
+PDF_DECL_OPTIONAL_FIELD(
+    PdfFunctionVec*,
+    PdfFunctionVecOptional,
+    as_function_vec
+)
+
+typedef struct {
+    /// (Required) An array of m positive integers that shall specify the
+    /// number of samples in each input dimension of the sample table.
+    PdfNumberVec* size;
+
+    /// (Required) The number of bits that shall represent each sample. (If the
+    /// function has multiple output values, each one shall occupy
+    /// BitsPerSample bits.) Valid values shall be 1, 2, 4, 8, 12, 16, 24, and
+    /// 32.
+    PdfInteger bits_per_sample;
+
+    /// (Optional) The order of interpolation between samples. Valid values
+    /// shall be 1 and 3, specifying linear and cubic spline interpolation,
+    /// respectively. Default value: 1.
+    PdfIntegerOptional order;
+
+    /// (Optional) An array of 2 × m numbers specifying the linear mapping of
+    /// input values into the domain of the function's sample table. Default
+    /// value: [ 0 (Size0 − 1) 0 (Size1 − 1) … ].
+    PdfNumberVecOptional encode;
+
+    /// (Optional) An array of 2 × n numbers specifying the linear mapping of
+    /// sample values into the range appropriate for the function's output
+    /// values. Default value: same as the value of Range.
+    PdfNumberVecOptional decode;
+
+    /// The samples mapped through Decode, with the n outputs of each sample
+    /// adjacent and the first input dimension varying fastest.
+    const double* samples;
+
+    /// The number of samples in each input dimension, and the distance in
+    /// `samples` between neighbors in that dimension.
+    const size_t* sample_counts;
+    const size_t* strides;
+
+    /// Encode as reals.
+    const double* encode_values;
+} PdfFunctionType0;
 
 typedef struct {
     /// (Optional) An array of n numbers that shall define the function result
@@ -34,6 +83,10 @@ typedef struct {
     /// (Required) The interpolation exponent. Each input value x shall return n
     /// values, given by yj = C0j + xN × (C1j − C0j ), for 0 ≤ j < n.
     PdfNumber n;
+
+    /// C0 and C1 as reals, with their defaults filled in.
+    const double* c0_values;
+    const double* c1_values;
 } PdfFunctionType2;
 
 typedef struct {
@@ -52,6 +105,10 @@ typedef struct {
     /// each subset of the domain defined by Domain and the Bounds array to the
     /// domain of the corresponding function.
     PdfNumberVec* encode;
+
+    /// Bounds and Encode as reals.
+    const double* bound_values;
+    const double* encode_values;
 } PdfFunctionType3;
 
 struct PdfFunction {
@@ -79,10 +136,19 @@ struct PdfFunction {
     PdfNumberVecOptional range;
 
     union {
+        PdfFunctionType0 type0;
         PdfFunctionType2 type2;
         PdfFunctionType3 type3;
-        PSInterpreter* type4;
+        PdfCalculator* type4;
     } data;
+
+    /// The number of input values, m, and output values, n.
+    size_t input_count;
+    size_t output_count;
+
+    /// Domain and Range as reals. `range_values` is NULL if Range is absent.
+    const double* domain_values;
+    const double* range_values;
 };
 
 Error* pdf_deserde_function(
@@ -94,3 +160,14 @@ Error* pdf_deserde_function(
 /// Run a function using the operands in io and returning the outputs in io
 Error*
 pdf_run_function(const PdfFunction* function, Arena* arena, PdfObjectVec* io);
+
+/// Evaluates a function on its `input_count` inputs, storing its
+/// `output_count` outputs, at most `PDF_FUNCTION_MAX_IO`, in `outputs`. This
+/// uses the tables built when the function was deserialized, so it doesn't
+/// allocate unless evaluating fails, and may be called from several threads
+/// at once.
+Error* pdf_eval_function(
+    const PdfFunction* function,
+    const double* inputs,
+    double* outputs
+);
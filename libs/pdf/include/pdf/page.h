@@ -272,3 +272,13 @@ Error* pdf_page_iter_new(
 );
 
 Error* pdf_page_iter_next(PdfPageIter* iter, PdfPage* out_page, bool* done);
+
+/// Returns the number of pages in the document, from the root of its page
+/// tree.
+Error* pdf_get_page_count(PdfResolver* resolver, size_t* page_count);
+
+/// Looks up a page by its index in the document, filling in the attributes
+/// it inherits from the page tree. The page tree is indexed as it's walked,
+/// using each node's `Count` to descend straight to the page, so only the
+/// nodes on the way to the page and their immediate kids are read.
+Error* pdf_get_page(PdfResolver* resolver, size_t page_idx, PdfPage* page);
@@ -20,6 +20,13 @@ Error* pdf_resolver_new(
     PdfResolver** resolver
 );
 
+/// Creates a resolver for the same document as `resolver`, with its own
+/// cursor and allocating from `arena`. Resolvers sharing a document may be
+/// used on different threads at once, though each one only from a single
+/// thread at a time. Resolved objects are cached for the whole document, so
+/// `arena` must outlive every resolver sharing it.
+PdfResolver* pdf_resolver_fork(Arena* arena, PdfResolver* resolver);
+
 Arena* pdf_resolver_arena(PdfResolver* resolver);
 Error*
 pdf_resolve_ref(PdfResolver* resolver, PdfIndirectRef ref, PdfObject* resolved);
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
+
 #include "err/error.h"
 #include "pdf/color_space.h"
 #include "pdf/deserde.h"
@@ -8,6 +11,28 @@
 #include "pdf/resolver.h"
 #include "pdf/types.h"
 
+/// Function-based shadings
+typedef struct {
+    /// (Optional) An array of four numbers [ xmin xmax ymin ymax ] specifying
+    /// the rectangular domain of coordinates over which the colour function(s)
+    /// are defined. Default value: [ 0.0 1.0 0.0 1.0 ].
+    PdfNumber domain[4];
+
+    /// (Optional) An array of six numbers specifying a transformation matrix
+    /// mapping the coordinate space specified by the Domain entry into the
+    /// shading’s target coordinate space. Default value: the identity matrix
+    /// [ 1 0 0 1 0 0 ].
+    PdfGeomPdfMatOptional matrix;
+
+    /// (Required) A 2-in, n-out function or an array of n 2-in, 1-out
+    /// functions (where n is the number of colour components in the shading
+    /// dictionary’s colour space). Each function’s domain shall be a superset
+    /// of that of the shading dictionary. If the value returned by the
+    /// function for a given colour component is out of range, it shall be
+    /// adjusted to the nearest valid value.
+    PdfFunctionVec* function;
+} PdfShadingDictType1;
+
 /// Axial shadings
 typedef struct {
     /// (Required) An array of four numbers [ x0 y0 x1 y1 ] specifying the
@@ -69,9 +94,49 @@ typedef struct {
     PdfBoolean extend[2];
 } PdfShadingDictType3;
 
+/// Free-form (type 4) and lattice-form (type 5) Gouraud-shaded triangle
+/// meshes, and Coons (type 6) and tensor-product (type 7) patch meshes, whose
+/// vertices are packed into the shading's stream.
+typedef struct {
+    /// (Required) The number of bits used to represent each vertex coordinate.
+    /// The value shall be 1, 2, 4, 8, 12, 16, 24, or 32.
+    PdfInteger bits_per_coordinate;
+
+    /// (Required) The number of bits used to represent each colour component.
+    /// The value shall be 1, 2, 4, 8, 12, or 16.
+    PdfInteger bits_per_component;
+
+    /// (Required for types 4, 6 and 7, absent for type 5) The number of bits
+    /// used to represent the edge flag for each vertex or patch. The value
+    /// shall be 2, 4, or 8, but only the least significant 2 bits in each
+    /// flag value shall be used.
+    PdfIntegerOptional bits_per_flag;
+
+    /// (Required for type 5, absent otherwise) The number of vertices in each
+    /// row of the lattice. The value shall be greater than or equal to 2.
+    PdfIntegerOptional vertices_per_row;
+
+    /// (Required) An array of numbers specifying how to map vertex coordinates
+    /// and colour components into the appropriate ranges of values, as
+    /// [ xmin xmax ymin ymax c1,min c1,max … cn,min cn,max ].
+    PdfNumberVec* decode;
+
+    /// (Optional) A 1-in, n-out function or an array of n 1-in, 1-out
+    /// functions. If this entry is present, the colour data for each vertex
+    /// shall be specified by a single parametric variable rather than by n
+    /// separate colour components.
+    PdfFunctionVecOptional function;
+
+    /// The decoded bytes of the shading's stream.
+    const uint8_t* stream_bytes;
+    size_t stream_len;
+} PdfShadingDictMesh;
+
 typedef union {
+    PdfShadingDictType1 type1;
     PdfShadingDictType2 type2;
     PdfShadingDictType3 type3;
+    PdfShadingDictMesh mesh;
 } PdfShadingDictData;
 
 typedef struct {
@@ -111,7 +176,7 @@ typedef struct {
     /// prevent aliasing artifacts.
     PdfBooleanOptional anti_alias;
 
-    /// Type specific data
+    /// Type specific data. Types 4 to 7 share `mesh`.
     PdfShadingDictData data;
 } PdfShadingDict;
 
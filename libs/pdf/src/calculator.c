@@ -0,0 +1,1489 @@
+#include "calculator.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "arena/arena.h"
+#include "err/error.h"
+#include "logger/log.h"
+#include "postscript/tokenizer.h"
+
+/// Operands live in the registers, followed by a scratch register for
+/// shuffling them. Instructions refer to the program's constants by indices
+/// past the registers, so they read constants without loading them first.
+#define CALCULATOR_SCRATCH_REGISTER PDF_CALCULATOR_MAX_STACK
+#define CALCULATOR_REGISTER_COUNT (CALCULATOR_SCRATCH_REGISTER + 1)
+#define CALCULATOR_FIRST_CONSTANT CALCULATOR_REGISTER_COUNT
+
+typedef enum {
+    CALCULATOR_OP_MOVE,
+    CALCULATOR_OP_JUMP,
+    CALCULATOR_OP_JUMP_IF_FALSE,
+
+    CALCULATOR_OP_ABS,
+    CALCULATOR_OP_CEILING,
+    CALCULATOR_OP_COS,
+    CALCULATOR_OP_CVI,
+    CALCULATOR_OP_FLOOR,
+    CALCULATOR_OP_LN,
+    CALCULATOR_OP_LOG,
+    CALCULATOR_OP_NEG,
+    CALCULATOR_OP_NOT_BOOLEAN,
+    CALCULATOR_OP_NOT_INTEGER,
+    CALCULATOR_OP_ROUND,
+    CALCULATOR_OP_SIN,
+    CALCULATOR_OP_SQRT,
+    CALCULATOR_OP_TRUNCATE,
+
+    CALCULATOR_OP_ADD,
+    CALCULATOR_OP_AND,
+    CALCULATOR_OP_ATAN,
+    CALCULATOR_OP_BITSHIFT,
+    CALCULATOR_OP_DIV,
+    CALCULATOR_OP_EQ,
+    CALCULATOR_OP_EXP,
+    CALCULATOR_OP_GE,
+    CALCULATOR_OP_GT,
+    CALCULATOR_OP_IDIV,
+    CALCULATOR_OP_LE,
+    CALCULATOR_OP_LT,
+    CALCULATOR_OP_MOD,
+    CALCULATOR_OP_MUL,
+    CALCULATOR_OP_NE,
+    CALCULATOR_OP_OR,
+    CALCULATOR_OP_SUB,
+    CALCULATOR_OP_XOR
+} CalculatorOpcode;
+
+/// Writes the register `dst` from `lhs` and `rhs`, which are registers or
+/// constants. Jumps continue from the instruction at `operand`.
+typedef struct {
+    uint8_t opcode;
+    uint8_t dst;
+    uint32_t lhs;
+    uint32_t rhs;
+    uint32_t operand;
+} CalculatorInstr;
+
+#define DVEC_NAME CalculatorInstrVec
+#define DVEC_LOWERCASE_NAME calculator_instr_vec
+#define DVEC_TYPE CalculatorInstr
+#include "arena/dvec_impl.h"
+
+#define DVEC_NAME CalculatorConstantVec
+#define DVEC_LOWERCASE_NAME calculator_constant_vec
+#define DVEC_TYPE double
+#include "arena/dvec_impl.h"
+
+#define DVEC_NAME CalculatorTokenVec
+#define DVEC_LOWERCASE_NAME calculator_token_vec
+#define DVEC_TYPE PSToken
+#include "arena/dvec_impl.h"
+
+struct PdfCalculator {
+    const CalculatorInstr* code;
+    size_t code_len;
+
+    const double* constants;
+    size_t constant_count;
+
+    size_t input_count;
+    const PdfCalculatorType* output_types;
+    const uint32_t* output_regs;
+    size_t output_count;
+};
+
+static int32_t calculator_int(double value) {
+    return (int32_t)fmax(fmin(trunc(value), (double)INT32_MAX), INT32_MIN);
+}
+
+static Error* calculator_apply(
+    CalculatorOpcode opcode,
+    double lhs,
+    double rhs,
+    double* out
+) {
+    switch (opcode) {
+        case CALCULATOR_OP_ABS: {
+            *out = fabs(lhs);
+            return NULL;
+        }
+        case CALCULATOR_OP_CEILING: {
+            *out = ceil(lhs);
+            return NULL;
+        }
+        case CALCULATOR_OP_COS: {
+            *out = cos(lhs * M_PI / 180.0);
+            return NULL;
+        }
+        case CALCULATOR_OP_CVI: {
+            *out = calculator_int(lhs);
+            return NULL;
+        }
+        case CALCULATOR_OP_FLOOR: {
+            *out = floor(lhs);
+            return NULL;
+        }
+        case CALCULATOR_OP_LN:
+        case CALCULATOR_OP_LOG: {
+            if (lhs <= 0.0) {
+                return ERROR(
+                    PS_ERR_UNDEFINED_RESULT,
+                    "Logarithm of %f",
+                    lhs
+                );
+            }
+            *out = opcode == CALCULATOR_OP_LN ? log(lhs) : log10(lhs);
+            return NULL;
+        }
+        case CALCULATOR_OP_NEG: {
+            *out = -lhs;
+            return NULL;
+        }
+        case CALCULATOR_OP_NOT_BOOLEAN: {
+            *out = lhs == 0.0 ? 1.0 : 0.0;
+            return NULL;
+        }
+        case CALCULATOR_OP_NOT_INTEGER: {
+            *out = ~calculator_int(lhs);
+            return NULL;
+        }
+        case CALCULATOR_OP_ROUND: {
+            // Halves round up, rather than away from zero
+            *out = floor(lhs + 0.5);
+            return NULL;
+        }
+        case CALCULATOR_OP_SIN: {
+            *out = sin(lhs * M_PI / 180.0);
+            return NULL;
+        }
+        case CALCULATOR_OP_SQRT: {
+            if (lhs < 0.0) {
+                return ERROR(
+                    PS_ERR_UNDEFINED_RESULT,
+                    "Square root of %f",
+                    lhs
+                );
+            }
+            *out = sqrt(lhs);
+            return NULL;
+        }
+        case CALCULATOR_OP_TRUNCATE: {
+            *out = trunc(lhs);
+            return NULL;
+        }
+        case CALCULATOR_OP_ADD: {
+            *out = lhs + rhs;
+            return NULL;
+        }
+        case CALCULATOR_OP_AND: {
+            *out = calculator_int(lhs) & calculator_int(rhs);
+            return NULL;
+        }
+        case CALCULATOR_OP_ATAN: {
+            if (lhs == 0.0 && rhs == 0.0) {
+                return ERROR(PS_ERR_UNDEFINED_RESULT, "Angle of 0 / 0");
+            }
+            double angle = atan2(lhs, rhs) * 180.0 / M_PI;
+            *out = angle < 0.0 ? angle + 360.0 : angle;
+            return NULL;
+        }
+        case CALCULATOR_OP_BITSHIFT: {
+            uint32_t bits = (uint32_t)calculator_int(lhs);
+            int32_t shift = calculator_int(rhs);
+            if (shift >= 32 || shift <= -32) {
+                bits = 0;
+            } else if (shift >= 0) {
+                bits <<= shift;
+            } else {
+                bits >>= -shift;
+            }
+            *out = (int32_t)bits;
+            return NULL;
+        }
+        case CALCULATOR_OP_DIV: {
+            if (rhs == 0.0) {
+                return ERROR(PS_ERR_UNDEFINED_RESULT, "Division by zero");
+            }
+            *out = lhs / rhs;
+            return NULL;
+        }
+        case CALCULATOR_OP_EQ: {
+            *out = lhs == rhs ? 1.0 : 0.0;
+            return NULL;
+        }
+        case CALCULATOR_OP_EXP: {
+            *out = pow(lhs, rhs);
+            if (isnan(*out)) {
+                return ERROR(
+                    PS_ERR_UNDEFINED_RESULT,
+                    "%f raised to %f",
+                    lhs,
+                    rhs
+                );
+            }
+            return NULL;
+        }
+        case CALCULATOR_OP_GE: {
+            *out = lhs >= rhs ? 1.0 : 0.0;
+            return NULL;
+        }
+        case CALCULATOR_OP_GT: {
+            *out = lhs > rhs ? 1.0 : 0.0;
+            return NULL;
+        }
+        case CALCULATOR_OP_IDIV:
+        case CALCULATOR_OP_MOD: {
+            int64_t divisor = calculator_int(rhs);
+            if (divisor == 0) {
+                return ERROR(PS_ERR_UNDEFINED_RESULT, "Division by zero");
+            }
+            int64_t dividend = calculator_int(lhs);
+            *out = (double)(opcode == CALCULATOR_OP_IDIV ? dividend / divisor
+                                                          : dividend % divisor);
+            return NULL;
+        }
+        case CALCULATOR_OP_LE: {
+            *out = lhs <= rhs ? 1.0 : 0.0;
+            return NULL;
+        }
+        case CALCULATOR_OP_LT: {
+            *out = lhs < rhs ? 1.0 : 0.0;
+            return NULL;
+        }
+        case CALCULATOR_OP_MUL: {
+            *out = lhs * rhs;
+            return NULL;
+        }
+        case CALCULATOR_OP_NE: {
+            *out = lhs != rhs ? 1.0 : 0.0;
+            return NULL;
+        }
+        case CALCULATOR_OP_OR: {
+            *out = calculator_int(lhs) | calculator_int(rhs);
+            return NULL;
+        }
+        case CALCULATOR_OP_SUB: {
+            *out = lhs - rhs;
+            return NULL;
+        }
+        case CALCULATOR_OP_XOR: {
+            *out = calculator_int(lhs) ^ calculator_int(rhs);
+            return NULL;
+        }
+        case CALCULATOR_OP_MOVE:
+        case CALCULATOR_OP_JUMP:
+        case CALCULATOR_OP_JUMP_IF_FALSE: {
+            break;
+        }
+    }
+
+    LOG_PANIC("Unreachable");
+}
+
+typedef enum {
+    /// Integers give an integer, and other numbers give a real.
+    CALCULATOR_RULE_NUMERIC,
+
+    /// Numbers give a real.
+    CALCULATOR_RULE_REAL,
+
+    /// Numbers give an integer.
+    CALCULATOR_RULE_TO_INTEGER,
+
+    /// Integers give an integer.
+    CALCULATOR_RULE_INTEGER,
+
+    /// Numbers give a boolean.
+    CALCULATOR_RULE_COMPARE,
+
+    /// Numbers or booleans give a boolean.
+    CALCULATOR_RULE_EQUALITY,
+
+    /// Booleans give a boolean, and integers give an integer.
+    CALCULATOR_RULE_LOGICAL
+} CalculatorRule;
+
+typedef struct {
+    const char* name;
+    CalculatorOpcode opcode;
+    size_t arity;
+    CalculatorRule rule;
+} CalculatorOperator;
+
+static const CalculatorOperator calculator_operators[] = {
+    {"abs", CALCULATOR_OP_ABS, 1, CALCULATOR_RULE_NUMERIC},
+    {"add", CALCULATOR_OP_ADD, 2, CALCULATOR_RULE_NUMERIC},
+    {"and", CALCULATOR_OP_AND, 2, CALCULATOR_RULE_LOGICAL},
+    {"atan", CALCULATOR_OP_ATAN, 2, CALCULATOR_RULE_REAL},
+    {"bitshift", CALCULATOR_OP_BITSHIFT, 2, CALCULATOR_RULE_INTEGER},
+    {"ceiling", CALCULATOR_OP_CEILING, 1, CALCULATOR_RULE_NUMERIC},
+    {"cos", CALCULATOR_OP_COS, 1, CALCULATOR_RULE_REAL},
+    {"cvi", CALCULATOR_OP_CVI, 1, CALCULATOR_RULE_TO_INTEGER},
+    {"div", CALCULATOR_OP_DIV, 2, CALCULATOR_RULE_REAL},
+    {"eq", CALCULATOR_OP_EQ, 2, CALCULATOR_RULE_EQUALITY},
+    {"exp", CALCULATOR_OP_EXP, 2, CALCULATOR_RULE_REAL},
+    {"floor", CALCULATOR_OP_FLOOR, 1, CALCULATOR_RULE_NUMERIC},
+    {"ge", CALCULATOR_OP_GE, 2, CALCULATOR_RULE_COMPARE},
+    {"gt", CALCULATOR_OP_GT, 2, CALCULATOR_RULE_COMPARE},
+    {"idiv", CALCULATOR_OP_IDIV, 2, CALCULATOR_RULE_INTEGER},
+    {"le", CALCULATOR_OP_LE, 2, CALCULATOR_RULE_COMPARE},
+    {"ln", CALCULATOR_OP_LN, 1, CALCULATOR_RULE_REAL},
+    {"log", CALCULATOR_OP_LOG, 1, CALCULATOR_RULE_REAL},
+    {"lt", CALCULATOR_OP_LT, 2, CALCULATOR_RULE_COMPARE},
+    {"mod", CALCULATOR_OP_MOD, 2, CALCULATOR_RULE_INTEGER},
+    {"mul", CALCULATOR_OP_MUL, 2, CALCULATOR_RULE_NUMERIC},
+    {"ne", CALCULATOR_OP_NE, 2, CALCULATOR_RULE_EQUALITY},
+    {"neg", CALCULATOR_OP_NEG, 1, CALCULATOR_RULE_NUMERIC},
+    {"not", CALCULATOR_OP_NOT_BOOLEAN, 1, CALCULATOR_RULE_LOGICAL},
+    {"or", CALCULATOR_OP_OR, 2, CALCULATOR_RULE_LOGICAL},
+    {"round", CALCULATOR_OP_ROUND, 1, CALCULATOR_RULE_NUMERIC},
+    {"sin", CALCULATOR_OP_SIN, 1, CALCULATOR_RULE_REAL},
+    {"sqrt", CALCULATOR_OP_SQRT, 1, CALCULATOR_RULE_REAL},
+    {"sub", CALCULATOR_OP_SUB, 2, CALCULATOR_RULE_NUMERIC},
+    {"truncate", CALCULATOR_OP_TRUNCATE, 1, CALCULATOR_RULE_NUMERIC},
+    {"xor", CALCULATOR_OP_XOR, 2, CALCULATOR_RULE_LOGICAL}
+};
+
+/// An operand on the stack while compiling, and the register holding it.
+/// Several operands may share a register, so stack operators only rearrange
+/// these while compiling.
+typedef struct {
+    PdfCalculatorType type;
+    uint32_t reg;
+} CalculatorSlot;
+
+typedef struct {
+    CalculatorInstrVec* code;
+    CalculatorConstantVec* constants;
+
+    CalculatorSlot stack[PDF_CALCULATOR_MAX_STACK];
+    size_t depth;
+} CalculatorCompiler;
+
+static bool calculator_is_constant(CalculatorSlot slot) {
+    return slot.reg >= CALCULATOR_FIRST_CONSTANT;
+}
+
+static double
+calculator_constant(const CalculatorCompiler* compiler, CalculatorSlot slot) {
+    RELEASE_ASSERT(calculator_is_constant(slot));
+
+    double value;
+    RELEASE_ASSERT(calculator_constant_vec_get(
+        compiler->constants,
+        slot.reg - CALCULATOR_FIRST_CONSTANT,
+        &value
+    ));
+    return value;
+}
+
+static bool calculator_is_number(PdfCalculatorType type) {
+    return type != PDF_CALCULATOR_TYPE_BOOLEAN;
+}
+
+static size_t calculator_emit(
+    CalculatorCompiler* compiler,
+    CalculatorOpcode opcode,
+    size_t dst,
+    size_t lhs,
+    size_t rhs,
+    uint32_t operand
+) {
+    RELEASE_ASSERT(dst < CALCULATOR_REGISTER_COUNT);
+    RELEASE_ASSERT(lhs <= UINT32_MAX);
+    RELEASE_ASSERT(rhs <= UINT32_MAX);
+
+    calculator_instr_vec_push(
+        compiler->code,
+        (CalculatorInstr) {.opcode = (uint8_t)opcode,
+                           .dst = (uint8_t)dst,
+                           .lhs = (uint32_t)lhs,
+                           .rhs = (uint32_t)rhs,
+                           .operand = operand}
+    );
+
+    return calculator_instr_vec_len(compiler->code) - 1;
+}
+
+/// Points the jump at `idx` to the next instruction emitted.
+static void calculator_patch_jump(CalculatorCompiler* compiler, size_t idx) {
+    CalculatorInstr* instr = NULL;
+    RELEASE_ASSERT(calculator_instr_vec_get_ptr(compiler->code, idx, &instr));
+    instr->operand = (uint32_t)calculator_instr_vec_len(compiler->code);
+}
+
+static Error*
+calculator_push(CalculatorCompiler* compiler, CalculatorSlot slot) {
+    if (compiler->depth == PDF_CALCULATOR_MAX_STACK) {
+        return ERROR(PS_ERR_LIMITCHECK, "Calculator function stack overflow");
+    }
+
+    compiler->stack[compiler->depth++] = slot;
+    return NULL;
+}
+
+/// Finds a register no operand on the stack is held in. There are as many
+/// registers as operands the stack can hold, so one is free whenever the
+/// stack has room for another operand.
+static size_t calculator_free_register(const CalculatorCompiler* compiler) {
+    bool used[PDF_CALCULATOR_MAX_STACK] = {false};
+    for (size_t idx = 0; idx < compiler->depth; idx++) {
+        if (compiler->stack[idx].reg < PDF_CALCULATOR_MAX_STACK) {
+            used[compiler->stack[idx].reg] = true;
+        }
+    }
+
+    size_t reg = 0;
+    while (used[reg]) {
+        reg++;
+        RELEASE_ASSERT(reg < PDF_CALCULATOR_MAX_STACK);
+    }
+
+    return reg;
+}
+
+static Error* calculator_push_constant(
+    CalculatorCompiler* compiler,
+    PdfCalculatorType type,
+    double value
+) {
+    size_t constant_count = calculator_constant_vec_len(compiler->constants);
+    size_t idx = 0;
+    for (; idx < constant_count; idx++) {
+        double* constant = NULL;
+        RELEASE_ASSERT(
+            calculator_constant_vec_get_ptr(compiler->constants, idx, &constant)
+        );
+        if (memcmp(constant, &value, sizeof(double)) == 0) {
+            break;
+        }
+    }
+
+    if (idx == constant_count) {
+        if (idx > UINT32_MAX - CALCULATOR_FIRST_CONSTANT) {
+            return ERROR(
+                PS_ERR_LIMITCHECK,
+                "Calculator function has too many constants"
+            );
+        }
+        calculator_constant_vec_push(compiler->constants, value);
+    }
+
+    return calculator_push(
+        compiler,
+        (CalculatorSlot) {.type = type,
+                          .reg = (uint32_t)(CALCULATOR_FIRST_CONSTANT + idx)}
+    );
+}
+
+static Error*
+calculator_pop(CalculatorCompiler* compiler, CalculatorSlot* slot_out) {
+    if (compiler->depth == 0) {
+        return ERROR(PS_ERR_OPERANDS_EMPTY);
+    }
+
+    *slot_out = compiler->stack[--compiler->depth];
+    return NULL;
+}
+
+/// Pops the operand of `copy`, `index` or `roll`, which must be constant
+/// since operands are assigned registers while compiling.
+static Error*
+calculator_pop_count(CalculatorCompiler* compiler, int32_t* count_out) {
+    CalculatorSlot slot;
+    TRY(calculator_pop(compiler, &slot));
+
+    if (slot.type != PDF_CALCULATOR_TYPE_INTEGER
+        || !calculator_is_constant(slot)) {
+        return ERROR(
+            PS_ERR_OPERAND_TYPE,
+            "Stack operator counts must be constant integers"
+        );
+    }
+
+    *count_out = (int32_t)calculator_constant(compiler, slot);
+    return NULL;
+}
+
+/// Moves each operand into its register in `targets`, so both paths through a
+/// conditional leave operands in the same place. Moves are ordered so no
+/// register is overwritten while another operand still needs it, going
+/// through the scratch register to break cycles.
+static void calculator_materialize(
+    CalculatorCompiler* compiler,
+    const uint8_t* targets
+) {
+    size_t sources[PDF_CALCULATOR_MAX_STACK];
+    bool pending[PDF_CALCULATOR_MAX_STACK];
+    size_t pending_count = 0;
+    for (size_t idx = 0; idx < compiler->depth; idx++) {
+        sources[idx] = compiler->stack[idx].reg;
+        pending[idx] = sources[idx] != targets[idx];
+        pending_count += pending[idx];
+    }
+
+    while (pending_count != 0) {
+        bool progressed = false;
+        for (size_t idx = 0; idx < compiler->depth; idx++) {
+            if (!pending[idx]) {
+                continue;
+            }
+
+            bool is_needed = false;
+            for (size_t other = 0; other < compiler->depth; other++) {
+                is_needed |= pending[other] && sources[other] == targets[idx];
+            }
+            if (is_needed) {
+                continue;
+            }
+
+            calculator_emit(
+                compiler,
+                CALCULATOR_OP_MOVE,
+                targets[idx],
+                sources[idx],
+                0,
+                0
+            );
+            pending[idx] = false;
+            pending_count--;
+            progressed = true;
+        }
+
+        if (progressed) {
+            continue;
+        }
+
+        // Every remaining move overwrites a register another one reads, so
+        // they form cycles. One of the registers is set aside to break its
+        // cycle, which is finished before another is found.
+        size_t blocked = 0;
+        while (!pending[blocked]) {
+            blocked++;
+        }
+        calculator_emit(
+            compiler,
+            CALCULATOR_OP_MOVE,
+            CALCULATOR_SCRATCH_REGISTER,
+            targets[blocked],
+            0,
+            0
+        );
+        for (size_t idx = 0; idx < compiler->depth; idx++) {
+            RELEASE_ASSERT(
+                !pending[idx] || sources[idx] != CALCULATOR_SCRATCH_REGISTER
+            );
+            if (pending[idx] && sources[idx] == targets[blocked]) {
+                sources[idx] = CALCULATOR_SCRATCH_REGISTER;
+            }
+        }
+    }
+
+    for (size_t idx = 0; idx < compiler->depth; idx++) {
+        compiler->stack[idx].reg = targets[idx];
+    }
+}
+
+/// Picks distinct registers for the operands from `first` on, keeping
+/// operands in place where they're the only one in a register. `avoid` is
+/// left for an operand that mustn't be overwritten.
+static void calculator_layout(
+    const CalculatorCompiler* compiler,
+    size_t first,
+    size_t avoid,
+    uint8_t* targets
+) {
+    bool claimed[PDF_CALCULATOR_MAX_STACK + 1] = {false};
+    for (size_t idx = 0; idx < first; idx++) {
+        claimed[targets[idx]] = true;
+    }
+    if (avoid < PDF_CALCULATOR_MAX_STACK) {
+        claimed[avoid] = true;
+    }
+
+    bool placed[PDF_CALCULATOR_MAX_STACK] = {false};
+    for (size_t idx = first; idx < compiler->depth; idx++) {
+        size_t reg = compiler->stack[idx].reg;
+        if (reg < PDF_CALCULATOR_MAX_STACK && !claimed[reg]) {
+            targets[idx] = (uint8_t)reg;
+            claimed[reg] = true;
+            placed[idx] = true;
+        }
+    }
+
+    // Registers still held by operands are avoided, so moving into the new
+    // ones doesn't need ordering
+    bool used[PDF_CALCULATOR_MAX_STACK + 1] = {false};
+    memcpy(used, claimed, sizeof(used));
+    for (size_t idx = 0; idx < compiler->depth; idx++) {
+        if (compiler->stack[idx].reg < PDF_CALCULATOR_MAX_STACK) {
+            used[compiler->stack[idx].reg] = true;
+        }
+    }
+
+    size_t reg = 0;
+    for (size_t idx = first; idx < compiler->depth; idx++) {
+        if (placed[idx]) {
+            continue;
+        }
+        while (used[reg]) {
+            reg++;
+        }
+        RELEASE_ASSERT(reg < PDF_CALCULATOR_MAX_STACK);
+        targets[idx] = (uint8_t)reg;
+        used[reg] = true;
+    }
+}
+
+/// Pushes copies of the `count` operands starting at `first`.
+static Error*
+calculator_copy(CalculatorCompiler* compiler, size_t first, size_t count) {
+    for (size_t idx = 0; idx < count; idx++) {
+        TRY(calculator_push(compiler, compiler->stack[first + idx]));
+    }
+
+    return NULL;
+}
+
+static Error*
+calculator_roll(CalculatorCompiler* compiler, int32_t count, int32_t shift) {
+    if (count < 0) {
+        return ERROR(PS_ERR_OPERAND_TYPE, "Negative roll count");
+    }
+    if ((size_t)count > compiler->depth) {
+        return ERROR(PS_ERR_OPERANDS_EMPTY);
+    }
+    if (count == 0) {
+        return NULL;
+    }
+
+    size_t n = (size_t)count;
+    size_t j = (size_t)(((shift % count) + count) % count);
+    size_t base = compiler->depth - n;
+
+    CalculatorSlot rolled[PDF_CALCULATOR_MAX_STACK];
+    memcpy(rolled, &compiler->stack[base], n * sizeof(CalculatorSlot));
+    for (size_t idx = 0; idx < n; idx++) {
+        compiler->stack[base + idx] = rolled[(idx + n - j) % n];
+    }
+
+    return NULL;
+}
+
+static Error* calculator_result_type(
+    const CalculatorOperator* operator,
+    const CalculatorSlot* operands,
+    PdfCalculatorType* type_out
+) {
+    bool all_integers = true;
+    bool all_numbers = true;
+    bool all_booleans = true;
+    for (size_t idx = 0; idx < operator->arity; idx++) {
+        PdfCalculatorType type = operands[idx].type;
+        all_integers &= type == PDF_CALCULATOR_TYPE_INTEGER;
+        all_numbers &= calculator_is_number(type);
+        all_booleans &= type == PDF_CALCULATOR_TYPE_BOOLEAN;
+    }
+
+    bool valid = false;
+    switch (operator->rule) {
+        case CALCULATOR_RULE_NUMERIC: {
+            valid = all_numbers;
+            *type_out = all_integers ? PDF_CALCULATOR_TYPE_INTEGER
+                                     : PDF_CALCULATOR_TYPE_REAL;
+            break;
+        }
+        case CALCULATOR_RULE_REAL: {
+            valid = all_numbers;
+            *type_out = PDF_CALCULATOR_TYPE_REAL;
+            break;
+        }
+        case CALCULATOR_RULE_TO_INTEGER: {
+            valid = all_numbers;
+            *type_out = PDF_CALCULATOR_TYPE_INTEGER;
+            break;
+        }
+        case CALCULATOR_RULE_INTEGER: {
+            valid = all_integers;
+            *type_out = PDF_CALCULATOR_TYPE_INTEGER;
+            break;
+        }
+        case CALCULATOR_RULE_COMPARE: {
+            valid = all_numbers;
+            *type_out = PDF_CALCULATOR_TYPE_BOOLEAN;
+            break;
+        }
+        case CALCULATOR_RULE_EQUALITY: {
+            valid = all_numbers || all_booleans;
+            *type_out = PDF_CALCULATOR_TYPE_BOOLEAN;
+            break;
+        }
+        case CALCULATOR_RULE_LOGICAL: {
+            valid = all_integers || all_booleans;
+            *type_out = all_booleans ? PDF_CALCULATOR_TYPE_BOOLEAN
+                                     : PDF_CALCULATOR_TYPE_INTEGER;
+            break;
+        }
+    }
+
+    if (!valid) {
+        return ERROR(
+            PS_ERR_OPERAND_TYPE,
+            "Invalid operands for `%s`",
+            operator->name
+        );
+    }
+
+    return NULL;
+}
+
+static Error* calculator_compile_operator(
+    CalculatorCompiler* compiler,
+    const CalculatorOperator* operator
+) {
+    CalculatorSlot operands[2] = {0};
+    for (size_t idx = operator->arity; idx-- > 0;) {
+        TRY(calculator_pop(compiler, &operands[idx]));
+    }
+
+    PdfCalculatorType type;
+    TRY(calculator_result_type(operator, operands, &type));
+
+    CalculatorOpcode opcode = operator->opcode;
+    if (opcode == CALCULATOR_OP_NOT_BOOLEAN
+        && type == PDF_CALCULATOR_TYPE_INTEGER) {
+        opcode = CALCULATOR_OP_NOT_INTEGER;
+    }
+    if (opcode == CALCULATOR_OP_CVI
+        && operands[0].type == PDF_CALCULATOR_TYPE_INTEGER) {
+        return calculator_push(compiler, operands[0]);
+    }
+
+    bool all_constant = true;
+    for (size_t idx = 0; idx < operator->arity; idx++) {
+        all_constant &= calculator_is_constant(operands[idx]);
+    }
+
+    if (all_constant) {
+        double lhs = calculator_constant(compiler, operands[0]);
+        double rhs = operator->arity == 2
+                       ? calculator_constant(compiler, operands[1])
+                       : 0.0;
+
+        double value;
+        TRY(calculator_apply(opcode, lhs, rhs, &value));
+        return calculator_push_constant(compiler, type, value);
+    }
+
+    // Operands are read before the result is written, so the result may
+    // reuse one of their registers
+    size_t dst = calculator_free_register(compiler);
+    calculator_emit(compiler, opcode, dst, operands[0].reg, operands[1].reg, 0);
+    return calculator_push(
+        compiler,
+        (CalculatorSlot) {.type = type, .reg = (uint32_t)dst}
+    );
+}
+
+static Error*
+calculator_compile_name(CalculatorCompiler* compiler, const char* name) {
+    if (strcmp(name, "true") == 0 || strcmp(name, "false") == 0) {
+        return calculator_push_constant(
+            compiler,
+            PDF_CALCULATOR_TYPE_BOOLEAN,
+            strcmp(name, "true") == 0 ? 1.0 : 0.0
+        );
+    } else if (strcmp(name, "pop") == 0) {
+        CalculatorSlot popped;
+        return calculator_pop(compiler, &popped);
+    } else if (strcmp(name, "dup") == 0) {
+        if (compiler->depth == 0) {
+            return ERROR(PS_ERR_OPERANDS_EMPTY);
+        }
+        return calculator_copy(compiler, compiler->depth - 1, 1);
+    } else if (strcmp(name, "copy") == 0) {
+        int32_t count;
+        TRY(calculator_pop_count(compiler, &count));
+        if (count < 0 || (size_t)count > compiler->depth) {
+            return ERROR(PS_ERR_OPERANDS_EMPTY);
+        }
+        return calculator_copy(
+            compiler,
+            compiler->depth - (size_t)count,
+            (size_t)count
+        );
+    } else if (strcmp(name, "index") == 0) {
+        int32_t idx;
+        TRY(calculator_pop_count(compiler, &idx));
+        if (idx < 0 || (size_t)idx >= compiler->depth) {
+            return ERROR(PS_ERR_OPERANDS_EMPTY);
+        }
+        return calculator_copy(compiler, compiler->depth - 1 - (size_t)idx, 1);
+    } else if (strcmp(name, "exch") == 0) {
+        return calculator_roll(compiler, 2, 1);
+    } else if (strcmp(name, "roll") == 0) {
+        int32_t shift;
+        int32_t count;
+        TRY(calculator_pop_count(compiler, &shift));
+        TRY(calculator_pop_count(compiler, &count));
+        return calculator_roll(compiler, count, shift);
+    } else if (strcmp(name, "cvr") == 0) {
+        CalculatorSlot slot;
+        TRY(calculator_pop(compiler, &slot));
+        if (!calculator_is_number(slot.type)) {
+            return ERROR(PS_ERR_OPERAND_TYPE, "Invalid operand for `cvr`");
+        }
+        slot.type = PDF_CALCULATOR_TYPE_REAL;
+        return calculator_push(compiler, slot);
+    }
+
+    for (size_t idx = 0;
+         idx < sizeof(calculator_operators) / sizeof(CalculatorOperator);
+         idx++) {
+        if (strcmp(name, calculator_operators[idx].name) == 0) {
+            return calculator_compile_operator(
+                compiler,
+                &calculator_operators[idx]
+            );
+        }
+    }
+
+    return ERROR(
+        PDF_ERR_UNKNOWN_OPERATOR,
+        "Unknown calculator function operator `%s`",
+        name
+    );
+}
+
+/// Finds the `}` closing the procedure opened at `start`.
+static Error* calculator_proc_end(
+    const PSToken* tokens,
+    size_t start,
+    size_t end,
+    size_t* end_out
+) {
+    size_t nesting = 0;
+    for (size_t idx = start; idx < end; idx++) {
+        if (tokens[idx].type == PS_TOKEN_START_PROC) {
+            nesting++;
+        } else if (tokens[idx].type == PS_TOKEN_END_PROC && --nesting == 0) {
+            *end_out = idx;
+            return NULL;
+        }
+    }
+
+    return ERROR(PS_ERR_EOF, "Unterminated calculator function procedure");
+}
+
+static Error* calculator_compile_block(
+    CalculatorCompiler* compiler,
+    const PSToken* tokens,
+    size_t start,
+    size_t end
+);
+
+/// Merges the types of the operands left by one branch of a conditional with
+/// those left by the other.
+static Error* calculator_join(
+    CalculatorCompiler* compiler,
+    const CalculatorSlot* other,
+    size_t other_depth
+) {
+    if (compiler->depth != other_depth) {
+        return ERROR(
+            PS_ERR_OPERAND_TYPE,
+            "Branches of a conditional must leave the same number of operands"
+        );
+    }
+
+    for (size_t idx = 0; idx < compiler->depth; idx++) {
+        CalculatorSlot* slot = &compiler->stack[idx];
+        if (slot->type == other[idx].type) {
+            continue;
+        }
+        if (!calculator_is_number(slot->type)
+            || !calculator_is_number(other[idx].type)) {
+            return ERROR(
+                PS_ERR_OPERAND_TYPE,
+                "Branches of a conditional must leave operands of the same "
+                "types"
+            );
+        }
+        slot->type = PDF_CALCULATOR_TYPE_REAL;
+    }
+
+    return NULL;
+}
+
+/// Compiles `if`, or `ifelse` if `has_else` is set. Constant conditions only
+/// compile the branch taken.
+static Error* calculator_compile_conditional(
+    CalculatorCompiler* compiler,
+    const PSToken* tokens,
+    size_t then_start,
+    size_t then_end,
+    bool has_else,
+    size_t else_start,
+    size_t else_end
+) {
+    CalculatorSlot condition;
+    TRY(calculator_pop(compiler, &condition));
+    if (condition.type != PDF_CALCULATOR_TYPE_BOOLEAN) {
+        return ERROR(
+            PS_ERR_OPERAND_TYPE,
+            "Conditions of `if` and `ifelse` must be booleans"
+        );
+    }
+
+    if (calculator_is_constant(condition)) {
+        if (calculator_constant(compiler, condition) != 0.0) {
+            return calculator_compile_block(
+                compiler,
+                tokens,
+                then_start,
+                then_end
+            );
+        } else if (has_else) {
+            return calculator_compile_block(
+                compiler,
+                tokens,
+                else_start,
+                else_end
+            );
+        }
+        return NULL;
+    }
+
+    // Operands sharing a register or held in constants are given their own,
+    // so each branch can write them. The condition is kept until the jump.
+    uint8_t targets[PDF_CALCULATOR_MAX_STACK];
+    calculator_layout(compiler, 0, condition.reg, targets);
+    calculator_materialize(compiler, targets);
+
+    CalculatorSlot entry[PDF_CALCULATOR_MAX_STACK];
+    size_t entry_depth = compiler->depth;
+    memcpy(entry, compiler->stack, entry_depth * sizeof(CalculatorSlot));
+
+    size_t branch = calculator_emit(
+        compiler,
+        CALCULATOR_OP_JUMP_IF_FALSE,
+        0,
+        condition.reg,
+        0,
+        0
+    );
+    TRY(calculator_compile_block(compiler, tokens, then_start, then_end));
+
+    if (!has_else) {
+        TRY(calculator_join(compiler, entry, entry_depth));
+        calculator_materialize(compiler, targets);
+        calculator_patch_jump(compiler, branch);
+        return NULL;
+    }
+
+    // Operands pushed by the branches past the entry's depth are placed
+    // after the then branch, and the else branch follows it
+    size_t kept_depth =
+        compiler->depth < entry_depth ? compiler->depth : entry_depth;
+    calculator_layout(
+        compiler,
+        kept_depth,
+        CALCULATOR_SCRATCH_REGISTER,
+        targets
+    );
+    calculator_materialize(compiler, targets);
+
+    CalculatorSlot then_stack[PDF_CALCULATOR_MAX_STACK];
+    size_t then_depth = compiler->depth;
+    memcpy(then_stack, compiler->stack, then_depth * sizeof(CalculatorSlot));
+
+    size_t skip = calculator_emit(compiler, CALCULATOR_OP_JUMP, 0, 0, 0, 0);
+    calculator_patch_jump(compiler, branch);
+
+    memcpy(compiler->stack, entry, entry_depth * sizeof(CalculatorSlot));
+    compiler->depth = entry_depth;
+    TRY(calculator_compile_block(compiler, tokens, else_start, else_end));
+
+    TRY(calculator_join(compiler, then_stack, then_depth));
+    calculator_materialize(compiler, targets);
+    calculator_patch_jump(compiler, skip);
+    return NULL;
+}
+
+static Error* calculator_compile_block(
+    CalculatorCompiler* compiler,
+    const PSToken* tokens,
+    size_t start,
+    size_t end
+) {
+    for (size_t idx = start; idx < end; idx++) {
+        const PSToken* token = &tokens[idx];
+        switch (token->type) {
+            case PS_TOKEN_INTEGER: {
+                TRY(calculator_push_constant(
+                    compiler,
+                    PDF_CALCULATOR_TYPE_INTEGER,
+                    token->data.integer
+                ));
+                break;
+            }
+            case PS_TOKEN_REAL: {
+                TRY(calculator_push_constant(
+                    compiler,
+                    PDF_CALCULATOR_TYPE_REAL,
+                    token->data.real
+                ));
+                break;
+            }
+            case PS_TOKEN_EXE_NAME: {
+                TRY(calculator_compile_name(compiler, token->data.name));
+                break;
+            }
+            case PS_TOKEN_START_PROC: {
+                size_t then_end;
+                TRY(calculator_proc_end(tokens, idx, end, &then_end));
+
+                bool has_else = then_end + 1 < end
+                             && tokens[then_end + 1].type
+                                    == PS_TOKEN_START_PROC;
+                size_t else_end = then_end;
+                if (has_else) {
+                    TRY(calculator_proc_end(
+                        tokens,
+                        then_end + 1,
+                        end,
+                        &else_end
+                    ));
+                }
+
+                size_t operator_idx = else_end + 1;
+                const char* expected = has_else ? "ifelse" : "if";
+                if (operator_idx >= end
+                    || tokens[operator_idx].type != PS_TOKEN_EXE_NAME
+                    || strcmp(tokens[operator_idx].data.name, expected) != 0) {
+                    return ERROR(
+                        PS_ERR_OPERAND_TYPE,
+                        "Calculator function procedures must be followed by "
+                        "`%s`",
+                        expected
+                    );
+                }
+
+                TRY(calculator_compile_conditional(
+                    compiler,
+                    tokens,
+                    idx + 1,
+                    then_end,
+                    has_else,
+                    then_end + 2,
+                    else_end
+                ));
+                idx = operator_idx;
+                break;
+            }
+            default: {
+                return ERROR(
+                    PS_ERR_OPERAND_TYPE,
+                    "Unsupported token type %d in calculator function",
+                    (int)token->type
+                );
+            }
+        }
+    }
+
+    return NULL;
+}
+
+Error* pdf_calculator_compile(
+    Arena* arena,
+    const uint8_t* data,
+    size_t data_len,
+    size_t input_count,
+    PdfCalculator** calculator_out
+) {
+    RELEASE_ASSERT(arena);
+    RELEASE_ASSERT(data || data_len == 0);
+    RELEASE_ASSERT(calculator_out);
+
+    if (input_count > PDF_CALCULATOR_MAX_STACK) {
+        return ERROR(
+            PS_ERR_LIMITCHECK,
+            "Calculator function has too many inputs"
+        );
+    }
+
+    PSTokenizer* tokenizer = ps_tokenizer_new(arena, data, data_len);
+    CalculatorTokenVec* token_vec = calculator_token_vec_new(arena);
+    while (true) {
+        PSToken token;
+        bool got_token;
+        TRY(ps_next_token(tokenizer, &token, &got_token));
+        if (!got_token) {
+            break;
+        }
+        calculator_token_vec_push(token_vec, token);
+    }
+
+    size_t token_count = calculator_token_vec_len(token_vec);
+    PSToken* tokens = arena_alloc(arena, (token_count + 1) * sizeof(PSToken));
+    for (size_t idx = 0; idx < token_count; idx++) {
+        RELEASE_ASSERT(calculator_token_vec_get(token_vec, idx, &tokens[idx]));
+    }
+
+    size_t program_end = 0;
+    if (token_count == 0 || tokens[0].type != PS_TOKEN_START_PROC) {
+        return ERROR(
+            PS_ERR_OPERAND_TYPE,
+            "Calculator functions must be a procedure"
+        );
+    }
+    TRY(calculator_proc_end(tokens, 0, token_count, &program_end));
+    if (program_end + 1 != token_count) {
+        return ERROR(
+            PS_ERR_OPERAND_TYPE,
+            "Unexpected tokens after calculator function"
+        );
+    }
+
+    CalculatorCompiler compiler = {
+        .code = calculator_instr_vec_new(arena),
+        .constants = calculator_constant_vec_new(arena),
+        .depth = 0
+    };
+    for (size_t idx = 0; idx < input_count; idx++) {
+        TRY(calculator_push(
+            &compiler,
+            (CalculatorSlot) {.type = PDF_CALCULATOR_TYPE_REAL,
+                              .reg = (uint32_t)idx}
+        ));
+    }
+
+    TRY(calculator_compile_block(&compiler, tokens, 1, program_end));
+
+    PdfCalculator* calculator = arena_alloc(arena, sizeof(PdfCalculator));
+    calculator->code_len = calculator_instr_vec_len(compiler.code);
+    CalculatorInstr* code = arena_alloc(
+        arena,
+        (calculator->code_len + 1) * sizeof(CalculatorInstr)
+    );
+    for (size_t idx = 0; idx < calculator->code_len; idx++) {
+        RELEASE_ASSERT(
+            calculator_instr_vec_get(compiler.code, idx, &code[idx])
+        );
+    }
+    calculator->code = code;
+
+    calculator->constant_count =
+        calculator_constant_vec_len(compiler.constants);
+    double* constants = arena_alloc(
+        arena,
+        (calculator->constant_count + 1) * sizeof(double)
+    );
+    for (size_t idx = 0; idx < calculator->constant_count; idx++) {
+        RELEASE_ASSERT(calculator_constant_vec_get(
+            compiler.constants,
+            idx,
+            &constants[idx]
+        ));
+    }
+    calculator->constants = constants;
+
+    calculator->input_count = input_count;
+    calculator->output_count = compiler.depth;
+    PdfCalculatorType* output_types =
+        arena_alloc(arena, (compiler.depth + 1) * sizeof(PdfCalculatorType));
+    uint32_t* output_regs =
+        arena_alloc(arena, (compiler.depth + 1) * sizeof(uint32_t));
+    for (size_t idx = 0; idx < compiler.depth; idx++) {
+        output_types[idx] = compiler.stack[idx].type;
+        output_regs[idx] = compiler.stack[idx].reg;
+    }
+    calculator->output_types = output_types;
+    calculator->output_regs = output_regs;
+
+    LOG_DIAG(
+        DEBUG,
+        PS,
+        "Compiled calculator function to %zu instructions and %zu constants",
+        calculator->code_len,
+        calculator->constant_count
+    );
+
+    *calculator_out = calculator;
+    return NULL;
+}
+
+size_t pdf_calculator_input_count(const PdfCalculator* calculator) {
+    RELEASE_ASSERT(calculator);
+    return calculator->input_count;
+}
+
+size_t pdf_calculator_output_count(const PdfCalculator* calculator) {
+    RELEASE_ASSERT(calculator);
+    return calculator->output_count;
+}
+
+PdfCalculatorType
+pdf_calculator_output_type(const PdfCalculator* calculator, size_t idx) {
+    RELEASE_ASSERT(calculator);
+    RELEASE_ASSERT(idx < calculator->output_count);
+    return calculator->output_types[idx];
+}
+
+/// Reads `src`, which is either a register or a constant.
+static double calculator_read(
+    const PdfCalculator* calculator,
+    const double* registers,
+    uint32_t src
+) {
+    return src < CALCULATOR_FIRST_CONSTANT
+             ? registers[src]
+             : calculator->constants[src - CALCULATOR_FIRST_CONSTANT];
+}
+
+Error* pdf_calculator_eval(
+    const PdfCalculator* calculator,
+    const double* inputs,
+    double* outputs
+) {
+    RELEASE_ASSERT(calculator);
+    RELEASE_ASSERT(inputs || calculator->input_count == 0);
+    RELEASE_ASSERT(outputs || calculator->output_count == 0);
+
+    double registers[CALCULATOR_REGISTER_COUNT];
+    memcpy(registers, inputs, calculator->input_count * sizeof(double));
+
+    size_t pc = 0;
+    while (pc < calculator->code_len) {
+        const CalculatorInstr* instr = &calculator->code[pc++];
+        switch ((CalculatorOpcode)instr->opcode) {
+            case CALCULATOR_OP_MOVE: {
+                registers[instr->dst] =
+                    calculator_read(calculator, registers, instr->lhs);
+                break;
+            }
+            case CALCULATOR_OP_JUMP: {
+                pc = instr->operand;
+                break;
+            }
+            case CALCULATOR_OP_JUMP_IF_FALSE: {
+                if (calculator_read(calculator, registers, instr->lhs)
+                    == 0.0) {
+                    pc = instr->operand;
+                }
+                break;
+            }
+            default: {
+                TRY(calculator_apply(
+                    (CalculatorOpcode)instr->opcode,
+                    calculator_read(calculator, registers, instr->lhs),
+                    calculator_read(calculator, registers, instr->rhs),
+                    &registers[instr->dst]
+                ));
+                break;
+            }
+        }
+    }
+
+    for (size_t idx = 0; idx < calculator->output_count; idx++) {
+        outputs[idx] = calculator_read(
+            calculator,
+            registers,
+            calculator->output_regs[idx]
+        );
+    }
+    return NULL;
+}
+
+#ifdef TEST
+
+#include "test/test.h"
+
+static Error* calculator_test_compile(
+    Arena* arena,
+    const char* program,
+    size_t input_count,
+    PdfCalculator** calculator_out
+) {
+    return pdf_calculator_compile(
+        arena,
+        (const uint8_t*)program,
+        strlen(program),
+        input_count,
+        calculator_out
+    );
+}
+
+TEST_FUNC(test_calculator_stack_operators) {
+    Arena* arena = arena_new(1024);
+
+    PdfCalculator* calculator;
+    TEST_REQUIRE(calculator_test_compile(
+        arena,
+        "{ 2 copy mul 3 1 roll exch sub 1 index 2 div }",
+        2,
+        &calculator
+    ));
+    TEST_ASSERT_EQ(pdf_calculator_output_count(calculator), (size_t)3);
+
+    double outputs[3];
+    TEST_REQUIRE(pdf_calculator_eval(calculator, (double[]) {3.0, 5.0}, outputs)
+    );
+    TEST_ASSERT_EQ(outputs[0], 15.0);
+    TEST_ASSERT_EQ(outputs[1], 2.0);
+    TEST_ASSERT_EQ(outputs[2], 7.5);
+
+    // Operands left out of place are moved back through the scratch register
+    TEST_REQUIRE(calculator_test_compile(
+        arena,
+        "{ 3 1 roll exch }",
+        3,
+        &calculator
+    ));
+    TEST_REQUIRE(
+        pdf_calculator_eval(calculator, (double[]) {1.0, 2.0, 3.0}, outputs)
+    );
+    TEST_ASSERT_EQ(outputs[0], 3.0);
+    TEST_ASSERT_EQ(outputs[1], 2.0);
+    TEST_ASSERT_EQ(outputs[2], 1.0);
+
+    arena_free(arena);
+    return TEST_RESULT_PASS;
+}
+
+TEST_FUNC(test_calculator_conditionals) {
+    Arena* arena = arena_new(1024);
+
+    PdfCalculator* calculator;
+    TEST_REQUIRE(calculator_test_compile(
+        arena,
+        "{ dup 0.5 gt { 1 sub } { 2 mul } ifelse dup 0 lt { neg } if }",
+        1,
+        &calculator
+    ));
+
+    double output;
+    TEST_REQUIRE(pdf_calculator_eval(calculator, (double[]) {0.25}, &output));
+    TEST_ASSERT_EQ(output, 0.5);
+    TEST_REQUIRE(pdf_calculator_eval(calculator, (double[]) {0.75}, &output));
+    TEST_ASSERT_EQ(output, 0.25);
+
+    // Constant branches leave the operand in a register either way
+    TEST_REQUIRE(calculator_test_compile(
+        arena,
+        "{ 0 gt { 1 } { 0 } ifelse }",
+        1,
+        &calculator
+    ));
+    TEST_ASSERT_EQ(
+        (int)pdf_calculator_output_type(calculator, 0),
+        (int)PDF_CALCULATOR_TYPE_INTEGER
+    );
+    TEST_REQUIRE(pdf_calculator_eval(calculator, (double[]) {-1.0}, &output));
+    TEST_ASSERT_EQ(output, 0.0);
+    TEST_REQUIRE(pdf_calculator_eval(calculator, (double[]) {2.0}, &output));
+    TEST_ASSERT_EQ(output, 1.0);
+
+    arena_free(arena);
+    return TEST_RESULT_PASS;
+}
+
+TEST_FUNC(test_calculator_constant_folding) {
+    Arena* arena = arena_new(1024);
+
+    PdfCalculator* calculator;
+    TEST_REQUIRE(calculator_test_compile(
+        arena,
+        "{ 2 3 add 4 mul 7 2 idiv true { sub } { add } ifelse mul }",
+        1,
+        &calculator
+    ));
+    TEST_ASSERT_EQ(calculator->code_len, (size_t)1);
+
+    double output;
+    TEST_REQUIRE(pdf_calculator_eval(calculator, (double[]) {0.5}, &output));
+    TEST_ASSERT_EQ(output, 8.5);
+
+    arena_free(arena);
+    return TEST_RESULT_PASS;
+}
+
+TEST_FUNC(test_calculator_many_constants) {
+    Arena* arena = arena_new(1024);
+
+    // Far more constants than registers, as in programs generated from
+    // lookup tables
+    char program[4096] = "{";
+    size_t len = 1;
+    for (int idx = 0; idx < 250; idx++) {
+        int written = snprintf(
+            program + len,
+            sizeof(program) - len,
+            " %d.5 add",
+            idx
+        );
+        TEST_ASSERT(written > 0 && (size_t)written < sizeof(program) - len);
+        len += (size_t)written;
+    }
+    snprintf(program + len, sizeof(program) - len, " 249.5 }");
+
+    PdfCalculator* calculator;
+    TEST_REQUIRE(calculator_test_compile(arena, program, 1, &calculator));
+    TEST_ASSERT_EQ(calculator->constant_count, (size_t)250);
+    TEST_ASSERT_EQ(pdf_calculator_output_count(calculator), (size_t)2);
+
+    double outputs[2];
+    TEST_REQUIRE(pdf_calculator_eval(calculator, (double[]) {1.0}, outputs));
+    TEST_ASSERT_EQ(outputs[0], 31251.0);
+    TEST_ASSERT_EQ(outputs[1], 249.5);
+
+    arena_free(arena);
+    return TEST_RESULT_PASS;
+}
+
+TEST_FUNC(test_calculator_operand_types) {
+    Arena* arena = arena_new(1024);
+
+    PdfCalculator* calculator;
+    TEST_REQUIRE(calculator_test_compile(
+        arena,
+        "{ cvi 3 and 1 bitshift 5 3 mod exch 2 1 eq not }",
+        1,
+        &calculator
+    ));
+    TEST_ASSERT_EQ(pdf_calculator_output_count(calculator), (size_t)3);
+    TEST_ASSERT_EQ(
+        (int)pdf_calculator_output_type(calculator, 2),
+        (int)PDF_CALCULATOR_TYPE_BOOLEAN
+    );
+
+    double outputs[3];
+    TEST_REQUIRE(pdf_calculator_eval(calculator, (double[]) {7.9}, outputs));
+    TEST_ASSERT_EQ(outputs[0], 2.0);
+    TEST_ASSERT_EQ(outputs[1], 6.0);
+    TEST_ASSERT_EQ(outputs[2], 1.0);
+
+    Error* error = calculator_test_compile(arena, "{ 2 idiv }", 1, &calculator);
+    TEST_ASSERT(error);
+    TEST_ASSERT_EQ((int)error_code(error), (int)PS_ERR_OPERAND_TYPE);
+    error_free(error);
+
+    error = calculator_test_compile(
+        arena,
+        "{ dup 0 gt { pop } if }",
+        1,
+        &calculator
+    );
+    TEST_ASSERT(error);
+    error_free(error);
+
+    arena_free(arena);
+    return TEST_RESULT_PASS;
+}
+
+#endif // TEST
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena/arena.h"
+#include "err/error.h"
+
+/// The most operands a PostScript calculator function may have on its stack
+/// at once.
+#define PDF_CALCULATOR_MAX_STACK 100
+
+typedef enum {
+    PDF_CALCULATOR_TYPE_BOOLEAN,
+    PDF_CALCULATOR_TYPE_INTEGER,
+    PDF_CALCULATOR_TYPE_REAL
+} PdfCalculatorType;
+
+/// A PostScript calculator program compiled to register bytecode. Calculator
+/// programs have no loops, so the register holding every operand is known
+/// while compiling, and stack operators like `exch` and `roll` compile to
+/// nothing. Evaluating the program needs no operand stack.
+typedef struct PdfCalculator PdfCalculator;
+
+/// Compiles the calculator program in `data`, which takes `input_count` real
+/// operands. Operations on constants are folded, and the types of the
+/// operands are checked, while compiling.
+Error* pdf_calculator_compile(
+    Arena* arena,
+    const uint8_t* data,
+    size_t data_len,
+    size_t input_count,
+    PdfCalculator** calculator_out
+);
+
+size_t pdf_calculator_input_count(const PdfCalculator* calculator);
+size_t pdf_calculator_output_count(const PdfCalculator* calculator);
+PdfCalculatorType
+pdf_calculator_output_type(const PdfCalculator* calculator, size_t idx);
+
+/// Runs the program on `inputs`, storing its results in `outputs`. Booleans
+/// are stored as 0 and 1. This doesn't allocate unless evaluating fails, and
+/// may be called from several threads at once.
+Error* pdf_calculator_eval(
+    const PdfCalculator* calculator,
+    const double* inputs,
+    double* outputs
+);
@@ -5,6 +5,7 @@
 #include <stdio.h>
 
 #include "arena/arena.h"
+#include "calculator.h"
 #include "ctx.h"
 #include "err/error.h"
 #include "logger/log.h"
@@ -14,9 +15,6 @@
 #include "pdf/resolver.h"
 #include "pdf/stream_dict.h"
 #include "pdf/types.h"
-#include "postscript/interpreter.h"
-#include "postscript/object.h"
-#include "postscript/tokenizer.h"
 #include "test_helpers.h"
 
 PDF_IMPL_FIELD(PdfFunction, function)
@@ -28,6 +26,220 @@ PDF_IMPL_FIELD(PdfFunction, function)
 
 PDF_IMPL_ARRAY_FIELD(PdfFunctionVec, function_vec, function)
 PDF_IMPL_AS_ARRAY_FIELD(PdfFunctionVec, function_vec, function)
+PDF_IMPL_OPTIONAL_FIELD(
+    PdfFunctionVec*,
+    PdfFunctionVecOptional,
+    as_function_vec
+)
+
+/// Converts an array of numbers into an array of reals.
+static double* function_reals(Arena* arena, const PdfNumberVec* numbers) {
+    size_t len = pdf_number_vec_len(numbers);
+    double* reals = arena_alloc(arena, (len + 1) * sizeof(double));
+    for (size_t idx = 0; idx < len; idx++) {
+        PdfNumber number;
+        RELEASE_ASSERT(pdf_number_vec_get(numbers, idx, &number));
+        reals[idx] = pdf_number_as_real(number);
+    }
+
+    return reals;
+}
+
+/// Converts an optional array of numbers into an array of reals, or an array
+/// of `len` copies of `default_value` if it's absent.
+static double* function_reals_or(
+    Arena* arena,
+    PdfNumberVecOptional numbers,
+    size_t len,
+    double default_value
+) {
+    if (numbers.is_some) {
+        return function_reals(arena, numbers.value);
+    }
+
+    double* reals = arena_alloc(arena, (len + 1) * sizeof(double));
+    for (size_t idx = 0; idx < len; idx++) {
+        reals[idx] = default_value;
+    }
+
+    return reals;
+}
+
+/// Reads the sample table of a type 0 function, mapping each sample through
+/// Decode.
+static Error* function_decode_samples(
+    Arena* arena,
+    const PdfObject* stream,
+    PdfFunction* function
+) {
+    PdfFunctionType0* sampled = &function->data.type0;
+    size_t output_count = function->output_count;
+
+    size_t sample_count = output_count;
+    for (size_t idx = 0; idx < function->input_count; idx++) {
+        if (sampled->sample_counts[idx] > SIZE_MAX / sample_count) {
+            return ERROR(
+                PDF_ERR_INCORRECT_TYPE,
+                "Type0 function sample table is too large"
+            );
+        }
+        sample_count *= sampled->sample_counts[idx];
+    }
+
+    size_t bits = (size_t)sampled->bits_per_sample;
+    size_t data_len = stream->data.stream.decoded_stream_len;
+    if (sample_count > data_len * 8 / bits) {
+        return ERROR(
+            PDF_ERR_INCORRECT_TYPE,
+            "Type0 function stream has %zu bytes, but its %zu samples need %zu",
+            data_len,
+            sample_count,
+            (sample_count * bits + 7) / 8
+        );
+    }
+
+    const double* decode = sampled->decode.is_some
+                             ? function_reals(arena, sampled->decode.value)
+                             : function->range_values;
+    const uint8_t* data = stream->data.stream.stream_bytes;
+    double max_sample = ldexp(1.0, (int)bits) - 1.0;
+
+    double* samples = arena_alloc(arena, sample_count * sizeof(double));
+    for (size_t idx = 0; idx < sample_count; idx++) {
+        uint64_t raw = 0;
+        for (size_t bit = idx * bits; bit < (idx + 1) * bits; bit++) {
+            raw = (raw << 1) | ((data[bit / 8] >> (7 - bit % 8)) & 1);
+        }
+
+        double min = decode[idx % output_count * 2];
+        double max = decode[idx % output_count * 2 + 1];
+        samples[idx] = min + (double)raw * (max - min) / max_sample;
+    }
+    sampled->samples = samples;
+
+    return NULL;
+}
+
+/// Validates a type 0 function's dictionary and builds its sample table.
+static Error* function_deserde_sampled(
+    const PdfObject* resolved,
+    PdfFunction* function,
+    PdfResolver* resolver
+) {
+    PdfFunctionType0* sampled = &function->data.type0;
+    PdfFieldDescriptor specific_fields[] = {
+        pdf_ignored_field("FunctionType", NULL),
+        pdf_ignored_field("Domain", NULL),
+        pdf_ignored_field("Range", NULL),
+        pdf_number_vec_field("Size", &sampled->size),
+        pdf_integer_field("BitsPerSample", &sampled->bits_per_sample),
+        pdf_integer_optional_field("Order", &sampled->order),
+        pdf_number_vec_optional_field("Encode", &sampled->encode),
+        pdf_number_vec_optional_field("Decode", &sampled->decode)
+    };
+
+    if (resolved->type != PDF_OBJECT_TYPE_STREAM) {
+        return ERROR(
+            PDF_ERR_INCORRECT_TYPE,
+            "Type0 function must be a stream"
+        );
+    }
+
+    TRY(pdf_deserde_fields(
+        resolved->data.stream.stream_dict->raw_dict,
+        specific_fields,
+        sizeof(specific_fields) / sizeof(PdfFieldDescriptor),
+        true,
+        resolver,
+        "Type0 PdfFunction"
+    ));
+
+    if (!function->range.is_some) {
+        return ERROR(
+            PDF_ERR_INCORRECT_TYPE,
+            "Type0 function must have a Range"
+        );
+    }
+    function->output_count = pdf_number_vec_len(function->range.value) / 2;
+
+    switch (sampled->bits_per_sample) {
+        case 1:
+        case 2:
+        case 4:
+        case 8:
+        case 12:
+        case 16:
+        case 24:
+        case 32: {
+            break;
+        }
+        default: {
+            return ERROR(
+                PDF_ERR_INCORRECT_TYPE,
+                "Invalid Type0 function BitsPerSample %d",
+                (int)sampled->bits_per_sample
+            );
+        }
+    }
+
+    // Cubic spline interpolation isn't supported, so Order 3 tables are
+    // interpolated linearly
+    if (sampled->order.is_some && sampled->order.value != 1
+        && sampled->order.value != 3) {
+        return ERROR(
+            PDF_ERR_INCORRECT_TYPE,
+            "Invalid Type0 function Order %d",
+            (int)sampled->order.value
+        );
+    }
+
+    size_t input_count = function->input_count;
+    if (pdf_number_vec_len(sampled->size) != input_count
+        || (sampled->encode.is_some
+            && pdf_number_vec_len(sampled->encode.value) != 2 * input_count)
+        || (sampled->decode.is_some
+            && pdf_number_vec_len(sampled->decode.value)
+                   != 2 * function->output_count)) {
+        return ERROR(
+            PDF_ERR_INCORRECT_TYPE,
+            "Type0 function Size, Encode or Decode doesn't match its Domain "
+            "and Range"
+        );
+    }
+
+    Arena* arena = pdf_resolver_arena(resolver);
+    size_t* sample_counts = arena_alloc(arena, input_count * sizeof(size_t));
+    size_t* strides = arena_alloc(arena, input_count * sizeof(size_t));
+    double* encode = arena_alloc(arena, 2 * input_count * sizeof(double));
+    size_t stride = function->output_count;
+    for (size_t idx = 0; idx < input_count; idx++) {
+        PdfNumber size;
+        RELEASE_ASSERT(pdf_number_vec_get(sampled->size, idx, &size));
+        if (size.type != PDF_NUMBER_TYPE_INTEGER || size.value.integer < 1) {
+            return ERROR(
+                PDF_ERR_INCORRECT_TYPE,
+                "Type0 function Size must be positive integers"
+            );
+        }
+
+        sample_counts[idx] = (size_t)size.value.integer;
+        strides[idx] = stride;
+        stride *= sample_counts[idx];
+
+        encode[idx * 2] = 0.0;
+        encode[idx * 2 + 1] = (double)(sample_counts[idx] - 1);
+    }
+
+    if (sampled->encode.is_some) {
+        encode = function_reals(arena, sampled->encode.value);
+    }
+
+    sampled->sample_counts = sample_counts;
+    sampled->strides = strides;
+    sampled->encode_values = encode;
+
+    return function_decode_samples(arena, resolved, function);
+}
 
 Error* pdf_deserde_function(
     const PdfObject* object,
@@ -72,15 +284,49 @@ Error* pdf_deserde_function(
         );
     }
 
+    size_t domain_len = pdf_number_vec_len(target_ptr->domain);
+    if (domain_len == 0 || domain_len % 2 != 0
+        || (target_ptr->range.is_some
+            && pdf_number_vec_len(target_ptr->range.value) % 2 != 0)) {
+        return ERROR(
+            PDF_ERR_INCORRECT_TYPE,
+            "Function Domain and Range must be pairs of numbers"
+        );
+    }
+
+    if (domain_len / 2 > PDF_FUNCTION_MAX_IO
+        || (target_ptr->range.is_some
+            && pdf_number_vec_len(target_ptr->range.value) / 2
+                   > PDF_FUNCTION_MAX_IO)) {
+        return ERROR(
+            PDF_ERR_INCORRECT_TYPE,
+            "Functions may have at most %d inputs and outputs",
+            PDF_FUNCTION_MAX_IO
+        );
+    }
+
+    Arena* arena = pdf_resolver_arena(resolver);
+    target_ptr->input_count = domain_len / 2;
+    target_ptr->domain_values = function_reals(arena, target_ptr->domain);
+    target_ptr->range_values =
+        target_ptr->range.is_some
+            ? function_reals(arena, target_ptr->range.value)
+            : NULL;
+
     switch (target_ptr->function_type) {
+        case 0: {
+            TRY(function_deserde_sampled(&resolved, target_ptr, resolver));
+            break;
+        }
         case 2: {
+            PdfFunctionType2* exponential = &target_ptr->data.type2;
             PdfFieldDescriptor specific_fields[] = {
                 pdf_ignored_field("FunctionType", NULL),
                 pdf_ignored_field("Domain", NULL),
                 pdf_ignored_field("Range", NULL),
-                pdf_number_vec_optional_field("C0", &target_ptr->data.type2.c0),
-                pdf_number_vec_optional_field("C1", &target_ptr->data.type2.c1),
-                pdf_number_field("N", &target_ptr->data.type2.n)
+                pdf_number_vec_optional_field("C0", &exponential->c0),
+                pdf_number_vec_optional_field("C1", &exponential->c1),
+                pdf_number_field("N", &exponential->n)
             };
 
             TRY(pdf_deserde_fields(
@@ -91,19 +337,39 @@ Error* pdf_deserde_function(
                 resolver,
                 "Type3 PdfFunction"
             ));
+
+            if (target_ptr->input_count != 1) {
+                return ERROR(PDF_ERR_INCORRECT_TYPE);
+            }
+
+            size_t output_count = 1;
+            if (exponential->c0.is_some) {
+                output_count = pdf_number_vec_len(exponential->c0.value);
+            }
+            if (exponential->c1.is_some) {
+                size_t c1_len = pdf_number_vec_len(exponential->c1.value);
+                if (exponential->c0.is_some && c1_len != output_count) {
+                    return ERROR(PDF_ERR_INCORRECT_TYPE);
+                }
+                output_count = c1_len;
+            }
+            target_ptr->output_count = output_count;
+
+            exponential->c0_values =
+                function_reals_or(arena, exponential->c0, output_count, 0.0);
+            exponential->c1_values =
+                function_reals_or(arena, exponential->c1, output_count, 1.0);
             break;
         }
         case 3: {
+            PdfFunctionType3* stitching = &target_ptr->data.type3;
             PdfFieldDescriptor specific_fields[] = {
                 pdf_ignored_field("FunctionType", NULL),
                 pdf_ignored_field("Domain", NULL),
                 pdf_ignored_field("Range", NULL),
-                pdf_function_vec_field(
-                    "Functions",
-                    &target_ptr->data.type3.functions
-                ),
-                pdf_number_vec_field("Bounds", &target_ptr->data.type3.bounds),
-                pdf_number_vec_field("Encode", &target_ptr->data.type3.encode)
+                pdf_function_vec_field("Functions", &stitching->functions),
+                pdf_number_vec_field("Bounds", &stitching->bounds),
+                pdf_number_vec_field("Encode", &stitching->encode)
             };
 
             TRY(pdf_deserde_fields(
@@ -115,19 +381,46 @@ Error* pdf_deserde_function(
                 "Type3 PdfFunction"
             ));
 
-            size_t k = pdf_function_vec_len(target_ptr->data.type3.functions);
+            if (target_ptr->input_count != 1) {
+                return ERROR(PDF_ERR_INCORRECT_TYPE);
+            }
+
+            size_t k = pdf_function_vec_len(stitching->functions);
             if (k == 0) {
                 return ERROR(PDF_ERR_INCORRECT_TYPE);
             }
 
-            if (pdf_number_vec_len(target_ptr->data.type3.bounds) != k - 1) {
+            if (pdf_number_vec_len(stitching->bounds) != k - 1) {
                 return ERROR(PDF_ERR_INCORRECT_TYPE);
             }
 
-            if (pdf_number_vec_len(target_ptr->data.type3.encode) != 2 * k) {
+            if (pdf_number_vec_len(stitching->encode) != 2 * k) {
                 return ERROR(PDF_ERR_INCORRECT_TYPE);
             }
 
+            for (size_t idx = 0; idx < k; idx++) {
+                PdfFunction* function;
+                RELEASE_ASSERT(pdf_function_vec_get_ptr(
+                    stitching->functions,
+                    idx,
+                    &function
+                ));
+
+                if (idx == 0) {
+                    target_ptr->output_count = function->output_count;
+                }
+                if (function->input_count != 1
+                    || function->output_count != target_ptr->output_count) {
+                    return ERROR(
+                        PDF_ERR_INCORRECT_TYPE,
+                        "Type3 function's functions must have 1 input and "
+                        "the same number of outputs"
+                    );
+                }
+            }
+
+            stitching->bound_values = function_reals(arena, stitching->bounds);
+            stitching->encode_values = function_reals(arena, stitching->encode);
             break;
         }
         case 4: {
@@ -138,453 +431,286 @@ Error* pdf_deserde_function(
                 );
             }
 
-            PSInterpreter* interpreter =
-                ps_interpreter_new(pdf_resolver_arena(resolver));
-            PSTokenizer* tokenizer = ps_tokenizer_new(
-                pdf_resolver_arena(resolver),
+            TRY(pdf_calculator_compile(
+                arena,
                 resolved.data.stream.stream_bytes,
-                resolved.data.stream.decoded_stream_len
-            );
-
-            TRY(ps_interpret_token(
-                interpreter,
-                (PSToken) {.type = PS_TOKEN_LIT_NAME, .data.name = "func"}
+                resolved.data.stream.decoded_stream_len,
+                target_ptr->input_count,
+                &target_ptr->data.type4
             ));
-
-            TRY(ps_interpret_tokens(interpreter, tokenizer));
-
-            TRY(ps_interpret_token(
-                interpreter,
-                (PSToken) {.type = PS_TOKEN_EXE_NAME, .data.name = "def"}
-            ));
-
-            target_ptr->data.type4 = interpreter;
+            target_ptr->output_count =
+                pdf_calculator_output_count(target_ptr->data.type4);
             break;
         }
         default: {
-            LOG_TODO("Function type %d", target_ptr->function_type);
+            return ERROR(
+                PDF_ERR_INCORRECT_TYPE,
+                "Invalid function type %d",
+                (int)target_ptr->function_type
+            );
         }
     }
 
-    return NULL;
-}
-
-static Error*
-clip_num(PdfObject object, PdfNumber min, PdfNumber max, PdfObject* out) {
-    PdfNumber val;
-    switch (object.type) {
-        case PDF_OBJECT_TYPE_INTEGER: {
-            val.type = PDF_NUMBER_TYPE_INTEGER;
-            val.value.integer = object.data.integer;
-            break;
-        }
-        case PDF_OBJECT_TYPE_REAL: {
-            val.type = PDF_NUMBER_TYPE_REAL;
-            val.value.real = object.data.real;
-            break;
-        }
-        case PDF_OBJECT_TYPE_BOOLEAN: {
-            *out = object;
-            return NULL;
-        }
-        default: {
-            return ERROR(PDF_ERR_INCORRECT_TYPE);
-        }
+    if (target_ptr->output_count == 0) {
+        return ERROR(PDF_ERR_INCORRECT_TYPE, "Function has no outputs");
     }
 
-    switch (pdf_number_cmp(val, min)) {
-        case -1: {
-            *out = pdf_number_as_object(min);
-            return NULL;
-        }
-        case 0: {
-            *out = object;
-            break;
-        }
-        case 1: {
-            break;
-        }
-        default: {
-            LOG_PANIC("Unreachable");
-        }
+    if (target_ptr->output_count > PDF_FUNCTION_MAX_IO) {
+        return ERROR(
+            PDF_ERR_INCORRECT_TYPE,
+            "Function has %zu outputs, more than %d",
+            target_ptr->output_count,
+            PDF_FUNCTION_MAX_IO
+        );
     }
 
-    if (pdf_number_cmp(val, max) <= 0) {
-        *out = object;
-    } else {
-        *out = pdf_number_as_object(max);
+    if (target_ptr->range.is_some
+        && pdf_number_vec_len(target_ptr->range.value)
+               != 2 * target_ptr->output_count) {
+        return ERROR(
+            PDF_ERR_INCORRECT_TYPE,
+            "Function Range doesn't match its %zu outputs",
+            target_ptr->output_count
+        );
     }
 
     return NULL;
 }
 
-Error*
-pdf_run_function(const PdfFunction* function, Arena* arena, PdfObjectVec* io) {
-    RELEASE_ASSERT(function);
-    RELEASE_ASSERT(arena);
-    RELEASE_ASSERT(io);
-
-    switch (function->function_type) {
-        case 2: {
-            if (pdf_number_vec_len(function->domain) != 2) {
-                return ERROR(PDF_ERR_INCORRECT_TYPE);
-            }
-            if (pdf_object_vec_len(io) != 1) {
-                return ERROR(PDF_ERR_EXCESS_OPERAND);
-            }
-
-            PdfObject input_object;
-            RELEASE_ASSERT(pdf_object_vec_get(io, 0, &input_object));
-
-            PdfNumber domain_min;
-            PdfNumber domain_max;
-            RELEASE_ASSERT(
-                pdf_number_vec_get(function->domain, 0, &domain_min)
-            );
-            RELEASE_ASSERT(
-                pdf_number_vec_get(function->domain, 1, &domain_max)
-            );
+/// Clips `value` to [min, max]. NaN is clipped to `min`.
+static double function_clip(double value, double min, double max) {
+    if (value > max) {
+        return max;
+    }
+    if (value >= min) {
+        return value;
+    }
+    return min;
+}
 
-            PdfObject clipped_input;
-            TRY(clip_num(input_object, domain_min, domain_max, &clipped_input));
+/// Maps `x` from [x_min, x_max] onto [y_min, y_max].
+static double function_interpolate(
+    double x,
+    double x_min,
+    double x_max,
+    double y_min,
+    double y_max
+) {
+    if (x_max == x_min) {
+        return y_min;
+    }
+    return y_min + (x - x_min) * (y_max - y_min) / (x_max - x_min);
+}
 
-            PdfNumber x_num;
-            TRY(pdf_deserde_number(&clipped_input, &x_num, NULL));
-            PdfReal x = pdf_number_as_real(x_num);
+/// Interpolates a type 0 function's samples multilinearly. Only the corners
+/// of the containing cell along dimensions where the input lies strictly
+/// between two samples are visited.
+static void function_eval_sampled(
+    const PdfFunction* function,
+    const double* inputs,
+    double* outputs
+) {
+    const PdfFunctionType0* sampled = &function->data.type0;
+    size_t input_count = function->input_count;
+    size_t output_count = function->output_count;
+
+    size_t base = 0;
+    size_t active_count = 0;
+    size_t active_strides[PDF_FUNCTION_MAX_IO];
+    double active_fracs[PDF_FUNCTION_MAX_IO];
+    for (size_t idx = 0; idx < input_count; idx++) {
+        double x = function_clip(
+            inputs[idx],
+            function->domain_values[idx * 2],
+            function->domain_values[idx * 2 + 1]
+        );
+        double last = (double)(sampled->sample_counts[idx] - 1);
+        double position = function_clip(
+            function_interpolate(
+                x,
+                function->domain_values[idx * 2],
+                function->domain_values[idx * 2 + 1],
+                sampled->encode_values[idx * 2],
+                sampled->encode_values[idx * 2 + 1]
+            ),
+            0.0,
+            last
+        );
 
-            size_t output_size = 1;
-            if (function->data.type2.c0.is_some) {
-                output_size = pdf_number_vec_len(function->data.type2.c0.value);
-            }
-            if (function->data.type2.c1.is_some) {
-                size_t c1_size =
-                    pdf_number_vec_len(function->data.type2.c1.value);
-                if (function->data.type2.c0.is_some && c1_size != output_size) {
-                    return ERROR(PDF_ERR_INCORRECT_TYPE);
-                }
-                output_size = c1_size;
-            }
+        size_t cell = (size_t)position;
+        double frac = position - (double)cell;
+        base += cell * sampled->strides[idx];
+        if (frac > 0.0) {
+            active_strides[active_count] = sampled->strides[idx];
+            active_fracs[active_count] = frac;
+            active_count++;
+        }
+    }
 
-            if (output_size == 0) {
-                return ERROR(PDF_ERR_INCORRECT_TYPE);
-            }
+    for (size_t output_idx = 0; output_idx < output_count; output_idx++) {
+        outputs[output_idx] = 0.0;
+    }
 
-            if (function->range.is_some
-                && pdf_number_vec_len(function->range.value)
-                       != 2 * output_size) {
-                return ERROR(PDF_ERR_INCORRECT_TYPE);
+    for (size_t corner = 0; corner < ((size_t)1 << active_count); corner++) {
+        size_t offset = base;
+        double weight = 1.0;
+        for (size_t idx = 0; idx < active_count; idx++) {
+            if (corner & ((size_t)1 << idx)) {
+                offset += active_strides[idx];
+                weight *= active_fracs[idx];
+            } else {
+                weight *= 1.0 - active_fracs[idx];
             }
+        }
 
-            PdfReal n = pdf_number_as_real(function->data.type2.n);
-            PdfReal x_to_n = pow(x, n);
-
-            pdf_object_vec_clear(io);
-            for (size_t idx = 0; idx < output_size; idx++) {
-                PdfReal c0 = 0.0;
-                if (function->data.type2.c0.is_some) {
-                    PdfNumber c0_number;
-                    RELEASE_ASSERT(pdf_number_vec_get(
-                        function->data.type2.c0.value,
-                        idx,
-                        &c0_number
-                    ));
-                    c0 = pdf_number_as_real(c0_number);
-                }
-
-                PdfReal c1 = 1.0;
-                if (function->data.type2.c1.is_some) {
-                    PdfNumber c1_number;
-                    RELEASE_ASSERT(pdf_number_vec_get(
-                        function->data.type2.c1.value,
-                        idx,
-                        &c1_number
-                    ));
-                    c1 = pdf_number_as_real(c1_number);
-                }
+        for (size_t output_idx = 0; output_idx < output_count; output_idx++) {
+            outputs[output_idx] +=
+                weight * sampled->samples[offset + output_idx];
+        }
+    }
+}
 
-                PdfObject output = {
-                    .type = PDF_OBJECT_TYPE_REAL,
-                    .data.real = c0 + x_to_n * (c1 - c0)
-                };
-
-                if (function->range.is_some) {
-                    PdfNumber range_min;
-                    PdfNumber range_max;
-                    RELEASE_ASSERT(pdf_number_vec_get(
-                        function->range.value,
-                        2 * idx,
-                        &range_min
-                    ));
-                    RELEASE_ASSERT(pdf_number_vec_get(
-                        function->range.value,
-                        2 * idx + 1,
-                        &range_max
-                    ));
-
-                    PdfObject clipped_output;
-                    TRY(
-                        clip_num(output, range_min, range_max, &clipped_output)
-                    );
-                    output = clipped_output;
-                }
+Error* pdf_eval_function(
+    const PdfFunction* function,
+    const double* inputs,
+    double* outputs
+) {
+    RELEASE_ASSERT(function);
+    RELEASE_ASSERT(inputs);
+    RELEASE_ASSERT(outputs);
 
-                pdf_object_vec_push(io, output);
+    const double* domain = function->domain_values;
+    switch (function->function_type) {
+        case 0: {
+            function_eval_sampled(function, inputs, outputs);
+            break;
+        }
+        case 2: {
+            const PdfFunctionType2* exponential = &function->data.type2;
+            double x = function_clip(inputs[0], domain[0], domain[1]);
+            double n = pdf_number_as_real(exponential->n);
+            double x_to_n = n == 1.0 ? x : pow(x, n);
+
+            for (size_t idx = 0; idx < function->output_count; idx++) {
+                double c0 = exponential->c0_values[idx];
+                double c1 = exponential->c1_values[idx];
+                outputs[idx] = c0 + x_to_n * (c1 - c0);
             }
-
             break;
         }
         case 3: {
-            if (pdf_number_vec_len(function->domain) != 2) {
-                return ERROR(PDF_ERR_INCORRECT_TYPE);
-            }
-            if (pdf_object_vec_len(io) != 1) {
-                return ERROR(PDF_ERR_EXCESS_OPERAND);
-            }
-
-            size_t k = pdf_function_vec_len(function->data.type3.functions);
-            if (k == 0) {
-                return ERROR(PDF_ERR_INCORRECT_TYPE);
-            }
-            if (pdf_number_vec_len(function->data.type3.bounds) != k - 1) {
-                return ERROR(PDF_ERR_INCORRECT_TYPE);
-            }
-            if (pdf_number_vec_len(function->data.type3.encode) != 2 * k) {
-                return ERROR(PDF_ERR_INCORRECT_TYPE);
-            }
-
-            PdfObject input_object;
-            RELEASE_ASSERT(pdf_object_vec_get(io, 0, &input_object));
-
-            PdfNumber domain_min_num;
-            PdfNumber domain_max_num;
-            RELEASE_ASSERT(
-                pdf_number_vec_get(function->domain, 0, &domain_min_num)
-            );
-            RELEASE_ASSERT(
-                pdf_number_vec_get(function->domain, 1, &domain_max_num)
-            );
-
-            PdfObject clipped_input;
-            TRY(clip_num(
-                input_object,
-                domain_min_num,
-                domain_max_num,
-                &clipped_input
-            ));
-
-            PdfNumber x_num;
-            TRY(pdf_deserde_number(&clipped_input, &x_num, NULL));
-            PdfReal x = pdf_number_as_real(x_num);
-
-            PdfReal domain_min = pdf_number_as_real(domain_min_num);
-            PdfReal domain_max = pdf_number_as_real(domain_max_num);
-
-            size_t selected_idx = k - 1;
-            PdfReal selected_low = domain_min;
-            PdfReal selected_high = domain_max;
-            PdfReal low = domain_min;
-            for (size_t idx = 0; idx < k; idx++) {
-                PdfReal high = domain_max;
-                if (idx + 1 < k) {
-                    PdfNumber bound;
-                    RELEASE_ASSERT(pdf_number_vec_get(
-                        function->data.type3.bounds,
-                        idx,
-                        &bound
-                    ));
-                    high = pdf_number_as_real(bound);
-                }
-
-                bool in_interval = false;
-                if (idx + 1 == k) {
-                    in_interval = (x >= low - 1e-9) && (x <= high + 1e-9);
+            const PdfFunctionType3* stitching = &function->data.type3;
+            double x = function_clip(inputs[0], domain[0], domain[1]);
+
+            // Find the first function whose upper bound is above x
+            size_t k = pdf_function_vec_len(stitching->functions);
+            size_t low = 0;
+            size_t high = k - 1;
+            while (low < high) {
+                size_t mid = low + (high - low) / 2;
+                if (x < stitching->bound_values[mid]) {
+                    high = mid;
                 } else {
-                    in_interval = (x >= low - 1e-9) && (x < high);
+                    low = mid + 1;
                 }
-                if (in_interval) {
-                    selected_idx = idx;
-                    selected_low = low;
-                    selected_high = high;
-                    break;
-                }
-
-                low = high;
             }
 
-            PdfNumber encode_min_num;
-            PdfNumber encode_max_num;
-            RELEASE_ASSERT(pdf_number_vec_get(
-                function->data.type3.encode,
-                2 * selected_idx,
-                &encode_min_num
-            ));
-            RELEASE_ASSERT(pdf_number_vec_get(
-                function->data.type3.encode,
-                2 * selected_idx + 1,
-                &encode_max_num
-            ));
-
-            PdfReal encode_min = pdf_number_as_real(encode_min_num);
-            PdfReal encode_max = pdf_number_as_real(encode_max_num);
+            PdfFunction* selected;
+            RELEASE_ASSERT(
+                pdf_function_vec_get_ptr(stitching->functions, low, &selected)
+            );
 
-            PdfReal mapped_x = encode_min;
-            if (fabs(selected_high - selected_low) > 1e-9) {
-                mapped_x = encode_min
-                         + ((x - selected_low) * (encode_max - encode_min))
-                               / (selected_high - selected_low);
+            double mapped_x = function_interpolate(
+                x,
+                low == 0 ? domain[0] : stitching->bound_values[low - 1],
+                low == k - 1 ? domain[1] : stitching->bound_values[low],
+                stitching->encode_values[low * 2],
+                stitching->encode_values[low * 2 + 1]
+            );
+            TRY(pdf_eval_function(selected, &mapped_x, outputs));
+            break;
+        }
+        case 4: {
+            double clipped[PDF_FUNCTION_MAX_IO];
+            for (size_t idx = 0; idx < function->input_count; idx++) {
+                clipped[idx] = function_clip(
+                    inputs[idx],
+                    domain[idx * 2],
+                    domain[idx * 2 + 1]
+                );
             }
 
-            PdfFunction selected_function;
-            RELEASE_ASSERT(pdf_function_vec_get(
-                function->data.type3.functions,
-                selected_idx,
-                &selected_function
-            ));
+            TRY(pdf_calculator_eval(function->data.type4, clipped, outputs));
+            break;
+        }
+        default: {
+            LOG_PANIC("Unreachable");
+        }
+    }
 
-            pdf_object_vec_clear(io);
-            pdf_object_vec_push(
-                io,
-                (PdfObject) {.type = PDF_OBJECT_TYPE_REAL,
-                             .data.real = mapped_x}
+    if (function->range_values) {
+        for (size_t idx = 0; idx < function->output_count; idx++) {
+            outputs[idx] = function_clip(
+                outputs[idx],
+                function->range_values[idx * 2],
+                function->range_values[idx * 2 + 1]
             );
-            TRY(pdf_run_function(&selected_function, arena, io));
+        }
+    }
 
-            if (function->range.is_some) {
-                size_t output_len = pdf_object_vec_len(io);
-                if (output_len == 0) {
-                    return ERROR(PDF_ERR_INCORRECT_TYPE);
-                }
-                if (pdf_number_vec_len(function->range.value)
-                    != 2 * output_len) {
-                    return ERROR(PDF_ERR_INCORRECT_TYPE);
-                }
+    return NULL;
+}
 
-                PdfObject clipped_outputs[output_len];
-                for (size_t idx = 0; idx < output_len; idx++) {
-                    PdfObject output;
-                    RELEASE_ASSERT(pdf_object_vec_get(io, idx, &output));
-
-                    PdfNumber range_min;
-                    PdfNumber range_max;
-                    RELEASE_ASSERT(pdf_number_vec_get(
-                        function->range.value,
-                        2 * idx,
-                        &range_min
-                    ));
-                    RELEASE_ASSERT(pdf_number_vec_get(
-                        function->range.value,
-                        2 * idx + 1,
-                        &range_max
-                    ));
-
-                    TRY(clip_num(
-                        output,
-                        range_min,
-                        range_max,
-                        &clipped_outputs[idx]
-                    ));
-                }
+Error*
+pdf_run_function(const PdfFunction* function, Arena* arena, PdfObjectVec* io) {
+    RELEASE_ASSERT(function);
+    RELEASE_ASSERT(arena);
+    RELEASE_ASSERT(io);
 
-                pdf_object_vec_clear(io);
-                for (size_t idx = 0; idx < output_len; idx++) {
-                    pdf_object_vec_push(io, clipped_outputs[idx]);
-                }
-            }
+    if (pdf_object_vec_len(io) != function->input_count) {
+        return ERROR(PDF_ERR_EXCESS_OPERAND);
+    }
 
-            break;
-        }
-        case 4: {
-            for (size_t idx = 0; idx < pdf_object_vec_len(io); idx++) {
-                PdfObject pdf_operand;
-                RELEASE_ASSERT(pdf_object_vec_get(io, idx, &pdf_operand));
-
-                PdfObject clipped;
-                PdfNumber min;
-                PdfNumber max;
-                if (!pdf_number_vec_get(function->domain, 2 * idx, &min)
-                    || !pdf_number_vec_get(
-                        function->domain,
-                        2 * idx + 1,
-                        &max
-                    )) {
-                    return ERROR(PDF_ERR_EXCESS_OPERAND);
-                }
-                TRY(clip_num(pdf_operand, min, max, &clipped));
-
-                PSObject operand = {
-                    .literal = true,
-                    .access = PS_ACCESS_UNLIMITED
-                };
-                if (clipped.type == PDF_OBJECT_TYPE_INTEGER) {
-                    operand.type = PS_OBJECT_INTEGER;
-                    operand.data.integer = clipped.data.integer;
-                } else if (clipped.type == PDF_OBJECT_TYPE_REAL) {
-                    operand.type = PS_OBJECT_REAL;
-                    operand.data.real = clipped.data.real;
-                } else if (clipped.type == PDF_OBJECT_TYPE_BOOLEAN) {
-                    operand.type = PS_OBJECT_BOOLEAN;
-                    operand.data.boolean = clipped.data.boolean;
-                } else {
-                    return ERROR(PDF_ERR_INCORRECT_TYPE);
-                }
+    double inputs[PDF_FUNCTION_MAX_IO];
+    for (size_t idx = 0; idx < function->input_count; idx++) {
+        PdfObject operand;
+        RELEASE_ASSERT(pdf_object_vec_get(io, idx, &operand));
 
-                TRY(ps_interpret_object(function->data.type4, operand));
-            }
+        PdfNumber number;
+        TRY(pdf_deserde_number(&operand, &number, NULL));
+        inputs[idx] = pdf_number_as_real(number);
+    }
 
-            TRY(ps_interpret_token(
-                function->data.type4,
-                (PSToken) {.type = PS_TOKEN_EXE_NAME, .data.name = "func"}
-            ));
+    double outputs[PDF_FUNCTION_MAX_IO];
+    TRY(pdf_eval_function(function, inputs, outputs));
 
-            pdf_object_vec_clear(io);
-
-            PSObjectList* stack = ps_interpreter_stack(function->data.type4);
-            for (size_t idx = 0; idx < ps_object_list_len(stack); idx++) {
-                PSObject output;
-                RELEASE_ASSERT(ps_object_list_get(stack, idx, &output));
-
-                PdfObject converted;
-                if (output.type == PS_OBJECT_INTEGER) {
-                    converted.type = PDF_OBJECT_TYPE_INTEGER;
-                    converted.data.integer = output.data.integer;
-                } else if (output.type == PS_OBJECT_REAL) {
-                    converted.type = PDF_OBJECT_TYPE_REAL;
-                    converted.data.real = output.data.real;
-                } else if (output.type == PS_OBJECT_BOOLEAN) {
-                    converted.type = PDF_OBJECT_TYPE_BOOLEAN;
-                    converted.data.boolean = output.data.boolean;
-                } else {
-                    return ERROR(PS_ERR_OPERAND_TYPE);
+    pdf_object_vec_clear(io);
+    for (size_t idx = 0; idx < function->output_count; idx++) {
+        PdfObject output = {
+            .type = PDF_OBJECT_TYPE_REAL,
+            .data.real = outputs[idx]
+        };
+
+        // Calculator functions may also return integers and booleans
+        if (function->function_type == 4) {
+            switch (pdf_calculator_output_type(function->data.type4, idx)) {
+                case PDF_CALCULATOR_TYPE_BOOLEAN: {
+                    output.type = PDF_OBJECT_TYPE_BOOLEAN;
+                    output.data.boolean = outputs[idx] != 0.0;
+                    break;
                 }
-
-                if (function->range.is_some) {
-                    PdfNumber min, max;
-                    if (!pdf_number_vec_get(
-                            function->range.value,
-                            2 * idx,
-                            &min
-                        )
-                        || !pdf_number_vec_get(
-                            function->range.value,
-                            2 * idx + 1,
-                            &max
-                        )) {
-                        return ERROR(PDF_ERR_EXCESS_OPERAND);
-                    }
-
-                    PdfObject clipped;
-                    TRY(clip_num(converted, min, max, &clipped));
-                    pdf_object_vec_push(io, clipped);
-                } else {
-                    pdf_object_vec_push(io, converted);
+                case PDF_CALCULATOR_TYPE_INTEGER: {
+                    output.type = PDF_OBJECT_TYPE_INTEGER;
+                    output.data.integer = (PdfInteger)outputs[idx];
+                    break;
+                }
+                case PDF_CALCULATOR_TYPE_REAL: {
+                    break;
                 }
             }
-
-            break;
-        }
-        default: {
-            LOG_TODO("Function type %d", function->function_type);
         }
+
+        pdf_object_vec_push(io, output);
     }
 
     return NULL;
@@ -687,6 +813,105 @@ TEST_FUNC(test_pdf_function_type3) {
     return TEST_RESULT_PASS;
 }
 
+TEST_FUNC(test_pdf_function_type0) {
+    Arena* arena = arena_new(256);
+    uint8_t buffer[] = "10 0 obj\n"
+                       "<< /FunctionType 0\n"
+                       "/Domain [0.0 1.0 0.0 1.0]\n"
+                       "/Range [0.0 1.0]\n"
+                       "/Size [2 2]\n"
+                       "/BitsPerSample 8\n"
+                       "/Length 4\n"
+                       ">>\n stream\n"
+                       "\x00\xff\xff\x00\n"
+                       "endstream\n endobj";
+    PdfCtx* ctx =
+        pdf_ctx_new(arena, buffer, sizeof(buffer) / sizeof(uint8_t) - 1);
+    PdfResolver* resolver = pdf_fake_resolver_new(arena, ctx);
+
+    PdfObject object;
+    TEST_REQUIRE(pdf_parse_object(resolver, &object, false));
+
+    PdfFunction func;
+    TEST_REQUIRE(pdf_deserde_function(&object, &func, resolver));
+    TEST_ASSERT_EQ(func.input_count, (size_t)2);
+    TEST_ASSERT_EQ(func.output_count, (size_t)1);
+
+    double output;
+    TEST_REQUIRE(pdf_eval_function(&func, (double[]) {0.5, 0.5}, &output));
+    TEST_ASSERT_EQ(output, 0.5);
+
+    TEST_REQUIRE(pdf_eval_function(&func, (double[]) {0.25, 0.0}, &output));
+    TEST_ASSERT_EQ(output, 0.25);
+
+    // Inputs are clipped to the domain
+    TEST_REQUIRE(pdf_eval_function(&func, (double[]) {2.0, -1.0}, &output));
+    TEST_ASSERT_EQ(output, 1.0);
+
+    return TEST_RESULT_PASS;
+}
+
+TEST_FUNC(test_pdf_function_type3_bounds) {
+    Arena* arena = arena_new(1024);
+    uint8_t buffer[] = "10 0 obj\n"
+                       "<< /FunctionType 3\n"
+                       "/Domain [0.0 3.0]\n"
+                       "/Functions [\n"
+                       "<< /FunctionType 2 /Domain [0 1] /C0 [0] /C1 [1] /N 1 >>\n"
+                       "<< /FunctionType 2 /Domain [0 1] /C0 [1] /C1 [2] /N 1 >>\n"
+                       "<< /FunctionType 2 /Domain [0 1] /C0 [2] /C1 [3] /N 1 >>\n"
+                       "]\n"
+                       "/Bounds [1.0 2.0]\n"
+                       "/Encode [0 1 0 1 0 1]\n"
+                       ">>\n endobj";
+    PdfCtx* ctx =
+        pdf_ctx_new(arena, buffer, sizeof(buffer) / sizeof(uint8_t) - 1);
+    PdfResolver* resolver = pdf_fake_resolver_new(arena, ctx);
+
+    PdfObject object;
+    TEST_REQUIRE(pdf_parse_object(resolver, &object, false));
+
+    PdfFunction func;
+    TEST_REQUIRE(pdf_deserde_function(&object, &func, resolver));
+
+    double inputs[] = {-1.0, 0.5, 1.0, 1.5, 2.0, 2.75, 3.0, 4.0};
+    double expected[] = {0.0, 0.5, 1.0, 1.5, 2.0, 2.75, 3.0, 3.0};
+    for (size_t idx = 0; idx < sizeof(inputs) / sizeof(double); idx++) {
+        double output;
+        TEST_REQUIRE(pdf_eval_function(&func, &inputs[idx], &output));
+        TEST_ASSERT_EQ(output, expected[idx]);
+    }
+
+    return TEST_RESULT_PASS;
+}
+
+TEST_FUNC(test_pdf_function_too_many_inputs) {
+    Arena* arena = arena_new(1024);
+    uint8_t buffer[] = "10 0 obj\n"
+                       "<< /FunctionType 2\n"
+                       "/Domain [0 1 0 1 0 1 0 1 0 1 0 1 0 1 0 1 0 1 0 1 0 1 0 "
+                       "1 0 1 0 1 0 1 0 1 0 1 0 1 0 1 0 1 0 1 0 1 0 1 0 1 0 1 "
+                       "0 1 0 1 0 1 0 1 0 1 0 1 0 1 0 1]\n"
+                       "/N 1.0\n"
+                       ">>\n endobj";
+    PdfCtx* ctx =
+        pdf_ctx_new(arena, buffer, sizeof(buffer) / sizeof(uint8_t) - 1);
+    PdfResolver* resolver = pdf_fake_resolver_new(arena, ctx);
+
+    PdfObject object;
+    TEST_REQUIRE(pdf_parse_object(resolver, &object, false));
+
+    // 33 inputs is more than the evaluation buffers hold
+    PdfFunction func;
+    Error* error = pdf_deserde_function(&object, &func, resolver);
+    TEST_ASSERT(error);
+    TEST_ASSERT_EQ((int)error_code(error), (int)PDF_ERR_INCORRECT_TYPE);
+    error_free(error);
+
+    arena_free(arena);
+    return TEST_RESULT_PASS;
+}
+
 TEST_FUNC(test_pdf_function) {
     Arena* arena = arena_new(128);
     uint8_t buffer[] = "10 0 obj\n"
@@ -729,6 +954,22 @@ TEST_FUNC(test_pdf_function) {
     TEST_ASSERT_EQ((int)out.type, (int)PDF_OBJECT_TYPE_REAL);
     TEST_ASSERT_EQ(out.data.real, 0.5);
 
+    // Running it again gives the same single output
+    pdf_object_vec_clear(io);
+    pdf_object_vec_push(
+        io,
+        (PdfObject) {.type = PDF_OBJECT_TYPE_REAL, .data.real = 0.25}
+    );
+    pdf_object_vec_push(
+        io,
+        (PdfObject) {.type = PDF_OBJECT_TYPE_REAL, .data.real = 0.5}
+    );
+    TEST_REQUIRE(pdf_run_function(&func, arena, io));
+
+    TEST_ASSERT_EQ(pdf_object_vec_len(io), (size_t)1);
+    TEST_ASSERT(pdf_object_vec_pop(io, &out));
+    TEST_ASSERT_EQ(out.data.real, 0.5);
+
     return TEST_RESULT_PASS;
 }
 
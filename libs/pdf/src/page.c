@@ -8,10 +8,13 @@
 #include "logger/log.h"
 #include "pdf/content_stream/stream.h"
 #include "pdf/deserde.h"
+#include "pdf/catalog.h"
 #include "pdf/object.h"
+#include "pdf/pdf.h"
 #include "pdf/resolver.h"
 #include "pdf/resources.h"
 #include "pdf/types.h"
+#include "resolver.h"
 
 PDF_IMPL_RESOLVABLE_FIELD(PdfPages, PdfPagesRef, pages)
 PDF_IMPL_OPTIONAL_FIELD(PdfPagesRef, PdfPagesRefOptional, pages_ref)
@@ -150,7 +153,7 @@ Error* pdf_deserde_page_tree(
     if (strcmp(type, "Page") == 0) {
         target_ptr->kind = PDF_PAGE_TREE_PAGE;
         TRY(pdf_deserde_page(object, &target_ptr->value.page, resolver));
-    } else if (strcmp(type, "Page") == 0) {
+    } else if (strcmp(type, "Pages") == 0) {
         target_ptr->kind = PDF_PAGE_TREE_PAGES;
         TRY(pdf_deserde_pages(object, &target_ptr->value.pages, resolver));
     } else {
@@ -291,3 +294,365 @@ Error* pdf_page_iter_next(PdfPageIter* iter, PdfPage* out_page, bool* done) {
 
     return NULL;
 }
+
+typedef struct PdfPageIndexNode PdfPageIndexNode;
+
+typedef struct {
+    PdfPageTreeRef ref;
+    bool is_pages;
+
+    /// The index of the kid's first page among its parent's pages.
+    size_t first_page;
+    size_t page_count;
+
+    /// The kid's own index node, built the first time it's descended into.
+    PdfPageIndexNode* node;
+} PdfPageIndexKid;
+
+struct PdfPageIndexNode {
+    /// The node, with the attributes it inherits from its ancestors filled in.
+    PdfPages pages;
+    size_t depth;
+
+    /// The node's kids, scanned the first time it's descended into.
+    PdfPageIndexKid* kids;
+    size_t kid_count;
+};
+
+struct PdfPageIndex {
+    PdfPageIndexNode* root;
+};
+
+#define PDF_PAGE_INDEX_MAX_DEPTH 1024
+
+static PdfPageIndexNode*
+pdf_page_index_node_new(Arena* arena, const PdfPages* pages, size_t depth) {
+    RELEASE_ASSERT(arena);
+    RELEASE_ASSERT(pages);
+
+    PdfPageIndexNode* node = arena_alloc(arena, sizeof(PdfPageIndexNode));
+    node->pages = *pages;
+    node->depth = depth;
+    node->kids = NULL;
+    node->kid_count = 0;
+
+    return node;
+}
+
+/// Finds the number of pages below each kid of `node`. Only each kid's `Type`
+/// and `Count` are read, so scanning a node doesn't deserialize its pages.
+static Error*
+pdf_page_index_scan_kids(PdfResolver* resolver, PdfPageIndexNode* node) {
+    RELEASE_ASSERT(resolver);
+    RELEASE_ASSERT(node);
+
+    size_t kid_count = pdf_page_tree_ref_vec_len(node->pages.kids);
+    PdfPageIndexKid* kids = arena_alloc(
+        pdf_resolver_arena(resolver),
+        sizeof(PdfPageIndexKid) * (kid_count == 0 ? 1 : kid_count)
+    );
+
+    size_t first_page = 0;
+    for (size_t idx = 0; idx < kid_count; idx++) {
+        PdfPageTreeRef kid_ref;
+        RELEASE_ASSERT(
+            pdf_page_tree_ref_vec_get(node->pages.kids, idx, &kid_ref)
+        );
+
+        PdfObject kid_object;
+        TRY(pdf_resolve_ref(resolver, kid_ref.ref, &kid_object));
+
+        PdfName type = NULL;
+        PdfIntegerOptional count;
+        PdfFieldDescriptor stub_fields[] = {
+            pdf_name_field("Type", &type),
+            pdf_integer_optional_field("Count", &count)
+        };
+        TRY(pdf_deserde_fields(
+            &kid_object,
+            stub_fields,
+            sizeof(stub_fields) / sizeof(PdfFieldDescriptor),
+            true,
+            resolver,
+            "PageTree count stub"
+        ));
+
+        bool is_pages;
+        size_t page_count;
+        if (strcmp(type, "Page") == 0) {
+            is_pages = false;
+            page_count = 1;
+        } else if (strcmp(type, "Pages") == 0) {
+            if (!count.is_some || count.value < 0) {
+                return ERROR(
+                    PDF_ERR_INVALID_PAGE_TREE,
+                    "Page tree node has an invalid `Count`"
+                );
+            }
+
+            is_pages = true;
+            page_count = (size_t)count.value;
+        } else {
+            return ERROR(
+                PDF_ERR_INVALID_SUBTYPE,
+                "`Type` must be `Page` or `Pages`"
+            );
+        }
+
+        kids[idx] = (PdfPageIndexKid) {.ref = kid_ref,
+                                       .is_pages = is_pages,
+                                       .first_page = first_page,
+                                       .page_count = page_count,
+                                       .node = NULL};
+        first_page += page_count;
+    }
+
+    node->kids = kids;
+    node->kid_count = kid_count;
+
+    return NULL;
+}
+
+/// Finds the kid of a scanned node containing the node's `page_idx`th page.
+static PdfPageIndexKid*
+pdf_page_index_find_kid(PdfPageIndexNode* node, size_t page_idx) {
+    RELEASE_ASSERT(node);
+    RELEASE_ASSERT(node->kids);
+
+    // Find the last kid starting at or before the page
+    size_t low = 0;
+    size_t high = node->kid_count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (node->kids[mid].first_page <= page_idx) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    if (low == 0) {
+        return NULL;
+    }
+
+    PdfPageIndexKid* kid = &node->kids[low - 1];
+    if (page_idx - kid->first_page >= kid->page_count) {
+        return NULL;
+    }
+
+    return kid;
+}
+
+static Error* pdf_page_index_get(PdfResolver* resolver, PdfPageIndex** out) {
+    RELEASE_ASSERT(resolver);
+    RELEASE_ASSERT(out);
+
+    PdfPageIndex* page_index = pdf_resolver_page_index(resolver);
+    if (!page_index) {
+        PdfCatalog catalog;
+        TRY(pdf_get_catalog(resolver, &catalog));
+        TRY(pdf_resolve_pages(&catalog.pages, resolver));
+
+        Arena* arena = pdf_resolver_arena(resolver);
+        page_index = arena_alloc(arena, sizeof(PdfPageIndex));
+        page_index->root =
+            pdf_page_index_node_new(arena, catalog.pages.resolved, 0);
+        pdf_resolver_set_page_index(resolver, page_index);
+    }
+
+    *out = page_index;
+    return NULL;
+}
+
+Error* pdf_get_page_count(PdfResolver* resolver, size_t* page_count) {
+    RELEASE_ASSERT(resolver);
+    RELEASE_ASSERT(page_count);
+
+    PdfPageIndex* page_index;
+    TRY(pdf_page_index_get(resolver, &page_index));
+
+    if (page_index->root->pages.count < 0) {
+        return ERROR(
+            PDF_ERR_INVALID_PAGE_TREE,
+            "Page tree root has a negative `Count`"
+        );
+    }
+
+    *page_count = (size_t)page_index->root->pages.count;
+    return NULL;
+}
+
+Error* pdf_get_page(PdfResolver* resolver, size_t page_idx, PdfPage* page) {
+    RELEASE_ASSERT(resolver);
+    RELEASE_ASSERT(page);
+
+    PdfPageIndex* page_index;
+    TRY(pdf_page_index_get(resolver, &page_index));
+
+    PdfPageIndexNode* node = page_index->root;
+    size_t remaining = page_idx;
+    while (true) {
+        if (!node->kids) {
+            TRY(pdf_page_index_scan_kids(resolver, node));
+        }
+
+        PdfPageIndexKid* kid = pdf_page_index_find_kid(node, remaining);
+        if (!kid) {
+            return ERROR(
+                PDF_ERR_PAGE_OUT_OF_RANGE,
+                "Page %zu is past the end of the document",
+                page_idx
+            );
+        }
+        remaining -= kid->first_page;
+
+        // Inherited attributes are filled in when a kid is first resolved,
+        // from its parent which already has its own filled in
+        bool newly_resolved = !kid->ref.resolved;
+        TRY(pdf_resolve_page_tree(&kid->ref, resolver));
+        if (newly_resolved) {
+            pdf_page_tree_inherit(kid->ref.resolved, &node->pages);
+        }
+
+        PdfPageTree* tree = kid->ref.resolved;
+        if ((tree->kind == PDF_PAGE_TREE_PAGES) != kid->is_pages) {
+            return ERROR(
+                PDF_ERR_INVALID_PAGE_TREE,
+                "Page tree node changed type while indexing"
+            );
+        }
+
+        if (!kid->is_pages) {
+            *page = tree->value.page;
+            return NULL;
+        }
+
+        if (!kid->node) {
+            if (node->depth + 1 >= PDF_PAGE_INDEX_MAX_DEPTH) {
+                return ERROR(
+                    PDF_ERR_INVALID_PAGE_TREE,
+                    "Page tree is deeper than %d nodes",
+                    PDF_PAGE_INDEX_MAX_DEPTH
+                );
+            }
+
+            kid->node = pdf_page_index_node_new(
+                pdf_resolver_arena(resolver),
+                &tree->value.pages,
+                node->depth + 1
+            );
+        }
+        node = kid->node;
+    }
+}
+
+#ifdef TEST
+#include "test/test.h"
+#include "test_helpers.h"
+
+static Error* new_page_tree_test_resolver(Arena* arena, PdfResolver** out) {
+    const char* objects[] = {
+        "<< /Type /Catalog /Pages 2 0 R >>",
+        "<< /Type /Pages /Kids [3 0 R 6 0 R 7 0 R] /Count 5 /Resources << >> >>",
+        "<< /Type /Pages /Parent 2 0 R /Kids [4 0 R 5 0 R] /Count 2 /MediaBox [0 0 100 200] >>",
+        "<< /Type /Page /Parent 3 0 R >>",
+        "<< /Type /Page /Parent 3 0 R /MediaBox [0 0 300 400] >>",
+        "<< /Type /Page /Parent 2 0 R /Rotate 180 >>",
+        "<< /Type /Pages /Parent 2 0 R /Kids [8 0 R] /Count 2 /Rotate 90 >>",
+        "<< /Type /Pages /Parent 7 0 R /Kids [9 0 R 10 0 R] /Count 2 >>",
+        "<< /Type /Page /Parent 8 0 R >>",
+        "<< /Type /Page /Parent 8 0 R /Rotate 270 >>"
+    };
+    char* buffer = pdf_construct_deserde_test_doc(
+        objects,
+        sizeof(objects) / sizeof(const char*),
+        "<< /Size 11 /Root 1 0 R >>",
+        arena
+    );
+
+    TRY(pdf_resolver_new(arena, (uint8_t*)buffer, strlen(buffer), out));
+    return NULL;
+}
+
+TEST_FUNC(test_page_get_by_index) {
+    Arena* arena = arena_new(1024);
+    PdfResolver* resolver;
+    TEST_REQUIRE(new_page_tree_test_resolver(arena, &resolver));
+
+    size_t page_count;
+    TEST_REQUIRE(pdf_get_page_count(resolver, &page_count));
+    TEST_ASSERT_EQ((size_t)5, page_count);
+
+    // Out of order, so later lookups reuse the index built by earlier ones
+    PdfPage page;
+    TEST_REQUIRE(pdf_get_page(resolver, 4, &page));
+    TEST_ASSERT(page.rotate.is_some);
+    TEST_ASSERT_EQ((PdfInteger)270, page.rotate.value);
+    TEST_ASSERT(page.resources.is_some);
+
+    TEST_REQUIRE(pdf_get_page(resolver, 3, &page));
+    TEST_ASSERT(page.rotate.is_some);
+    TEST_ASSERT_EQ((PdfInteger)90, page.rotate.value);
+
+    TEST_REQUIRE(pdf_get_page(resolver, 0, &page));
+    TEST_ASSERT(page.media_box.is_some);
+    TEST_ASSERT_EQ(
+        200.0,
+        pdf_number_as_real(page.media_box.value.upper_right_y)
+    );
+    TEST_ASSERT(!page.rotate.is_some);
+
+    TEST_REQUIRE(pdf_get_page(resolver, 1, &page));
+    TEST_ASSERT(page.media_box.is_some);
+    TEST_ASSERT_EQ(
+        400.0,
+        pdf_number_as_real(page.media_box.value.upper_right_y)
+    );
+
+    TEST_REQUIRE(pdf_get_page(resolver, 2, &page));
+    TEST_ASSERT(page.rotate.is_some);
+    TEST_ASSERT_EQ((PdfInteger)180, page.rotate.value);
+    TEST_ASSERT(!page.media_box.is_some);
+
+    TEST_REQUIRE_ERR(
+        pdf_get_page(resolver, 5, &page),
+        PDF_ERR_PAGE_OUT_OF_RANGE
+    );
+
+    arena_free(arena);
+    return TEST_RESULT_PASS;
+}
+
+TEST_FUNC(test_page_iter_nested_tree) {
+    Arena* arena = arena_new(1024);
+    PdfResolver* resolver;
+    TEST_REQUIRE(new_page_tree_test_resolver(arena, &resolver));
+
+    PdfCatalog catalog;
+    TEST_REQUIRE(pdf_get_catalog(resolver, &catalog));
+
+    PdfPageIter* iter;
+    TEST_REQUIRE(pdf_page_iter_new(resolver, catalog.pages, &iter));
+
+    PdfInteger expected_rotations[] = {0, 0, 180, 90, 270};
+    size_t page_count = 0;
+    while (true) {
+        PdfPage page;
+        bool done;
+        TEST_REQUIRE(pdf_page_iter_next(iter, &page, &done));
+        if (done) {
+            break;
+        }
+
+        TEST_ASSERT(page_count < 5);
+        PdfInteger rotation = page.rotate.is_some ? page.rotate.value : 0;
+        TEST_ASSERT_EQ(expected_rotations[page_count], rotation);
+        page_count++;
+    }
+    TEST_ASSERT_EQ((size_t)5, page_count);
+
+    arena_free(arena);
+    return TEST_RESULT_PASS;
+}
+
+#endif // TEST
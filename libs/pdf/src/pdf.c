@@ -1,5 +1,6 @@
 #include "pdf/pdf.h"
 
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -14,6 +15,7 @@
 #include "pdf/resolver.h"
 #include "pdf/trailer.h"
 #include "pdf/types.h"
+#include "resolver.h"
 #include "test_helpers.h"
 #include "xref.h"
 
@@ -54,6 +56,7 @@ struct PdfResolver {
     uint8_t version;
     PdfTrailer trailer;
     PdfCatalog* catalog;
+    PdfPageIndex* page_index;
 };
 
 static Error* parse_header(PdfCtx* ctx, uint8_t* version);
@@ -81,13 +84,14 @@ Error* pdf_resolver_new(
     size_t current_xref_offset;
     TRY(parse_startxref(ctx, &current_xref_offset));
 
-    XRefTable* xref = pdf_xref_init(arena, ctx);
+    XRefTable* xref = pdf_xref_init(arena);
     *resolver = arena_alloc(arena, sizeof(PdfResolver));
     (*resolver)->arena = arena;
     (*resolver)->ctx = ctx;
     (*resolver)->xref = xref;
     (*resolver)->version = version;
     (*resolver)->catalog = NULL;
+    (*resolver)->page_index = NULL;
 
     size_t first_trailer_offset = SIZE_MAX;
     while (current_xref_offset != 0) {
@@ -117,6 +121,26 @@ Error* pdf_resolver_new(
     return NULL;
 }
 
+PdfResolver* pdf_resolver_fork(Arena* arena, PdfResolver* resolver) {
+    RELEASE_ASSERT(arena);
+    RELEASE_ASSERT(resolver);
+
+    PdfResolver* fork = arena_alloc(arena, sizeof(PdfResolver));
+    fork->arena = arena;
+    fork->ctx = pdf_ctx_new(
+        arena,
+        pdf_ctx_get_raw(resolver->ctx),
+        pdf_ctx_buffer_len(resolver->ctx)
+    );
+    fork->xref = resolver->xref;
+    fork->version = resolver->version;
+    fork->trailer = resolver->trailer;
+    fork->catalog = NULL;
+    fork->page_index = NULL;
+
+    return fork;
+}
+
 #ifdef TEST
 PdfResolver* pdf_fake_resolver_new(Arena* arena, PdfCtx* ctx) {
     RELEASE_ASSERT(arena);
@@ -128,6 +152,7 @@ PdfResolver* pdf_fake_resolver_new(Arena* arena, PdfCtx* ctx) {
     resolver->version = 0;
     resolver->xref = NULL;
     resolver->catalog = NULL;
+    resolver->page_index = NULL;
 
     return resolver;
 }
@@ -145,6 +170,22 @@ PdfCtx* pdf_resolver_ctx(PdfResolver* resolver) {
     return resolver->ctx;
 }
 
+PdfPageIndex* pdf_resolver_page_index(PdfResolver* resolver) {
+    RELEASE_ASSERT(resolver);
+
+    return resolver->page_index;
+}
+
+void pdf_resolver_set_page_index(
+    PdfResolver* resolver,
+    PdfPageIndex* page_index
+) {
+    RELEASE_ASSERT(resolver);
+    RELEASE_ASSERT(page_index);
+
+    resolver->page_index = page_index;
+}
+
 static Error* parse_stub_trailer(PdfResolver* resolver, StubTrailer* trailer) {
     RELEASE_ASSERT(resolver);
     RELEASE_ASSERT(trailer);
@@ -212,18 +253,38 @@ Error* pdf_resolve_ref(
     RELEASE_ASSERT(resolved);
 
     XRefEntry* entry;
+    size_t offset;
     TRY(pdf_xref_get_entry(
         resolver->xref,
+        resolver->ctx,
         ref.object_id,
         ref.generation,
-        &entry
+        &entry,
+        &offset
     ));
 
-    TRY(pdf_ctx_seek(resolver->ctx, entry->offset));
+    PdfObject* object =
+        atomic_load_explicit(&entry->object, memory_order_acquire);
+    if (!object) {
+        TRY(pdf_ctx_seek(resolver->ctx, offset));
+
+        PdfObject* parsed = arena_alloc(resolver->arena, sizeof(PdfObject));
+        TRY(pdf_parse_object(resolver, parsed, false));
+
+        // If another resolver sharing the document published the object
+        // first, its copy is used and this one is left in the arena
+        if (atomic_compare_exchange_strong_explicit(
+                &entry->object,
+                &object,
+                parsed,
+                memory_order_acq_rel,
+                memory_order_acquire
+            )) {
+            object = parsed;
+        }
+    }
 
-    entry->object = arena_alloc(resolver->arena, sizeof(PdfObject));
-    TRY(pdf_parse_object(resolver, entry->object, false));
-    *resolved = *entry->object;
+    *resolved = *object;
 
     return NULL;
 }
@@ -458,4 +519,56 @@ TEST_FUNC(test_startxref_invalid3) {
     return TEST_RESULT_PASS;
 }
 
+TEST_FUNC(test_resolver_fork_shares_objects) {
+    Arena* arena = arena_new(1024);
+    const char* objects[] = {
+        "<< /Type /Catalog /Pages 2 0 R >>",
+        "<< /Type /Pages /Kids [] /Count 0 >>"
+    };
+    char* buffer = pdf_construct_deserde_test_doc(
+        objects,
+        2,
+        "<< /Size 3 /Root 1 0 R >>",
+        arena
+    );
+
+    PdfResolver* resolver;
+    TEST_REQUIRE(pdf_resolver_new(
+        arena,
+        (uint8_t*)buffer,
+        strlen(buffer),
+        &resolver
+    ));
+
+    Arena* fork_arena = arena_new(128);
+    PdfResolver* fork = pdf_resolver_fork(fork_arena, resolver);
+
+    PdfIndirectRef ref = {.object_id = 2, .generation = 0};
+    PdfObject forked_object;
+    TEST_REQUIRE(pdf_resolve_ref(fork, ref, &forked_object));
+    PdfObject object;
+    TEST_REQUIRE(pdf_resolve_ref(resolver, ref, &object));
+
+    // The object parsed by the fork is cached for the original resolver
+    TEST_ASSERT_EQ(
+        (PdfObjectType)PDF_OBJECT_TYPE_INDIRECT_OBJECT,
+        forked_object.type
+    );
+    TEST_ASSERT_EQ(
+        (PdfObjectType)PDF_OBJECT_TYPE_INDIRECT_OBJECT,
+        object.type
+    );
+    TEST_ASSERT(
+        object.data.indirect_object.object
+        == forked_object.data.indirect_object.object
+    );
+
+    PdfCatalog catalog;
+    TEST_REQUIRE(pdf_get_catalog(fork, &catalog));
+
+    arena_free(fork_arena);
+    arena_free(arena);
+    return TEST_RESULT_PASS;
+}
+
 #endif // TEST
@@ -4,3 +4,12 @@
 #include "pdf/resolver.h"
 
 PdfCtx* pdf_resolver_ctx(PdfResolver* resolver);
+
+typedef struct PdfPageIndex PdfPageIndex;
+
+/// The page index built by `pdf_get_page`, or NULL if it hasn't been built.
+PdfPageIndex* pdf_resolver_page_index(PdfResolver* resolver);
+void pdf_resolver_set_page_index(
+    PdfResolver* resolver,
+    PdfPageIndex* page_index
+);
@@ -1,5 +1,6 @@
 #include "pdf/shading.h"
 
+#include <stdbool.h>
 #include <stdio.h>
 
 #include "err/error.h"
@@ -15,6 +16,13 @@ static const PdfNumber* default_domain = (PdfNumber[]) {
     {.type = PDF_NUMBER_TYPE_REAL, .value.real = 1.0}
 };
 
+static const PdfNumber* default_function_domain = (PdfNumber[]) {
+    {.type = PDF_NUMBER_TYPE_REAL, .value.real = 0.0},
+    {.type = PDF_NUMBER_TYPE_REAL, .value.real = 1.0},
+    {.type = PDF_NUMBER_TYPE_REAL, .value.real = 0.0},
+    {.type = PDF_NUMBER_TYPE_REAL, .value.real = 1.0}
+};
+
 static const PdfBoolean* default_extend = (PdfBoolean[]) {false, false};
 
 Error* pdf_deserde_shading_dict(
@@ -44,6 +52,40 @@ Error* pdf_deserde_shading_dict(
     ));
 
     switch (target_ptr->shading_type) {
+        case 1: {
+            PdfFieldDescriptor specific_fields[] = {
+                pdf_ignored_field("ShadingType", NULL),
+                pdf_ignored_field("ColorSpace", NULL),
+                pdf_ignored_field("Background", NULL),
+                pdf_ignored_field("BBox", NULL),
+                pdf_ignored_field("AntiAlias", NULL),
+                pdf_number_fixed_array_field(
+                    "Domain",
+                    target_ptr->data.type1.domain,
+                    4,
+                    default_function_domain
+                ),
+                pdf_pdf_mat_optional_field(
+                    "Matrix",
+                    &target_ptr->data.type1.matrix
+                ),
+                pdf_as_function_vec_field(
+                    "Function",
+                    &target_ptr->data.type1.function
+                )
+            };
+
+            TRY(pdf_deserde_fields(
+                object,
+                specific_fields,
+                sizeof(specific_fields) / sizeof(PdfFieldDescriptor),
+                false,
+                resolver,
+                "Type1 shading dict"
+            ));
+
+            break;
+        }
         case 2: {
             PdfFieldDescriptor specific_fields[] = {
                 pdf_ignored_field("ShadingType", NULL),
@@ -128,8 +170,80 @@ Error* pdf_deserde_shading_dict(
 
             break;
         }
+        case 4:
+        case 5:
+        case 6:
         case 7: {
-            LOG_WARN(PDF, "Unimplemented shading type 7");
+            PdfShadingDictMesh* mesh = &target_ptr->data.mesh;
+            PdfFieldDescriptor specific_fields[] = {
+                pdf_ignored_field("ShadingType", NULL),
+                pdf_ignored_field("ColorSpace", NULL),
+                pdf_ignored_field("Background", NULL),
+                pdf_ignored_field("BBox", NULL),
+                pdf_ignored_field("AntiAlias", NULL),
+                pdf_integer_field(
+                    "BitsPerCoordinate",
+                    &mesh->bits_per_coordinate
+                ),
+                pdf_integer_field(
+                    "BitsPerComponent",
+                    &mesh->bits_per_component
+                ),
+                pdf_integer_optional_field(
+                    "BitsPerFlag",
+                    &mesh->bits_per_flag
+                ),
+                pdf_integer_optional_field(
+                    "VerticesPerRow",
+                    &mesh->vertices_per_row
+                ),
+                pdf_number_vec_field("Decode", &mesh->decode),
+                pdf_as_function_vec_optional_field(
+                    "Function",
+                    &mesh->function
+                )
+            };
+
+            TRY(pdf_deserde_fields(
+                object,
+                specific_fields,
+                sizeof(specific_fields) / sizeof(PdfFieldDescriptor),
+                true,
+                resolver,
+                "Mesh shading dict"
+            ));
+
+            bool has_layout = target_ptr->shading_type == 5
+                                ? mesh->vertices_per_row.is_some
+                                      && mesh->vertices_per_row.value >= 2
+                                : mesh->bits_per_flag.is_some;
+            if (!has_layout) {
+                return ERROR(
+                    PDF_ERR_MISSING_DICT_KEY,
+                    "Type %d shading dict is missing its layout",
+                    (int)target_ptr->shading_type
+                );
+            }
+            if (pdf_number_vec_len(mesh->decode) < 6
+                || pdf_number_vec_len(mesh->decode) % 2 != 0) {
+                return ERROR(
+                    PDF_ERR_INCORRECT_TYPE,
+                    "Mesh shading Decode must have pairs for the coordinates "
+                    "and at least one color component"
+                );
+            }
+
+            PdfObject resolved;
+            TRY(pdf_resolve_object(resolver, object, &resolved, true));
+            if (resolved.type != PDF_OBJECT_TYPE_STREAM) {
+                return ERROR(
+                    PDF_ERR_INCORRECT_TYPE,
+                    "Mesh shadings must be streams"
+                );
+            }
+            mesh->stream_bytes = resolved.data.stream.stream_bytes;
+            mesh->stream_len = resolved.data.stream.decoded_stream_len;
+
             break;
         }
         default: {
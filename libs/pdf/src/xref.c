@@ -1,5 +1,6 @@
 #include "xref.h"
 
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -23,8 +24,6 @@ typedef struct {
 #include "arena/dvec_impl.h"
 
 struct XRefTable {
-    Arena* arena;
-    PdfCtx* ctx;
     XRefSubsectionVec* subsections;
 };
 
@@ -72,31 +71,17 @@ Error* pdf_xref_parse_subsection_header(
 }
 
 Error* pdf_xref_parse_entry(
-    Arena* arena,
     PdfCtx* ctx,
-    XRefSubsection* subsection,
-    size_t entry
+    const XRefSubsection* subsection,
+    size_t entry,
+    size_t* offset_out,
+    size_t* generation_out
 ) {
-    RELEASE_ASSERT(arena);
     RELEASE_ASSERT(ctx);
     RELEASE_ASSERT(subsection);
     RELEASE_ASSERT(entry < subsection->num_entries);
-
-    if (!subsection->entries) {
-        LOG_DIAG(
-            DEBUG,
-            XREF,
-            "Initializing entries table for subsection with %zu entries",
-            subsection->num_entries
-        );
-
-        subsection->entries =
-            arena_alloc(arena, sizeof(XRefEntry) * subsection->num_entries);
-        for (size_t idx = 0; idx < subsection->num_entries; idx++) {
-            subsection->entries[idx].entry_parsed = false;
-            subsection->entries[idx].object = NULL;
-        }
-    }
+    RELEASE_ASSERT(offset_out);
+    RELEASE_ASSERT(generation_out);
 
     // Seek entry
     size_t entry_offset = subsection->start_offset + 20 * entry;
@@ -122,20 +107,16 @@ Error* pdf_xref_parse_entry(
     expected_length = 5;
     TRY(pdf_ctx_parse_int(ctx, &expected_length, &generation, NULL));
 
-    subsection->entries[entry].offset = (size_t)offset;
-    subsection->entries[entry].generation = (size_t)generation;
-    subsection->entries[entry].entry_parsed = true;
+    *offset_out = (size_t)offset;
+    *generation_out = (size_t)generation;
 
     return NULL;
 }
 
-XRefTable* pdf_xref_init(Arena* arena, PdfCtx* ctx) {
+XRefTable* pdf_xref_init(Arena* arena) {
     RELEASE_ASSERT(arena);
-    RELEASE_ASSERT(ctx);
 
     XRefTable* xref = arena_alloc(arena, sizeof(XRefTable));
-    xref->arena = arena;
-    xref->ctx = ctx;
     xref->subsections = xref_subsection_vec_new(arena);
 
     return xref;
@@ -202,12 +183,23 @@ Error* pdf_xref_parse_section(
             num_objects
         );
 
+        // Entries are allocated up front, so that resolvers on other
+        // threads only ever race on the entries themselves
+        XRefEntry* entries =
+            arena_alloc(arena, sizeof(XRefEntry) * (size_t)num_objects);
+        for (size_t idx = 0; idx < (size_t)num_objects; idx++) {
+            atomic_init(&entries[idx].state, XREF_ENTRY_UNPARSED);
+            entries[idx].offset = 0;
+            entries[idx].generation = 0;
+            atomic_init(&entries[idx].object, NULL);
+        }
+
         xref_subsection_vec_push(
             xref->subsections,
             (XRefSubsection) {.start_offset = subsection_start,
                               .first_object = (uint32_t)first_object,
                               .num_entries = (uint32_t)num_objects,
-                              .entries = NULL}
+                              .entries = entries}
         );
 
         // Seek next subsection
@@ -229,12 +221,16 @@ Error* pdf_xref_parse_section(
 
 Error* pdf_xref_get_entry(
     XRefTable* xref,
+    PdfCtx* ctx,
     size_t object_id,
     size_t generation,
-    XRefEntry** entry
+    XRefEntry** entry,
+    size_t* offset
 ) {
     RELEASE_ASSERT(xref);
+    RELEASE_ASSERT(ctx);
     RELEASE_ASSERT(entry);
+    RELEASE_ASSERT(offset);
 
     LOG_DIAG(
         DEBUG,
@@ -261,8 +257,15 @@ Error* pdf_xref_get_entry(
         }
 
         size_t entry_idx = object_id - subsection->first_object;
-        if (!subsection->entries // ASan fails at this if statement
-            || !subsection->entries[entry_idx].entry_parsed) {
+        XRefEntry* found = &subsection->entries[entry_idx];
+
+        size_t entry_offset;
+        size_t entry_generation;
+        if (atomic_load_explicit(&found->state, memory_order_acquire)
+            == XREF_ENTRY_PARSED) {
+            entry_offset = found->offset;
+            entry_generation = found->generation;
+        } else {
             LOG_DIAG(
                 TRACE,
                 XREF,
@@ -271,19 +274,40 @@ Error* pdf_xref_get_entry(
                 subsection_idx
             );
             TRY(pdf_xref_parse_entry(
-                xref->arena,
-                xref->ctx,
+                ctx,
                 subsection,
-                entry_idx
+                entry_idx,
+                &entry_offset,
+                &entry_generation
             ));
-        }
 
-        *entry = &subsection->entries[entry_idx];
+            // Only the first thread to parse the entry publishes it. Any
+            // others use what they parsed, which is the same.
+            XRefEntryState expected = XREF_ENTRY_UNPARSED;
+            if (atomic_compare_exchange_strong_explicit(
+                    &found->state,
+                    &expected,
+                    XREF_ENTRY_PUBLISHING,
+                    memory_order_acquire,
+                    memory_order_relaxed
+                )) {
+                found->offset = entry_offset;
+                found->generation = entry_generation;
+                atomic_store_explicit(
+                    &found->state,
+                    XREF_ENTRY_PARSED,
+                    memory_order_release
+                );
+            }
+        }
 
-        if ((size_t)(*entry)->generation != generation) {
+        if (entry_generation != generation) {
             return ERROR(PDF_ERR_XREF_GENERATION_MISMATCH);
         }
 
+        *entry = found;
+        *offset = entry_offset;
+
         return NULL;
     }
 
@@ -301,7 +325,7 @@ TEST_FUNC(test_xref_create) {
         pdf_ctx_new(arena, buffer, sizeof(buffer) / sizeof(uint8_t) - 1);
     TEST_ASSERT(ctx);
 
-    XRefTable* xref = pdf_xref_init(arena, ctx);
+    XRefTable* xref = pdf_xref_init(arena);
     TEST_REQUIRE(pdf_xref_parse_section(arena, ctx, 0, xref));
 
     TEST_ASSERT_EQ((size_t)2, xref_subsection_vec_len(xref->subsections));
@@ -331,18 +355,24 @@ TEST_FUNC(test_xref_get_entries_ok) {
         pdf_ctx_new(arena, buffer, sizeof(buffer) / sizeof(uint8_t) - 1);
     TEST_ASSERT(ctx);
 
-    XRefTable* xref = pdf_xref_init(arena, ctx);
+    XRefTable* xref = pdf_xref_init(arena);
     TEST_REQUIRE(pdf_xref_parse_section(arena, ctx, 0, xref));
 
     XRefEntry* entry;
-    TEST_REQUIRE(pdf_xref_get_entry(xref, 0, 65536, &entry));
-    TEST_ASSERT_EQ((size_t)0, entry->offset);
+    size_t offset;
+    TEST_REQUIRE(pdf_xref_get_entry(xref, ctx, 0, 65536, &entry, &offset));
+    TEST_ASSERT_EQ((size_t)0, offset);
 
-    TEST_REQUIRE(pdf_xref_get_entry(xref, 2, 2, &entry));
-    TEST_ASSERT_EQ((size_t)542, entry->offset);
+    TEST_REQUIRE(pdf_xref_get_entry(xref, ctx, 2, 2, &entry, &offset));
+    TEST_ASSERT_EQ((size_t)542, offset);
 
-    TEST_REQUIRE(pdf_xref_get_entry(xref, 1, 0, &entry));
-    TEST_ASSERT_EQ((size_t)42, entry->offset);
+    TEST_REQUIRE(pdf_xref_get_entry(xref, ctx, 1, 0, &entry, &offset));
+    TEST_ASSERT_EQ((size_t)42, offset);
+
+    // Once parsed, entries are read back without the table
+    TEST_REQUIRE(pdf_xref_get_entry(xref, ctx, 2, 2, &entry, &offset));
+    TEST_ASSERT_EQ((size_t)542, entry->offset);
+    TEST_ASSERT_EQ((size_t)542, offset);
 
     arena_free(arena);
     return TEST_RESULT_PASS;
@@ -356,12 +386,13 @@ TEST_FUNC(test_xref_out_of_bound_entry) {
         pdf_ctx_new(arena, buffer, sizeof(buffer) / sizeof(uint8_t) - 1);
     TEST_ASSERT(ctx);
 
-    XRefTable* xref = pdf_xref_init(arena, ctx);
+    XRefTable* xref = pdf_xref_init(arena);
     TEST_REQUIRE(pdf_xref_parse_section(arena, ctx, 0, xref));
 
     XRefEntry* entry;
+    size_t offset;
     TEST_REQUIRE_ERR(
-        pdf_xref_get_entry(xref, 3, 0, &entry),
+        pdf_xref_get_entry(xref, ctx, 3, 0, &entry, &offset),
         PDF_ERR_INVALID_XREF_REFERENCE
     );
 
@@ -377,12 +408,13 @@ TEST_FUNC(test_xref_generation_mismatch) {
         pdf_ctx_new(arena, buffer, sizeof(buffer) / sizeof(uint8_t) - 1);
     TEST_ASSERT(ctx);
 
-    XRefTable* xref = pdf_xref_init(arena, ctx);
+    XRefTable* xref = pdf_xref_init(arena);
     TEST_REQUIRE(pdf_xref_parse_section(arena, ctx, 0, xref));
 
     XRefEntry* entry;
+    size_t offset;
     TEST_REQUIRE_ERR(
-        pdf_xref_get_entry(xref, 0, 0, &entry),
+        pdf_xref_get_entry(xref, ctx, 0, 0, &entry, &offset),
         PDF_ERR_XREF_GENERATION_MISMATCH
     );
 
@@ -1,19 +1,30 @@
 #pragma once
 
+#include <stdatomic.h>
+
 #include "ctx.h"
 #include "err/error.h"
 #include "pdf/object.h"
 
 typedef struct XRefTable XRefTable;
 
+typedef enum {
+    XREF_ENTRY_UNPARSED,
+    XREF_ENTRY_PUBLISHING,
+    XREF_ENTRY_PARSED
+} XRefEntryState;
+
+/// An entry is shared by every resolver reading the document, which may be on
+/// different threads. The offset and generation are only valid once `state`
+/// is `XREF_ENTRY_PARSED`, and `object` is set at most once.
 typedef struct {
+    _Atomic(XRefEntryState) state;
     size_t offset;
     size_t generation;
-    bool entry_parsed;
-    PdfObject* object;
+    _Atomic(PdfObject*) object;
 } XRefEntry;
 
-XRefTable* pdf_xref_init(Arena* arena, PdfCtx* ctx);
+XRefTable* pdf_xref_init(Arena* arena);
 
 Error* pdf_xref_parse_section(
     Arena* arena,
@@ -22,9 +33,13 @@ Error* pdf_xref_parse_section(
     XRefTable* xref
 );
 
+/// Looks up an entry, reading it from the table with `ctx` if it hasn't been
+/// yet. Safe to call from several threads, each with their own `ctx`.
 Error* pdf_xref_get_entry(
     XRefTable* xref,
+    PdfCtx* ctx,
     size_t object_id,
     size_t generation,
-    XRefEntry** entry
+    XRefEntry** entry,
+    size_t* offset
 );
@@ -1,8 +1,14 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
 #include "arena/arena.h"
 #include "canvas/canvas.h"
+#include "color/rgb.h"
 #include "err/error.h"
+#include "geom/rect.h"
 #include "pdf/page.h"
 #include "pdf/resolver.h"
 
@@ -11,10 +17,163 @@ typedef enum RenderCanvasType {
     RENDER_CANVAS_TYPE_SCALABLE
 } RenderCanvasType;
 
+/// Bytes of glyph outlines cached for each font unless another budget is
+/// given.
+#define RENDER_DEFAULT_GLYPH_CACHE_BUDGET ((size_t)4 << 20)
+
+typedef enum RenderPageBox {
+    RENDER_PAGE_BOX_MEDIA,
+    RENDER_PAGE_BOX_CROP
+} RenderPageBox;
+
+typedef struct RenderOptions {
+    /// Output resolution, where 72 DPI maps one default user space unit to one
+    /// pixel. Ignored if `width` and `height` are set.
+    double dpi;
+
+    /// Explicit output size in pixels, which the page box is stretched to
+    /// fill. Used only if both are nonzero.
+    uint32_t width;
+    uint32_t height;
+
+    /// The page boundary to render. The crop box falls back to the media box
+    /// when the page has none.
+    RenderPageBox page_box;
+
+    /// If set, only `region` is rendered, onto a canvas of the region's size.
+    /// The region is in default user space, or in pixels of the full-size
+    /// output when `region_in_device_space` is set. Content outside the
+    /// region is culled.
+    bool has_region;
+    bool region_in_device_space;
+    GeomRect region;
+
+    Rgba background;
+
+    /// Threads rasterizing raster output. With more than one, the page is
+    /// first recorded into a display list, which is then rasterized in tiles
+    /// of full-width rows in parallel, producing identical pixels.
+    uint32_t thread_count;
+
+    /// Bytes of glyph outlines each worker of `render_pages_batch` caches for
+    /// each font. Caches passed to the other functions are given their budget
+    /// when they're created.
+    size_t glyph_cache_budget;
+} RenderOptions;
+
+/// Options rendering the whole media box at 72 DPI onto white, on one thread,
+/// with the default glyph cache budget.
+RenderOptions render_options_default(void);
+
+/// What's derived from a document while rendering it, kept for every page
+/// rendered with the cache: parsed font programs and their glyphs, CMaps,
+/// ICC profiles, deserialized resources and recorded form XObjects. A cache
+/// may only be used with one resolver, which must outlive it, and by one
+/// thread at a time.
+typedef struct RenderDocumentCache RenderDocumentCache;
+
+/// Creates a cache keeping up to `glyph_cache_budget` bytes of glyph outlines
+/// for each font.
+RenderDocumentCache* render_document_cache_new(size_t glyph_cache_budget);
+void render_document_cache_free(RenderDocumentCache* cache);
+
+/// Renders a page with the default options.
 Error* render_page(
     Arena* arena,
     PdfResolver* resolver,
+    RenderDocumentCache* cache,
     const PdfPage* page,
     RenderCanvasType canvas_type,
     Canvas** canvas
 );
+
+/// Renders a page at the resolution, page box and region given by `options`.
+Error* render_page_with_options(
+    Arena* arena,
+    PdfResolver* resolver,
+    RenderDocumentCache* cache,
+    const PdfPage* page,
+    RenderCanvasType canvas_type,
+    const RenderOptions* options,
+    Canvas** canvas
+);
+
+/// A page's drawing commands, recorded once so the page can be drawn again at
+/// any resolution without re-running its content stream.
+typedef struct RenderDisplayList RenderDisplayList;
+
+/// Records a page into a display list allocated on `arena`. Paths and glyph
+/// outlines are kept as curves, and shadings are sampled only once the list
+/// is drawn. The document must stay open for as long as the list is drawn.
+Error* render_page_record(
+    Arena* arena,
+    PdfResolver* resolver,
+    RenderDocumentCache* cache,
+    const PdfPage* page,
+    RenderDisplayList** list_out
+);
+
+/// Draws a recorded page onto a new canvas at the resolution, page box and
+/// region given by `options`, as `render_page_with_options` would.
+Error* render_display_list_draw(
+    Arena* arena,
+    const RenderDisplayList* list,
+    RenderCanvasType canvas_type,
+    const RenderOptions* options,
+    Canvas** canvas
+);
+
+/// Receives row `y` of a banded render as `width` premultiplied RGBA8 pixels.
+/// The row is only valid for the duration of the call. Returning an error
+/// stops the render.
+typedef Error* (*RenderRowSink)(
+    void* user_data,
+    uint32_t y,
+    const uint8_t* rgba,
+    uint32_t width
+);
+
+/// Rasterizes a page in horizontal bands of `band_height` rows, passing each
+/// row to `sink` from top to bottom. The page is recorded once and the
+/// recording is replayed into each band, skipping paths outside it, so only
+/// one band of pixels is held in memory at a time. Rows are identical to
+/// those of `render_page_with_options`, except that text is drawn from glyph
+/// outlines rather than cached glyph masks.
+Error* render_page_banded(
+    Arena* arena,
+    PdfResolver* resolver,
+    RenderDocumentCache* cache,
+    const PdfPage* page,
+    const RenderOptions* options,
+    uint32_t band_height,
+    RenderRowSink sink,
+    void* sink_data
+);
+
+/// Receives a page of a batch render, along with its index in the document.
+/// The canvas is only valid for the duration of the call. Returning an error
+/// stops the batch.
+typedef Error* (*RenderBatchCallback)(
+    void* user_data,
+    size_t page_idx,
+    Canvas* canvas
+);
+
+/// Renders the pages of the document in `buffer` listed in `page_indices`,
+/// on up to `thread_count` worker threads. Workers share the parsed document,
+/// including its font programs and CMaps, but have their own arenas, glyph
+/// caches and canvases. Pages are passed to `callback` on the calling thread,
+/// in the order they are listed, as soon as each one and those before it are
+/// done. The first error, from a page or the callback, ends the batch and is
+/// returned.
+Error* render_pages_batch(
+    const uint8_t* buffer,
+    size_t buffer_size,
+    const size_t* page_indices,
+    size_t page_count,
+    RenderCanvasType canvas_type,
+    const RenderOptions* options,
+    uint32_t thread_count,
+    RenderBatchCallback callback,
+    void* user_data
+);
@@ -1,11 +1,28 @@
 #pragma once
 
+#include "arena/arena.h"
 #include "color/icc_cache.h"
+#include "font_cache.h"
 #include "pdf/fonts/agl.h"
-#include "pdf/fonts/cmap.h"
+#include "resource_cache.h"
+
+/// Interpreted form XObjects, declared in `form_cache.h`, which can't be
+/// included here since it depends on the graphics state.
+typedef struct RenderFormCache RenderFormCache;
 
 typedef struct {
-    PdfCMapCache* cmap_cache;
+    /// Holds values cached lazily while rendering, which are kept for every
+    /// page of the document rendered with the cache.
+    Arena* arena;
+
     PdfAglGlyphList* glyph_list;
     IccProfileCache icc_cache;
+    RenderFontCache* font_cache;
+    RenderResourceCache* resource_cache;
+
+    /// Recordings of forms are kept for every page, but their rasterizations
+    /// only for the page being rendered, on `page_arena`, which is NULL
+    /// between pages.
+    RenderFormCache* form_cache;
+    Arena* page_arena;
 } RenderCache;
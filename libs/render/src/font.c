@@ -8,9 +8,13 @@
 #include "arena/common.h"
 #include "cache.h"
 #include "canvas/canvas.h"
+#include "canvas/path_builder.h"
 #include "cff/cff.h"
 #include "err/error.h"
+#include "font_cache.h"
 #include "geom/mat3.h"
+#include "glyph_atlas.h"
+#include "glyph_cache.h"
 #include "logger/log.h"
 #include "parse_ctx/ctx.h"
 #include "pdf/fonts/agl.h"
@@ -50,8 +54,8 @@ Error* next_cid(
 
             // Get CMap. TODO: Check ROS against descendent font's ROS
             PdfCMap* cmap = NULL;
-            TRY(pdf_cmap_cache_get(
-                cache->cmap_cache,
+            TRY(render_font_cache_get_cmap(
+                cache->font_cache,
                 font->data.type0.encoding,
                 &cmap
             ));
@@ -89,6 +93,7 @@ Error* next_cid(
 Error* cid_to_gid(
     Arena* arena,
     PdfFont* font,
+    PdfCMap** to_unicode,
     RenderCache* cache,
     PdfResolver* resolver,
     uint32_t cid,
@@ -96,6 +101,7 @@ Error* cid_to_gid(
 ) {
     RELEASE_ASSERT(arena);
     RELEASE_ASSERT(font);
+    RELEASE_ASSERT(to_unicode);
     RELEASE_ASSERT(cache);
     RELEASE_ASSERT(resolver);
     RELEASE_ASSERT(gid_out);
@@ -122,6 +128,7 @@ Error* cid_to_gid(
             TRY(cid_to_gid(
                 arena,
                 &descendent_font,
+                to_unicode,
                 cache,
                 resolver,
                 cid,
@@ -190,16 +197,18 @@ Error* cid_to_gid(
             RELEASE_ASSERT(cid < 256);
 
             if (font->data.true_type.to_unicode.is_some) {
-                PdfCMap* to_unicode = NULL;
-                TRY(pdf_parse_cmap(
-                    arena,
-                    font->data.true_type.to_unicode.value.stream_bytes,
-                    font->data.true_type.to_unicode.value.decoded_stream_len,
-                    &to_unicode
-                ));
+                if (!*to_unicode) {
+                    TRY(pdf_parse_cmap(
+                        cache->arena,
+                        font->data.true_type.to_unicode.value.stream_bytes,
+                        font->data.true_type.to_unicode.value
+                            .decoded_stream_len,
+                        to_unicode
+                    ));
+                }
 
                 uint32_t unicode;
-                TRY(pdf_cmap_get_unicode(to_unicode, cid, &unicode));
+                TRY(pdf_cmap_get_unicode(*to_unicode, cid, &unicode));
                 *gid_out = unicode;
             } else {
                 const char* glyph = pdf_encoding_map_codepoint(
@@ -210,14 +219,16 @@ Error* cid_to_gid(
 
                 if (!cache->glyph_list) {
                     uint8_t* glyph_list = load_file_to_buffer(
-                        arena,
+                        cache->arena,
                         "assets/agl-aglfn/glyphlist.txt",
                         NULL
                     );
                     RELEASE_ASSERT(glyph_list);
 
-                    cache->glyph_list =
-                        pdf_parse_agl_glyphlist(arena, (char*)glyph_list);
+                    cache->glyph_list = pdf_parse_agl_glyphlist(
+                        cache->arena,
+                        (char*)glyph_list
+                    );
                 }
 
                 uint16_t codepoints[4] = {0, 0, 0, 0};
@@ -247,9 +258,119 @@ Error* cid_to_gid(
     return NULL;
 }
 
+static Error* build_glyph_outline(
+    RenderFontProgram* program,
+    bool lookup_by_cid,
+    uint32_t gid,
+    PathBuilder* path
+) {
+    RELEASE_ASSERT(program);
+    RELEASE_ASSERT(path);
+
+    switch (program->type) {
+        case RENDER_FONT_PROGRAM_SFNT: {
+            SfntGlyph glyph;
+            if (lookup_by_cid) {
+                TRY(sfnt_get_glyph_for_cid(program->data.sfnt, gid, &glyph));
+            } else {
+                TRY(sfnt_get_glyph_for_gid(program->data.sfnt, gid, &glyph));
+            }
+
+            sfnt_glyph_outline(&glyph, geom_mat3_identity(), path);
+            return NULL;
+        }
+        case RENDER_FONT_PROGRAM_CFF: {
+            TRY(cff_glyph_outline(program->data.cff, gid, path));
+            return NULL;
+        }
+    }
+
+    LOG_PANIC("Unreachable");
+}
+
+/// Draws a glyph from its cached font-unit outline, building and caching the
+/// outline on a miss.
+static Error* render_program_glyph(
+    RenderFontProgram* program,
+    bool lookup_by_cid,
+    uint32_t gid,
+    Canvas* canvas,
+    GeomMat3 transform,
+    CanvasBrush brush
+) {
+    RELEASE_ASSERT(program);
+    RELEASE_ASSERT(canvas);
+
+    const PathBuilder* outline = render_glyph_cache_get(program->glyphs, gid);
+    Arena* uncached_arena = NULL;
+
+    if (!outline) {
+        Arena* outline_arena = arena_new(1024);
+        PathBuilder* path = path_builder_new(outline_arena);
+
+        Error* outline_error =
+            build_glyph_outline(program, lookup_by_cid, gid, path);
+        if (outline_error) {
+            arena_free(outline_arena);
+            return outline_error;
+        }
+
+        // Glyph ids are 16-bit in every supported font format, so anything
+        // larger is drawn without being cached.
+        if (gid <= UINT16_MAX) {
+            outline = render_glyph_cache_insert(
+                program->glyphs,
+                gid,
+                outline_arena,
+                path
+            );
+        } else {
+            uncached_arena = outline_arena;
+            outline = path;
+        }
+    }
+
+    // Plain filled text is composited from cached coverage masks where
+    // possible, which avoids re-flattening and re-scanning every glyph
+    bool use_atlas =
+        brush.enable_fill && !brush.enable_stroke && !brush.even_odd_fill;
+    if (use_atlas
+        && render_glyph_atlas_draw(
+            program->atlas,
+            gid,
+            outline,
+            canvas,
+            transform,
+            brush.fill_rgba
+        )) {
+        if (uncached_arena) {
+            arena_free(uncached_arena);
+        }
+        return NULL;
+    }
+
+    Arena* temp_arena = arena_new(4096);
+    PathBuilderOptions path_options = path_builder_options_default();
+    if (canvas_is_raster(canvas)) {
+        path_options = path_builder_options_flattened();
+    }
+    PathBuilder* path = path_builder_new_with_options(temp_arena, path_options);
+
+    path_builder_append_transformed(path, outline, transform);
+    canvas_draw_path(canvas, path, brush);
+
+    arena_free(temp_arena);
+    if (uncached_arena) {
+        arena_free(uncached_arena);
+    }
+
+    return NULL;
+}
+
 Error* render_glyph(
     Arena* arena,
     PdfFont* font,
+    RenderCache* cache,
     PdfResolver* resolver,
     uint32_t gid,
     Canvas* canvas,
@@ -258,6 +379,7 @@ Error* render_glyph(
 ) {
     RELEASE_ASSERT(arena);
     RELEASE_ASSERT(font);
+    RELEASE_ASSERT(cache);
     RELEASE_ASSERT(resolver);
 
     switch (font->type) {
@@ -282,6 +404,7 @@ Error* render_glyph(
             TRY(render_glyph(
                 arena,
                 &descendent_font,
+                cache,
                 resolver,
                 gid,
                 canvas,
@@ -291,133 +414,68 @@ Error* render_glyph(
             return NULL;
         }
         case PDF_FONT_CIDTYPE0: {
-            TRY(pdf_resolve_font_descriptor(
+            RenderFontProgram* program = NULL;
+            TRY(render_font_cache_get(
+                cache->font_cache,
+                resolver,
                 &font->data.cid.font_descriptor,
-                resolver
+                &program
             ));
-            PdfFontDescriptor* font_descriptor =
-                font->data.cid.font_descriptor.resolved;
-
-            if (font_descriptor->font_file.is_some) {
-                LOG_TODO("Embedded Type1 font");
-            } else if (font_descriptor->font_file2.is_some) {
-                LOG_TODO("Embedded Type2 font");
-            } else if (font_descriptor->font_file3.is_some) {
-                PdfFontStreamDict stream_dict;
-                TRY(pdf_deserde_font_stream_dict(
-                    font_descriptor->font_file3.value.stream_dict->raw_dict,
-                    &stream_dict,
-                    resolver
-                ));
-
-                if (!stream_dict.subtype.is_some) {
-                    return ERROR(
-                        PDF_ERR_MISSING_DICT_KEY,
-                        "`Subtype` is required for FontFile3"
-                    );
-                }
-
-                PdfName subtype = stream_dict.subtype.value;
-                if (strcmp(subtype, "Type1C") == 0) {
-                    LOG_TODO("Type1C FontFile3 embedded font");
-                } else if (strcmp(subtype, "CIDFontType0C") == 0) {
-                    Arena* local_arena = arena_new(1024);
-                    CffFontSet* cff_font_set;
-                    ParseCtx cff_ctx = parse_ctx_new(
-                        font_descriptor->font_file3.value.stream_bytes,
-                        font_descriptor->font_file3.value.decoded_stream_len
-                    );
-                    TRY(cff_parse_fontset(arena, cff_ctx, &cff_font_set));
-
-                    TRY(cff_render_glyph(
-                        cff_font_set,
-                        gid,
-                        canvas,
-                        transform,
-                        brush
-                    ));
 
-                    arena_free(local_arena);
-                } else {
-                    LOG_TODO("Make this an error");
-                }
-            } else {
-                LOG_TODO("Non-embedded CIDType0 fonts");
+            if (program->type != RENDER_FONT_PROGRAM_CFF) {
+                LOG_TODO("Non-CFF CIDType0 fonts");
             }
 
+            TRY(render_program_glyph(
+                program,
+                false,
+                gid,
+                canvas,
+                transform,
+                brush
+            ));
             return NULL;
         }
         case PDF_FONT_CIDTYPE2: {
-            TRY(pdf_resolve_font_descriptor(
+            RenderFontProgram* program = NULL;
+            TRY(render_font_cache_get(
+                cache->font_cache,
+                resolver,
                 &font->data.cid.font_descriptor,
-                resolver
+                &program
             ));
-            PdfFontDescriptor* font_descriptor =
-                font->data.cid.font_descriptor.resolved;
-
-            SfntFont sfnt_font;
-            if (font_descriptor->font_file2.is_some) {
-                TRY(sfnt_font_new(
-                    arena,
-                    parse_ctx_new(
-                        font_descriptor->font_file2.value.stream_bytes,
-                        font_descriptor->font_file2.value.decoded_stream_len
-                    ),
-                    &sfnt_font
-                ));
-            } else {
-                // TODO: proper resolution, caching
-                TRY(sfnt_font_new(
-                    arena,
-                    parse_ctx_from_file(
-                        arena,
-                        "assets/fonts-urw-base35/fonts/NimbusSans-Regular.ttf"
-                    ),
-                    &sfnt_font
-                ));
-            }
-
-            SfntGlyph glyph;
-            TRY(sfnt_get_glyph_for_gid(&sfnt_font, gid, &glyph));
-            sfnt_glyph_render(canvas, &glyph, transform, brush);
+            RELEASE_ASSERT(program->type == RENDER_FONT_PROGRAM_SFNT);
 
+            TRY(render_program_glyph(
+                program,
+                false,
+                gid,
+                canvas,
+                transform,
+                brush
+            ));
             return NULL;
         }
         case PDF_FONT_TRUETYPE: {
             RELEASE_ASSERT(font->data.true_type.font_descriptor.is_some);
 
-            TRY(pdf_resolve_font_descriptor(
+            RenderFontProgram* program = NULL;
+            TRY(render_font_cache_get(
+                cache->font_cache,
+                resolver,
                 &font->data.true_type.font_descriptor.value,
-                resolver
+                &program
             ));
-            PdfFontDescriptor* font_descriptor =
-                font->data.true_type.font_descriptor.value.resolved;
-
-            SfntFont sfnt_font;
-            if (font_descriptor->font_file2.is_some) {
-                TRY(sfnt_font_new(
-                    arena,
-                    parse_ctx_new(
-                        font_descriptor->font_file2.value.stream_bytes,
-                        font_descriptor->font_file2.value.decoded_stream_len
-                    ),
-                    &sfnt_font
-                ));
-            } else {
-                // TODO: proper resolution, caching
-                TRY(sfnt_font_new(
-                    arena,
-                    parse_ctx_from_file(
-                        arena,
-                        "assets/fonts-urw-base35/fonts/NimbusSans-Regular.ttf"
-                    ),
-                    &sfnt_font
-                ));
-            }
+            RELEASE_ASSERT(program->type == RENDER_FONT_PROGRAM_SFNT);
 
-            SfntGlyph glyph;
-            TRY(sfnt_get_glyph_for_cid(&sfnt_font, gid, &glyph));
-            sfnt_glyph_render(canvas, &glyph, transform, brush);
+            TRY(render_program_glyph(
+                program,
+                true,
+                gid,
+                canvas,
+                transform,
+                brush
+            ));
             break;
         }
         default: {
@@ -525,11 +583,13 @@ Error* cid_to_width(
 
 Error* get_font_matrix(
     Arena* arena,
+    RenderCache* cache,
     PdfResolver* resolver,
     PdfFont* font,
     GeomMat3* font_matrix_out
 ) {
     RELEASE_ASSERT(arena);
+    RELEASE_ASSERT(cache);
     RELEASE_ASSERT(font);
     RELEASE_ASSERT(font_matrix_out);
 
@@ -555,6 +615,7 @@ Error* get_font_matrix(
             // Call recursively
             TRY(get_font_matrix(
                 arena,
+                cache,
                 resolver,
                 &descendent_font,
                 font_matrix_out
@@ -562,124 +623,49 @@ Error* get_font_matrix(
             return NULL;
         }
         case PDF_FONT_CIDTYPE0: {
-            TRY(pdf_resolve_font_descriptor(
+            RenderFontProgram* program = NULL;
+            TRY(render_font_cache_get(
+                cache->font_cache,
+                resolver,
                 &font->data.cid.font_descriptor,
-                resolver
+                &program
             ));
-            PdfFontDescriptor* font_descriptor =
-                font->data.cid.font_descriptor.resolved;
 
-            if (font_descriptor->font_file.is_some) {
-                LOG_TODO("Embedded Type1 font");
-            } else if (font_descriptor->font_file2.is_some) {
-                LOG_TODO("Embedded Type2 font");
-            } else if (font_descriptor->font_file3.is_some) {
-                PdfFontStreamDict stream_dict;
-                TRY(pdf_deserde_font_stream_dict(
-                    font_descriptor->font_file3.value.stream_dict->raw_dict,
-                    &stream_dict,
-                    resolver
-                ));
-
-                if (!stream_dict.subtype.is_some) {
-                    return ERROR(
-                        PDF_ERR_MISSING_DICT_KEY,
-                        "`Subtype` is required for FontFile3"
-                    );
-                }
-
-                PdfName subtype = stream_dict.subtype.value;
-                if (strcmp(subtype, "Type1C") == 0) {
-                    LOG_TODO("Type1C FontFile3 embedded font");
-                } else if (strcmp(subtype, "CIDFontType0C") == 0) {
-                    Arena* local_arena = arena_new(1024);
-                    CffFontSet* cff_font_set;
-                    ParseCtx cff_ctx = parse_ctx_new(
-                        font_descriptor->font_file3.value.stream_bytes,
-                        font_descriptor->font_file3.value.decoded_stream_len
-                    );
-                    TRY(cff_parse_fontset(arena, cff_ctx, &cff_font_set));
-
-                    *font_matrix_out = cff_font_matrix(cff_font_set);
-                    arena_free(local_arena);
-                } else {
-                    LOG_TODO("Make this an error");
-                }
-            } else {
-                LOG_TODO("Non-embedded CIDType0 fonts");
+            if (program->type != RENDER_FONT_PROGRAM_CFF) {
+                LOG_TODO("Non-CFF CIDType0 fonts");
             }
 
+            *font_matrix_out = cff_font_matrix(program->data.cff);
             return NULL;
         }
         case PDF_FONT_CIDTYPE2: {
-            // TODO: proper font resolution, caching, using embedded
-            TRY(pdf_resolve_font_descriptor(
+            RenderFontProgram* program = NULL;
+            TRY(render_font_cache_get(
+                cache->font_cache,
+                resolver,
                 &font->data.cid.font_descriptor,
-                resolver
+                &program
             ));
-            PdfFontDescriptor* font_descriptor =
-                font->data.cid.font_descriptor.resolved;
-
-            SfntFont sfnt_font;
-            if (font_descriptor->font_file2.is_some) {
-                TRY(sfnt_font_new(
-                    arena,
-                    parse_ctx_new(
-                        font_descriptor->font_file2.value.stream_bytes,
-                        font_descriptor->font_file2.value.decoded_stream_len
-                    ),
-                    &sfnt_font
-                ));
-            } else {
-                // TODO: proper resolution, caching
-                TRY(sfnt_font_new(
-                    arena,
-                    parse_ctx_from_file(
-                        arena,
-                        "assets/fonts-urw-base35/fonts/NimbusMonoPS-Regular.ttf"
-                    ),
-                    &sfnt_font
-                ));
-            }
+            RELEASE_ASSERT(program->type == RENDER_FONT_PROGRAM_SFNT);
 
-            units_per_em = (double)sfnt_font_head(&sfnt_font).units_per_em;
+            units_per_em =
+                (double)sfnt_font_head(program->data.sfnt).units_per_em;
             break;
         }
         case PDF_FONT_TRUETYPE: {
-            // TODO: proper font resolution, caching, using embedded
             RELEASE_ASSERT(font->data.true_type.font_descriptor.is_some);
 
-            TRY(pdf_resolve_font_descriptor(
+            RenderFontProgram* program = NULL;
+            TRY(render_font_cache_get(
+                cache->font_cache,
+                resolver,
                 &font->data.true_type.font_descriptor.value,
-                resolver
+                &program
             ));
-            PdfFontDescriptor* font_descriptor =
-                font->data.true_type.font_descriptor.value.resolved;
-
-            SfntFont sfnt_font;
-            if (font_descriptor->font_file2.is_some) {
-                TRY(sfnt_font_new(
-                    arena,
-                    parse_ctx_new(
-                        font_descriptor->font_file2.value.stream_bytes,
-                        font_descriptor->font_file2.value.decoded_stream_len
-                    ),
-                    &sfnt_font
-                ));
-            } else {
-                // TODO: proper resolution, caching
-                TRY(sfnt_font_new(
-                    arena,
-                    parse_ctx_from_file(
-                        arena,
-                        "assets/fonts-urw-base35/fonts/NimbusMonoPS-Regular.ttf"
-                    ),
-                    &sfnt_font
-                ));
-            }
-
-            units_per_em = (double)sfnt_font_head(&sfnt_font).units_per_em;
+            RELEASE_ASSERT(program->type == RENDER_FONT_PROGRAM_SFNT);
 
+            units_per_em =
+                (double)sfnt_font_head(program->data.sfnt).units_per_em;
             break;
         }
         default: {
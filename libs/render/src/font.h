@@ -22,10 +22,12 @@ Error* next_cid(
     uint32_t* cid_out
 );
 
-/// Maps a CID to a GID for the given glyph.
+/// Maps a CID to a GID for the given glyph. `to_unicode` holds the font's
+/// parsed ToUnicode CMap, and is filled in on first use.
 Error* cid_to_gid(
     Arena* arena,
     PdfFont* font,
+    PdfCMap** to_unicode,
     RenderCache* cache,
     PdfResolver* resolver,
     uint32_t cid,
@@ -36,6 +38,7 @@ Error* cid_to_gid(
 Error* render_glyph(
     Arena* arena,
     PdfFont* font,
+    RenderCache* cache,
     PdfResolver* resolver,
     uint32_t gid,
     Canvas* canvas,
@@ -54,6 +57,7 @@ Error* cid_to_width(
 /// Get the font matrix for a font
 Error* get_font_matrix(
     Arena* arena,
+    RenderCache* cache,
     PdfResolver* resolver,
     PdfFont* font,
     GeomMat3* font_matrix_out
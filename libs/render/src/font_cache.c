@@ -0,0 +1,350 @@
+#include "font_cache.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "arena/arena.h"
+#include "cff/cff.h"
+#include "err/error.h"
+#include "font_registry.h"
+#include "glyph_atlas.h"
+#include "glyph_cache.h"
+#include "logger/log.h"
+#include "parse_ctx/ctx.h"
+#include "pdf/fonts/cmap.h"
+#include "pdf/fonts/font_descriptor.h"
+#include "pdf/fonts/stream_dict.h"
+#include "pdf/object.h"
+#include "pdf/resolver.h"
+#include "pdf/stream_dict.h"
+#include "sfnt/sfnt.h"
+
+typedef struct {
+    PdfIndirectRef descriptor_ref;
+    RenderFontProgram program;
+} RenderFontCacheEntry;
+
+#define DVEC_NAME RenderFontCacheEntryVec
+#define DVEC_LOWERCASE_NAME render_font_cache_entry_vec
+#define DVEC_TYPE RenderFontCacheEntry
+#include "arena/dvec_impl.h"
+
+typedef struct {
+    char* name;
+    PdfCMap* cmap;
+} RenderCMapEntry;
+
+#define DVEC_NAME RenderCMapEntryVec
+#define DVEC_LOWERCASE_NAME render_cmap_entry_vec
+#define DVEC_TYPE RenderCMapEntry
+#include "arena/dvec_impl.h"
+
+struct RenderFontStore {
+    /// Guards the fields below, including allocations on `arena`.
+    pthread_mutex_t mutex;
+    Arena* arena;
+
+    /// Parsed programs, without glyph caches or atlases. Font caches only
+    /// read glyphs through their own copies of them.
+    RenderFontCacheEntryVec* programs;
+    PdfCMapCache* cmap_cache;
+};
+
+struct RenderFontCache {
+    Arena* arena;
+    RenderFontStore* store;
+    size_t glyph_cache_budget;
+    RenderFontCacheEntryVec* entries;
+    RenderCMapEntryVec* cmaps;
+};
+
+RenderFontStore* render_font_store_new(void) {
+    Arena* arena = arena_new(65536);
+
+    RenderFontStore* store = arena_alloc(arena, sizeof(RenderFontStore));
+    RELEASE_ASSERT(pthread_mutex_init(&store->mutex, NULL) == 0);
+    store->arena = arena;
+    store->programs = render_font_cache_entry_vec_new(arena);
+    store->cmap_cache = pdf_cmap_cache_new(arena);
+
+    return store;
+}
+
+void render_font_store_free(RenderFontStore* store) {
+    RELEASE_ASSERT(store);
+
+    RELEASE_ASSERT(pthread_mutex_destroy(&store->mutex) == 0);
+    arena_free(store->arena);
+}
+
+RenderFontCache* render_font_cache_new(
+    Arena* arena,
+    RenderFontStore* store,
+    size_t glyph_cache_budget
+) {
+    RELEASE_ASSERT(arena);
+
+    RenderFontCache* cache = arena_alloc(arena, sizeof(RenderFontCache));
+    cache->arena = arena;
+    cache->store = store;
+    cache->glyph_cache_budget = glyph_cache_budget;
+    cache->entries = render_font_cache_entry_vec_new(arena);
+    cache->cmaps = render_cmap_entry_vec_new(arena);
+
+    return cache;
+}
+
+void render_font_cache_free(RenderFontCache* cache) {
+    RELEASE_ASSERT(cache);
+
+    for (size_t idx = 0;
+         idx < render_font_cache_entry_vec_len(cache->entries);
+         idx++) {
+        RenderFontCacheEntry* entry = NULL;
+        RELEASE_ASSERT(
+            render_font_cache_entry_vec_get_ptr(cache->entries, idx, &entry)
+        );
+        render_glyph_cache_free(entry->program.glyphs);
+        render_glyph_atlas_free(entry->program.atlas);
+    }
+}
+
+static Error* load_font_program(
+    Arena* arena,
+    PdfResolver* resolver,
+    PdfFontDescriptorRef* descriptor,
+    RenderFontProgram* program_out
+) {
+    RELEASE_ASSERT(arena);
+    RELEASE_ASSERT(resolver);
+    RELEASE_ASSERT(descriptor);
+    RELEASE_ASSERT(program_out);
+
+    LOG_DIAG(
+        DEBUG,
+        FONT,
+        "Parsing font program for descriptor %zu %zu",
+        descriptor->ref.object_id,
+        descriptor->ref.generation
+    );
+
+    PdfFontDescriptor* font_descriptor = descriptor->resolved;
+
+    if (font_descriptor->font_file.is_some) {
+        LOG_TODO("Embedded Type1 font");
+    } else if (font_descriptor->font_file2.is_some) {
+        program_out->type = RENDER_FONT_PROGRAM_SFNT;
+        program_out->embedded = true;
+        program_out->data.sfnt = arena_alloc(arena, sizeof(SfntFont));
+        TRY(sfnt_font_new(
+            arena,
+            parse_ctx_new(
+                font_descriptor->font_file2.value.stream_bytes,
+                font_descriptor->font_file2.value.decoded_stream_len
+            ),
+            program_out->data.sfnt
+        ));
+    } else if (font_descriptor->font_file3.is_some) {
+        PdfFontStreamDict stream_dict;
+        TRY(pdf_deserde_font_stream_dict(
+            font_descriptor->font_file3.value.stream_dict->raw_dict,
+            &stream_dict,
+            resolver
+        ));
+
+        if (!stream_dict.subtype.is_some) {
+            return ERROR(
+                PDF_ERR_MISSING_DICT_KEY,
+                "`Subtype` is required for FontFile3"
+            );
+        }
+
+        PdfName subtype = stream_dict.subtype.value;
+        if (strcmp(subtype, "Type1C") == 0) {
+            LOG_TODO("Type1C FontFile3 embedded font");
+        } else if (strcmp(subtype, "CIDFontType0C") == 0) {
+            program_out->type = RENDER_FONT_PROGRAM_CFF;
+            program_out->embedded = true;
+            TRY(cff_parse_fontset(
+                arena,
+                parse_ctx_new(
+                    font_descriptor->font_file3.value.stream_bytes,
+                    font_descriptor->font_file3.value.decoded_stream_len
+                ),
+                &program_out->data.cff
+            ));
+        } else {
+            LOG_TODO("Make this an error");
+        }
+    } else {
+        program_out->type = RENDER_FONT_PROGRAM_SFNT;
+        program_out->embedded = false;
+        program_out->data.sfnt = arena_alloc(arena, sizeof(SfntFont));
+        TRY(render_font_registry_get(
+            arena,
+            font_descriptor,
+            program_out->data.sfnt
+        ));
+    }
+
+    return NULL;
+}
+
+static RenderFontProgram*
+find_font_program(RenderFontCacheEntryVec* entries, PdfIndirectRef ref) {
+    for (size_t idx = 0; idx < render_font_cache_entry_vec_len(entries);
+         idx++) {
+        RenderFontCacheEntry* entry = NULL;
+        RELEASE_ASSERT(
+            render_font_cache_entry_vec_get_ptr(entries, idx, &entry)
+        );
+
+        if (entry->descriptor_ref.object_id == ref.object_id
+            && entry->descriptor_ref.generation == ref.generation) {
+            return &entry->program;
+        }
+    }
+
+    return NULL;
+}
+
+/// Gets the program for a resolved `descriptor` from `store`, parsing it
+/// there on first use, and copies it into `program_out` with parser state of
+/// its own allocated on `arena`.
+static Error* render_font_store_get(
+    RenderFontStore* store,
+    Arena* arena,
+    PdfResolver* resolver,
+    PdfFontDescriptorRef* descriptor,
+    RenderFontProgram* program_out
+) {
+    RELEASE_ASSERT(pthread_mutex_lock(&store->mutex) == 0);
+
+    Error* error = NULL;
+    RenderFontProgram* shared =
+        find_font_program(store->programs, descriptor->ref);
+    if (!shared) {
+        RenderFontCacheEntry entry = {.descriptor_ref = descriptor->ref};
+        error = load_font_program(
+            store->arena,
+            resolver,
+            descriptor,
+            &entry.program
+        );
+        if (!error) {
+            shared = &render_font_cache_entry_vec_push(store->programs, entry)
+                          ->program;
+        }
+    }
+
+    if (!error) {
+        *program_out = *shared;
+    }
+
+    RELEASE_ASSERT(pthread_mutex_unlock(&store->mutex) == 0);
+
+    if (error) {
+        return error;
+    }
+
+    switch (program_out->type) {
+        case RENDER_FONT_PROGRAM_SFNT: {
+            SfntFont* sfnt = arena_alloc(arena, sizeof(SfntFont));
+            sfnt_font_copy(arena, program_out->data.sfnt, sfnt);
+            program_out->data.sfnt = sfnt;
+            break;
+        }
+        case RENDER_FONT_PROGRAM_CFF: {
+            program_out->data.cff =
+                cff_fontset_copy(arena, program_out->data.cff);
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+Error* render_font_cache_get(
+    RenderFontCache* cache,
+    PdfResolver* resolver,
+    PdfFontDescriptorRef* descriptor,
+    RenderFontProgram** program_out
+) {
+    RELEASE_ASSERT(cache);
+    RELEASE_ASSERT(resolver);
+    RELEASE_ASSERT(descriptor);
+    RELEASE_ASSERT(program_out);
+
+    RenderFontProgram* cached =
+        find_font_program(cache->entries, descriptor->ref);
+    if (cached) {
+        *program_out = cached;
+        return NULL;
+    }
+
+    TRY(pdf_resolve_font_descriptor(descriptor, resolver));
+
+    RenderFontCacheEntry entry = {.descriptor_ref = descriptor->ref};
+    if (cache->store) {
+        TRY(render_font_store_get(
+            cache->store,
+            cache->arena,
+            resolver,
+            descriptor,
+            &entry.program
+        ));
+    } else {
+        TRY(load_font_program(
+            cache->arena,
+            resolver,
+            descriptor,
+            &entry.program
+        ));
+    }
+    entry.program.glyphs =
+        render_glyph_cache_new(cache->arena, cache->glyph_cache_budget);
+    entry.program.atlas =
+        render_glyph_atlas_new(cache->arena, RENDER_GLYPH_ATLAS_BUDGET);
+
+    *program_out = &render_font_cache_entry_vec_push(cache->entries, entry)
+                        ->program;
+    return NULL;
+}
+
+Error* render_font_cache_get_cmap(
+    RenderFontCache* cache,
+    char* name,
+    PdfCMap** cmap_out
+) {
+    RELEASE_ASSERT(cache);
+    RELEASE_ASSERT(name);
+    RELEASE_ASSERT(cmap_out);
+
+    for (size_t idx = 0; idx < render_cmap_entry_vec_len(cache->cmaps);
+         idx++) {
+        RenderCMapEntry entry;
+        RELEASE_ASSERT(render_cmap_entry_vec_get(cache->cmaps, idx, &entry));
+
+        if (strcmp(entry.name, name) == 0) {
+            *cmap_out = entry.cmap;
+            return NULL;
+        }
+    }
+
+    // CMaps are only read once they're parsed, so they can be shared as is
+    RenderCMapEntry entry = {.name = name, .cmap = NULL};
+    if (cache->store) {
+        RenderFontStore* store = cache->store;
+        RELEASE_ASSERT(pthread_mutex_lock(&store->mutex) == 0);
+        Error* error = pdf_cmap_cache_get(store->cmap_cache, name, &entry.cmap);
+        RELEASE_ASSERT(pthread_mutex_unlock(&store->mutex) == 0);
+        TRY(error);
+    } else {
+        TRY(pdf_load_cmap(cache->arena, name, &entry.cmap));
+    }
+
+    render_cmap_entry_vec_push(cache->cmaps, entry);
+    *cmap_out = entry.cmap;
+    return NULL;
+}
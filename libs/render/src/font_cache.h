@@ -0,0 +1,75 @@
+#pragma once
+
+#include "arena/arena.h"
+#include "cff/cff.h"
+#include "err/error.h"
+#include "glyph_atlas.h"
+#include "glyph_cache.h"
+#include "pdf/fonts/cmap.h"
+#include "pdf/fonts/font_descriptor.h"
+#include "pdf/resolver.h"
+#include "sfnt/sfnt.h"
+
+typedef enum {
+    RENDER_FONT_PROGRAM_SFNT,
+    RENDER_FONT_PROGRAM_CFF
+} RenderFontProgramType;
+
+/// A parsed font program, either embedded in the document or substituted for
+/// a non-embedded font.
+typedef struct {
+    RenderFontProgramType type;
+    bool embedded;
+
+    union {
+        SfntFont* sfnt;
+        CffFontSet* cff;
+    } data;
+
+    RenderGlyphCache* glyphs;
+    RenderGlyphAtlas* atlas;
+} RenderFontProgram;
+
+/// Font programs and predefined CMaps parsed once for a document, and shared
+/// by the font caches of every thread rendering it.
+typedef struct RenderFontStore RenderFontStore;
+
+RenderFontStore* render_font_store_new(void);
+
+/// Frees the store. The programs it holds point into the document's streams,
+/// so the resolvers which loaded them must outlive it.
+void render_font_store_free(RenderFontStore* store);
+
+/// Cache of parsed font programs, keyed by the indirect reference of the font
+/// descriptor which owns them, and of the predefined CMaps used by fonts.
+typedef struct RenderFontCache RenderFontCache;
+
+/// Creates a font cache. Each font program gets its own glyph outline cache
+/// limited to `glyph_cache_budget` bytes, and its own glyph mask atlas. If
+/// `store` isn't null, programs and CMaps are parsed into it, and the cache
+/// only keeps its own copy of each program's parser state, so it may be used
+/// on a different thread from other caches sharing the store.
+RenderFontCache* render_font_cache_new(
+    Arena* arena,
+    RenderFontStore* store,
+    size_t glyph_cache_budget
+);
+
+/// Releases the glyph outlines and masks held by every cached font program.
+void render_font_cache_free(RenderFontCache* cache);
+
+/// Gets the font program for `descriptor`, parsing it on first use. The
+/// returned program is owned by the cache.
+Error* render_font_cache_get(
+    RenderFontCache* cache,
+    PdfResolver* resolver,
+    PdfFontDescriptorRef* descriptor,
+    RenderFontProgram** program_out
+);
+
+/// Gets the predefined CMap called `name`, loading it on first use.
+Error* render_font_cache_get_cmap(
+    RenderFontCache* cache,
+    char* name,
+    PdfCMap** cmap_out
+);
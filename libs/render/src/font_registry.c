@@ -0,0 +1,285 @@
+#include "font_registry.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "arena/arena.h"
+#include "err/error.h"
+#include "logger/log.h"
+#include "parse_ctx/ctx.h"
+#include "pdf/fonts/font_descriptor.h"
+#include "pdf/types.h"
+#include "sfnt/sfnt.h"
+
+#define FONT_FLAG_FIXED_PITCH (1 << 0)
+#define FONT_FLAG_SERIF (1 << 1)
+#define FONT_FLAG_ITALIC (1 << 6)
+#define FONT_FLAG_FORCE_BOLD (1 << 18)
+
+typedef struct {
+    /// Names which start with any of these prefixes belong to the family.
+    const char* prefixes[3];
+
+    /// Regular, bold, italic and bold-italic files, without an extension.
+    const char* files[4];
+} SubstituteFamily;
+
+// Narrow families come first, since their names extend the regular ones
+static const SubstituteFamily SUBSTITUTE_FAMILIES[] = {
+    {{"Helvetica-Narrow", "ArialNarrow", "Arial-Narrow"},
+     {"NimbusSansNarrow-Regular",
+      "NimbusSansNarrow-Bold",
+      "NimbusSansNarrow-Oblique",
+      "NimbusSansNarrow-BoldOblique"}},
+    {{"Helvetica", "Arial", NULL},
+     {"NimbusSans-Regular",
+      "NimbusSans-Bold",
+      "NimbusSans-Italic",
+      "NimbusSans-BoldItalic"}},
+    {{"Times", NULL, NULL},
+     {"NimbusRoman-Regular",
+      "NimbusRoman-Bold",
+      "NimbusRoman-Italic",
+      "NimbusRoman-BoldItalic"}},
+    {{"Courier", NULL, NULL},
+     {"NimbusMonoPS-Regular",
+      "NimbusMonoPS-Bold",
+      "NimbusMonoPS-Italic",
+      "NimbusMonoPS-BoldItalic"}},
+    {{"Symbol", NULL, NULL},
+     {"StandardSymbolsPS",
+      "StandardSymbolsPS",
+      "StandardSymbolsPS",
+      "StandardSymbolsPS"}},
+    {{"ZapfDingbats", "Dingbats", NULL},
+     {"D050000L", "D050000L", "D050000L", "D050000L"}},
+    {{"Palatino", "BookAntiqua", NULL},
+     {"P052-Roman", "P052-Bold", "P052-Italic", "P052-BoldItalic"}},
+    {{"Bookman", NULL, NULL},
+     {"URWBookman-Light",
+      "URWBookman-Demi",
+      "URWBookman-LightItalic",
+      "URWBookman-DemiItalic"}},
+    {{"AvantGarde", NULL, NULL},
+     {"URWGothic-Book",
+      "URWGothic-Demi",
+      "URWGothic-BookOblique",
+      "URWGothic-DemiOblique"}},
+    {{"NewCenturySchlbk", "CenturySchoolbook", NULL},
+     {"C059-Roman", "C059-Bold", "C059-Italic", "C059-BdIta"}},
+    {{"ZapfChancery", NULL, NULL},
+     {"Z003-MediumItalic",
+      "Z003-MediumItalic",
+      "Z003-MediumItalic",
+      "Z003-MediumItalic"}}
+};
+
+#define SUBSTITUTE_SANS 1
+#define SUBSTITUTE_SERIF 2
+#define SUBSTITUTE_MONO 3
+
+#define REGISTRY_MAX_FONTS 48
+
+typedef enum {
+    REGISTRY_FONT_UNLOADED,
+    REGISTRY_FONT_LOADED,
+    REGISTRY_FONT_FAILED
+} RegistryFontState;
+
+typedef struct {
+    const char* file;
+    RegistryFontState state;
+
+    const uint8_t* map;
+    size_t map_len;
+
+    /// Parsed tables, shared by every caller. Its cursors and arena are never
+    /// used directly, only copied.
+    SfntFont font;
+} RegistryFont;
+
+static pthread_mutex_t registry_mutex = PTHREAD_MUTEX_INITIALIZER;
+static Arena* registry_arena = NULL;
+static RegistryFont registry_fonts[REGISTRY_MAX_FONTS];
+static size_t registry_font_count = 0;
+
+static bool name_contains(const char* name, const char* const* needles) {
+    for (size_t idx = 0; needles[idx]; idx++) {
+        if (strstr(name, needles[idx])) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+const char*
+render_font_registry_match(const char* font_name, PdfInteger flags, bool bold) {
+    static const char* const BOLD_NAMES[] =
+        {"Bold", "bold", "Black", "Heavy", "Demi", NULL};
+    static const char* const ITALIC_NAMES[] = {"Italic", "Oblique", NULL};
+
+    const char* name = font_name ? font_name : "";
+
+    // Skip the subset tag, six uppercase letters followed by a plus sign
+    if (strlen(name) > 7 && name[6] == '+') {
+        bool is_tag = true;
+        for (size_t idx = 0; idx < 6; idx++) {
+            is_tag &= name[idx] >= 'A' && name[idx] <= 'Z';
+        }
+
+        if (is_tag) {
+            name += 7;
+        }
+    }
+
+    const SubstituteFamily* family = NULL;
+    size_t family_count =
+        sizeof(SUBSTITUTE_FAMILIES) / sizeof(SUBSTITUTE_FAMILIES[0]);
+    for (size_t family_idx = 0; family_idx < family_count && !family;
+         family_idx++) {
+        const SubstituteFamily* candidate = &SUBSTITUTE_FAMILIES[family_idx];
+        for (size_t prefix_idx = 0;
+             prefix_idx < 3 && candidate->prefixes[prefix_idx];
+             prefix_idx++) {
+            const char* prefix = candidate->prefixes[prefix_idx];
+            if (strncmp(name, prefix, strlen(prefix)) == 0) {
+                family = candidate;
+                break;
+            }
+        }
+    }
+
+    if (!family) {
+        if (flags & FONT_FLAG_FIXED_PITCH) {
+            family = &SUBSTITUTE_FAMILIES[SUBSTITUTE_MONO];
+        } else if (flags & FONT_FLAG_SERIF) {
+            family = &SUBSTITUTE_FAMILIES[SUBSTITUTE_SERIF];
+        } else {
+            family = &SUBSTITUTE_FAMILIES[SUBSTITUTE_SANS];
+        }
+    }
+
+    bool is_bold = bold || (flags & FONT_FLAG_FORCE_BOLD)
+                || name_contains(name, BOLD_NAMES);
+    bool is_italic =
+        (flags & FONT_FLAG_ITALIC) || name_contains(name, ITALIC_NAMES);
+
+    return family->files[(is_bold ? 1 : 0) + (is_italic ? 2 : 0)];
+}
+
+/// Maps and parses `font`. Must be called with the registry lock held.
+static Error* registry_font_load(RegistryFont* font) {
+    char path[256];
+    int path_len = snprintf(
+        path,
+        sizeof(path),
+        "%s%s.ttf",
+        RENDER_FONT_REGISTRY_DIR,
+        font->file
+    );
+    RELEASE_ASSERT(path_len > 0 && (size_t)path_len < sizeof(path));
+
+    LOG_DIAG(INFO, FONT, "Loading substitute font `%s`", path);
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return ERROR(RENDER_ERR_FONT_UNAVAILABLE, "Failed to open `%s`", path);
+    }
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size <= 0) {
+        close(fd);
+        return ERROR(RENDER_ERR_FONT_UNAVAILABLE, "Failed to stat `%s`", path);
+    }
+
+    size_t map_len = (size_t)file_stat.st_size;
+    void* map = mmap(NULL, map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return ERROR(RENDER_ERR_FONT_UNAVAILABLE, "Failed to map `%s`", path);
+    }
+
+    if (!registry_arena) {
+        registry_arena = arena_new(65536);
+    }
+
+    Error* error = sfnt_font_new(
+        registry_arena,
+        parse_ctx_new(map, map_len),
+        &font->font
+    );
+    if (error) {
+        munmap(map, map_len);
+        return error;
+    }
+
+    font->map = map;
+    font->map_len = map_len;
+    return NULL;
+}
+
+/// Finds or creates the registry slot for `file`. Must be called with the
+/// registry lock held.
+static RegistryFont* registry_font_slot(const char* file) {
+    for (size_t idx = 0; idx < registry_font_count; idx++) {
+        if (strcmp(registry_fonts[idx].file, file) == 0) {
+            return &registry_fonts[idx];
+        }
+    }
+
+    RELEASE_ASSERT(registry_font_count < REGISTRY_MAX_FONTS);
+    RegistryFont* font = &registry_fonts[registry_font_count++];
+    font->file = file;
+    font->state = REGISTRY_FONT_UNLOADED;
+    return font;
+}
+
+Error* render_font_registry_get(
+    Arena* arena,
+    const PdfFontDescriptor* descriptor,
+    SfntFont* out
+) {
+    RELEASE_ASSERT(arena);
+    RELEASE_ASSERT(descriptor);
+    RELEASE_ASSERT(out);
+
+    bool bold = descriptor->font_weight.is_some
+             && pdf_number_as_real(descriptor->font_weight.value) >= 600.0;
+    const char* file = render_font_registry_match(
+        descriptor->font_name,
+        descriptor->flags,
+        bold
+    );
+
+    RELEASE_ASSERT(pthread_mutex_lock(&registry_mutex) == 0);
+
+    RegistryFont* font = registry_font_slot(file);
+    Error* error = NULL;
+    if (font->state == REGISTRY_FONT_UNLOADED) {
+        error = registry_font_load(font);
+        font->state = error ? REGISTRY_FONT_FAILED : REGISTRY_FONT_LOADED;
+    } else if (font->state == REGISTRY_FONT_FAILED) {
+        error = ERROR(
+            RENDER_ERR_FONT_UNAVAILABLE,
+            "Substitute font `%s` failed to load",
+            file
+        );
+    }
+
+    if (!error) {
+        sfnt_font_copy(arena, &font->font, out);
+    }
+
+    RELEASE_ASSERT(pthread_mutex_unlock(&registry_mutex) == 0);
+
+    return error;
+}
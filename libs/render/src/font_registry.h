@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "arena/arena.h"
+#include "err/error.h"
+#include "pdf/fonts/font_descriptor.h"
+#include "sfnt/sfnt.h"
+
+/// Directory containing the URW base35 fonts used as substitutes.
+#define RENDER_FONT_REGISTRY_DIR "assets/fonts-urw-base35/fonts/"
+
+/// Picks the URW base35 font file which best substitutes for a font that
+/// isn't embedded, based on its PostScript name (with any subset tag) and its
+/// font descriptor flags. Standard 14 names and their common aliases map to
+/// their metric-compatible clones, and anything unrecognized falls back to a
+/// sans, serif or monospace font based on the flags.
+const char*
+render_font_registry_match(const char* font_name, PdfInteger flags, bool bold);
+
+/// Gets the substitute font for `descriptor`. Font files are memory-mapped and
+/// parsed at most once per process, and their tables are shared between all
+/// threads and documents. `out` gets its own parse cursors and allocates
+/// glyphs on `arena`, so it may be used independently of other callers.
+Error* render_font_registry_get(
+    Arena* arena,
+    const PdfFontDescriptor* descriptor,
+    SfntFont* out
+);
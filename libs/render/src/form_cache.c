@@ -0,0 +1,296 @@
+#include "form_cache.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "arena/arena.h"
+#include "arena/common.h"
+#include "geom/mat3.h"
+#include "geom/vec3.h"
+#include "graphics_state.h"
+#include "logger/log.h"
+#include "pdf/color_space.h"
+#include "pdf/resolver.h"
+#include "text_state.h"
+
+/// How far a translation may be from a whole pixel and still be treated as
+/// one.
+#define RENDER_FORM_PIXEL_EPSILON 1e-6
+
+#define RENDER_FORM_CACHE_NONE UINT32_MAX
+#define RENDER_FORM_CACHE_INITIAL_BUCKETS 16
+
+#define DVEC_NAME RenderFormEntryVec
+#define DVEC_LOWERCASE_NAME render_form_entry_vec
+#define DVEC_TYPE RenderFormEntry
+#include "arena/dvec_impl.h"
+
+/// A chained hash table of entry indices, keyed by the reference of each
+/// entry's form. The number of buckets is doubled whenever there are as many
+/// entries.
+struct RenderFormCache {
+    Arena* arena;
+    RenderFormEntryVec* entries;
+    Uint32Array* buckets;
+
+    /// Bytes of rasterizations made for the page being rendered.
+    size_t raster_bytes;
+};
+
+static Uint32Array* render_form_cache_new_buckets(Arena* arena, size_t len) {
+    Uint32Array* buckets = uint32_array_new(arena, len);
+    for (size_t idx = 0; idx < len; idx++) {
+        uint32_array_set(buckets, idx, RENDER_FORM_CACHE_NONE);
+    }
+
+    return buckets;
+}
+
+RenderFormCache* render_form_cache_new(Arena* arena) {
+    RELEASE_ASSERT(arena);
+
+    RenderFormCache* cache = arena_alloc(arena, sizeof(RenderFormCache));
+    cache->arena = arena;
+    cache->entries = render_form_entry_vec_new(arena);
+    cache->buckets = render_form_cache_new_buckets(
+        arena,
+        RENDER_FORM_CACHE_INITIAL_BUCKETS
+    );
+    cache->raster_bytes = 0;
+
+    return cache;
+}
+
+static uint32_t*
+render_form_cache_bucket(Uint32Array* buckets, PdfIndirectRef ref) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    hash = (hash ^ (uint64_t)ref.object_id) * 0x100000001b3ull;
+    hash = (hash ^ (uint64_t)ref.generation) * 0x100000001b3ull;
+    hash ^= hash >> 29;
+    size_t bucket_idx = (size_t)(hash & (uint32_array_len(buckets) - 1));
+
+    uint32_t* bucket = NULL;
+    RELEASE_ASSERT(uint32_array_get_ptr(buckets, bucket_idx, &bucket));
+    return bucket;
+}
+
+static RenderFormEntry*
+render_form_cache_get(RenderFormCache* cache, uint32_t entry_idx) {
+    RenderFormEntry* entry = NULL;
+    RELEASE_ASSERT(
+        render_form_entry_vec_get_ptr(cache->entries, entry_idx, &entry)
+    );
+    return entry;
+}
+
+static void render_form_cache_link(RenderFormCache* cache, uint32_t entry_idx) {
+    RenderFormEntry* entry = render_form_cache_get(cache, entry_idx);
+    uint32_t* bucket = render_form_cache_bucket(cache->buckets, entry->ref);
+    entry->next = *bucket;
+    *bucket = entry_idx;
+}
+
+static void render_form_cache_grow(RenderFormCache* cache) {
+    cache->buckets = render_form_cache_new_buckets(
+        cache->arena,
+        uint32_array_len(cache->buckets) * 2
+    );
+
+    for (uint32_t entry_idx = 0;
+         entry_idx < render_form_entry_vec_len(cache->entries);
+         entry_idx++) {
+        render_form_cache_link(cache, entry_idx);
+    }
+}
+
+static bool render_form_vec3_eq(GeomVec3 a, GeomVec3 b) {
+    return a.x == b.x && a.y == b.y && a.z == b.z;
+}
+
+static bool render_form_text_state_eq(const TextState* a, const TextState* b) {
+    return a->font_set == b->font_set
+        && a->character_spacing == b->character_spacing
+        && a->word_spacing == b->word_spacing
+        && a->horizontal_scaling == b->horizontal_scaling
+        && a->leading == b->leading && a->text_font == b->text_font
+        && a->text_font_size == b->text_font_size
+        && a->text_mode == b->text_mode && a->text_rise == b->text_rise;
+}
+
+/// Compares everything a form inherits from the graphics state it's drawn
+/// with, other than the CTM and clip. Color spaces are compared bytewise, so
+/// equal color spaces may compare unequal, which only costs a cache miss.
+static bool
+render_form_gstate_eq(const GraphicsState* a, const GraphicsState* b) {
+    return memcmp(
+               &a->stroking_color_space,
+               &b->stroking_color_space,
+               sizeof(PdfColorSpace)
+           ) == 0
+        && memcmp(
+               &a->nonstroking_color_space,
+               &b->nonstroking_color_space,
+               sizeof(PdfColorSpace)
+           ) == 0
+        && render_form_vec3_eq(a->stroking_rgb, b->stroking_rgb)
+        && render_form_vec3_eq(a->nonstroking_rgb, b->nonstroking_rgb)
+        && render_form_text_state_eq(&a->text_state, &b->text_state)
+        && a->line_width == b->line_width && a->line_cap == b->line_cap
+        && a->line_join == b->line_join && a->miter_limit == b->miter_limit
+        && a->stroke_adjustment == b->stroke_adjustment
+        && a->stroking_alpha == b->stroking_alpha
+        && a->nonstroking_alpha == b->nonstroking_alpha
+        && a->alpha_source == b->alpha_source
+        && a->stroking_overprint == b->stroking_overprint
+        && a->nonstroking_overprint == b->nonstroking_overprint
+        && a->overprint_mode == b->overprint_mode
+        && a->flatness == b->flatness && a->smoothness == b->smoothness;
+}
+
+RenderFormEntry* render_form_cache_entry(
+    RenderFormCache* cache,
+    PdfIndirectRef ref,
+    const GraphicsState* gstate
+) {
+    RELEASE_ASSERT(cache);
+    RELEASE_ASSERT(gstate);
+
+    uint32_t entry_idx = *render_form_cache_bucket(cache->buckets, ref);
+    while (entry_idx != RENDER_FORM_CACHE_NONE) {
+        RenderFormEntry* entry = render_form_cache_get(cache, entry_idx);
+        if (entry->ref.object_id == ref.object_id
+            && entry->ref.generation == ref.generation
+            && render_form_gstate_eq(&entry->gstate, gstate)) {
+            return entry;
+        }
+
+        entry_idx = entry->next;
+    }
+
+    RELEASE_ASSERT(
+        render_form_entry_vec_len(cache->entries) < RENDER_FORM_CACHE_NONE,
+        "Too many cached forms"
+    );
+    if (render_form_entry_vec_len(cache->entries)
+        >= uint32_array_len(cache->buckets)) {
+        render_form_cache_grow(cache);
+    }
+
+    RenderFormEntry entry = {
+        .ref = ref,
+        .gstate = *gstate,
+        .draw_count = 0,
+        .list = NULL,
+        .has_pending_transform = false,
+        .raster_count = 0
+    };
+    entry.gstate.ctm = geom_mat3_identity();
+    entry.gstate.clip_depth = 0;
+
+    entry_idx = (uint32_t)render_form_entry_vec_len(cache->entries);
+    RenderFormEntry* pushed = render_form_entry_vec_push(cache->entries, entry);
+    render_form_cache_link(cache, entry_idx);
+    return pushed;
+}
+
+void render_form_cache_end_page(RenderFormCache* cache) {
+    RELEASE_ASSERT(cache);
+
+    for (uint32_t entry_idx = 0;
+         entry_idx < render_form_entry_vec_len(cache->entries);
+         entry_idx++) {
+        RenderFormEntry* entry = render_form_cache_get(cache, entry_idx);
+        entry->has_pending_transform = false;
+        entry->raster_count = 0;
+    }
+
+    cache->raster_bytes = 0;
+}
+
+bool render_form_cache_reserve_raster(
+    RenderFormCache* cache,
+    uint32_t width,
+    uint32_t height
+) {
+    RELEASE_ASSERT(cache);
+
+    size_t bytes = (size_t)width * (size_t)height * 4;
+    if (bytes > RENDER_FORM_RASTER_BUDGET - cache->raster_bytes) {
+        return false;
+    }
+
+    cache->raster_bytes += bytes;
+    return true;
+}
+
+static bool render_form_whole_pixel(double value, int32_t* pixel_out) {
+    double rounded = round(value);
+    if (fabs(value - rounded) > RENDER_FORM_PIXEL_EPSILON
+        || fabs(rounded) > (double)INT32_MAX) {
+        return false;
+    }
+
+    *pixel_out = (int32_t)rounded;
+    return true;
+}
+
+bool render_form_whole_pixel_offset(
+    GeomMat3 base,
+    GeomMat3 transform,
+    int32_t* x_out,
+    int32_t* y_out
+) {
+    RELEASE_ASSERT(x_out);
+    RELEASE_ASSERT(y_out);
+
+    for (int row = 0; row < 2; row++) {
+        for (int col = 0; col < 2; col++) {
+            if (base.mat[row][col] != transform.mat[row][col]) {
+                return false;
+            }
+        }
+    }
+
+    return render_form_whole_pixel(transform.mat[2][0] - base.mat[2][0], x_out)
+        && render_form_whole_pixel(
+               transform.mat[2][1] - base.mat[2][1],
+               y_out
+        );
+}
+
+const RenderFormRaster* render_form_entry_find_raster(
+    const RenderFormEntry* entry,
+    GeomMat3 transform,
+    double stroke_width_scale,
+    int32_t* x_out,
+    int32_t* y_out
+) {
+    RELEASE_ASSERT(entry);
+    RELEASE_ASSERT(x_out);
+    RELEASE_ASSERT(y_out);
+
+    for (size_t idx = 0; idx < entry->raster_count; idx++) {
+        const RenderFormRaster* raster = &entry->rasters[idx];
+        if (raster->stroke_width_scale != stroke_width_scale) {
+            continue;
+        }
+
+        int32_t offset_x = 0;
+        int32_t offset_y = 0;
+        if (render_form_whole_pixel_offset(
+                raster->transform,
+                transform,
+                &offset_x,
+                &offset_y
+            )) {
+            *x_out = raster->x + offset_x;
+            *y_out = raster->y + offset_y;
+            return raster;
+        }
+    }
+
+    return NULL;
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena/arena.h"
+#include "cache.h"
+#include "canvas/canvas.h"
+#include "canvas/display_list.h"
+#include "geom/mat3.h"
+#include "graphics_state.h"
+#include "pdf/resolver.h"
+
+/// Byte budget of the pixels of every form rasterization made for a page.
+#define RENDER_FORM_RASTER_BUDGET ((size_t)64 << 20)
+
+/// Rasterizations kept for each form and inherited graphics state.
+#define RENDER_FORM_MAX_RASTERS 4
+
+/// A form drawn onto a transparent raster canvas, which can be composited
+/// again wherever the form is drawn with a transform differing only by a
+/// translation of whole pixels.
+typedef struct {
+    /// Maps the space the form was drawn into onto device space.
+    GeomMat3 transform;
+    double stroke_width_scale;
+
+    /// The device pixel the top-left corner of `canvas` was drawn at.
+    int32_t x;
+    int32_t y;
+    Canvas* canvas;
+} RenderFormRaster;
+
+/// A form XObject drawn with one inherited graphics state, and what's been
+/// kept of it to draw it again.
+typedef struct {
+    PdfIndirectRef ref;
+
+    /// The inherited graphics state, ignoring the CTM and clip depth.
+    GraphicsState gstate;
+
+    /// How many times the form's been drawn with this state, on every page.
+    size_t draw_count;
+
+    /// The form's content in the space it's drawn into, recorded the first
+    /// time it's drawn, or NULL until then. Kept for every page.
+    CanvasDisplayList* list;
+
+    /// The transform the form was last drawn at onto a raster canvas without
+    /// a rasterization to reuse. The form is rasterized if it's drawn at the
+    /// same transform, up to whole pixels, again. This and the rasterizations
+    /// are only kept for the page being rendered.
+    bool has_pending_transform;
+    GeomMat3 pending_transform;
+
+    RenderFormRaster rasters[RENDER_FORM_MAX_RASTERS];
+    size_t raster_count;
+
+    /// The next entry in this entry's bucket.
+    uint32_t next;
+} RenderFormEntry;
+
+RenderFormCache* render_form_cache_new(Arena* arena);
+
+/// Finds the entry for the form XObject `ref` drawn with `gstate`, adding an
+/// empty one if there is none.
+RenderFormEntry* render_form_cache_entry(
+    RenderFormCache* cache,
+    PdfIndirectRef ref,
+    const GraphicsState* gstate
+);
+
+/// Drops every entry's rasterizations and pending transform, and refills the
+/// raster budget, once the page they were made for is done.
+void render_form_cache_end_page(RenderFormCache* cache);
+
+/// Reserves the budget for a `width` x `height` rasterization. Returns false
+/// if it would exceed the budget.
+bool render_form_cache_reserve_raster(
+    RenderFormCache* cache,
+    uint32_t width,
+    uint32_t height
+);
+
+/// Checks whether `transform` differs from `base` only by a translation of
+/// whole pixels, finding the translation if so.
+bool render_form_whole_pixel_offset(
+    GeomMat3 base,
+    GeomMat3 transform,
+    int32_t* x_out,
+    int32_t* y_out
+);
+
+/// Finds a rasterization of `entry` which can be composited at `transform`,
+/// along with the translation to composite it at. Returns NULL if there is
+/// none.
+const RenderFormRaster* render_form_entry_find_raster(
+    const RenderFormEntry* entry,
+    GeomMat3 transform,
+    double stroke_width_scale,
+    int32_t* x_out,
+    int32_t* y_out
+);
@@ -0,0 +1,337 @@
+#include "glyph_atlas.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "arena/arena.h"
+#include "arena/common.h"
+#include "canvas/canvas.h"
+#include "canvas/path_builder.h"
+#include "geom/mat3.h"
+#include "logger/log.h"
+
+#define RENDER_GLYPH_ATLAS_NONE UINT32_MAX
+#define RENDER_GLYPH_ATLAS_INITIAL_BUCKETS 256
+
+typedef struct {
+    uint32_t gid;
+    double scale_x;
+    double scale_y;
+    uint32_t subpixel_x;
+    uint32_t subpixel_y;
+} RenderGlyphAtlasKey;
+
+typedef struct {
+    RenderGlyphAtlasKey key;
+
+    /// Whether the glyph fit in a mask. Oversized glyphs are remembered so
+    /// that they aren't flattened twice just to be rejected again.
+    bool has_mask;
+    CanvasMask mask;
+
+    uint32_t next;
+} RenderGlyphAtlasEntry;
+
+#define DVEC_NAME RenderGlyphAtlasEntryVec
+#define DVEC_LOWERCASE_NAME render_glyph_atlas_entry_vec
+#define DVEC_TYPE RenderGlyphAtlasEntry
+#include "arena/dvec_impl.h"
+
+struct RenderGlyphAtlas {
+    size_t byte_budget;
+
+    /// Owns the entries, buckets and masks, and is reset on every flush.
+    Arena* arena;
+    RenderGlyphAtlasEntryVec* entries;
+    Uint32Array* buckets;
+
+    RenderGlyphAtlasStats stats;
+};
+
+static Uint32Array* render_glyph_atlas_new_buckets(Arena* arena, size_t len) {
+    Uint32Array* buckets = uint32_array_new(arena, len);
+    for (size_t idx = 0; idx < len; idx++) {
+        uint32_array_set(buckets, idx, RENDER_GLYPH_ATLAS_NONE);
+    }
+
+    return buckets;
+}
+
+static void render_glyph_atlas_flush(RenderGlyphAtlas* atlas) {
+    arena_reset(atlas->arena);
+    atlas->entries = render_glyph_atlas_entry_vec_new(atlas->arena);
+    atlas->buckets = render_glyph_atlas_new_buckets(
+        atlas->arena,
+        RENDER_GLYPH_ATLAS_INITIAL_BUCKETS
+    );
+    atlas->stats.bytes_used = 0;
+}
+
+RenderGlyphAtlas* render_glyph_atlas_new(Arena* arena, size_t byte_budget) {
+    RELEASE_ASSERT(arena);
+
+    RenderGlyphAtlas* atlas = arena_alloc(arena, sizeof(RenderGlyphAtlas));
+    atlas->byte_budget = byte_budget;
+    atlas->arena = arena_new(65536);
+    atlas->stats = (RenderGlyphAtlasStats) {0};
+    render_glyph_atlas_flush(atlas);
+
+    return atlas;
+}
+
+void render_glyph_atlas_free(RenderGlyphAtlas* atlas) {
+    RELEASE_ASSERT(atlas);
+
+    LOG_DIAG(
+        DEBUG,
+        FONT,
+        "Glyph atlas: %llu hits, %llu misses, %llu bypasses, %llu flushes, "
+        "%zu bytes",
+        (unsigned long long)atlas->stats.hits,
+        (unsigned long long)atlas->stats.misses,
+        (unsigned long long)atlas->stats.bypasses,
+        (unsigned long long)atlas->stats.flushes,
+        atlas->stats.bytes_used
+    );
+
+    arena_free(atlas->arena);
+    atlas->arena = NULL;
+}
+
+/// Rounds `value` to 11 significant bits, so that scales differing by less
+/// than about 0.05% share masks.
+static double render_glyph_atlas_quantize_scale(double value) {
+    int exponent;
+    double mantissa = frexp(value, &exponent);
+    return ldexp(round(mantissa * 2048.0) / 2048.0, exponent);
+}
+
+static uint64_t render_glyph_atlas_hash(RenderGlyphAtlasKey key) {
+    uint64_t scale_x_bits;
+    uint64_t scale_y_bits;
+    memcpy(&scale_x_bits, &key.scale_x, sizeof(uint64_t));
+    memcpy(&scale_y_bits, &key.scale_y, sizeof(uint64_t));
+
+    uint64_t hash = 0xcbf29ce484222325ull;
+    uint64_t words[] = {
+        key.gid,
+        scale_x_bits,
+        scale_y_bits,
+        ((uint64_t)key.subpixel_x << 32) | key.subpixel_y
+    };
+    for (size_t idx = 0; idx < sizeof(words) / sizeof(words[0]); idx++) {
+        hash = (hash ^ words[idx]) * 0x100000001b3ull;
+        hash ^= hash >> 29;
+    }
+
+    return hash;
+}
+
+static bool
+render_glyph_atlas_key_eq(RenderGlyphAtlasKey lhs, RenderGlyphAtlasKey rhs) {
+    return lhs.gid == rhs.gid && lhs.scale_x == rhs.scale_x
+        && lhs.scale_y == rhs.scale_y && lhs.subpixel_x == rhs.subpixel_x
+        && lhs.subpixel_y == rhs.subpixel_y;
+}
+
+static uint32_t*
+render_glyph_atlas_bucket(RenderGlyphAtlas* atlas, RenderGlyphAtlasKey key) {
+    size_t bucket_count = uint32_array_len(atlas->buckets);
+    size_t bucket_idx =
+        (size_t)(render_glyph_atlas_hash(key) & (bucket_count - 1));
+
+    uint32_t* bucket = NULL;
+    RELEASE_ASSERT(uint32_array_get_ptr(atlas->buckets, bucket_idx, &bucket));
+    return bucket;
+}
+
+static RenderGlyphAtlasEntry*
+render_glyph_atlas_entry(RenderGlyphAtlas* atlas, uint32_t entry_idx) {
+    RenderGlyphAtlasEntry* entry = NULL;
+    RELEASE_ASSERT(
+        render_glyph_atlas_entry_vec_get_ptr(atlas->entries, entry_idx, &entry)
+    );
+    return entry;
+}
+
+static RenderGlyphAtlasEntry*
+render_glyph_atlas_lookup(RenderGlyphAtlas* atlas, RenderGlyphAtlasKey key) {
+    uint32_t entry_idx = *render_glyph_atlas_bucket(atlas, key);
+    while (entry_idx != RENDER_GLYPH_ATLAS_NONE) {
+        RenderGlyphAtlasEntry* entry =
+            render_glyph_atlas_entry(atlas, entry_idx);
+        if (render_glyph_atlas_key_eq(entry->key, key)) {
+            return entry;
+        }
+
+        entry_idx = entry->next;
+    }
+
+    return NULL;
+}
+
+static void render_glyph_atlas_grow(RenderGlyphAtlas* atlas) {
+    size_t bucket_count = uint32_array_len(atlas->buckets) * 2;
+    atlas->buckets = render_glyph_atlas_new_buckets(atlas->arena, bucket_count);
+
+    for (uint32_t entry_idx = 0;
+         entry_idx < render_glyph_atlas_entry_vec_len(atlas->entries);
+         entry_idx++) {
+        RenderGlyphAtlasEntry* entry =
+            render_glyph_atlas_entry(atlas, entry_idx);
+        uint32_t* bucket = render_glyph_atlas_bucket(atlas, entry->key);
+        entry->next = *bucket;
+        *bucket = entry_idx;
+    }
+}
+
+static RenderGlyphAtlasEntry* render_glyph_atlas_insert(
+    RenderGlyphAtlas* atlas,
+    RenderGlyphAtlasKey key,
+    const PathBuilder* outline,
+    Canvas* canvas
+) {
+    if (atlas->stats.bytes_used > atlas->byte_budget) {
+        render_glyph_atlas_flush(atlas);
+        atlas->stats.flushes++;
+    }
+
+    if (render_glyph_atlas_entry_vec_len(atlas->entries)
+        >= uint32_array_len(atlas->buckets)) {
+        render_glyph_atlas_grow(atlas);
+    }
+
+    RenderGlyphAtlasEntry entry = {.key = key, .has_mask = false};
+
+    // The mask is rasterized at the subpixel offset, relative to the integer
+    // pixel the glyph origin is snapped to.
+    Arena* path_arena = arena_new(4096);
+    PathBuilder* path = path_builder_new_with_options(
+        path_arena,
+        path_builder_options_flattened()
+    );
+    path_builder_append_transformed(
+        path,
+        outline,
+        geom_mat3_new_pdf(
+            key.scale_x,
+            0.0,
+            0.0,
+            key.scale_y,
+            (double)key.subpixel_x / RENDER_GLYPH_ATLAS_SUBPIXEL,
+            (double)key.subpixel_y / RENDER_GLYPH_ATLAS_SUBPIXEL
+        )
+    );
+
+    entry.has_mask = canvas_rasterize_mask(
+        canvas,
+        atlas->arena,
+        path,
+        false,
+        RENDER_GLYPH_ATLAS_MAX_SIZE,
+        &entry.mask
+    );
+    arena_free(path_arena);
+
+    atlas->stats.bytes_used += sizeof(RenderGlyphAtlasEntry);
+    if (entry.has_mask) {
+        atlas->stats.bytes_used +=
+            (size_t)entry.mask.width * (size_t)entry.mask.height;
+    }
+
+    uint32_t* bucket = render_glyph_atlas_bucket(atlas, key);
+    entry.next = *bucket;
+    *bucket = (uint32_t)render_glyph_atlas_entry_vec_len(atlas->entries);
+
+    return render_glyph_atlas_entry_vec_push(atlas->entries, entry);
+}
+
+/// Splits a device coordinate into the pixel the glyph origin snaps to and a
+/// subpixel bucket within it. Returns `false` if the coordinate is unusable.
+static bool render_glyph_atlas_snap(
+    double value,
+    int32_t* pixel_out,
+    uint32_t* subpixel_out
+) {
+    if (!isfinite(value) || fabs(value) > (double)INT32_MAX / 2) {
+        return false;
+    }
+
+    double steps = round(value * RENDER_GLYPH_ATLAS_SUBPIXEL);
+    double pixel = floor(steps / RENDER_GLYPH_ATLAS_SUBPIXEL);
+
+    *pixel_out = (int32_t)pixel;
+    *subpixel_out =
+        (uint32_t)(steps - pixel * RENDER_GLYPH_ATLAS_SUBPIXEL);
+    return true;
+}
+
+bool render_glyph_atlas_draw(
+    RenderGlyphAtlas* atlas,
+    uint32_t gid,
+    const PathBuilder* outline,
+    Canvas* canvas,
+    GeomMat3 transform,
+    Rgba rgba
+) {
+    RELEASE_ASSERT(atlas);
+    RELEASE_ASSERT(outline);
+    RELEASE_ASSERT(canvas);
+
+    double scale_x = transform.mat[0][0];
+    double skew_y = transform.mat[0][1];
+    double skew_x = transform.mat[1][0];
+    double scale_y = transform.mat[1][1];
+
+    // Rotated and skewed glyphs are rare enough that caching every angle
+    // isn't worthwhile
+    if (!canvas_is_raster(canvas) || !isfinite(scale_x) || !isfinite(scale_y)
+        || scale_x == 0.0 || scale_y == 0.0
+        || fabs(skew_x) + fabs(skew_y)
+               > 1e-9 * (fabs(scale_x) + fabs(scale_y))) {
+        atlas->stats.bypasses++;
+        return false;
+    }
+
+    RenderGlyphAtlasKey key = {
+        .gid = gid,
+        .scale_x = render_glyph_atlas_quantize_scale(scale_x),
+        .scale_y = render_glyph_atlas_quantize_scale(scale_y)
+    };
+
+    int32_t pixel_x;
+    int32_t pixel_y;
+    if (!render_glyph_atlas_snap(transform.mat[2][0], &pixel_x, &key.subpixel_x)
+        || !render_glyph_atlas_snap(
+            transform.mat[2][1],
+            &pixel_y,
+            &key.subpixel_y
+        )) {
+        atlas->stats.bypasses++;
+        return false;
+    }
+
+    RenderGlyphAtlasEntry* entry = render_glyph_atlas_lookup(atlas, key);
+    if (entry) {
+        atlas->stats.hits++;
+    } else {
+        atlas->stats.misses++;
+        entry = render_glyph_atlas_insert(atlas, key, outline, canvas);
+    }
+
+    if (!entry->has_mask) {
+        atlas->stats.bypasses++;
+        return false;
+    }
+
+    canvas_draw_mask(canvas, &entry->mask, pixel_x, pixel_y, rgba);
+    return true;
+}
+
+RenderGlyphAtlasStats render_glyph_atlas_stats(const RenderGlyphAtlas* atlas) {
+    RELEASE_ASSERT(atlas);
+    return atlas->stats;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena/arena.h"
+#include "canvas/canvas.h"
+#include "canvas/path_builder.h"
+#include "color/rgb.h"
+#include "geom/mat3.h"
+
+/// Default coverage budget for a single font.
+#define RENDER_GLYPH_ATLAS_BUDGET ((size_t)8 << 20)
+
+/// Glyphs larger than this many pixels in either dimension are drawn as paths,
+/// since they are rarely repeated and their masks would crowd out body text.
+#define RENDER_GLYPH_ATLAS_MAX_SIZE 256
+
+/// Number of horizontal and vertical subpixel positions cached per glyph.
+#define RENDER_GLYPH_ATLAS_SUBPIXEL 4
+
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t bypasses;
+    uint64_t flushes;
+    size_t bytes_used;
+} RenderGlyphAtlasStats;
+
+/// Per-font cache of rasterized glyph coverage masks, keyed by glyph, device
+/// scale and subpixel offset. Masks are only shared between axis-aligned
+/// transforms, and the whole atlas is flushed once it exceeds its budget.
+typedef struct RenderGlyphAtlas RenderGlyphAtlas;
+
+RenderGlyphAtlas* render_glyph_atlas_new(Arena* arena, size_t byte_budget);
+
+/// Frees every cached mask. The atlas itself lives on the arena it was created
+/// with.
+void render_glyph_atlas_free(RenderGlyphAtlas* atlas);
+
+/// Draws the font-unit `outline` of glyph `gid` under `transform` from a cached
+/// mask, rasterizing it on a miss. Returns `false` without drawing anything if
+/// the glyph can't be drawn from a mask, in which case the caller should draw
+/// the outline as a path.
+bool render_glyph_atlas_draw(
+    RenderGlyphAtlas* atlas,
+    uint32_t gid,
+    const PathBuilder* outline,
+    Canvas* canvas,
+    GeomMat3 transform,
+    Rgba rgba
+);
+
+RenderGlyphAtlasStats render_glyph_atlas_stats(const RenderGlyphAtlas* atlas);
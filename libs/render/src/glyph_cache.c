@@ -0,0 +1,221 @@
+#include "glyph_cache.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena/arena.h"
+#include "arena/common.h"
+#include "canvas/path_builder.h"
+#include "logger/log.h"
+
+#define RENDER_GLYPH_CACHE_NONE UINT32_MAX
+
+typedef struct {
+    uint32_t gid;
+    Arena* arena;
+    PathBuilder* outline;
+    size_t bytes;
+
+    // Links in the recency list, which runs from most to least recently used
+    uint32_t prev;
+    uint32_t next;
+} RenderGlyphCacheEntry;
+
+#define DVEC_NAME RenderGlyphCacheEntryVec
+#define DVEC_LOWERCASE_NAME render_glyph_cache_entry_vec
+#define DVEC_TYPE RenderGlyphCacheEntry
+#include "arena/dvec_impl.h"
+
+struct RenderGlyphCache {
+    size_t byte_budget;
+
+    /// Maps a gid to its entry index, or `RENDER_GLYPH_CACHE_NONE`.
+    Uint32Vec* gid_to_entry;
+    RenderGlyphCacheEntryVec* entries;
+    Uint32Vec* free_entries;
+
+    uint32_t most_recent;
+    uint32_t least_recent;
+
+    RenderGlyphCacheStats stats;
+};
+
+RenderGlyphCache* render_glyph_cache_new(Arena* arena, size_t byte_budget) {
+    RELEASE_ASSERT(arena);
+
+    RenderGlyphCache* cache = arena_alloc(arena, sizeof(RenderGlyphCache));
+    cache->byte_budget = byte_budget;
+    cache->gid_to_entry = uint32_vec_new(arena);
+    cache->entries = render_glyph_cache_entry_vec_new(arena);
+    cache->free_entries = uint32_vec_new(arena);
+    cache->most_recent = RENDER_GLYPH_CACHE_NONE;
+    cache->least_recent = RENDER_GLYPH_CACHE_NONE;
+    cache->stats = (RenderGlyphCacheStats) {0};
+
+    return cache;
+}
+
+static RenderGlyphCacheEntry*
+render_glyph_cache_entry(RenderGlyphCache* cache, uint32_t entry_idx) {
+    RenderGlyphCacheEntry* entry = NULL;
+    RELEASE_ASSERT(
+        render_glyph_cache_entry_vec_get_ptr(cache->entries, entry_idx, &entry)
+    );
+    return entry;
+}
+
+static uint32_t*
+render_glyph_cache_slot(RenderGlyphCache* cache, uint32_t gid) {
+    while (uint32_vec_len(cache->gid_to_entry) <= gid) {
+        uint32_vec_push(cache->gid_to_entry, RENDER_GLYPH_CACHE_NONE);
+    }
+
+    uint32_t* slot = NULL;
+    RELEASE_ASSERT(uint32_vec_get_ptr(cache->gid_to_entry, gid, &slot));
+    return slot;
+}
+
+static void
+render_glyph_cache_unlink(RenderGlyphCache* cache, uint32_t entry_idx) {
+    RenderGlyphCacheEntry* entry = render_glyph_cache_entry(cache, entry_idx);
+
+    if (entry->prev != RENDER_GLYPH_CACHE_NONE) {
+        render_glyph_cache_entry(cache, entry->prev)->next = entry->next;
+    } else {
+        cache->most_recent = entry->next;
+    }
+
+    if (entry->next != RENDER_GLYPH_CACHE_NONE) {
+        render_glyph_cache_entry(cache, entry->next)->prev = entry->prev;
+    } else {
+        cache->least_recent = entry->prev;
+    }
+
+    entry->prev = RENDER_GLYPH_CACHE_NONE;
+    entry->next = RENDER_GLYPH_CACHE_NONE;
+}
+
+static void
+render_glyph_cache_link_front(RenderGlyphCache* cache, uint32_t entry_idx) {
+    RenderGlyphCacheEntry* entry = render_glyph_cache_entry(cache, entry_idx);
+
+    entry->prev = RENDER_GLYPH_CACHE_NONE;
+    entry->next = cache->most_recent;
+
+    if (cache->most_recent != RENDER_GLYPH_CACHE_NONE) {
+        render_glyph_cache_entry(cache, cache->most_recent)->prev = entry_idx;
+    } else {
+        cache->least_recent = entry_idx;
+    }
+
+    cache->most_recent = entry_idx;
+}
+
+static void render_glyph_cache_evict_lru(RenderGlyphCache* cache) {
+    uint32_t entry_idx = cache->least_recent;
+    RELEASE_ASSERT(entry_idx != RENDER_GLYPH_CACHE_NONE);
+
+    render_glyph_cache_unlink(cache, entry_idx);
+
+    RenderGlyphCacheEntry* entry = render_glyph_cache_entry(cache, entry_idx);
+    *render_glyph_cache_slot(cache, entry->gid) = RENDER_GLYPH_CACHE_NONE;
+
+    arena_free(entry->arena);
+    entry->arena = NULL;
+    entry->outline = NULL;
+
+    cache->stats.bytes_used -= entry->bytes;
+    cache->stats.evictions++;
+    uint32_vec_push(cache->free_entries, entry_idx);
+}
+
+void render_glyph_cache_free(RenderGlyphCache* cache) {
+    RELEASE_ASSERT(cache);
+
+    LOG_DIAG(
+        DEBUG,
+        FONT,
+        "Glyph cache: %llu hits, %llu misses, %llu evictions, %zu bytes",
+        (unsigned long long)cache->stats.hits,
+        (unsigned long long)cache->stats.misses,
+        (unsigned long long)cache->stats.evictions,
+        cache->stats.bytes_used
+    );
+
+    while (cache->least_recent != RENDER_GLYPH_CACHE_NONE) {
+        render_glyph_cache_evict_lru(cache);
+    }
+}
+
+const PathBuilder*
+render_glyph_cache_get(RenderGlyphCache* cache, uint32_t gid) {
+    RELEASE_ASSERT(cache);
+
+    uint32_t entry_idx = RENDER_GLYPH_CACHE_NONE;
+    uint32_vec_get(cache->gid_to_entry, gid, &entry_idx);
+
+    if (entry_idx == RENDER_GLYPH_CACHE_NONE) {
+        cache->stats.misses++;
+        return NULL;
+    }
+
+    cache->stats.hits++;
+    if (cache->most_recent != entry_idx) {
+        render_glyph_cache_unlink(cache, entry_idx);
+        render_glyph_cache_link_front(cache, entry_idx);
+    }
+
+    return render_glyph_cache_entry(cache, entry_idx)->outline;
+}
+
+const PathBuilder* render_glyph_cache_insert(
+    RenderGlyphCache* cache,
+    uint32_t gid,
+    Arena* outline_arena,
+    PathBuilder* outline
+) {
+    RELEASE_ASSERT(cache);
+    RELEASE_ASSERT(outline_arena);
+    RELEASE_ASSERT(outline);
+    RELEASE_ASSERT(gid != RENDER_GLYPH_CACHE_NONE);
+    RELEASE_ASSERT(
+        *render_glyph_cache_slot(cache, gid) == RENDER_GLYPH_CACHE_NONE,
+        "Glyph %u is already cached",
+        gid
+    );
+
+    size_t bytes = arena_capacity(outline_arena);
+    while (cache->least_recent != RENDER_GLYPH_CACHE_NONE
+           && cache->stats.bytes_used + bytes > cache->byte_budget) {
+        render_glyph_cache_evict_lru(cache);
+    }
+
+    RenderGlyphCacheEntry entry = {
+        .gid = gid,
+        .arena = outline_arena,
+        .outline = outline,
+        .bytes = bytes,
+        .prev = RENDER_GLYPH_CACHE_NONE,
+        .next = RENDER_GLYPH_CACHE_NONE
+    };
+
+    uint32_t entry_idx;
+    if (uint32_vec_pop(cache->free_entries, &entry_idx)) {
+        *render_glyph_cache_entry(cache, entry_idx) = entry;
+    } else {
+        entry_idx = (uint32_t)render_glyph_cache_entry_vec_len(cache->entries);
+        render_glyph_cache_entry_vec_push(cache->entries, entry);
+    }
+
+    *render_glyph_cache_slot(cache, gid) = entry_idx;
+    render_glyph_cache_link_front(cache, entry_idx);
+    cache->stats.bytes_used += bytes;
+
+    return outline;
+}
+
+RenderGlyphCacheStats render_glyph_cache_stats(const RenderGlyphCache* cache) {
+    RELEASE_ASSERT(cache);
+    return cache->stats;
+}
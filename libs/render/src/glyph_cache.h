@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena/arena.h"
+#include "canvas/path_builder.h"
+
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    size_t bytes_used;
+} RenderGlyphCacheStats;
+
+/// Per-font cache of glyph outlines in font units, with least-recently-used
+/// eviction once the outlines exceed a byte budget. Each outline owns a small
+/// arena, so evicting a glyph releases its memory immediately.
+typedef struct RenderGlyphCache RenderGlyphCache;
+
+RenderGlyphCache* render_glyph_cache_new(Arena* arena, size_t byte_budget);
+
+/// Frees every cached outline. The cache itself lives on the arena it was
+/// created with.
+void render_glyph_cache_free(RenderGlyphCache* cache);
+
+/// Returns the cached outline for `gid`, or NULL on a miss.
+const PathBuilder*
+render_glyph_cache_get(RenderGlyphCache* cache, uint32_t gid);
+
+/// Inserts the outline for `gid`, taking ownership of `outline_arena` (which
+/// must own `outline`). Older outlines are evicted to stay within the budget,
+/// but the newest outline is always kept.
+const PathBuilder* render_glyph_cache_insert(
+    RenderGlyphCache* cache,
+    uint32_t gid,
+    Arena* outline_arena,
+    PathBuilder* outline
+);
+
+RenderGlyphCacheStats render_glyph_cache_stats(const RenderGlyphCache* cache);
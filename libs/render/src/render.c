@@ -1,34 +1,45 @@
 #include "render/render.h"
 
 #include <math.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "arena/arena.h"
 #include "cache.h"
 #include "canvas/canvas.h"
+#include "canvas/display_list.h"
 #include "canvas/path_builder.h"
 #include "color/icc_cache.h"
+#include "font_cache.h"
+#include "form_cache.h"
 #include "err/error.h"
 #include "geom/mat3.h"
 #include "geom/rect.h"
 #include "geom/vec2.h"
+#include "glyph_cache.h"
 #include "graphics_state.h"
 #include "logger/log.h"
 #include "pdf/color_space.h"
 #include "pdf/content_stream/operation.h"
 #include "pdf/content_stream/operator.h"
-#include "pdf/fonts/cmap.h"
 #include "pdf/fonts/font.h"
 #include "pdf/object.h"
+#include "pdf/page.h"
 #include "pdf/resolver.h"
 #include "pdf/resources.h"
 #include "pdf/shading.h"
 #include "pdf/types.h"
 #include "pdf/xobject.h"
+#include "resource_cache.h"
 #include "shading.h"
 #include "text_state.h"
 
+/// Rows in each tile when rasterizing in parallel. Small enough to balance
+/// the tiles between threads, large enough that most commands reach few.
+#define RENDER_TILE_HEIGHT 64
+
 static CanvasLineCap pdf_line_cap_to_canvas(PdfLineCapStyle line_cap) {
     switch (line_cap) {
         case PDF_LINE_CAP_STYLE_BUTT: {
@@ -67,6 +78,11 @@ typedef struct {
     PathBuilderOptions path_options;
     PathBuilder* path;
     double stroke_width_scale;
+
+    /// The canvas bounds in device space. Paths entirely outside them are
+    /// skipped.
+    GeomRect cull_rect;
+
     bool pending_clip;
     bool pending_clip_even_odd;
 
@@ -127,27 +143,6 @@ static double render_current_stroke_width(RenderState* state) {
     return current_graphics_state(state)->line_width * state->stroke_width_scale;
 }
 
-static double render_ctm_max_linear_scale(GeomMat3 ctm) {
-    double a = ctm.mat[0][0];
-    double b = ctm.mat[0][1];
-    double c = ctm.mat[1][0];
-    double d = ctm.mat[1][1];
-
-    double trace = a * a + b * b + c * c + d * d;
-    double det = a * d - b * c;
-    double disc = trace * trace - 4.0 * det * det;
-    if (disc < 0.0) {
-        disc = 0.0;
-    }
-
-    double sigma_max = sqrt(0.5 * (trace + sqrt(disc)));
-    if (sigma_max < 1e-9) {
-        return 1e-9;
-    }
-
-    return sigma_max;
-}
-
 static PathBuilderOptions
 render_current_path_options(RenderState* state, Canvas* canvas) {
     RELEASE_ASSERT(state);
@@ -163,8 +158,7 @@ render_current_path_options(RenderState* state, Canvas* canvas) {
         flatness = 1e-6;
     }
 
-    double ctm_scale =
-        render_ctm_max_linear_scale(current_graphics_state(state)->ctm);
+    double ctm_scale = geom_mat3_max_scale(current_graphics_state(state)->ctm);
     double raster_scale = 1.0;
     if (canvas_is_raster(canvas)) {
         raster_scale = 1.0 / canvas_raster_res(canvas);
@@ -220,6 +214,312 @@ static void apply_pending_clip_path(RenderState* state, Canvas* canvas) {
     state->pending_clip_even_odd = false;
 }
 
+/// Draws the current device-space path, unless its bounds, widened by the
+/// furthest a stroke join or cap can reach, miss the canvas entirely.
+static void
+render_draw_path(RenderState* state, Canvas* canvas, CanvasBrush brush) {
+    RELEASE_ASSERT(state);
+    RELEASE_ASSERT(canvas);
+
+    GeomRect bounds;
+    if (!path_builder_bounds(state->path, &bounds)) {
+        return;
+    }
+
+    double margin = 0.0;
+    if (brush.enable_stroke) {
+        margin = 0.5 * brush.stroke_width
+               * fmax(brush.miter_limit, sqrt(2.0));
+    }
+
+    if (bounds.max.x + margin < state->cull_rect.min.x
+        || bounds.min.x - margin > state->cull_rect.max.x
+        || bounds.max.y + margin < state->cull_rect.min.y
+        || bounds.min.y - margin > state->cull_rect.max.y) {
+        return;
+    }
+
+    canvas_draw_path(canvas, state->path, brush);
+}
+
+static Error* process_content_stream(
+    Arena* arena,
+    RenderState* state,
+    PdfContentStream* content_stream,
+    const PdfResourcesOptional* resources,
+    PdfResolver* resolver,
+    Canvas* canvas
+);
+
+static GeomRect render_form_bbox(const PdfFormXObject* form) {
+    return geom_rect_new(
+        geom_vec2_new(
+            pdf_number_as_real(form->bbox.lower_left_x),
+            pdf_number_as_real(form->bbox.lower_left_y)
+        ),
+        geom_vec2_new(
+            pdf_number_as_real(form->bbox.upper_right_x),
+            pdf_number_as_real(form->bbox.upper_right_y)
+        )
+    );
+}
+
+static GeomMat3 render_form_matrix(const PdfFormXObject* form) {
+    if (form->matrix.is_some) {
+        return form->matrix.value;
+    }
+
+    return geom_mat3_identity();
+}
+
+/// Interprets a form's content stream, clipped to its bounding box.
+static Error* render_form_xobject_contents(
+    Arena* arena,
+    RenderState* state,
+    PdfFormXObject* form,
+    PdfResolver* resolver,
+    Canvas* canvas
+) {
+    save_graphics_state(state);
+    current_graphics_state(state)->ctm = geom_mat3_mul(
+        render_form_matrix(form),
+        current_graphics_state(state)->ctm
+    );
+
+    GeomRect bbox = render_form_bbox(form);
+    PathBuilder* clip_path =
+        path_builder_new_with_options(arena, state->path_options);
+    path_builder_new_contour(clip_path, bbox.min);
+    path_builder_line_to(clip_path, geom_vec2_new(bbox.max.x, bbox.min.y));
+    path_builder_line_to(clip_path, bbox.max);
+    path_builder_line_to(clip_path, geom_vec2_new(bbox.min.x, bbox.max.y));
+
+    path_builder_apply_transform(
+        clip_path,
+        current_graphics_state(state)->ctm
+    );
+    canvas_push_clip_path(canvas, clip_path, false);
+    current_graphics_state(state)->clip_depth++;
+
+    TRY(process_content_stream(
+        arena,
+        state,
+        &form->content_stream,
+        &form->resources,
+        resolver,
+        canvas
+    ));
+
+    return restore_graphics_state(state, canvas);
+}
+
+/// Records a form into a vector display list in the space it's drawn into.
+/// The form inherits the current graphics state, but not the CTM, clip or
+/// culling, so the list can be drawn at any transform, on any page. Strokes
+/// are recorded unscaled.
+static Error* render_form_record(
+    Arena* arena,
+    RenderState* state,
+    PdfFormXObject* form,
+    PdfResolver* resolver,
+    CanvasDisplayList** list_out
+) {
+    CanvasDisplayList* list =
+        canvas_display_list_new(state->cache.arena, 0, 0, false);
+    Canvas* canvas = canvas_new_recording(arena, list);
+
+    GraphicsState gstate = *current_graphics_state(state);
+    gstate.ctm = geom_mat3_identity();
+    gstate.clip_depth = 0;
+
+    RenderState form_state = {
+        .graphics_state_stack = graphics_state_stack_new(arena),
+        .text_object_state = text_object_state_default(),
+        .path_options = path_builder_options_default(),
+        .stroke_width_scale = 1.0,
+        .cull_rect = geom_rect_new(
+            geom_vec2_new(-INFINITY, -INFINITY),
+            geom_vec2_new(INFINITY, INFINITY)
+        ),
+        .pending_clip = false,
+        .pending_clip_even_odd = false,
+        .cache = state->cache,
+        .path = NULL
+    };
+    graphics_state_stack_push_back(form_state.graphics_state_stack, gstate);
+    consume_current_path(arena, &form_state, canvas);
+
+    Error* error = render_form_xobject_contents(
+        arena,
+        &form_state,
+        form,
+        resolver,
+        canvas
+    );
+
+    // States the form saved but never restored still have clips to pop
+    while (!error
+           && graphics_state_stack_len(form_state.graphics_state_stack) > 1) {
+        error = restore_graphics_state(&form_state, canvas);
+    }
+
+    state->cache = form_state.cache;
+    if (error) {
+        return error;
+    }
+
+    *list_out = list;
+    return NULL;
+}
+
+/// Draws a recorded form onto a transparent raster canvas covering
+/// `device_bounds`, and keeps it to composite again. Returns NULL if the
+/// cache's raster budget is spent.
+static const RenderFormRaster* render_form_rasterize(
+    RenderState* state,
+    RenderFormEntry* entry,
+    GeomMat3 ctm,
+    GeomRect device_bounds
+) {
+    if (entry->raster_count == RENDER_FORM_MAX_RASTERS) {
+        return NULL;
+    }
+
+    GeomRect pixel_bounds = geom_rect_round(device_bounds);
+    GeomVec2 size = geom_rect_size(pixel_bounds);
+    if (size.x < 1.0 || size.y < 1.0 || size.x > (double)UINT32_MAX
+        || size.y > (double)UINT32_MAX
+        || fabs(pixel_bounds.min.x) > (double)INT32_MAX
+        || fabs(pixel_bounds.min.y) > (double)INT32_MAX
+        || !render_form_cache_reserve_raster(
+            state->cache.form_cache,
+            (uint32_t)size.x,
+            (uint32_t)size.y
+        )) {
+        return NULL;
+    }
+
+    Canvas* canvas = canvas_new_raster(
+        state->cache.page_arena,
+        (uint32_t)size.x,
+        (uint32_t)size.y,
+        rgba_new(0.0, 0.0, 0.0, 0.0)
+    );
+    canvas_display_list_replay_transformed(
+        entry->list,
+        canvas,
+        geom_mat3_mul(
+            ctm,
+            geom_mat3_translate(-pixel_bounds.min.x, -pixel_bounds.min.y)
+        ),
+        state->stroke_width_scale
+    );
+
+    RenderFormRaster* raster = &entry->rasters[entry->raster_count++];
+    *raster = (RenderFormRaster) {
+        .transform = ctm,
+        .stroke_width_scale = state->stroke_width_scale,
+        .x = (int32_t)pixel_bounds.min.x,
+        .y = (int32_t)pixel_bounds.min.y,
+        .canvas = canvas
+    };
+    return raster;
+}
+
+/// Draws a form XObject. The first time a form is drawn with an inherited
+/// graphics state, it's recorded, and that recording is replayed wherever it's
+/// drawn with that state again, on any page. On raster canvases, a form drawn
+/// twice on a page at the same transform up to whole pixels is also
+/// rasterized, and the page's later draws at such transforms composite those
+/// pixels.
+static Error* render_form_xobject(
+    Arena* arena,
+    RenderState* state,
+    RenderXObject* xobject,
+    PdfResolver* resolver,
+    Canvas* canvas
+) {
+    RELEASE_ASSERT(xobject->xobject.type == PDF_XOBJECT_FORM);
+    PdfFormXObject* form = &xobject->xobject.data.form;
+
+    // Form content is clipped to its bounding box
+    GeomMat3 ctm = current_graphics_state(state)->ctm;
+    GeomRect device_bounds = geom_rect_transform(
+        render_form_bbox(form),
+        geom_mat3_mul(render_form_matrix(form), ctm)
+    );
+    if (device_bounds.max.x < state->cull_rect.min.x
+        || device_bounds.min.x > state->cull_rect.max.x
+        || device_bounds.max.y < state->cull_rect.min.y
+        || device_bounds.min.y > state->cull_rect.max.y) {
+        return NULL;
+    }
+
+    // Forms are streams, so they're always indirect, but one which isn't
+    // can't be told apart from others
+    if (!xobject->has_ref) {
+        return render_form_xobject_contents(
+            arena,
+            state,
+            form,
+            resolver,
+            canvas
+        );
+    }
+
+    RenderFormEntry* entry = render_form_cache_entry(
+        state->cache.form_cache,
+        xobject->ref,
+        current_graphics_state(state)
+    );
+    entry->draw_count++;
+    if (!entry->list) {
+        TRY(render_form_record(arena, state, form, resolver, &entry->list));
+    }
+
+    if (canvas_is_raster(canvas)) {
+        int32_t x = 0;
+        int32_t y = 0;
+        const RenderFormRaster* raster = render_form_entry_find_raster(
+            entry,
+            ctm,
+            state->stroke_width_scale,
+            &x,
+            &y
+        );
+
+        if (!raster && entry->has_pending_transform
+            && render_form_whole_pixel_offset(
+                entry->pending_transform,
+                ctm,
+                &x,
+                &y
+            )) {
+            raster = render_form_rasterize(state, entry, ctm, device_bounds);
+            if (raster) {
+                x = raster->x;
+                y = raster->y;
+            }
+        }
+
+        if (raster) {
+            canvas_draw_raster(canvas, raster->canvas, x, y);
+            return NULL;
+        }
+
+        entry->has_pending_transform = true;
+        entry->pending_transform = ctm;
+    }
+
+    canvas_display_list_replay_transformed(
+        entry->list,
+        canvas,
+        ctm,
+        state->stroke_width_scale
+    );
+    return NULL;
+}
+
 static Error* process_content_stream(
     Arena* arena,
     RenderState* state,
@@ -266,21 +566,18 @@ static Error* process_content_stream(
                 RELEASE_ASSERT(resources->is_some); // TODO: Make this an error
                 RELEASE_ASSERT(resources->value.ext_gstate.is_some);
 
-                PdfObject gstate_object;
-                TRY(pdf_object_dict_get(
+                const PdfGStateParams* params = NULL;
+                TRY(render_resource_cache_get_gstate(
+                    state->cache.resource_cache,
+                    resolver,
                     &resources->value.ext_gstate.value,
                     op.data.set_gstate,
-                    &gstate_object
+                    &params
                 ));
 
-                PdfGStateParams params;
-                TRY(
-                    pdf_deserde_gstate_params(&gstate_object, &params, resolver)
-                );
-
                 graphics_state_apply_params(
                     current_graphics_state(state),
-                    params
+                    *params
                 );
                 render_refresh_path_options(state, canvas);
                 break;
@@ -374,7 +671,7 @@ static Error* process_content_stream(
                     current_graphics_state(state)->ctm
                 );
                 apply_pending_clip_path(state, canvas);
-                canvas_draw_path(canvas, state->path, brush);
+                render_draw_path(state, canvas, brush);
                 consume_current_path(arena, state, canvas);
                 break;
             }
@@ -394,7 +691,7 @@ static Error* process_content_stream(
                     current_graphics_state(state)->ctm
                 );
                 apply_pending_clip_path(state, canvas);
-                canvas_draw_path(canvas, state->path, brush);
+                render_draw_path(state, canvas, brush);
                 consume_current_path(arena, state, canvas);
                 break;
             }
@@ -414,7 +711,7 @@ static Error* process_content_stream(
                     current_graphics_state(state)->ctm
                 );
                 apply_pending_clip_path(state, canvas);
-                canvas_draw_path(canvas, state->path, brush);
+                render_draw_path(state, canvas, brush);
                 consume_current_path(arena, state, canvas);
                 break;
             }
@@ -445,7 +742,7 @@ static Error* process_content_stream(
                     current_graphics_state(state)->ctm
                 );
                 apply_pending_clip_path(state, canvas);
-                canvas_draw_path(canvas, state->path, brush);
+                render_draw_path(state, canvas, brush);
                 consume_current_path(arena, state, canvas);
                 break;
             }
@@ -477,7 +774,7 @@ static Error* process_content_stream(
                     current_graphics_state(state)->ctm
                 );
                 apply_pending_clip_path(state, canvas);
-                canvas_draw_path(canvas, state->path, brush);
+                render_draw_path(state, canvas, brush);
                 consume_current_path(arena, state, canvas);
                 break;
             }
@@ -510,7 +807,7 @@ static Error* process_content_stream(
                     current_graphics_state(state)->ctm
                 );
                 apply_pending_clip_path(state, canvas);
-                canvas_draw_path(canvas, state->path, brush);
+                render_draw_path(state, canvas, brush);
                 consume_current_path(arena, state, canvas);
                 break;
             }
@@ -544,7 +841,7 @@ static Error* process_content_stream(
                     current_graphics_state(state)->ctm
                 );
                 apply_pending_clip_path(state, canvas);
-                canvas_draw_path(canvas, state->path, brush);
+                render_draw_path(state, canvas, brush);
                 consume_current_path(arena, state, canvas);
                 break;
             }
@@ -595,17 +892,12 @@ static Error* process_content_stream(
                 ); // TODO: This should be an error, and ideally a function
                 RELEASE_ASSERT(resources->value.font.is_some);
 
-                PdfObject font_object;
-                TRY(pdf_object_dict_get(
+                TRY(render_resource_cache_get_font(
+                    state->cache.resource_cache,
+                    resolver,
                     &resources->value.font.value,
                     op.data.set_font.font,
-                    &font_object
-                ));
-
-                TRY(pdf_deserde_font(
-                    &font_object,
-                    &current_graphics_state(state)->text_state.text_font,
-                    resolver
+                    &current_graphics_state(state)->text_state.text_font
                 ));
                 current_graphics_state(state)->text_state.text_font_size =
                     op.data.set_font.size;
@@ -967,9 +1259,8 @@ static Error* process_content_stream(
                     pdf_deserde_shading_dict(&resolved, &shading_dict, resolver)
                 );
 
-                render_shading(
+                render_shading_deferred(
                     &shading_dict,
-                    arena,
                     current_graphics_state(state)->ctm,
                     canvas
                 );
@@ -980,85 +1271,27 @@ static Error* process_content_stream(
                 RELEASE_ASSERT(resources->is_some);
                 RELEASE_ASSERT(resources->value.xobject.is_some);
 
-                PdfObject xobject_object;
-                TRY(pdf_object_dict_get(
+                RenderXObject* xobject = NULL;
+                TRY(render_resource_cache_get_xobject(
+                    state->cache.resource_cache,
+                    resolver,
                     &resources->value.xobject.value,
                     op.data.paint_xobject,
-                    &xobject_object
+                    &xobject
                 ));
 
-                PdfXObject xobject;
-                TRY(pdf_deserde_xobject(&xobject_object, &xobject, resolver));
-
-                switch (xobject.type) {
+                switch (xobject->xobject.type) {
                     case PDF_XOBJECT_IMAGE: {
                         LOG_TODO();
                     }
                     case PDF_XOBJECT_FORM: {
-                        PdfFormXObject* form = &xobject.data.form;
-                        GeomMat3 matrix;
-                        if (form->matrix.is_some) {
-                            matrix = form->matrix.value;
-                        } else {
-                            matrix = geom_mat3_identity();
-                        }
-
-                        save_graphics_state(state);
-                        current_graphics_state(state)->ctm = geom_mat3_mul(
-                            matrix,
-                            current_graphics_state(state)->ctm
-                        );
-
-                        PathBuilder* clip_path = path_builder_new_with_options(
-                            arena,
-                            state->path_options
-                        );
-                        path_builder_new_contour(
-                            clip_path,
-                            geom_vec2_new(
-                                pdf_number_as_real(form->bbox.lower_left_x),
-                                pdf_number_as_real(form->bbox.lower_left_y)
-                            )
-                        );
-                        path_builder_line_to(
-                            clip_path,
-                            geom_vec2_new(
-                                pdf_number_as_real(form->bbox.upper_right_x),
-                                pdf_number_as_real(form->bbox.lower_left_y)
-                            )
-                        );
-                        path_builder_line_to(
-                            clip_path,
-                            geom_vec2_new(
-                                pdf_number_as_real(form->bbox.upper_right_x),
-                                pdf_number_as_real(form->bbox.upper_right_y)
-                            )
-                        );
-                        path_builder_line_to(
-                            clip_path,
-                            geom_vec2_new(
-                                pdf_number_as_real(form->bbox.lower_left_x),
-                                pdf_number_as_real(form->bbox.upper_right_y)
-                            )
-                        );
-
-                        path_builder_apply_transform(
-                            clip_path,
-                            current_graphics_state(state)->ctm
-                        );
-                        canvas_push_clip_path(canvas, clip_path, false);
-                        current_graphics_state(state)->clip_depth++;
-
-                        TRY(process_content_stream(
+                        TRY(render_form_xobject(
                             arena,
                             state,
-                            &form->content_stream,
-                            &form->resources,
+                            xobject,
                             resolver,
                             canvas
                         ));
-
-                        TRY(restore_graphics_state(state, canvas));
                     }
                 }
 
@@ -1073,80 +1306,241 @@ static Error* process_content_stream(
     return NULL;
 }
 
-Error* render_page(
+static Error* process_page_contents(
     Arena* arena,
-    PdfResolver* resolver,
+    RenderState* state,
     const PdfPage* page,
-    RenderCanvasType canvas_type,
-    Canvas** canvas
+    PdfResolver* resolver,
+    Canvas* canvas
 ) {
     RELEASE_ASSERT(arena);
-    RELEASE_ASSERT(resolver);
+    RELEASE_ASSERT(state);
     RELEASE_ASSERT(page);
+    RELEASE_ASSERT(resolver);
     RELEASE_ASSERT(canvas);
-    RELEASE_ASSERT(!*canvas);
+
+    if (!page->contents.is_some) {
+        return NULL;
+    }
+
+    for (size_t contents_idx = 0;
+         contents_idx < pdf_content_stream_ref_vec_len(page->contents.value);
+         contents_idx++) {
+        PdfContentStreamRef stream_ref;
+        RELEASE_ASSERT(pdf_content_stream_ref_vec_get(
+            page->contents.value,
+            contents_idx,
+            &stream_ref
+        ));
+
+        TRY(pdf_resolve_content_stream(&stream_ref, resolver));
+        PdfContentStream* stream = stream_ref.resolved;
+
+        TRY(process_content_stream(
+            arena,
+            state,
+            stream,
+            &page->resources,
+            resolver,
+            canvas
+        ));
+    }
+
+    return NULL;
+}
+
+RenderOptions render_options_default(void) {
+    return (RenderOptions) {.dpi = 72.0,
+                            .width = 0,
+                            .height = 0,
+                            .page_box = RENDER_PAGE_BOX_MEDIA,
+                            .has_region = false,
+                            .region_in_device_space = false,
+                            .region = geom_rect_new(
+                                geom_vec2_new(0.0, 0.0),
+                                geom_vec2_new(0.0, 0.0)
+                            ),
+                            .background = rgba_new(1.0, 1.0, 1.0, 1.0),
+                            .thread_count = 1,
+                            .glyph_cache_budget =
+                                RENDER_DEFAULT_GLYPH_CACHE_BUDGET};
+}
+
+static GeomRect render_rect_from_pdf(PdfRectangle rect) {
+    // Rectangles may be given by any two opposite corners
+    GeomRect corners = pdf_rectangle_to_geom(rect);
+    return geom_rect_new(corners.min, corners.max);
+}
+
+/// Where a page lands in device space for some render options.
+typedef struct {
+    /// Maps default user space onto the full-size output, with y downwards.
+    GeomMat3 device_transform;
+
+    /// The rendered part of the full-size output, in whole pixels.
+    GeomRect device_rect;
+    uint32_t width;
+    uint32_t height;
+
+    double stroke_width_scale;
+} RenderPageGeometry;
+
+static Error* render_page_geometry(
+    const PdfPage* page,
+    const RenderOptions* options,
+    RenderPageGeometry* geometry_out
+) {
+    RELEASE_ASSERT(page);
+    RELEASE_ASSERT(options);
+    RELEASE_ASSERT(geometry_out);
     RELEASE_ASSERT(page->media_box.is_some);
 
-    PdfRectangle mediabox = page->media_box.value;
+    GeomRect box = render_rect_from_pdf(page->media_box.value);
+    if (options->page_box == RENDER_PAGE_BOX_CROP && page->crop_box.is_some) {
+        box = geom_rect_intersection(
+            box,
+            render_rect_from_pdf(page->crop_box.value)
+        );
+    }
 
-    GeomRect rect = geom_rect_new(
-        geom_vec2_new(
-            pdf_number_as_real(mediabox.upper_right_x),
-            pdf_number_as_real(mediabox.upper_right_y)
-        ),
-        geom_vec2_new(
-            pdf_number_as_real(mediabox.lower_left_x),
-            pdf_number_as_real(mediabox.lower_left_y)
-        )
+    GeomVec2 box_size = geom_rect_size(box);
+    if (box_size.x <= 0.0 || box_size.y <= 0.0) {
+        return ERROR(RENDER_ERR_INVALID_PAGE_BOX, "Page box has no area");
+    }
+
+    double scale_x = options->dpi / 72.0;
+    double scale_y = scale_x;
+    if (options->width != 0 && options->height != 0) {
+        scale_x = (double)options->width / box_size.x;
+        scale_y = (double)options->height / box_size.y;
+    }
+    RELEASE_ASSERT(scale_x > 0.0 && scale_y > 0.0);
+
+    GeomMat3 device_transform = geom_mat3_new_pdf(
+        scale_x,
+        0.0,
+        0.0,
+        -scale_y,
+        -box.min.x * scale_x,
+        box.max.y * scale_y
     );
 
-    GeomVec2 rect_size = geom_rect_size(rect);
-    uint32_t canvas_width = (uint32_t)ceil(rect_size.x);
-    uint32_t canvas_height = (uint32_t)ceil(rect_size.y);
-    double canvas_scale = 1.0;
-    switch (canvas_type) {
-        case RENDER_CANVAS_TYPE_RASTER: {
-            const uint32_t resolution_multiplier = 5;
-            canvas_scale = (double)resolution_multiplier;
-            uint32_t raster_canvas_width =
-                (uint32_t)ceil(rect_size.x * (double)resolution_multiplier);
-            uint32_t raster_canvas_height =
-                (uint32_t)ceil(rect_size.y * (double)resolution_multiplier);
-            *canvas = canvas_new_raster(
-                arena,
-                raster_canvas_width,
-                raster_canvas_height,
-                rgba_new(1.0, 1.0, 1.0, 1.0)
-            );
-            break;
-        }
-        case RENDER_CANVAS_TYPE_SCALABLE: {
-            *canvas = canvas_new_scalable(
-                arena,
-                canvas_width,
-                canvas_height,
-                rgba_new(1.0, 1.0, 1.0, 1.0),
-                1.0
-            );
-            break;
+    GeomRect device_rect = geom_rect_new(
+        geom_vec2_new(0.0, 0.0),
+        geom_vec2_new(ceil(box_size.x * scale_x), ceil(box_size.y * scale_y))
+    );
+    if (options->has_region) {
+        GeomRect region = options->region;
+        if (!options->region_in_device_space) {
+            region = geom_rect_transform(region, device_transform);
         }
+
+        device_rect = geom_rect_intersection(
+            device_rect,
+            geom_rect_round(region)
+        );
     }
 
+    uint32_t width = 0;
+    uint32_t height = 0;
+    if (device_rect.max.x > device_rect.min.x
+        && device_rect.max.y > device_rect.min.y) {
+        width = (uint32_t)(device_rect.max.x - device_rect.min.x);
+        height = (uint32_t)(device_rect.max.y - device_rect.min.y);
+    }
+
+    *geometry_out = (RenderPageGeometry) {
+        .device_transform = device_transform,
+        .device_rect = device_rect,
+        .width = width,
+        .height = height,
+        .stroke_width_scale = fmax(scale_x, scale_y)
+    };
+    return NULL;
+}
+
+/// Creates a cache on `arena`, which parses font programs and CMaps into
+/// `font_store` if it isn't null.
+static RenderCache render_cache_new(
+    Arena* arena,
+    RenderFontStore* font_store,
+    size_t glyph_cache_budget
+) {
+    return (RenderCache) {
+        .arena = arena,
+        .glyph_list = NULL,
+        .icc_cache = icc_profile_cache_new(arena),
+        .font_cache =
+            render_font_cache_new(arena, font_store, glyph_cache_budget),
+        .resource_cache = render_resource_cache_new(arena),
+        .form_cache = render_form_cache_new(arena),
+        .page_arena = NULL
+    };
+}
+
+/// Starts rendering a page with `cache`, whose form rasterizations are made
+/// on `arena` until the page is finished.
+static void render_cache_begin_page(RenderCache* cache, Arena* arena) {
+    cache->page_arena = arena;
+}
+
+/// Finishes the page started with `render_cache_begin_page`, dropping the
+/// cache's references to the page's arena, which may be freed after this.
+static void render_cache_end_page(RenderCache* cache) {
+    render_form_cache_end_page(cache->form_cache);
+    cache->page_arena = NULL;
+}
+
+struct RenderDocumentCache {
+    RenderCache cache;
+};
+
+RenderDocumentCache* render_document_cache_new(size_t glyph_cache_budget) {
+    Arena* arena = arena_new(65536);
+
+    RenderDocumentCache* cache =
+        arena_alloc(arena, sizeof(RenderDocumentCache));
+    cache->cache = render_cache_new(arena, NULL, glyph_cache_budget);
+
+    return cache;
+}
+
+void render_document_cache_free(RenderDocumentCache* cache) {
+    RELEASE_ASSERT(cache);
+
+    render_font_cache_free(cache->cache.font_cache);
+    arena_free(cache->cache.arena);
+}
+
+/// Runs the page's content stream once, drawing the device-space rectangle
+/// `device_rect` onto `canvas`. Anything that only lives for this pass is
+/// allocated on `arena`, so it may be shorter-lived than `cache`. Curves are
+/// flattened as they're built if `flatten_curves` is set.
+static Error* render_page_pass(
+    Arena* arena,
+    RenderCache* cache,
+    PdfResolver* resolver,
+    const PdfPage* page,
+    const RenderPageGeometry* geometry,
+    GeomRect device_rect,
+    bool flatten_curves,
+    Canvas* canvas
+) {
     PathBuilderOptions path_options = path_builder_options_default();
-    if (canvas_is_raster(*canvas)) {
+    if (flatten_curves) {
         path_options = path_builder_options_flattened();
     }
 
+    GeomVec2 canvas_size = geom_rect_size(device_rect);
     RenderState state = {
         .graphics_state_stack = graphics_state_stack_new(arena),
         .text_object_state = text_object_state_default(),
         .path_options = path_options,
-        .stroke_width_scale = canvas_scale,
+        .stroke_width_scale = geometry->stroke_width_scale,
+        .cull_rect = geom_rect_new(geom_vec2_new(0.0, 0.0), canvas_size),
         .pending_clip = false,
         .pending_clip_even_odd = false,
-        .cache.cmap_cache = pdf_cmap_cache_new(arena),
-        .cache.glyph_list = NULL,
-        .cache.icc_cache = icc_profile_cache_new(arena),
+        .cache = *cache,
         .path = NULL
     };
 
@@ -1155,48 +1549,883 @@ Error* render_page(
         graphics_state_default()
     );
 
-    double scale = canvas_scale; // TODO: load
+    // The canvas starts at the top-left corner of `device_rect`
     current_graphics_state(&state)->ctm = geom_mat3_mul(
-        geom_mat3_translate(-rect.min.x * scale, -rect.min.y * scale),
-        geom_mat3_new(
-            scale,
-            0.0,
-            0.0,
-            0.0,
-            -scale,
-            0.0,
-            -rect.min.x * scale,
-            rect.max.y * scale,
+        geometry->device_transform,
+        geom_mat3_translate(-device_rect.min.x, -device_rect.min.y)
+    );
+    consume_current_path(arena, &state, canvas);
+
+    Error* error =
+        process_page_contents(arena, &state, page, resolver, canvas);
+
+    // Keeps anything loaded lazily during the pass for the next one
+    *cache = state.cache;
+    return error;
+}
+
+Error* render_page(
+    Arena* arena,
+    PdfResolver* resolver,
+    RenderDocumentCache* cache,
+    const PdfPage* page,
+    RenderCanvasType canvas_type,
+    Canvas** canvas
+) {
+    RenderOptions options = render_options_default();
+    return render_page_with_options(
+        arena,
+        resolver,
+        cache,
+        page,
+        canvas_type,
+        &options,
+        canvas
+    );
+}
+
+static Canvas* render_new_canvas(
+    Arena* arena,
+    RenderCanvasType canvas_type,
+    const RenderPageGeometry* geometry,
+    const RenderOptions* options
+) {
+    switch (canvas_type) {
+        case RENDER_CANVAS_TYPE_RASTER: {
+            return canvas_new_raster(
+                arena,
+                geometry->width,
+                geometry->height,
+                options->background
+            );
+        }
+        case RENDER_CANVAS_TYPE_SCALABLE: {
+            return canvas_new_scalable(
+                arena,
+                geometry->width,
+                geometry->height,
+                options->background,
+                1.0
+            );
+        }
+    }
+
+    LOG_PANIC("Unreachable");
+}
+
+/// Parallel rasterization needs the whole page up front, so it's recorded
+/// first and only drawn once interpretation has finished. Returns the
+/// recording canvas to draw onto, or `canvas` itself if drawing directly.
+static Canvas* render_begin_tiled(
+    Arena* arena,
+    RenderCanvasType canvas_type,
+    const RenderPageGeometry* geometry,
+    const RenderOptions* options,
+    Canvas* canvas,
+    CanvasDisplayList** display_list_out
+) {
+    *display_list_out = NULL;
+    if (canvas_type != RENDER_CANVAS_TYPE_RASTER
+        || options->thread_count <= 1) {
+        return canvas;
+    }
+
+    *display_list_out = canvas_display_list_new(
+        arena,
+        geometry->width,
+        geometry->height,
+        true
+    );
+    return canvas_new_recording(arena, *display_list_out);
+}
+
+static void render_finish_tiled(
+    CanvasDisplayList* display_list,
+    const RenderOptions* options,
+    Canvas* canvas
+) {
+    if (!display_list) {
+        return;
+    }
+
+    canvas_display_list_rasterize_tiled(
+        display_list,
+        canvas,
+        RENDER_TILE_HEIGHT,
+        options->thread_count
+    );
+}
+
+/// Renders a page onto a new canvas allocated on `arena`, reusing whatever
+/// `cache` already holds from earlier pages of the same document.
+static Error* render_page_with_cache(
+    Arena* arena,
+    RenderCache* cache,
+    PdfResolver* resolver,
+    const PdfPage* page,
+    RenderCanvasType canvas_type,
+    const RenderOptions* options,
+    Canvas** canvas
+) {
+    RenderPageGeometry geometry;
+    TRY(render_page_geometry(page, options, &geometry));
+
+    *canvas = render_new_canvas(arena, canvas_type, &geometry, options);
+
+    CanvasDisplayList* display_list;
+    Canvas* pass_canvas = render_begin_tiled(
+        arena,
+        canvas_type,
+        &geometry,
+        options,
+        *canvas,
+        &display_list
+    );
+
+    TRY(render_page_pass(
+        arena,
+        cache,
+        resolver,
+        page,
+        &geometry,
+        geometry.device_rect,
+        canvas_is_raster(pass_canvas),
+        pass_canvas
+    ));
+
+    render_finish_tiled(display_list, options, *canvas);
+
+    return NULL;
+}
+
+Error* render_page_with_options(
+    Arena* arena,
+    PdfResolver* resolver,
+    RenderDocumentCache* cache,
+    const PdfPage* page,
+    RenderCanvasType canvas_type,
+    const RenderOptions* options,
+    Canvas** canvas
+) {
+    RELEASE_ASSERT(arena);
+    RELEASE_ASSERT(resolver);
+    RELEASE_ASSERT(cache);
+    RELEASE_ASSERT(page);
+    RELEASE_ASSERT(options);
+    RELEASE_ASSERT(canvas);
+    RELEASE_ASSERT(!*canvas);
+
+    render_cache_begin_page(&cache->cache, arena);
+    Error* error = render_page_with_cache(
+        arena,
+        &cache->cache,
+        resolver,
+        page,
+        canvas_type,
+        options,
+        canvas
+    );
+    render_cache_end_page(&cache->cache);
+
+    return error;
+}
+
+/// Records a page into `commands`, a vector display list the size of
+/// `geometry`. Only the recorded commands outlive the pass, so paths and forms
+/// are dropped with it. Curves are kept unless `flatten_curves` is set, which
+/// flattens them as a raster pass would, for lists only drawn at the recorded
+/// resolution.
+static Error* render_page_record_commands(
+    RenderDocumentCache* cache,
+    PdfResolver* resolver,
+    const PdfPage* page,
+    const RenderPageGeometry* geometry,
+    bool flatten_curves,
+    CanvasDisplayList* commands
+) {
+    Arena* pass_arena = arena_new(65536);
+    render_cache_begin_page(&cache->cache, pass_arena);
+
+    Error* error = render_page_pass(
+        pass_arena,
+        &cache->cache,
+        resolver,
+        page,
+        geometry,
+        geometry->device_rect,
+        flatten_curves,
+        canvas_new_recording(pass_arena, commands)
+    );
+
+    render_cache_end_page(&cache->cache);
+    arena_free(pass_arena);
+    return error;
+}
+
+Error* render_page_banded(
+    Arena* arena,
+    PdfResolver* resolver,
+    RenderDocumentCache* cache,
+    const PdfPage* page,
+    const RenderOptions* options,
+    uint32_t band_height,
+    RenderRowSink sink,
+    void* sink_data
+) {
+    RELEASE_ASSERT(arena);
+    RELEASE_ASSERT(resolver);
+    RELEASE_ASSERT(cache);
+    RELEASE_ASSERT(page);
+    RELEASE_ASSERT(options);
+    RELEASE_ASSERT(band_height != 0);
+    RELEASE_ASSERT(sink);
+
+    RenderPageGeometry geometry;
+    TRY(render_page_geometry(page, options, &geometry));
+
+    // The page is interpreted once, into a display list at the output
+    // resolution with curves flattened just as they would be for the whole
+    // page. Each band replays it onto a canvas holding only the band's rows,
+    // which culls everything outside them, and is dropped once its rows have
+    // been written.
+    CanvasDisplayList* commands = canvas_display_list_new(
+        arena,
+        geometry.width,
+        geometry.height,
+        false
+    );
+    Error* error = render_page_record_commands(
+        cache,
+        resolver,
+        page,
+        &geometry,
+        true,
+        commands
+    );
+
+    Arena* band_arena = arena_new(65536);
+    for (uint32_t band_y = 0; band_y < geometry.height && !error;
+         band_y += band_height) {
+        uint32_t rows = geometry.height - band_y;
+        if (rows > band_height) {
+            rows = band_height;
+        }
+
+        // The band keeps the page's row coordinates, so its pixels are
+        // computed exactly as they would be for the whole page
+        arena_reset(band_arena);
+        Canvas* canvas = canvas_new_raster_band(
+            band_arena,
+            geometry.width,
+            geometry.height,
+            band_y,
+            band_y + rows,
+            options->background
+        );
+
+        // Strokes were already scaled to the output resolution while
+        // recording
+        canvas_display_list_replay_transformed(
+            commands,
+            canvas,
+            geom_mat3_identity(),
             1.0
+        );
+
+        for (uint32_t row = band_y; row < band_y + rows && !error; row++) {
+            error = sink(
+                sink_data,
+                row,
+                canvas_raster_row(canvas, row),
+                geometry.width
+            );
+        }
+    }
+
+    arena_free(band_arena);
+
+    return error;
+}
+
+struct RenderDisplayList {
+    PdfPage page;
+
+    /// Maps the canvas the page was recorded onto from default user space.
+    GeomMat3 recorded_transform;
+    CanvasDisplayList* commands;
+};
+
+/// Maps default user space onto the top-left corner of the rendered region.
+static GeomMat3 render_page_canvas_transform(const RenderPageGeometry* geometry
+) {
+    return geom_mat3_mul(
+        geometry->device_transform,
+        geom_mat3_translate(
+            -geometry->device_rect.min.x,
+            -geometry->device_rect.min.y
         )
     );
-    consume_current_path(arena, &state, *canvas);
-
-    if (page->contents.is_some) {
-        for (size_t contents_idx = 0;
-             contents_idx
-             < pdf_content_stream_ref_vec_len(page->contents.value);
-             contents_idx++) {
-            PdfContentStreamRef stream_ref;
-            RELEASE_ASSERT(pdf_content_stream_ref_vec_get(
-                page->contents.value,
-                contents_idx,
-                &stream_ref
-            ));
-
-            TRY(pdf_resolve_content_stream(&stream_ref, resolver));
-            PdfContentStream* stream = stream_ref.resolved;
-
-            TRY(process_content_stream(
-                arena,
-                &state,
-                stream,
-                &page->resources,
-                resolver,
-                *canvas
-            ));
+}
+
+Error* render_page_record(
+    Arena* arena,
+    PdfResolver* resolver,
+    RenderDocumentCache* cache,
+    const PdfPage* page,
+    RenderDisplayList** list_out
+) {
+    RELEASE_ASSERT(arena);
+    RELEASE_ASSERT(resolver);
+    RELEASE_ASSERT(cache);
+    RELEASE_ASSERT(page);
+    RELEASE_ASSERT(list_out);
+
+    RenderOptions options = render_options_default();
+    RenderPageGeometry geometry;
+    TRY(render_page_geometry(page, &options, &geometry));
+
+    RenderDisplayList* list = arena_alloc(arena, sizeof(RenderDisplayList));
+    list->page = *page;
+    list->recorded_transform = render_page_canvas_transform(&geometry);
+    list->commands = canvas_display_list_new(
+        arena,
+        geometry.width,
+        geometry.height,
+        false
+    );
+
+    TRY(render_page_record_commands(
+        cache,
+        resolver,
+        page,
+        &geometry,
+        false,
+        list->commands
+    ));
+
+    *list_out = list;
+    return NULL;
+}
+
+Error* render_display_list_draw(
+    Arena* arena,
+    const RenderDisplayList* list,
+    RenderCanvasType canvas_type,
+    const RenderOptions* options,
+    Canvas** canvas
+) {
+    RELEASE_ASSERT(arena);
+    RELEASE_ASSERT(list);
+    RELEASE_ASSERT(options);
+    RELEASE_ASSERT(canvas);
+    RELEASE_ASSERT(!*canvas);
+
+    RenderPageGeometry geometry;
+    TRY(render_page_geometry(&list->page, options, &geometry));
+
+    GeomMat3 transform = geom_mat3_mul(
+        geom_mat3_inverse(list->recorded_transform),
+        render_page_canvas_transform(&geometry)
+    );
+
+    *canvas = render_new_canvas(arena, canvas_type, &geometry, options);
+
+    CanvasDisplayList* display_list;
+    Canvas* pass_canvas = render_begin_tiled(
+        arena,
+        canvas_type,
+        &geometry,
+        options,
+        *canvas,
+        &display_list
+    );
+
+    // Pages are recorded at 72 DPI, where strokes aren't scaled
+    canvas_display_list_replay_transformed(
+        list->commands,
+        pass_canvas,
+        transform,
+        geometry.stroke_width_scale
+    );
+
+    render_finish_tiled(display_list, options, *canvas);
+
+    return NULL;
+}
+
+/// A page of a batch render, from the worker rendering it to the thread
+/// delivering it.
+typedef struct {
+    bool done;
+    Error* error;
+    Arena* arena;
+    Canvas* canvas;
+} RenderBatchSlot;
+
+typedef struct {
+    const size_t* page_indices;
+    size_t page_count;
+    RenderCanvasType canvas_type;
+    const RenderOptions* options;
+
+    /// Slots are claimed in order, at most `window` ahead of the next slot to
+    /// be delivered, which bounds the number of finished canvases held.
+    pthread_mutex_t mutex;
+    pthread_cond_t claim_cond;
+    pthread_cond_t done_cond;
+    size_t next_slot;
+    size_t delivered;
+    size_t window;
+    bool stop;
+
+    RenderBatchSlot* slots;
+} RenderBatch;
+
+/// A worker's document state, kept across the pages it renders.
+typedef struct {
+    RenderBatch* batch;
+    Arena* arena;
+    PdfResolver* resolver;
+    RenderCache cache;
+} RenderBatchWorker;
+
+static Error* render_batch_worker_render(
+    RenderBatch* batch,
+    RenderBatchWorker* worker,
+    size_t slot_idx,
+    RenderBatchSlot* slot
+) {
+    PdfPage page;
+    TRY(pdf_get_page(worker->resolver, batch->page_indices[slot_idx], &page));
+
+    render_cache_begin_page(&worker->cache, slot->arena);
+    Error* error = render_page_with_cache(
+        slot->arena,
+        &worker->cache,
+        worker->resolver,
+        &page,
+        batch->canvas_type,
+        batch->options,
+        &slot->canvas
+    );
+    render_cache_end_page(&worker->cache);
+
+    return error;
+}
+
+static void* render_batch_worker(void* data) {
+    RenderBatchWorker* worker = data;
+    RenderBatch* batch = worker->batch;
+
+    while (true) {
+        RELEASE_ASSERT(pthread_mutex_lock(&batch->mutex) == 0);
+        while (!batch->stop && batch->next_slot < batch->page_count
+               && batch->next_slot >= batch->delivered + batch->window) {
+            RELEASE_ASSERT(
+                pthread_cond_wait(&batch->claim_cond, &batch->mutex) == 0
+            );
+        }
+
+        if (batch->stop || batch->next_slot >= batch->page_count) {
+            RELEASE_ASSERT(pthread_mutex_unlock(&batch->mutex) == 0);
+            break;
         }
+
+        size_t slot_idx = batch->next_slot++;
+        RELEASE_ASSERT(pthread_mutex_unlock(&batch->mutex) == 0);
+
+        RenderBatchSlot result = {
+            .done = true,
+            .arena = arena_new(65536),
+            .canvas = NULL
+        };
+        result.error =
+            render_batch_worker_render(batch, worker, slot_idx, &result);
+
+        RELEASE_ASSERT(pthread_mutex_lock(&batch->mutex) == 0);
+        batch->slots[slot_idx] = result;
+        RELEASE_ASSERT(pthread_cond_broadcast(&batch->done_cond) == 0);
+        RELEASE_ASSERT(pthread_mutex_unlock(&batch->mutex) == 0);
     }
 
     return NULL;
 }
+
+Error* render_pages_batch(
+    const uint8_t* buffer,
+    size_t buffer_size,
+    const size_t* page_indices,
+    size_t page_count,
+    RenderCanvasType canvas_type,
+    const RenderOptions* options,
+    uint32_t thread_count,
+    RenderBatchCallback callback,
+    void* user_data
+) {
+    RELEASE_ASSERT(buffer);
+    RELEASE_ASSERT(page_indices || page_count == 0);
+    RELEASE_ASSERT(options);
+    RELEASE_ASSERT(callback);
+
+    if (page_count == 0) {
+        return NULL;
+    }
+
+    size_t worker_count = thread_count == 0 ? 1 : (size_t)thread_count;
+    if (worker_count > page_count) {
+        worker_count = page_count;
+    }
+
+    Arena* arena = arena_new(4096);
+    PdfResolver* resolver;
+    Error* resolver_error =
+        pdf_resolver_new(arena, buffer, buffer_size, &resolver);
+    if (resolver_error) {
+        arena_free(arena);
+        return resolver_error;
+    }
+
+    RenderBatch batch = {
+        .page_indices = page_indices,
+        .page_count = page_count,
+        .canvas_type = canvas_type,
+        .options = options,
+        .next_slot = 0,
+        .delivered = 0,
+        .window = worker_count * 2,
+        .stop = false,
+        .slots = arena_alloc(arena, sizeof(RenderBatchSlot) * page_count)
+    };
+    memset(batch.slots, 0, sizeof(RenderBatchSlot) * page_count);
+    RELEASE_ASSERT(pthread_mutex_init(&batch.mutex, NULL) == 0);
+    RELEASE_ASSERT(pthread_cond_init(&batch.claim_cond, NULL) == 0);
+    RELEASE_ASSERT(pthread_cond_init(&batch.done_cond, NULL) == 0);
+
+    // Workers share the document's parsed objects through their forks of the
+    // resolver, and its font programs and CMaps through the font store. Their
+    // arenas hold those objects, so they're only freed once every worker is
+    // done. ICC profiles cache their transforms as they're used, so each
+    // worker parses its own.
+    RenderFontStore* font_store = render_font_store_new();
+    RenderBatchWorker* workers =
+        arena_alloc(arena, sizeof(RenderBatchWorker) * worker_count);
+    pthread_t* threads = arena_alloc(arena, sizeof(pthread_t) * worker_count);
+    for (size_t idx = 0; idx < worker_count; idx++) {
+        RenderBatchWorker* worker = &workers[idx];
+        worker->batch = &batch;
+        worker->arena = arena_new(65536);
+        worker->resolver = pdf_resolver_fork(worker->arena, resolver);
+        worker->cache = render_cache_new(
+            worker->arena,
+            font_store,
+            options->glyph_cache_budget
+        );
+
+        RELEASE_ASSERT(
+            pthread_create(&threads[idx], NULL, render_batch_worker, worker)
+            == 0
+        );
+    }
+
+    // Pages are delivered from this thread, in order, as they finish
+    Error* error = NULL;
+    for (size_t slot_idx = 0; slot_idx < page_count && !error; slot_idx++) {
+        RenderBatchSlot* slot = &batch.slots[slot_idx];
+
+        RELEASE_ASSERT(pthread_mutex_lock(&batch.mutex) == 0);
+        while (!slot->done) {
+            RELEASE_ASSERT(
+                pthread_cond_wait(&batch.done_cond, &batch.mutex) == 0
+            );
+        }
+        RELEASE_ASSERT(pthread_mutex_unlock(&batch.mutex) == 0);
+
+        error = slot->error;
+        slot->error = NULL;
+        if (!error) {
+            error = callback(user_data, page_indices[slot_idx], slot->canvas);
+        }
+
+        arena_free(slot->arena);
+        slot->arena = NULL;
+
+        RELEASE_ASSERT(pthread_mutex_lock(&batch.mutex) == 0);
+        batch.delivered++;
+        batch.stop = error != NULL;
+        RELEASE_ASSERT(pthread_cond_broadcast(&batch.claim_cond) == 0);
+        RELEASE_ASSERT(pthread_mutex_unlock(&batch.mutex) == 0);
+    }
+
+    for (size_t idx = 0; idx < worker_count; idx++) {
+        RELEASE_ASSERT(pthread_join(threads[idx], NULL) == 0);
+    }
+
+    // Pages finished after an error are never delivered
+    for (size_t slot_idx = 0; slot_idx < page_count; slot_idx++) {
+        RenderBatchSlot* slot = &batch.slots[slot_idx];
+        if (slot->error) {
+            error_free(slot->error);
+        }
+        if (slot->arena) {
+            arena_free(slot->arena);
+        }
+    }
+
+    RELEASE_ASSERT(pthread_cond_destroy(&batch.done_cond) == 0);
+    RELEASE_ASSERT(pthread_cond_destroy(&batch.claim_cond) == 0);
+    RELEASE_ASSERT(pthread_mutex_destroy(&batch.mutex) == 0);
+
+    for (size_t idx = 0; idx < worker_count; idx++) {
+        render_font_cache_free(workers[idx].cache.font_cache);
+    }
+    render_font_store_free(font_store);
+    for (size_t idx = 0; idx < worker_count; idx++) {
+        arena_free(workers[idx].arena);
+    }
+    arena_free(arena);
+
+    return error;
+}
+
+#ifdef TEST
+
+#include "test/test.h"
+
+/// Writes `objects`, numbered from 1, into a document rooted at object 1.
+static char* render_test_doc(
+    Arena* arena,
+    const char** objects,
+    size_t object_count,
+    size_t* doc_len
+) {
+    size_t capacity = 256;
+    for (size_t idx = 0; idx < object_count; idx++) {
+        capacity += strlen(objects[idx]) + 64;
+    }
+
+    char* doc = arena_alloc(arena, capacity);
+    size_t* offsets = arena_alloc(arena, sizeof(size_t) * object_count);
+    int len = snprintf(doc, capacity, "%%PDF-1.4\n");
+    for (size_t idx = 0; idx < object_count; idx++) {
+        offsets[idx] = (size_t)len;
+        len += snprintf(
+            doc + len,
+            capacity - (size_t)len,
+            "%zu 0 obj %s endobj\n",
+            idx + 1,
+            objects[idx]
+        );
+    }
+
+    size_t startxref = (size_t)len;
+    len += snprintf(
+        doc + len,
+        capacity - (size_t)len,
+        "xref\n0 %zu\n0000000000 65535 f \n",
+        object_count + 1
+    );
+    for (size_t idx = 0; idx < object_count; idx++) {
+        len += snprintf(
+            doc + len,
+            capacity - (size_t)len,
+            "%010zu 00000 n \n",
+            offsets[idx]
+        );
+    }
+    len += snprintf(
+        doc + len,
+        capacity - (size_t)len,
+        "trailer\n<< /Size %zu /Root 1 0 R >>\nstartxref\n%zu\n%%%%EOF\n",
+        object_count + 1,
+        startxref
+    );
+    RELEASE_ASSERT((size_t)len < capacity);
+
+    *doc_len = (size_t)len;
+    return doc;
+}
+
+typedef struct {
+    Canvas* expected;
+    uint32_t next_row;
+    bool matches;
+} RenderTestBandSink;
+
+static Error* render_test_band_sink(
+    void* user_data,
+    uint32_t y,
+    const uint8_t* rgba,
+    uint32_t width
+) {
+    RenderTestBandSink* sink = user_data;
+    if (y != sink->next_row
+        || memcmp(rgba, canvas_raster_row(sink->expected, y), width * 4)
+               != 0) {
+        sink->matches = false;
+    }
+    sink->next_row = y + 1;
+
+    return NULL;
+}
+
+TEST_FUNC(test_render_page_banded_matches_direct) {
+    Arena* arena = arena_new(4096);
+
+    // Fractional, diagonal and curved edges, a shading and thin strokes
+    // ending between rows, so band seams cut through partially covered
+    // pixels and sampled rows
+    char content[8192];
+    int len = snprintf(
+        content,
+        sizeof(content),
+        "q 4.1 0 0 6.3 0.7 0.3 cm "
+        "0.2 0.4 0.8 rg 3.3 4.7 m 57.1 9.25 l 31.6 44.9 l h f "
+        "0.9 0.1 0.1 RG 3.5 w 5.2 41.3 m 20.7 2.1 40.4 60.3 55.9 12.6 c S "
+        "0 0.6 0.2 rg 12.25 18.5 33.5 11.125 re f "
+        "q 30.5 3.2 m 58.4 21.7 l 19.9 44.1 l h W n /S1 sh Q Q "
+        "0.2 0.2 0.8 RG 1 w "
+    );
+    for (int x = 50; x < 530; x += 8) {
+        len += snprintf(
+            content + len,
+            sizeof(content) - (size_t)len,
+            "%d 300 m %d 500 l %d 300 m %d 500 l ",
+            x,
+            x + 50,
+            x + 50,
+            x
+        );
+    }
+    snprintf(content + len, sizeof(content) - (size_t)len, "S");
+
+    char stream[9000];
+    snprintf(
+        stream,
+        sizeof(stream),
+        "<< /Length %zu >>\nstream\n%s\nendstream",
+        strlen(content),
+        content
+    );
+    const char* objects[] = {
+        "<< /Type /Catalog /Pages 2 0 R >>",
+        "<< /Type /Pages /Kids [3 0 R] /Count 1 >>",
+        "<< /Type /Page /Parent 2 0 R /MediaBox [0 0 595 842] "
+        "/Resources << /Shading << /S1 5 0 R >> >> /Contents 4 0 R >>",
+        stream,
+        "<< /ShadingType 3 "
+        "/ColorSpace [/CalRGB << /WhitePoint [0.9505 1 1.089] >>] "
+        "/Coords [33.3 21.1 2.7 37.9 26.4 19.3] /Extend [false true] "
+        "/Function << /FunctionType 2 /Domain [0 1] /C0 [1 0.8 0] "
+        "/C1 [0.1 0 0.6] /N 1.7 >> >>"
+    };
+
+    size_t doc_len;
+    char* doc = render_test_doc(arena, objects, 5, &doc_len);
+    PdfResolver* resolver;
+    TEST_REQUIRE(pdf_resolver_new(arena, (uint8_t*)doc, doc_len, &resolver));
+    PdfPage page;
+    TEST_REQUIRE(pdf_get_page(resolver, 0, &page));
+
+    RenderOptions options = render_options_default();
+    options.dpi = 150.0;
+    RenderDocumentCache* cache =
+        render_document_cache_new(RENDER_DEFAULT_GLYPH_CACHE_BUDGET);
+
+    Canvas* expected = NULL;
+    TEST_REQUIRE(render_page_with_options(
+        arena,
+        resolver,
+        cache,
+        &page,
+        RENDER_CANVAS_TYPE_RASTER,
+        &options,
+        &expected
+    ));
+
+    const uint32_t band_heights[] = {1, 5, 37};
+    for (size_t idx = 0; idx < 3; idx++) {
+        RenderTestBandSink sink = {
+            .expected = expected,
+            .next_row = 0,
+            .matches = true
+        };
+        TEST_REQUIRE(render_page_banded(
+            arena,
+            resolver,
+            cache,
+            &page,
+            &options,
+            band_heights[idx],
+            render_test_band_sink,
+            &sink
+        ));
+        TEST_ASSERT(sink.matches);
+        TEST_ASSERT_EQ(sink.next_row, (uint32_t)1755);
+    }
+
+    render_document_cache_free(cache);
+    arena_free(arena);
+    return TEST_RESULT_PASS;
+}
+
+TEST_FUNC(test_render_form_cached_between_pages) {
+    Arena* arena = arena_new(4096);
+
+    // Each page draws the form once, through its own resource dictionary
+    const char* objects[] = {
+        "<< /Type /Catalog /Pages 2 0 R >>",
+        "<< /Type /Pages /Kids [3 0 R 5 0 R] /Count 2 >>",
+        "<< /Type /Page /Parent 2 0 R /MediaBox [0 0 60 40] "
+        "/Resources << /XObject << /Head 7 0 R >> >> /Contents 4 0 R >>",
+        "<< /Length 28 >>\nstream\nq 1 0 0 1 5 20 cm /Head Do Q\nendstream",
+        "<< /Type /Page /Parent 2 0 R /MediaBox [0 0 60 40] "
+        "/Resources << /XObject << /Logo 7 0 R >> >> /Contents 6 0 R >>",
+        "<< /Length 28 >>\nstream\nq 1 0 0 1 15 5 cm /Logo Do Q\nendstream",
+        "<< /Type /XObject /Subtype /Form /BBox [0 0 40 15] /Length 34 >>"
+        "\nstream\n0.2 0.5 0.2 rg 1 2 38.5 11.25 re f\nendstream"
+    };
+
+    size_t doc_len;
+    char* doc = render_test_doc(arena, objects, 7, &doc_len);
+    PdfResolver* resolver;
+    TEST_REQUIRE(pdf_resolver_new(arena, (uint8_t*)doc, doc_len, &resolver));
+    RenderDocumentCache* cache =
+        render_document_cache_new(RENDER_DEFAULT_GLYPH_CACHE_BUDGET);
+
+    // Both pages draw it with the default graphics state
+    GraphicsState gstate = graphics_state_default();
+    PdfIndirectRef ref = {.object_id = 7, .generation = 0};
+    CanvasDisplayList* list = NULL;
+    for (size_t page_idx = 0; page_idx < 2; page_idx++) {
+        PdfPage page;
+        TEST_REQUIRE(pdf_get_page(resolver, page_idx, &page));
+
+        Canvas* canvas = NULL;
+        TEST_REQUIRE(render_page(
+            arena,
+            resolver,
+            cache,
+            &page,
+            RENDER_CANVAS_TYPE_RASTER,
+            &canvas
+        ));
+
+        RenderFormEntry* entry =
+            render_form_cache_entry(cache->cache.form_cache, ref, &gstate);
+        TEST_ASSERT_EQ(entry->draw_count, page_idx + 1);
+        TEST_ASSERT(entry->list);
+        if (page_idx == 0) {
+            list = entry->list;
+        }
+
+        // The second page replays what the first recorded
+        TEST_ASSERT(entry->list == list);
+        TEST_ASSERT_EQ(entry->raster_count, (size_t)0);
+    }
+
+    render_document_cache_free(cache);
+    arena_free(arena);
+    return TEST_RESULT_PASS;
+}
+
+#endif // TEST
@@ -0,0 +1,481 @@
+#include "resource_cache.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "arena/arena.h"
+#include "arena/common.h"
+#include "err/error.h"
+#include "logger/log.h"
+#include "pdf/fonts/font.h"
+#include "pdf/object.h"
+#include "pdf/resolver.h"
+#include "pdf/resources.h"
+#include "pdf/xobject.h"
+
+#define RENDER_RESOURCE_CACHE_NONE UINT32_MAX
+#define RENDER_RESOURCE_CACHE_INITIAL_BUCKETS 64
+
+typedef enum {
+    RENDER_RESOURCE_FONT,
+    RENDER_RESOURCE_GSTATE,
+    RENDER_RESOURCE_XOBJECT
+} RenderResourceKind;
+
+typedef struct {
+    RenderResourceKind kind;
+
+    /// The entries of the resource dictionary the name was looked up in,
+    /// which are shared by every copy of the dictionary.
+    const void* dict_entries;
+    const char* name;
+
+    bool has_ref;
+    PdfIndirectRef ref;
+
+    void* value;
+
+    /// The next entries in this entry's buckets of the name and reference
+    /// tables. Entries are only in the reference table if they have a
+    /// reference which no earlier entry of their kind has.
+    uint32_t next_named;
+    uint32_t next_ref;
+} RenderResourceEntry;
+
+#define DVEC_NAME RenderResourceEntryVec
+#define DVEC_LOWERCASE_NAME render_resource_entry_vec
+#define DVEC_TYPE RenderResourceEntry
+#include "arena/dvec_impl.h"
+
+/// Chained hash tables of entry indices, keyed by the kind, dictionary and
+/// name of each entry, and by the kind and reference of those with one. Both
+/// tables have the same number of buckets, which is doubled whenever there
+/// are as many entries.
+struct RenderResourceCache {
+    Arena* arena;
+    RenderResourceEntryVec* entries;
+    Uint32Array* named_buckets;
+    Uint32Array* ref_buckets;
+};
+
+static Uint32Array*
+render_resource_cache_new_buckets(Arena* arena, size_t len) {
+    Uint32Array* buckets = uint32_array_new(arena, len);
+    for (size_t idx = 0; idx < len; idx++) {
+        uint32_array_set(buckets, idx, RENDER_RESOURCE_CACHE_NONE);
+    }
+
+    return buckets;
+}
+
+RenderResourceCache* render_resource_cache_new(Arena* arena) {
+    RELEASE_ASSERT(arena);
+
+    RenderResourceCache* cache =
+        arena_alloc(arena, sizeof(RenderResourceCache));
+    cache->arena = arena;
+    cache->entries = render_resource_entry_vec_new(arena);
+    cache->named_buckets = render_resource_cache_new_buckets(
+        arena,
+        RENDER_RESOURCE_CACHE_INITIAL_BUCKETS
+    );
+    cache->ref_buckets = render_resource_cache_new_buckets(
+        arena,
+        RENDER_RESOURCE_CACHE_INITIAL_BUCKETS
+    );
+
+    return cache;
+}
+
+static uint64_t render_resource_hash_word(uint64_t hash, uint64_t word) {
+    hash = (hash ^ word) * 0x100000001b3ull;
+    return hash ^ (hash >> 29);
+}
+
+static uint64_t render_resource_named_hash(
+    RenderResourceKind kind,
+    const void* dict_entries,
+    const char* name
+) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    hash = render_resource_hash_word(hash, (uint64_t)kind);
+    hash = render_resource_hash_word(hash, (uint64_t)(uintptr_t)dict_entries);
+    for (const char* c = name; *c; c++) {
+        hash = render_resource_hash_word(hash, (uint64_t)(uint8_t)*c);
+    }
+
+    return hash;
+}
+
+static uint64_t
+render_resource_ref_hash(RenderResourceKind kind, PdfIndirectRef ref) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    hash = render_resource_hash_word(hash, (uint64_t)kind);
+    hash = render_resource_hash_word(hash, (uint64_t)ref.object_id);
+    return render_resource_hash_word(hash, (uint64_t)ref.generation);
+}
+
+static uint32_t*
+render_resource_cache_bucket(Uint32Array* buckets, uint64_t hash) {
+    size_t bucket_idx = (size_t)(hash & (uint32_array_len(buckets) - 1));
+
+    uint32_t* bucket = NULL;
+    RELEASE_ASSERT(uint32_array_get_ptr(buckets, bucket_idx, &bucket));
+    return bucket;
+}
+
+static RenderResourceEntry*
+render_resource_cache_entry(RenderResourceCache* cache, uint32_t entry_idx) {
+    RenderResourceEntry* entry = NULL;
+    RELEASE_ASSERT(
+        render_resource_entry_vec_get_ptr(cache->entries, entry_idx, &entry)
+    );
+    return entry;
+}
+
+static void* render_resource_cache_find_named(
+    RenderResourceCache* cache,
+    RenderResourceKind kind,
+    const PdfDict* dict,
+    const char* name
+) {
+    uint32_t entry_idx = *render_resource_cache_bucket(
+        cache->named_buckets,
+        render_resource_named_hash(kind, dict->entries, name)
+    );
+    while (entry_idx != RENDER_RESOURCE_CACHE_NONE) {
+        RenderResourceEntry* entry =
+            render_resource_cache_entry(cache, entry_idx);
+        if (entry->kind == kind && entry->dict_entries == dict->entries
+            && strcmp(entry->name, name) == 0) {
+            return entry->value;
+        }
+
+        entry_idx = entry->next_named;
+    }
+
+    return NULL;
+}
+
+static void* render_resource_cache_find_ref(
+    RenderResourceCache* cache,
+    RenderResourceKind kind,
+    PdfIndirectRef ref
+) {
+    uint32_t entry_idx = *render_resource_cache_bucket(
+        cache->ref_buckets,
+        render_resource_ref_hash(kind, ref)
+    );
+    while (entry_idx != RENDER_RESOURCE_CACHE_NONE) {
+        RenderResourceEntry* entry =
+            render_resource_cache_entry(cache, entry_idx);
+        if (entry->kind == kind && entry->ref.object_id == ref.object_id
+            && entry->ref.generation == ref.generation) {
+            return entry->value;
+        }
+
+        entry_idx = entry->next_ref;
+    }
+
+    return NULL;
+}
+
+/// Links the entry at `entry_idx` into the name table, and into the
+/// reference table if `link_ref` is set.
+static void render_resource_cache_link(
+    RenderResourceCache* cache,
+    uint32_t entry_idx,
+    bool link_ref
+) {
+    RenderResourceEntry* entry = render_resource_cache_entry(cache, entry_idx);
+
+    uint32_t* named_bucket = render_resource_cache_bucket(
+        cache->named_buckets,
+        render_resource_named_hash(
+            entry->kind,
+            entry->dict_entries,
+            entry->name
+        )
+    );
+    entry->next_named = *named_bucket;
+    *named_bucket = entry_idx;
+
+    entry->next_ref = RENDER_RESOURCE_CACHE_NONE;
+    if (link_ref) {
+        uint32_t* ref_bucket = render_resource_cache_bucket(
+            cache->ref_buckets,
+            render_resource_ref_hash(entry->kind, entry->ref)
+        );
+        entry->next_ref = *ref_bucket;
+        *ref_bucket = entry_idx;
+    }
+}
+
+static void render_resource_cache_grow(RenderResourceCache* cache) {
+    size_t bucket_count = uint32_array_len(cache->named_buckets) * 2;
+    cache->named_buckets =
+        render_resource_cache_new_buckets(cache->arena, bucket_count);
+    cache->ref_buckets =
+        render_resource_cache_new_buckets(cache->arena, bucket_count);
+
+    // Entries are relinked in insertion order, so the first entry with each
+    // reference is the one found by it
+    for (uint32_t entry_idx = 0;
+         entry_idx < render_resource_entry_vec_len(cache->entries);
+         entry_idx++) {
+        RenderResourceEntry* entry =
+            render_resource_cache_entry(cache, entry_idx);
+        bool link_ref =
+            entry->has_ref
+            && !render_resource_cache_find_ref(cache, entry->kind, entry->ref);
+        render_resource_cache_link(cache, entry_idx, link_ref);
+    }
+}
+
+/// Looks up a resource, returning its cached value or NULL. Unless the value
+/// was cached under this name, `object_out` is set to the dictionary entry it
+/// must be deserialized from or cached under.
+static Error* render_resource_cache_lookup(
+    RenderResourceCache* cache,
+    RenderResourceKind kind,
+    const PdfDict* dict,
+    const char* name,
+    PdfObject* object_out,
+    void** value_out,
+    bool* named_out
+) {
+    *value_out = render_resource_cache_find_named(cache, kind, dict, name);
+    *named_out = *value_out != NULL;
+    if (*named_out) {
+        return NULL;
+    }
+
+    TRY(pdf_object_dict_get(dict, name, object_out));
+
+    if (object_out->type == PDF_OBJECT_TYPE_INDIRECT_REF) {
+        *value_out = render_resource_cache_find_ref(
+            cache,
+            kind,
+            object_out->data.indirect_ref
+        );
+    }
+
+    return NULL;
+}
+
+static void render_resource_cache_insert(
+    RenderResourceCache* cache,
+    RenderResourceKind kind,
+    const PdfDict* dict,
+    const char* name,
+    const PdfObject* object,
+    void* value
+) {
+    size_t name_len = strlen(name);
+    char* name_copy = arena_alloc(cache->arena, name_len + 1);
+    memcpy(name_copy, name, name_len + 1);
+
+    // Names are cached even for references, so later lookups skip the
+    // dictionary search
+    RenderResourceEntry entry = {
+        .kind = kind,
+        .dict_entries = dict->entries,
+        .name = name_copy,
+        .has_ref = object->type == PDF_OBJECT_TYPE_INDIRECT_REF,
+        .value = value
+    };
+    bool link_ref = false;
+    if (entry.has_ref) {
+        entry.ref = object->data.indirect_ref;
+        link_ref = !render_resource_cache_find_ref(cache, kind, entry.ref);
+    }
+
+    if (render_resource_entry_vec_len(cache->entries)
+        >= uint32_array_len(cache->named_buckets)) {
+        render_resource_cache_grow(cache);
+    }
+
+    uint32_t entry_idx =
+        (uint32_t)render_resource_entry_vec_len(cache->entries);
+    render_resource_entry_vec_push(cache->entries, entry);
+    render_resource_cache_link(cache, entry_idx, link_ref);
+}
+
+static void render_font_init(RenderFont* font) {
+    font->glyph_font = font->font;
+    font->has_font_matrix = false;
+    font->to_unicode = NULL;
+    memset(font->has_code_width, 0, sizeof(font->has_code_width));
+
+    if (font->font.type == PDF_FONT_TYPE0) {
+        // Bound checked by the deserializer
+        PdfCIDFont cid_font;
+        RELEASE_ASSERT(pdf_cid_font_vec_get(
+            font->font.data.type0.descendant_fonts,
+            0,
+            &cid_font
+        ));
+
+        font->glyph_font = (PdfFont) {
+            .type =
+                (strcmp(cid_font.subtype, "CIDFontType0") == 0
+                     ? PDF_FONT_CIDTYPE0
+                     : PDF_FONT_CIDTYPE2),
+            .data.cid = cid_font
+        };
+    }
+}
+
+Error* render_resource_cache_get_font(
+    RenderResourceCache* cache,
+    PdfResolver* resolver,
+    const PdfDict* fonts,
+    const char* name,
+    RenderFont** font_out
+) {
+    RELEASE_ASSERT(cache);
+    RELEASE_ASSERT(resolver);
+    RELEASE_ASSERT(fonts);
+    RELEASE_ASSERT(name);
+    RELEASE_ASSERT(font_out);
+
+    PdfObject object;
+    void* value = NULL;
+    bool named = false;
+    TRY(render_resource_cache_lookup(
+        cache,
+        RENDER_RESOURCE_FONT,
+        fonts,
+        name,
+        &object,
+        &value,
+        &named
+    ));
+
+    if (!value) {
+        LOG_DIAG(DEBUG, RENDER, "Deserializing font resource `%s`", name);
+
+        RenderFont* font = arena_alloc(cache->arena, sizeof(RenderFont));
+        TRY(pdf_deserde_font(&object, &font->font, resolver));
+        render_font_init(font);
+        value = font;
+    }
+
+    if (!named) {
+        render_resource_cache_insert(
+            cache,
+            RENDER_RESOURCE_FONT,
+            fonts,
+            name,
+            &object,
+            value
+        );
+    }
+
+    *font_out = value;
+    return NULL;
+}
+
+Error* render_resource_cache_get_gstate(
+    RenderResourceCache* cache,
+    PdfResolver* resolver,
+    const PdfDict* ext_gstates,
+    const char* name,
+    const PdfGStateParams** params_out
+) {
+    RELEASE_ASSERT(cache);
+    RELEASE_ASSERT(resolver);
+    RELEASE_ASSERT(ext_gstates);
+    RELEASE_ASSERT(name);
+    RELEASE_ASSERT(params_out);
+
+    PdfObject object;
+    void* value = NULL;
+    bool named = false;
+    TRY(render_resource_cache_lookup(
+        cache,
+        RENDER_RESOURCE_GSTATE,
+        ext_gstates,
+        name,
+        &object,
+        &value,
+        &named
+    ));
+
+    if (!value) {
+        PdfGStateParams* params =
+            arena_alloc(cache->arena, sizeof(PdfGStateParams));
+        TRY(pdf_deserde_gstate_params(&object, params, resolver));
+        value = params;
+    }
+
+    if (!named) {
+        render_resource_cache_insert(
+            cache,
+            RENDER_RESOURCE_GSTATE,
+            ext_gstates,
+            name,
+            &object,
+            value
+        );
+    }
+
+    *params_out = value;
+    return NULL;
+}
+
+Error* render_resource_cache_get_xobject(
+    RenderResourceCache* cache,
+    PdfResolver* resolver,
+    const PdfDict* xobjects,
+    const char* name,
+    RenderXObject** xobject_out
+) {
+    RELEASE_ASSERT(cache);
+    RELEASE_ASSERT(resolver);
+    RELEASE_ASSERT(xobjects);
+    RELEASE_ASSERT(name);
+    RELEASE_ASSERT(xobject_out);
+
+    PdfObject object;
+    void* value = NULL;
+    bool named = false;
+    TRY(render_resource_cache_lookup(
+        cache,
+        RENDER_RESOURCE_XOBJECT,
+        xobjects,
+        name,
+        &object,
+        &value,
+        &named
+    ));
+
+    if (!value) {
+        LOG_DIAG(DEBUG, RENDER, "Deserializing XObject resource `%s`", name);
+
+        RenderXObject* xobject =
+            arena_alloc(cache->arena, sizeof(RenderXObject));
+        xobject->has_ref = object.type == PDF_OBJECT_TYPE_INDIRECT_REF;
+        if (xobject->has_ref) {
+            xobject->ref = object.data.indirect_ref;
+        }
+        TRY(pdf_deserde_xobject(&object, &xobject->xobject, resolver));
+        value = xobject;
+    }
+
+    if (!named) {
+        render_resource_cache_insert(
+            cache,
+            RENDER_RESOURCE_XOBJECT,
+            xobjects,
+            name,
+            &object,
+            value
+        );
+    }
+
+    *xobject_out = value;
+    return NULL;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "arena/arena.h"
+#include "err/error.h"
+#include "geom/mat3.h"
+#include "pdf/fonts/cmap.h"
+#include "pdf/fonts/font.h"
+#include "pdf/object.h"
+#include "pdf/resolver.h"
+#include "pdf/resources.h"
+#include "pdf/xobject.h"
+
+/// A font from a resource dictionary, along with data derived from it which
+/// every glyph would otherwise recompute.
+typedef struct {
+    PdfFont font;
+
+    /// The descendant CIDFont of a Type0 font, or a copy of `font` otherwise.
+    /// Font descriptors resolved through it stay resolved.
+    PdfFont glyph_font;
+
+    bool has_font_matrix;
+    GeomMat3 font_matrix;
+
+    /// The parsed ToUnicode CMap of a simple font, or NULL until first used.
+    PdfCMap* to_unicode;
+
+    /// Widths of single-byte codes, filled in as they are first used.
+    PdfNumber code_widths[256];
+    bool has_code_width[256];
+} RenderFont;
+
+/// An external object from a resource dictionary, along with the reference it
+/// was resolved from, which identifies it across pages.
+typedef struct {
+    PdfXObject xobject;
+
+    bool has_ref;
+    PdfIndirectRef ref;
+} RenderXObject;
+
+/// Memo of deserialized resources, keyed by the resource dictionary and name
+/// they were looked up with. Resources which are indirect objects are also
+/// keyed by their reference, so they are shared between resource dictionaries.
+typedef struct RenderResourceCache RenderResourceCache;
+
+RenderResourceCache* render_resource_cache_new(Arena* arena);
+
+/// Looks up the font named `name` in a /Font resource dictionary.
+Error* render_resource_cache_get_font(
+    RenderResourceCache* cache,
+    PdfResolver* resolver,
+    const PdfDict* fonts,
+    const char* name,
+    RenderFont** font_out
+);
+
+/// Looks up the graphics state parameters named `name` in an /ExtGState
+/// resource dictionary.
+Error* render_resource_cache_get_gstate(
+    RenderResourceCache* cache,
+    PdfResolver* resolver,
+    const PdfDict* ext_gstates,
+    const char* name,
+    const PdfGStateParams** params_out
+);
+
+/// Looks up the external object named `name` in an /XObject resource
+/// dictionary.
+Error* render_resource_cache_get_xobject(
+    RenderResourceCache* cache,
+    PdfResolver* resolver,
+    const PdfDict* xobjects,
+    const char* name,
+    RenderXObject** xobject_out
+);
@@ -1,10 +1,14 @@
 #include "shading.h"
 
 #include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 
 #include "arena/arena.h"
 #include "canvas/canvas.h"
+#include "canvas/path_builder.h"
 #include "color/rgb.h"
 #include "err/error.h"
 #include "geom/mat3.h"
@@ -27,245 +31,92 @@ static double clamp01(double value) {
     return value;
 }
 
+/// The most color components a shading's functions may return. DeviceN color
+/// spaces have at most 32 colorants.
+#define SHADING_MAX_COMPONENTS 32
+
+/// Evaluates a shading's function, or its array of 1-output functions, storing
+/// the color components in `outputs`.
 static Error* eval_shading_function(
     PdfFunctionVec* functions,
-    PdfReal input,
-    Arena* arena,
-    PdfObjectVec* io,
-    PdfObjectVec* scratch_outputs
+    const double* inputs,
+    size_t input_count,
+    double outputs[SHADING_MAX_COMPONENTS],
+    size_t* output_count_out
 ) {
     RELEASE_ASSERT(functions);
-    RELEASE_ASSERT(arena);
-    RELEASE_ASSERT(io);
-    RELEASE_ASSERT(scratch_outputs);
+    RELEASE_ASSERT(inputs);
+    RELEASE_ASSERT(outputs);
+    RELEASE_ASSERT(output_count_out);
 
     size_t function_count = pdf_function_vec_len(functions);
-    if (function_count == 0) {
+    if (function_count == 0 || function_count > SHADING_MAX_COMPONENTS) {
         return ERROR(PDF_ERR_INCORRECT_TYPE);
     }
 
-    if (function_count == 1) {
-        PdfFunction function;
-        RELEASE_ASSERT(pdf_function_vec_get(functions, 0, &function));
-
-        pdf_object_vec_clear(io);
-        pdf_object_vec_push(
-            io,
-            (PdfObject) {.type = PDF_OBJECT_TYPE_REAL, .data.real = input}
-        );
-        TRY(pdf_run_function(&function, arena, io));
-
-        if (pdf_object_vec_len(io) == 0) {
-            return ERROR(PDF_ERR_INCORRECT_TYPE);
-        }
-        return NULL;
-    }
-
-    pdf_object_vec_clear(scratch_outputs);
-
     for (size_t idx = 0; idx < function_count; idx++) {
-        PdfFunction function;
-        RELEASE_ASSERT(pdf_function_vec_get(functions, idx, &function));
+        PdfFunction* function;
+        RELEASE_ASSERT(pdf_function_vec_get_ptr(functions, idx, &function));
 
-        pdf_object_vec_clear(io);
-        pdf_object_vec_push(
-            io,
-            (PdfObject) {.type = PDF_OBJECT_TYPE_REAL, .data.real = input}
-        );
-        TRY(pdf_run_function(&function, arena, io));
-
-        if (pdf_object_vec_len(io) != 1) {
+        if (function->input_count != input_count) {
+            return ERROR(PDF_ERR_EXCESS_OPERAND);
+        }
+        if (function_count == 1
+                ? function->output_count > SHADING_MAX_COMPONENTS
+                : function->output_count != 1) {
             return ERROR(PDF_ERR_INCORRECT_TYPE);
         }
 
-        PdfObject output;
-        RELEASE_ASSERT(pdf_object_vec_get(io, 0, &output));
-        pdf_object_vec_push(scratch_outputs, output);
-    }
-
-    pdf_object_vec_clear(io);
-    for (size_t idx = 0; idx < function_count; idx++) {
-        PdfObject output;
-        RELEASE_ASSERT(pdf_object_vec_get(scratch_outputs, idx, &output));
-        pdf_object_vec_push(io, output);
+        TRY(pdf_eval_function(function, inputs, &outputs[idx]));
+        *output_count_out =
+            function_count == 1 ? function->output_count : function_count;
     }
 
     return NULL;
 }
 
-static bool solve_radial_t(
-    GeomVec2 point,
-    GeomVec2 c0,
-    PdfReal r0,
-    GeomVec2 c1,
-    PdfReal r1,
-    const PdfBoolean extend[2],
-    PdfReal* out_t
-) {
-    RELEASE_ASSERT(out_t);
-
-    const double eps = 1e-9;
-
-    double dc_x = c1.x - c0.x;
-    double dc_y = c1.y - c0.y;
-    double dr = r1 - r0;
-    double c0p_x = c0.x - point.x;
-    double c0p_y = c0.y - point.y;
-
-    double a = dc_x * dc_x + dc_y * dc_y - dr * dr;
-    double b = 2.0 * (c0p_x * dc_x + c0p_y * dc_y - r0 * dr);
-    double c = c0p_x * c0p_x + c0p_y * c0p_y - r0 * r0;
-
-    PdfReal roots[2];
-    size_t n_roots = 0;
-
-    if (fabs(a) < eps) {
-        if (fabs(b) < eps) {
-            return false;
-        }
-        roots[0] = -c / b;
-        n_roots = 1;
-    } else {
-        double disc = b * b - 4.0 * a * c;
-        if (disc < -eps) {
-            return false;
-        }
-
-        if (disc < 0.0) {
-            disc = 0.0;
-        }
-
-        double sqrt_disc = sqrt(disc);
-        double inv_den = 1.0 / (2.0 * a);
-        roots[0] = (-b - sqrt_disc) * inv_den;
-        roots[1] = (-b + sqrt_disc) * inv_den;
-        n_roots = 2;
-    }
-
-    bool has_inside = false;
-    PdfReal inside_t = 0.0;
-    for (size_t idx = 0; idx < n_roots; idx++) {
-        PdfReal t = roots[idx];
-        if (t >= -eps && t <= 1.0 + eps) {
-            PdfReal clamped_t = fmin(1.0, fmax(0.0, t));
-            if (!has_inside || clamped_t > inside_t) {
-                has_inside = true;
-                inside_t = clamped_t;
-            }
-        }
-    }
-
-    if (has_inside) {
-        *out_t = inside_t;
-        return true;
-    }
-
-    // No boundary crossing inside [0, 1]. If the point is in the end circle,
-    // it is inside every circle over the blend interval, so the latest paint
-    // sample is t=1.
-    double end_value = a + b + c;
-    if (end_value <= eps) {
-        *out_t = 1.0;
-        return true;
-    }
-
-    bool has_extended = false;
-    PdfReal extended_t = 0.0;
-    double extended_dist = 0.0;
-    for (size_t idx = 0; idx < n_roots; idx++) {
-        PdfReal t = roots[idx];
-        bool eligible = false;
-        double dist = 0.0;
-
-        if (t < 0.0 && extend[0]) {
-            eligible = true;
-            dist = -t;
-        } else if (t > 1.0 && extend[1]) {
-            eligible = true;
-            dist = t - 1.0;
-        }
-
-        if (!eligible) {
-            continue;
-        }
-
-        if (!has_extended || dist < extended_dist) {
-            has_extended = true;
-            extended_t = t;
-            extended_dist = dist;
-        }
-    }
-
-    if (has_extended) {
-        *out_t = extended_t;
-        return true;
-    }
-
-    return false;
-}
-
-static Error* shading_component_or_default(
-    const PdfObjectVec* components,
-    size_t idx,
-    PdfReal default_value,
-    PdfReal* out
+/// Gets a color component, or 0 if the function returned fewer components.
+static double shading_component(
+    const double* components,
+    size_t n_components,
+    size_t idx
 ) {
-    RELEASE_ASSERT(components);
-    RELEASE_ASSERT(out);
-
-    if (idx >= pdf_object_vec_len(components)) {
-        *out = default_value;
-        return NULL;
+    if (idx >= n_components) {
+        return 0.0;
     }
-
-    PdfObject component;
-    RELEASE_ASSERT(pdf_object_vec_get(components, idx, &component));
-
-    PdfNumber number;
-    TRY(pdf_deserde_number(&component, &number, NULL));
-    *out = pdf_number_as_real(number);
-    return NULL;
+    return components[idx];
 }
 
-static Error* shading_components_to_rgb(
+static void shading_components_to_rgb(
     const PdfShadingDict* shading_dict,
-    const PdfObjectVec* components,
+    const double* components,
+    size_t n_components,
     GeomVec3* out_rgb
 ) {
     RELEASE_ASSERT(shading_dict);
     RELEASE_ASSERT(components);
     RELEASE_ASSERT(out_rgb);
 
-    size_t n_components = pdf_object_vec_len(components);
-
     switch (shading_dict->color_space.family) {
         case PDF_COLOR_SPACE_DEVICE_GRAY: {
-            PdfReal gray = 0.0;
-            TRY(shading_component_or_default(components, 0, 0.0, &gray));
-            gray = clamp01(gray);
+            PdfReal gray =
+                clamp01(shading_component(components, n_components, 0));
             *out_rgb = geom_vec3_new(gray, gray, gray);
-            return NULL;
+            return;
         }
         case PDF_COLOR_SPACE_DEVICE_RGB:
         case PDF_COLOR_SPACE_CAL_RGB: {
-            PdfReal r = 0.0;
-            PdfReal g = 0.0;
-            PdfReal b = 0.0;
-            TRY(shading_component_or_default(components, 0, 0.0, &r));
-            TRY(shading_component_or_default(components, 1, 0.0, &g));
-            TRY(shading_component_or_default(components, 2, 0.0, &b));
+            PdfReal r = shading_component(components, n_components, 0);
+            PdfReal g = shading_component(components, n_components, 1);
+            PdfReal b = shading_component(components, n_components, 2);
             *out_rgb = geom_vec3_new(clamp01(r), clamp01(g), clamp01(b));
-            return NULL;
+            return;
         }
         case PDF_COLOR_SPACE_DEVICE_CMYK: {
-            PdfReal c = 0.0;
-            PdfReal m = 0.0;
-            PdfReal y = 0.0;
-            PdfReal k = 0.0;
-            TRY(shading_component_or_default(components, 0, 0.0, &c));
-            TRY(shading_component_or_default(components, 1, 0.0, &m));
-            TRY(shading_component_or_default(components, 2, 0.0, &y));
-            TRY(shading_component_or_default(components, 3, 0.0, &k));
+            PdfReal c = shading_component(components, n_components, 0);
+            PdfReal m = shading_component(components, n_components, 1);
+            PdfReal y = shading_component(components, n_components, 2);
+            PdfReal k = shading_component(components, n_components, 3);
             c = clamp01(c);
             m = clamp01(m);
             y = clamp01(y);
@@ -275,12 +126,11 @@ static Error* shading_components_to_rgb(
                 (1.0 - m) * (1.0 - k),
                 (1.0 - y) * (1.0 - k)
             );
-            return NULL;
+            return;
         }
         case PDF_COLOR_SPACE_DEVICE_N: {
-            PdfReal tint = 0.0;
-            TRY(shading_component_or_default(components, 0, 0.0, &tint));
-            tint = clamp01(tint);
+            PdfReal tint =
+                clamp01(shading_component(components, n_components, 0));
 
             PdfReal c = 0.0;
             PdfReal m = 0.0;
@@ -304,7 +154,7 @@ static Error* shading_components_to_rgb(
             } else {
                 PdfReal gray = 1.0 - tint;
                 *out_rgb = geom_vec3_new(gray, gray, gray);
-                return NULL;
+                return;
             }
 
             *out_rgb = geom_vec3_new(
@@ -312,193 +162,2027 @@ static Error* shading_components_to_rgb(
                 (1.0 - m) * (1.0 - k),
                 (1.0 - y) * (1.0 - k)
             );
-            return NULL;
+            return;
         }
         default: {
             if (n_components >= 3) {
-                PdfReal r = 0.0;
-                PdfReal g = 0.0;
-                PdfReal b = 0.0;
-                TRY(shading_component_or_default(components, 0, 0.0, &r));
-                TRY(shading_component_or_default(components, 1, 0.0, &g));
-                TRY(shading_component_or_default(components, 2, 0.0, &b));
+                PdfReal r = shading_component(components, n_components, 0);
+                PdfReal g = shading_component(components, n_components, 1);
+                PdfReal b = shading_component(components, n_components, 2);
                 *out_rgb = geom_vec3_new(clamp01(r), clamp01(g), clamp01(b));
-                return NULL;
+                return;
             }
             if (n_components >= 1) {
-                PdfReal gray = 0.0;
-                TRY(shading_component_or_default(components, 0, 0.0, &gray));
-                gray = clamp01(gray);
+                PdfReal gray =
+                    clamp01(shading_component(components, n_components, 0));
                 *out_rgb = geom_vec3_new(gray, gray, gray);
-                return NULL;
+                return;
             }
             *out_rgb = geom_vec3_new(0.0, 0.0, 0.0);
-            return NULL;
+            return;
         }
     }
 }
 
-void render_shading(
-    PdfShadingDict* shading_dict,
-    Arena* arena,
-    GeomMat3 ctm,
-    Canvas* canvas
+/// The parametric variable of samples a shading doesn't paint.
+#define SHADING_UNPAINTED ((double)NAN)
+
+/// Computes the parametric variable of a row of `count` samples, starting at
+/// `start` and `step` apart in shading space. Samples the shading doesn't
+/// paint are set to `SHADING_UNPAINTED`.
+typedef void (*ShadingRowFn)(
+    const void* geometry,
+    GeomVec2 start,
+    GeomVec2 step,
+    size_t count,
+    double* t_out
+);
+
+typedef struct {
+    GeomVec2 start;
+    GeomVec2 axis;
+    double inv_axis_len_sq;
+    PdfBoolean extend[2];
+} ShadingAxial;
+
+/// Maps an unclamped parametric variable onto [0, 1], or
+/// `SHADING_UNPAINTED` if the shading isn't extended that way.
+static double shading_extend_t(double t, const PdfBoolean extend[2]) {
+    if (t < 0.0) {
+        return extend[0] ? 0.0 : SHADING_UNPAINTED;
+    }
+    if (t > 1.0) {
+        return extend[1] ? 1.0 : SHADING_UNPAINTED;
+    }
+    return t;
+}
+
+static void shading_axial_row(
+    const void* geometry,
+    GeomVec2 start,
+    GeomVec2 step,
+    size_t count,
+    double* t_out
 ) {
-    RELEASE_ASSERT(shading_dict);
-    RELEASE_ASSERT(arena);
-    RELEASE_ASSERT(canvas);
+    const ShadingAxial* axial = geometry;
 
-    switch (shading_dict->shading_type) {
-        case 2: {
-            break;
+    // t is the projection onto the axis, so it changes by a constant amount
+    // from one sample to the next
+    double t = geom_vec2_dot(geom_vec2_sub(start, axial->start), axial->axis)
+             * axial->inv_axis_len_sq;
+    double t_step =
+        geom_vec2_dot(step, axial->axis) * axial->inv_axis_len_sq;
+
+    for (size_t idx = 0; idx < count; idx++) {
+        t_out[idx] = shading_extend_t(t, axial->extend);
+        t += t_step;
+    }
+}
+
+typedef struct {
+    GeomVec2 start_center;
+    double start_radius;
+    GeomVec2 center_delta;
+    double radius_delta;
+    PdfBoolean extend[2];
+} ShadingRadial;
+
+/// Finds the parametric variable of the latest circle passing through a
+/// point, given the coefficients of `a * t^2 + b * t + c = 0`, which holds
+/// where the point lies on the circle at t. Returns `SHADING_UNPAINTED` if
+/// no circle does.
+static double shading_radial_t(
+    const ShadingRadial* radial,
+    double a,
+    double b,
+    double c
+) {
+    const double eps = 1e-9;
+
+    double roots[2];
+    size_t n_roots = 0;
+    if (fabs(a) < eps) {
+        if (fabs(b) < eps) {
+            return SHADING_UNPAINTED;
+        }
+        roots[0] = -c / b;
+        n_roots = 1;
+    } else {
+        double disc = b * b - 4.0 * a * c;
+        if (disc < -eps) {
+            return SHADING_UNPAINTED;
         }
-        case 3: {
-            PdfShadingDictType3 radial = shading_dict->data.type3;
 
-            GeomVec2 p0 = geom_vec2_new(
-                pdf_number_as_real(radial.coords[0]),
-                pdf_number_as_real(radial.coords[1])
-            );
-            PdfReal r0 = pdf_number_as_real(radial.coords[2]);
-            GeomRect b0 = geom_rect_new_centered(p0, geom_vec2_new(r0, r0));
+        double sqrt_disc = sqrt(fmax(disc, 0.0));
+        double inv_den = 1.0 / (2.0 * a);
+        roots[0] = (-b - sqrt_disc) * inv_den;
+        roots[1] = (-b + sqrt_disc) * inv_den;
+        n_roots = 2;
+    }
 
-            GeomVec2 p1 = geom_vec2_new(
-                pdf_number_as_real(radial.coords[3]),
-                pdf_number_as_real(radial.coords[4])
-            );
-            PdfReal r1 = pdf_number_as_real(radial.coords[5]);
-            GeomRect b1 = geom_rect_new_centered(p1, geom_vec2_new(r1, r1));
-
-            GeomRect bbox = geom_rect_union(b0, b1);
-            if ((radial.extend[0] || radial.extend[1])
-                && shading_dict->bbox.is_some) {
-                bbox = pdf_rectangle_to_geom(shading_dict->bbox.value);
-            } else if (shading_dict->bbox.is_some) {
-                bbox = geom_rect_intersection(
-                    bbox,
-                    pdf_rectangle_to_geom(shading_dict->bbox.value)
-                );
-            }
+    // Later circles are painted over earlier ones, and circles with a
+    // negative radius aren't painted at all
+    double latest_t = SHADING_UNPAINTED;
+    for (size_t idx = 0; idx < n_roots; idx++) {
+        double t = roots[idx];
+        if (t >= -eps && t <= 1.0 + eps) {
+            t = fmin(1.0, fmax(0.0, t));
+        }
 
-            bbox = geom_rect_transform(bbox, ctm);
-            if (canvas_is_raster(canvas)) {
-                bbox = geom_rect_round(bbox);
-            }
+        double clamped_t = shading_extend_t(t, radial->extend);
+        if (isnan(clamped_t)
+            || radial->start_radius + t * radial->radius_delta < 0.0) {
+            continue;
+        }
 
-            if (!geom_rect_positive(bbox)) {
-                break;
-            }
+        if (isnan(latest_t) || t > latest_t) {
+            latest_t = t;
+        }
+    }
 
-            GeomMat3 inv_ctm = geom_mat3_inverse(ctm);
-            PdfReal domain_min = pdf_number_as_real(radial.domain[0]);
-            PdfReal domain_max = pdf_number_as_real(radial.domain[1]);
-            Arena* local_arena = arena_new(1024);
-            PdfObjectVec* function_io = pdf_object_vec_new(local_arena);
-            PdfObjectVec* function_outputs = pdf_object_vec_new(local_arena);
-            Error* render_error = NULL;
-            bool abort_render = false;
-
-            double step = canvas_raster_res(canvas);
-            size_t n_x = (size_t)ceil((bbox.max.x - bbox.min.x) / step);
-            size_t n_y = (size_t)ceil((bbox.max.y - bbox.min.y) / step);
-
-            for (size_t idx_x = 0; idx_x < n_x; idx_x++) {
-                double canvas_x = bbox.min.x + (double)idx_x * step;
-                if (!(canvas_x < bbox.max.x)) {
-                    break;
-                }
+    if (!isnan(latest_t)) {
+        return shading_extend_t(latest_t, radial->extend);
+    }
 
-                for (size_t idx_y = 0; idx_y < n_y; idx_y++) {
-                    double canvas_y = bbox.min.y + (double)idx_y * step;
-                    if (!(canvas_y < bbox.max.y)) {
-                        break;
-                    }
+    // Without a boundary crossing, a point inside the end circle is inside
+    // every circle, so the latest one painted is at t=1
+    if (a + b + c <= eps) {
+        return 1.0;
+    }
 
-                    GeomVec2 canvas_point = geom_vec2_new(canvas_x, canvas_y);
-                    GeomVec2 shading_point =
-                        geom_vec2_transform(canvas_point, inv_ctm);
-
-                    PdfReal t_geom = 0.0;
-                    if (!solve_radial_t(
-                            shading_point,
-                            p0,
-                            r0,
-                            p1,
-                            r1,
-                            radial.extend,
-                            &t_geom
-                        )) {
-                        continue;
-                    }
+    return SHADING_UNPAINTED;
+}
 
-                    PdfReal t_input =
-                        domain_min + t_geom * (domain_max - domain_min);
+static void shading_radial_row(
+    const void* geometry,
+    GeomVec2 start,
+    GeomVec2 step,
+    size_t count,
+    double* t_out
+) {
+    const ShadingRadial* radial = geometry;
 
-                    Error* function_error = eval_shading_function(
-                        radial.function,
-                        t_input,
-                        local_arena,
-                        function_io,
-                        function_outputs
-                    );
-                    if (function_error) {
-                        render_error = function_error;
-                        abort_render = true;
-                        break;
-                    }
+    GeomVec2 dc = radial->center_delta;
+    double dr = radial->radius_delta;
+    double r0 = radial->start_radius;
+    GeomVec2 offset = geom_vec2_sub(radial->start_center, start);
 
-                    size_t n_components = pdf_object_vec_len(function_io);
-                    if (n_components == 0) {
-                        render_error = ERROR(
-                            PDF_ERR_INCORRECT_TYPE,
-                            "Shading function returned zero output components"
-                        );
-                        abort_render = true;
-                        break;
-                    }
+    // Along the row, b is linear and c quadratic in the sample index, so
+    // they're stepped with forward differences
+    double a = geom_vec2_len_sq(dc) - dr * dr;
+    double b = 2.0 * (geom_vec2_dot(offset, dc) - r0 * dr);
+    double b_step = -2.0 * geom_vec2_dot(step, dc);
+    double c = geom_vec2_len_sq(offset) - r0 * r0;
+    double c_step =
+        -2.0 * geom_vec2_dot(offset, step) + geom_vec2_len_sq(step);
+    double c_step_step = 2.0 * geom_vec2_len_sq(step);
 
-                    GeomVec3 rgb;
-                    Error* color_error = shading_components_to_rgb(
-                        shading_dict,
-                        function_io,
-                        &rgb
-                    );
-                    if (color_error) {
-                        render_error = color_error;
-                        abort_render = true;
-                        break;
-                    }
+    for (size_t idx = 0; idx < count; idx++) {
+        t_out[idx] = shading_radial_t(radial, a, b, c);
+        b += b_step;
+        c += c_step;
+        c_step += c_step_step;
+    }
+}
 
-                    canvas_draw_pixel(
-                        canvas,
-                        canvas_point,
-                        rgba_new(
-                            clamp01(rgb.x),
-                            clamp01(rgb.y),
-                            clamp01(rgb.z),
-                            1.0
-                        )
-                    );
-                }
+static uint8_t shading_quantize(double value) {
+    return (uint8_t)round(clamp01(value) * 255.0);
+}
 
-                if (abort_render) {
-                    break;
-                }
-            }
-            arena_free(local_arena);
-            if (render_error != NULL) {
-                error_print(render_error);
-                error_free(render_error);
-                return;
-            }
+/// The number of intervals a shading's color table starts with, and the most
+/// it's refined to.
+#define SHADING_LUT_MIN_INTERVALS 256
+#define SHADING_LUT_MAX_INTERVALS 4096
+
+/// How far a color may stray from the interpolation of its neighbouring table
+/// entries, which is half a step of an 8-bit channel.
+#define SHADING_LUT_TOLERANCE (0.5 / 255.0)
+
+/// The colors of a shading at evenly spaced values of its parametric variable
+/// over [0, 1], interpolated linearly in between.
+typedef struct {
+    size_t intervals;
+
+    /// `intervals + 1` colors, the last at t=1.
+    GeomVec3* colors;
+} ShadingLut;
+
+static Error* shading_eval_color(
+    const PdfShadingDict* shading_dict,
+    PdfFunctionVec* functions,
+    const PdfNumber domain[2],
+    double t,
+    GeomVec3* rgb_out
+) {
+    PdfReal domain_min = pdf_number_as_real(domain[0]);
+    PdfReal domain_max = pdf_number_as_real(domain[1]);
+
+    PdfReal input = domain_min + t * (domain_max - domain_min);
+    double components[SHADING_MAX_COMPONENTS];
+    size_t n_components;
+    TRY(eval_shading_function(functions, &input, 1, components, &n_components)
+    );
+
+    GeomVec3 rgb;
+    shading_components_to_rgb(shading_dict, components, n_components, &rgb);
+    *rgb_out =
+        geom_vec3_new(clamp01(rgb.x), clamp01(rgb.y), clamp01(rgb.z));
+    return NULL;
+}
+
+static bool shading_lut_is_close(GeomVec3 color, GeomVec3 a, GeomVec3 b) {
+    return fabs(color.x - (a.x + b.x) * 0.5) <= SHADING_LUT_TOLERANCE
+        && fabs(color.y - (a.y + b.y) * 0.5) <= SHADING_LUT_TOLERANCE
+        && fabs(color.z - (a.z + b.z) * 0.5) <= SHADING_LUT_TOLERANCE;
+}
+
+/// Samples a shading's function and color conversion into a table. Each
+/// refinement evaluates the midpoint of every interval, and halves the
+/// intervals unless every midpoint is already within tolerance of its
+/// interpolation. Discontinuities stop refining at the largest table.
+static Error* shading_lut_new(
+    Arena* arena,
+    const PdfShadingDict* shading_dict,
+    PdfFunctionVec* functions,
+    const PdfNumber domain[2],
+    ShadingLut* lut_out
+) {
+    size_t intervals = SHADING_LUT_MIN_INTERVALS;
+    GeomVec3* colors = arena_alloc(arena, (intervals + 1) * sizeof(GeomVec3));
+    for (size_t idx = 0; idx <= intervals; idx++) {
+        TRY(shading_eval_color(
+            shading_dict,
+            functions,
+            domain,
+            (double)idx / (double)intervals,
+            &colors[idx]
+        ));
+    }
 
+    while (intervals < SHADING_LUT_MAX_INTERVALS) {
+        GeomVec3* refined =
+            arena_alloc(arena, (intervals * 2 + 1) * sizeof(GeomVec3));
+        bool is_close = true;
+
+        for (size_t idx = 0; idx < intervals; idx++) {
+            refined[idx * 2] = colors[idx];
+            TRY(shading_eval_color(
+                shading_dict,
+                functions,
+                domain,
+                ((double)idx + 0.5) / (double)intervals,
+                &refined[idx * 2 + 1]
+            ));
+
+            is_close = is_close
+                    && shading_lut_is_close(
+                           refined[idx * 2 + 1],
+                           colors[idx],
+                           colors[idx + 1]
+                    );
+        }
+        if (is_close) {
             break;
         }
-        case 7: {
+
+        refined[intervals * 2] = colors[intervals];
+        colors = refined;
+        intervals *= 2;
+    }
+
+    *lut_out = (ShadingLut) {.intervals = intervals, .colors = colors};
+    return NULL;
+}
+
+/// Writes the opaque premultiplied RGBA8 color at `t` in [0, 1].
+static void shading_lut_sample(const ShadingLut* lut, double t, uint8_t* out) {
+    double position = t * (double)lut->intervals;
+    size_t idx = (size_t)position;
+    if (idx >= lut->intervals) {
+        idx = lut->intervals - 1;
+    }
+
+    double frac = position - (double)idx;
+    GeomVec3 a = lut->colors[idx];
+    GeomVec3 b = lut->colors[idx + 1];
+    out[0] = shading_quantize(a.x + (b.x - a.x) * frac);
+    out[1] = shading_quantize(a.y + (b.y - a.y) * frac);
+    out[2] = shading_quantize(a.z + (b.z - a.z) * frac);
+    out[3] = 255;
+}
+
+/// Checks whether every table entry strictly between `first` and `last` is
+/// within tolerance of the interpolation between them.
+static bool
+shading_lut_is_linear(const ShadingLut* lut, size_t first, size_t last) {
+    GeomVec3 a = lut->colors[first];
+    GeomVec3 b = lut->colors[last];
+    double span = (double)(last - first);
+
+    for (size_t idx = first + 1; idx < last; idx++) {
+        GeomVec3 expected = geom_vec3_add(
+            a,
+            geom_vec3_mul(
+                geom_vec3_sub(b, a),
+                geom_vec3_scalar((double)(idx - first) / span)
+            )
+        );
+        GeomVec3 color = lut->colors[idx];
+        if (fabs(color.x - expected.x) > SHADING_LUT_TOLERANCE
+            || fabs(color.y - expected.y) > SHADING_LUT_TOLERANCE
+            || fabs(color.z - expected.z) > SHADING_LUT_TOLERANCE) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/// Converts a color table into gradient stops, greedily merging runs of
+/// entries which a single linear interpolation reproduces within tolerance.
+static CanvasGradientStop* shading_lut_stops(
+    Arena* arena,
+    const ShadingLut* lut,
+    size_t* stop_count_out
+) {
+    CanvasGradientStop* stops =
+        arena_alloc(arena, (lut->intervals + 1) * sizeof(CanvasGradientStop));
+    size_t stop_count = 0;
+
+    size_t first = 0;
+    while (true) {
+        GeomVec3 color = lut->colors[first];
+        stops[stop_count++] = (CanvasGradientStop) {
+            .offset = (double)first / (double)lut->intervals,
+            .rgba = rgba_new(color.x, color.y, color.z, 1.0)
+        };
+        if (first == lut->intervals) {
             break;
         }
-        default: {
-            LOG_TODO("Render shading type %d", shading_dict->shading_type);
+
+        size_t last = first + 1;
+        while (last < lut->intervals
+               && shading_lut_is_linear(lut, first, last + 1)) {
+            last++;
         }
+        first = last;
+    }
+
+    *stop_count_out = stop_count;
+    return stops;
+}
+
+/// Where a shading's pixels are drawn. Raster canvases are drawn onto
+/// directly, while vector canvases get an image covering the shading's pixels
+/// which is drawn onto them once the shading is done.
+typedef struct {
+    Canvas* canvas;
+    Canvas* image;
+    double res;
+
+    /// The device pixels drawn, from `min` up to but excluding `max`.
+    int32_t min_x;
+    int32_t min_y;
+    int32_t max_x;
+    int32_t max_y;
+} ShadingSurface;
+
+/// Finds the area of device space a shading may paint: the canvas's drawable
+/// bounds, limited by the shading's bounding box. Returns false if it's
+/// empty.
+static bool shading_area(
+    const PdfShadingDict* shading_dict,
+    GeomMat3 ctm,
+    Canvas* canvas,
+    GeomRect* area_out
+) {
+    GeomRect area;
+    if (!canvas_draw_bounds(canvas, &area)) {
+        return false;
+    }
+
+    if (shading_dict->bbox.is_some) {
+        area = geom_rect_intersection(
+            area,
+            geom_rect_transform(
+                pdf_rectangle_to_geom(shading_dict->bbox.value),
+                ctm
+            )
+        );
+    }
+
+    *area_out = area;
+    return area.min.x < area.max.x && area.min.y < area.max.y;
+}
+
+/// Clips `canvas` to the shading's bounding box, if it has one.
+static void shading_push_bbox_clip(
+    const PdfShadingDict* shading_dict,
+    Arena* arena,
+    GeomMat3 ctm,
+    Canvas* canvas
+) {
+    if (!shading_dict->bbox.is_some) {
+        return;
+    }
+
+    GeomRect bbox = pdf_rectangle_to_geom(shading_dict->bbox.value);
+    PathBuilder* clip = path_builder_new(arena);
+    path_builder_new_contour(clip, geom_vec2_transform(bbox.min, ctm));
+    path_builder_line_to(
+        clip,
+        geom_vec2_transform(geom_vec2_new(bbox.max.x, bbox.min.y), ctm)
+    );
+    path_builder_line_to(clip, geom_vec2_transform(bbox.max, ctm));
+    path_builder_line_to(
+        clip,
+        geom_vec2_transform(geom_vec2_new(bbox.min.x, bbox.max.y), ctm)
+    );
+    path_builder_close_contour(clip);
+    canvas_push_clip_path(canvas, clip, false);
+}
+
+static void shading_pop_bbox_clip(
+    const PdfShadingDict* shading_dict,
+    Canvas* canvas
+) {
+    if (shading_dict->bbox.is_some) {
+        canvas_pop_clip_paths(canvas, 1);
+    }
+}
+
+/// Sets up a surface covering the whole pixels overlapping `area`, in device
+/// space. Returns false if there are none.
+static bool shading_surface_begin(
+    Arena* arena,
+    Canvas* canvas,
+    GeomRect area,
+    ShadingSurface* surface_out
+) {
+    double res = canvas_raster_res(canvas);
+    double min_x = floor(area.min.x / res);
+    double min_y = floor(area.min.y / res);
+    double max_x = ceil(area.max.x / res);
+    double max_y = ceil(area.max.y / res);
+    if (!(min_x < max_x && min_y < max_y)) {
+        return false;
     }
+
+    ShadingSurface surface = {
+        .canvas = canvas,
+        .image = NULL,
+        .res = res,
+        .min_x = (int32_t)min_x,
+        .min_y = (int32_t)min_y,
+        .max_x = (int32_t)max_x,
+        .max_y = (int32_t)max_y
+    };
+    if (!canvas_is_raster(canvas)) {
+        surface.image = canvas_new_raster(
+            arena,
+            (uint32_t)(surface.max_x - surface.min_x),
+            (uint32_t)(surface.max_y - surface.min_y),
+            rgba_new(0.0, 0.0, 0.0, 0.0)
+        );
+    }
+
+    *surface_out = surface;
+    return true;
+}
+
+static void shading_surface_draw_span(
+    ShadingSurface* surface,
+    int32_t x,
+    int32_t y,
+    size_t count,
+    const uint8_t* pixels
+) {
+    if (surface->image) {
+        canvas_draw_span(
+            surface->image,
+            x - surface->min_x,
+            y - surface->min_y,
+            count,
+            pixels
+        );
+    } else {
+        canvas_draw_span(surface->canvas, x, y, count, pixels);
+    }
+}
+
+/// Draws a vector canvas's image onto it.
+static void shading_surface_end(ShadingSurface* surface) {
+    if (!surface->image) {
+        return;
+    }
+
+    canvas_draw_image(
+        surface->canvas,
+        surface->image,
+        geom_rect_new(
+            geom_vec2_new(
+                (double)surface->min_x * surface->res,
+                (double)surface->min_y * surface->res
+            ),
+            geom_vec2_new(
+                (double)surface->max_x * surface->res,
+                (double)surface->max_y * surface->res
+            )
+        )
+    );
+}
+
+/// Draws the runs of painted samples in a row as spans.
+static void shading_draw_row(
+    ShadingSurface* surface,
+    int32_t x,
+    int32_t y,
+    const double* ts,
+    const uint8_t* pixels,
+    size_t count
+) {
+    size_t idx = 0;
+    while (idx < count) {
+        if (isnan(ts[idx])) {
+            idx++;
+            continue;
+        }
+
+        size_t span_start = idx;
+        while (idx < count && !isnan(ts[idx])) {
+            idx++;
+        }
+
+        shading_surface_draw_span(
+            surface,
+            x + (int32_t)span_start,
+            y,
+            idx - span_start,
+            pixels + span_start * 4
+        );
+    }
+}
+
+/// Renders a shading whose color depends only on a parametric variable,
+/// sampled once at the center of every pixel in device space. Colors come
+/// from a table built before drawing, and rows of samples are evaluated
+/// together and drawn as spans. `geometry_bounds`
+/// limits the area painted in shading space, unless it is NULL.
+///
+/// Vector canvases are first offered `gradient`, the same geometry as a
+/// native gradient with its stops and transform left to fill in, unless it is
+/// NULL. If they can't draw it, the samples are drawn into an image instead.
+static void render_parametric_shading(
+    const PdfShadingDict* shading_dict,
+    PdfFunctionVec* functions,
+    const PdfNumber domain[2],
+    ShadingRowFn row_fn,
+    const void* geometry,
+    const GeomRect* geometry_bounds,
+    const CanvasGradient* gradient,
+    GeomMat3 ctm,
+    Canvas* canvas
+) {
+    GeomRect area;
+    if (!shading_area(shading_dict, ctm, canvas, &area)
+        || fabs(geom_mat3_det(ctm)) < 1e-12) {
+        return;
+    }
+    if (geometry_bounds) {
+        area = geom_rect_intersection(
+            area,
+            geom_rect_transform(*geometry_bounds, ctm)
+        );
+    }
+
+    Arena* local_arena = arena_new(1024);
+    ShadingLut lut;
+    Error* error =
+        shading_lut_new(local_arena, shading_dict, functions, domain, &lut);
+    if (error) {
+        error_print(error);
+        error_free(error);
+        arena_free(local_arena);
+        return;
+    }
+
+    // Vector canvases clip to the bounding box rather than testing samples,
+    // since gradients aren't sampled
+    bool is_vector = !canvas_is_raster(canvas);
+    if (is_vector) {
+        shading_push_bbox_clip(shading_dict, local_arena, ctm, canvas);
+    }
+
+    if (is_vector && gradient) {
+        CanvasGradient native = *gradient;
+        native.stops = shading_lut_stops(local_arena, &lut, &native.stop_count);
+        native.transform = ctm;
+
+        if (canvas_draw_gradient(canvas, &native)) {
+            shading_pop_bbox_clip(shading_dict, canvas);
+            arena_free(local_arena);
+            return;
+        }
+    }
+
+    // Without a native gradient, the samples are drawn into an image covering
+    // the area instead of as one element per span
+    ShadingSurface surface;
+    if (!shading_surface_begin(local_arena, canvas, area, &surface)) {
+        if (is_vector) {
+            shading_pop_bbox_clip(shading_dict, canvas);
+        }
+        arena_free(local_arena);
+        return;
+    }
+
+    // Samples step by a fixed amount in shading space along rows. Each row
+    // starts from its own device position rather than stepping down from the
+    // top of the area, so a row's samples don't depend on which rows of the
+    // canvas are drawn.
+    double res = surface.res;
+    double min_x = (double)surface.min_x;
+    GeomMat3 inv_ctm = geom_mat3_inverse(ctm);
+    GeomVec2 step_x = geom_vec2_sub(
+        geom_vec2_transform(
+            geom_vec2_new((min_x + 1.5) * res, 0.5 * res),
+            inv_ctm
+        ),
+        geom_vec2_transform(
+            geom_vec2_new((min_x + 0.5) * res, 0.5 * res),
+            inv_ctm
+        )
+    );
+
+    size_t count = (size_t)(surface.max_x - surface.min_x);
+    size_t rows = (size_t)(surface.max_y - surface.min_y);
+    double* ts = arena_alloc(local_arena, count * sizeof(double));
+    uint8_t* pixels = arena_alloc(local_arena, count * 4);
+
+    GeomRect bbox;
+    if (shading_dict->bbox.is_some) {
+        bbox = pdf_rectangle_to_geom(shading_dict->bbox.value);
+    }
+
+    for (size_t row = 0; row < rows; row++) {
+        double y = (double)surface.min_y + (double)row;
+        GeomVec2 start = geom_vec2_transform(
+            geom_vec2_new((min_x + 0.5) * res, (y + 0.5) * res),
+            inv_ctm
+        );
+        row_fn(geometry, start, step_x, count, ts);
+
+        // The bounding box may be rotated in device space, so each sample is
+        // checked against it in shading space
+        if (shading_dict->bbox.is_some) {
+            for (size_t idx = 0; idx < count; idx++) {
+                GeomVec2 point = geom_vec2_add(
+                    start,
+                    geom_vec2_scale(step_x, (double)idx)
+                );
+                if (point.x < bbox.min.x || point.x > bbox.max.x
+                    || point.y < bbox.min.y || point.y > bbox.max.y) {
+                    ts[idx] = SHADING_UNPAINTED;
+                }
+            }
+        }
+
+        for (size_t idx = 0; idx < count; idx++) {
+            if (!isnan(ts[idx])) {
+                shading_lut_sample(&lut, ts[idx], pixels + idx * 4);
+            }
+        }
+
+        shading_draw_row(
+            &surface,
+            surface.min_x,
+            surface.min_y + (int32_t)row,
+            ts,
+            pixels,
+            count
+        );
+    }
+
+    shading_surface_end(&surface);
+    if (is_vector) {
+        shading_pop_bbox_clip(shading_dict, canvas);
+    }
+
+    arena_free(local_arena);
+}
+
+/// Sub-pixel precision of mesh vertices. Vertices are snapped to it so the
+/// edge functions of triangles sharing an edge are exact negations of each
+/// other.
+#define SHADING_MESH_SUBPIXELS 256
+
+/// How far from the origin mesh vertices may lie, in device pixels, so edge
+/// functions fit in 64 bits.
+#define SHADING_MESH_MAX_COORD ((double)(1 << 21))
+
+/// Patches and function domains are subdivided until their pieces span about
+/// this many device pixels, halving them at most the given number of times.
+/// Colors are interpolated linearly within each piece, so pieces of a few
+/// pixels are indistinguishable from per-pixel evaluation.
+#define SHADING_SUBDIVISION_SIZE 4.0
+#define SHADING_SUBDIVISION_MAX_DEPTH 10
+
+/// Function domains are always halved this many times, so the flatness test
+/// of larger pieces doesn't miss features between its samples.
+#define SHADING_FUNCTION_MIN_DEPTH 2
+
+/// A vertex of a mesh in device pixels, with the value interpolated across
+/// the triangles it's part of. The value is an RGB color, unless the shading
+/// has a function, in which case it's the parametric variable mapped onto
+/// [0, 1] in `x`.
+typedef struct {
+    GeomVec2 position;
+    GeomVec3 value;
+} ShadingVertex;
+
+typedef struct {
+    ShadingVertex vertices[3];
+} ShadingTriangle;
+
+/// A tensor-product patch in device pixels. Control points are indexed as
+/// `points[i][j]`, weighted by the ith Bernstein polynomial in u and the jth
+/// in v. Values are at the corners (u, v) = (0, 0), (0, 1), (1, 1), (1, 0).
+typedef struct {
+    GeomVec2 points[4][4];
+    GeomVec3 values[4];
+} ShadingPatch;
+
+#define DVEC_NAME ShadingTriangleVec
+#define DVEC_LOWERCASE_NAME shading_triangle_vec
+#define DVEC_TYPE ShadingTriangle
+#include "arena/dvec_impl.h"
+
+#define DVEC_NAME ShadingPatchVec
+#define DVEC_LOWERCASE_NAME shading_patch_vec
+#define DVEC_TYPE ShadingPatch
+#include "arena/dvec_impl.h"
+
+/// Rasterizes Gouraud-shaded triangles onto a surface.
+typedef struct {
+    ShadingSurface* surface;
+
+    /// Maps parametric variables onto colors, or NULL if values are colors.
+    const ShadingLut* lut;
+
+    /// Scratch space for a row of pixels as wide as the surface.
+    uint8_t* pixels;
+} ShadingRaster;
+
+static int64_t shading_fixed(double coord) {
+    if (!(coord > -SHADING_MESH_MAX_COORD)) {
+        coord = -SHADING_MESH_MAX_COORD;
+    } else if (coord > SHADING_MESH_MAX_COORD) {
+        coord = SHADING_MESH_MAX_COORD;
+    }
+
+    return (int64_t)llround(coord * SHADING_MESH_SUBPIXELS);
+}
+
+static int64_t shading_floor_div(int64_t value, int64_t divisor) {
+    int64_t quotient = value / divisor;
+    return quotient * divisor > value ? quotient - 1 : quotient;
+}
+
+/// Evaluates the edge function of the directed edge from `p` to `q` at `r`,
+/// which is positive to the left of the edge in y-down space.
+static int64_t shading_edge(
+    int64_t px,
+    int64_t py,
+    int64_t qx,
+    int64_t qy,
+    int64_t rx,
+    int64_t ry
+) {
+    return (qx - px) * (ry - py) - (qy - py) * (rx - px);
+}
+
+/// Checks whether a point is inside an edge given its edge function. Points
+/// exactly on the edge belong to it only if it points down, or left when
+/// horizontal, so of two triangles sharing an edge, only one draws them.
+static bool shading_edge_contains(int64_t edge, int64_t dx, int64_t dy) {
+    return edge > 0 || (edge == 0 && (dy > 0 || (dy == 0 && dx < 0)));
+}
+
+static void shading_raster_color(
+    const ShadingRaster* raster,
+    GeomVec3 value,
+    uint8_t* out
+) {
+    if (raster->lut) {
+        shading_lut_sample(raster->lut, clamp01(value.x), out);
+        return;
+    }
+
+    out[0] = shading_quantize(value.x);
+    out[1] = shading_quantize(value.y);
+    out[2] = shading_quantize(value.z);
+    out[3] = 255;
+}
+
+/// Draws a triangle, interpolating its vertices' values linearly across it.
+/// The pixels drawn are those whose centers it covers, which are found with
+/// edge functions stepped incrementally along each row.
+static void shading_draw_triangle(
+    ShadingRaster* raster,
+    ShadingVertex a,
+    ShadingVertex b,
+    ShadingVertex c
+) {
+    int64_t ax = shading_fixed(a.position.x);
+    int64_t ay = shading_fixed(a.position.y);
+    int64_t bx = shading_fixed(b.position.x);
+    int64_t by = shading_fixed(b.position.y);
+    int64_t cx = shading_fixed(c.position.x);
+    int64_t cy = shading_fixed(c.position.y);
+
+    int64_t area = shading_edge(ax, ay, bx, by, cx, cy);
+    if (area == 0) {
+        return;
+    }
+    if (area < 0) {
+        ShadingVertex vertex = b;
+        b = c;
+        c = vertex;
+
+        int64_t swap = bx;
+        bx = cx;
+        cx = swap;
+        swap = by;
+        by = cy;
+        cy = swap;
+        area = -area;
+    }
+
+    // Find the pixels whose centers lie within the triangle's bounds
+    const int64_t half = SHADING_MESH_SUBPIXELS / 2;
+    int64_t min_x = shading_floor_div(
+                        (ax < bx ? (ax < cx ? ax : cx) : (bx < cx ? bx : cx))
+                            - half - 1,
+                        SHADING_MESH_SUBPIXELS
+                    )
+                  + 1;
+    int64_t max_x = shading_floor_div(
+        (ax > bx ? (ax > cx ? ax : cx) : (bx > cx ? bx : cx)) - half,
+        SHADING_MESH_SUBPIXELS
+    );
+    int64_t min_y = shading_floor_div(
+                        (ay < by ? (ay < cy ? ay : cy) : (by < cy ? by : cy))
+                            - half - 1,
+                        SHADING_MESH_SUBPIXELS
+                    )
+                  + 1;
+    int64_t max_y = shading_floor_div(
+        (ay > by ? (ay > cy ? ay : cy) : (by > cy ? by : cy)) - half,
+        SHADING_MESH_SUBPIXELS
+    );
+
+    ShadingSurface* surface = raster->surface;
+    if (min_x < surface->min_x) {
+        min_x = surface->min_x;
+    }
+    if (max_x >= surface->max_x) {
+        max_x = surface->max_x - 1;
+    }
+    if (min_y < surface->min_y) {
+        min_y = surface->min_y;
+    }
+    if (max_y >= surface->max_y) {
+        max_y = surface->max_y - 1;
+    }
+    if (min_x > max_x || min_y > max_y) {
+        return;
+    }
+
+    // Each vertex is weighted by the edge function of the opposite edge
+    double inv_area = 1.0 / (double)area;
+    int64_t step_a = -(cy - by) * SHADING_MESH_SUBPIXELS;
+    int64_t step_b = -(ay - cy) * SHADING_MESH_SUBPIXELS;
+    int64_t step_c = -(by - ay) * SHADING_MESH_SUBPIXELS;
+
+    for (int64_t y = min_y; y <= max_y; y++) {
+        int64_t sample_x = min_x * SHADING_MESH_SUBPIXELS + half;
+        int64_t sample_y = y * SHADING_MESH_SUBPIXELS + half;
+        int64_t edge_a = shading_edge(bx, by, cx, cy, sample_x, sample_y);
+        int64_t edge_b = shading_edge(cx, cy, ax, ay, sample_x, sample_y);
+        int64_t edge_c = shading_edge(ax, ay, bx, by, sample_x, sample_y);
+
+        // Triangles are convex, so the pixels covered in a row are a single
+        // run
+        int64_t span_start = -1;
+        int64_t span_end = -1;
+        for (int64_t x = min_x; x <= max_x; x++) {
+            bool is_inside =
+                shading_edge_contains(edge_a, cx - bx, cy - by)
+                && shading_edge_contains(edge_b, ax - cx, ay - cy)
+                && shading_edge_contains(edge_c, bx - ax, by - ay);
+
+            if (is_inside) {
+                if (span_start < 0) {
+                    span_start = x;
+                }
+
+                GeomVec3 value = geom_vec3_add(
+                    geom_vec3_add(
+                        geom_vec3_mul(
+                            a.value,
+                            geom_vec3_scalar((double)edge_a * inv_area)
+                        ),
+                        geom_vec3_mul(
+                            b.value,
+                            geom_vec3_scalar((double)edge_b * inv_area)
+                        )
+                    ),
+                    geom_vec3_mul(
+                        c.value,
+                        geom_vec3_scalar((double)edge_c * inv_area)
+                    )
+                );
+                shading_raster_color(
+                    raster,
+                    value,
+                    raster->pixels + (x - min_x) * 4
+                );
+                span_end = x + 1;
+            } else if (span_start >= 0) {
+                break;
+            }
+
+            edge_a += step_a;
+            edge_b += step_b;
+            edge_c += step_c;
+        }
+
+        if (span_start >= 0) {
+            shading_surface_draw_span(
+                surface,
+                (int32_t)span_start,
+                (int32_t)y,
+                (size_t)(span_end - span_start),
+                raster->pixels + (span_start - min_x) * 4
+            );
+        }
+    }
+}
+
+/// Finds how many times a piece spanning `length` device pixels is halved to
+/// reach pieces of about `SHADING_SUBDIVISION_SIZE`.
+static int shading_subdivision_depth(double length) {
+    int depth = 0;
+    double size = length;
+    while (depth < SHADING_SUBDIVISION_MAX_DEPTH
+           && size > SHADING_SUBDIVISION_SIZE) {
+        size *= 0.5;
+        depth++;
+    }
+
+    return depth;
+}
+
+static void shading_bernstein(double t, double out[4]) {
+    double s = 1.0 - t;
+    out[0] = s * s * s;
+    out[1] = 3.0 * t * s * s;
+    out[2] = 3.0 * t * t * s;
+    out[3] = t * t * t;
+}
+
+/// Draws a patch as a grid of triangle pairs. The grid's resolution in u and
+/// v follows the length of the control polygon in each direction in device
+/// space, so patches are split into pieces of a few pixels whatever the CTM's
+/// scale.
+static void shading_draw_patch(
+    ShadingRaster* raster,
+    const ShadingPatch* patch,
+    ShadingVertex* row_scratch
+) {
+    double u_length = 0.0;
+    double v_length = 0.0;
+    for (int outer = 0; outer < 4; outer++) {
+        double u_polygon = 0.0;
+        double v_polygon = 0.0;
+        for (int inner = 0; inner < 3; inner++) {
+            u_polygon += sqrt(geom_vec2_len_sq(geom_vec2_sub(
+                patch->points[inner + 1][outer],
+                patch->points[inner][outer]
+            )));
+            v_polygon += sqrt(geom_vec2_len_sq(geom_vec2_sub(
+                patch->points[outer][inner + 1],
+                patch->points[outer][inner]
+            )));
+        }
+        u_length = fmax(u_length, u_polygon);
+        v_length = fmax(v_length, v_polygon);
+    }
+
+    size_t u_steps = (size_t)1 << shading_subdivision_depth(u_length);
+    size_t v_steps = (size_t)1 << shading_subdivision_depth(v_length);
+
+    // Later rows overlap earlier ones where the patch folds over itself, so
+    // points with larger v are painted over those with smaller v
+    ShadingVertex* prev_row = row_scratch;
+    ShadingVertex* row = row_scratch + u_steps + 1;
+    for (size_t v_idx = 0; v_idx <= v_steps; v_idx++) {
+        double v = (double)v_idx / (double)v_steps;
+        double v_weights[4];
+        shading_bernstein(v, v_weights);
+
+        for (size_t u_idx = 0; u_idx <= u_steps; u_idx++) {
+            double u = (double)u_idx / (double)u_steps;
+            double u_weights[4];
+            shading_bernstein(u, u_weights);
+
+            GeomVec2 position = geom_vec2_new(0.0, 0.0);
+            for (int i = 0; i < 4; i++) {
+                for (int j = 0; j < 4; j++) {
+                    position = geom_vec2_add(
+                        position,
+                        geom_vec2_scale(
+                            patch->points[i][j],
+                            u_weights[i] * v_weights[j]
+                        )
+                    );
+                }
+            }
+
+            GeomVec3 value = geom_vec3_add(
+                geom_vec3_add(
+                    geom_vec3_mul(
+                        patch->values[0],
+                        geom_vec3_scalar((1.0 - u) * (1.0 - v))
+                    ),
+                    geom_vec3_mul(
+                        patch->values[1],
+                        geom_vec3_scalar((1.0 - u) * v)
+                    )
+                ),
+                geom_vec3_add(
+                    geom_vec3_mul(patch->values[2], geom_vec3_scalar(u * v)),
+                    geom_vec3_mul(
+                        patch->values[3],
+                        geom_vec3_scalar(u * (1.0 - v))
+                    )
+                )
+            );
+
+            row[u_idx] = (ShadingVertex) {.position = position, .value = value};
+        }
+
+        if (v_idx != 0) {
+            for (size_t u_idx = 0; u_idx < u_steps; u_idx++) {
+                shading_draw_triangle(
+                    raster,
+                    prev_row[u_idx],
+                    prev_row[u_idx + 1],
+                    row[u_idx]
+                );
+                shading_draw_triangle(
+                    raster,
+                    prev_row[u_idx + 1],
+                    row[u_idx + 1],
+                    row[u_idx]
+                );
+            }
+        }
+
+        ShadingVertex* swap = prev_row;
+        prev_row = row;
+        row = swap;
+    }
+}
+
+/// Reads the vertices packed into the stream of a mesh shading.
+typedef struct {
+    const PdfShadingDict* shading_dict;
+    const PdfShadingDictMesh* mesh;
+
+    const uint8_t* data;
+    size_t data_len;
+    size_t bit_offset;
+
+    /// The Decode array as reals.
+    double* decode;
+    size_t component_count;
+
+    /// Maps shading space onto device pixels.
+    GeomMat3 to_pixels;
+
+    /// The device pixel bounds of every point read so far.
+    bool has_bounds;
+    GeomRect bounds;
+
+    double components[SHADING_MAX_COMPONENTS];
+} ShadingMeshReader;
+
+static bool shading_mesh_read_bits(
+    ShadingMeshReader* reader,
+    PdfInteger bits,
+    uint32_t* out
+) {
+    if (bits <= 0 || bits > 32
+        || (size_t)bits > reader->data_len * 8 - reader->bit_offset) {
+        return false;
+    }
+
+    uint64_t value = 0;
+    for (PdfInteger idx = 0; idx < bits; idx++) {
+        size_t bit = reader->bit_offset++;
+        value = (value << 1) | ((reader->data[bit / 8] >> (7 - bit % 8)) & 1);
+    }
+
+    *out = (uint32_t)value;
+    return true;
+}
+
+/// Skips to the next byte boundary.
+static void shading_mesh_align(ShadingMeshReader* reader) {
+    reader->bit_offset = (reader->bit_offset + 7) / 8 * 8;
+}
+
+/// Reads a sample and maps it onto the range of the `decode_idx`th pair of
+/// the Decode array.
+static bool shading_mesh_read_sample(
+    ShadingMeshReader* reader,
+    PdfInteger bits,
+    size_t decode_idx,
+    double* out
+) {
+    uint32_t raw;
+    if (!shading_mesh_read_bits(reader, bits, &raw)) {
+        return false;
+    }
+
+    double min = reader->decode[decode_idx * 2];
+    double max = reader->decode[decode_idx * 2 + 1];
+    *out = min + (double)raw * (max - min) / (ldexp(1.0, (int)bits) - 1.0);
+    return true;
+}
+
+static bool
+shading_mesh_read_point(ShadingMeshReader* reader, GeomVec2* point_out) {
+    double x;
+    double y;
+    if (!shading_mesh_read_sample(
+            reader,
+            reader->mesh->bits_per_coordinate,
+            0,
+            &x
+        )
+        || !shading_mesh_read_sample(
+            reader,
+            reader->mesh->bits_per_coordinate,
+            1,
+            &y
+        )) {
+        return false;
+    }
+
+    GeomVec2 point =
+        geom_vec2_transform(geom_vec2_new(x, y), reader->to_pixels);
+    GeomRect point_bounds = geom_rect_new(point, point);
+    reader->bounds = reader->has_bounds
+                       ? geom_rect_union(reader->bounds, point_bounds)
+                       : point_bounds;
+    reader->has_bounds = true;
+
+    *point_out = point;
+    return true;
+}
+
+/// Reads a vertex's color components, converting them into its value. Sets
+/// `read_out` to false if the stream ends first.
+static Error* shading_mesh_read_value(
+    ShadingMeshReader* reader,
+    GeomVec3* value_out,
+    bool* read_out
+) {
+    *read_out = false;
+
+    for (size_t idx = 0; idx < reader->component_count; idx++) {
+        if (!shading_mesh_read_sample(
+                reader,
+                reader->mesh->bits_per_component,
+                idx + 2,
+                &reader->components[idx]
+            )) {
+            return NULL;
+        }
+    }
+    *read_out = true;
+
+    if (!reader->mesh->function.is_some) {
+        shading_components_to_rgb(
+            reader->shading_dict,
+            reader->components,
+            reader->component_count,
+            value_out
+        );
+        return NULL;
+    }
+
+    // Parametric values are mapped onto the color table's [0, 1] range
+    double t_min = reader->decode[4];
+    double t_max = reader->decode[5];
+    double t = t_max != t_min
+                 ? (reader->components[0] - t_min) / (t_max - t_min)
+                 : 0.0;
+    *value_out = geom_vec3_new(t, 0.0, 0.0);
+    return NULL;
+}
+
+static Error* shading_mesh_read_vertex(
+    ShadingMeshReader* reader,
+    ShadingVertex* vertex_out,
+    bool* read_out
+) {
+    *read_out = false;
+    if (!shading_mesh_read_point(reader, &vertex_out->position)) {
+        return NULL;
+    }
+
+    return shading_mesh_read_value(reader, &vertex_out->value, read_out);
+}
+
+/// Decodes a free-form triangle mesh. Each vertex's flag either starts a new
+/// triangle, or forms one with an edge of the previous triangle.
+static Error* shading_decode_free_form(
+    ShadingMeshReader* reader,
+    ShadingTriangleVec* triangles
+) {
+    ShadingVertex vertices[3];
+    size_t pending = 0;
+    bool has_triangle = false;
+
+    while (true) {
+        uint32_t flag;
+        ShadingVertex vertex;
+        bool is_read = false;
+        if (!shading_mesh_read_bits(
+                reader,
+                reader->mesh->bits_per_flag.value,
+                &flag
+            )) {
+            break;
+        }
+        TRY(shading_mesh_read_vertex(reader, &vertex, &is_read));
+        if (!is_read) {
+            break;
+        }
+        shading_mesh_align(reader);
+
+        if (pending == 0 && (flag & 3) != 0 && has_triangle) {
+            // Continue from the edge shared with the previous triangle
+            if ((flag & 3) == 2) {
+                vertices[1] = vertices[0];
+            }
+            vertices[0] = vertices[1];
+            vertices[1] = vertices[2];
+            vertices[2] = vertex;
+        } else {
+            vertices[pending++] = vertex;
+            if (pending != 3) {
+                continue;
+            }
+            pending = 0;
+        }
+
+        ShadingTriangle triangle;
+        memcpy(triangle.vertices, vertices, sizeof(vertices));
+        shading_triangle_vec_push(triangles, triangle);
+        has_triangle = true;
+    }
+
+    return NULL;
+}
+
+/// Decodes a lattice-form triangle mesh, splitting each cell of the lattice
+/// into two triangles.
+static Error* shading_decode_lattice(
+    ShadingMeshReader* reader,
+    Arena* arena,
+    ShadingTriangleVec* triangles
+) {
+    size_t row_len = (size_t)reader->mesh->vertices_per_row.value;
+    ShadingVertex* prev_row =
+        arena_alloc(arena, row_len * sizeof(ShadingVertex));
+    ShadingVertex* row = arena_alloc(arena, row_len * sizeof(ShadingVertex));
+
+    for (size_t row_idx = 0;; row_idx++) {
+        for (size_t idx = 0; idx < row_len; idx++) {
+            bool is_read = false;
+            TRY(shading_mesh_read_vertex(reader, &row[idx], &is_read));
+            if (!is_read) {
+                return NULL;
+            }
+        }
+
+        if (row_idx != 0) {
+            for (size_t idx = 0; idx + 1 < row_len; idx++) {
+                shading_triangle_vec_push(
+                    triangles,
+                    (ShadingTriangle) {
+                        .vertices = {prev_row[idx], prev_row[idx + 1], row[idx]}
+                    }
+                );
+                shading_triangle_vec_push(
+                    triangles,
+                    (ShadingTriangle) {
+                        .vertices = {prev_row[idx + 1], row[idx + 1], row[idx]}
+                    }
+                );
+            }
+        }
+
+        ShadingVertex* swap = prev_row;
+        prev_row = row;
+        row = swap;
+    }
+}
+
+/// The control points of a patch in the order they're packed, as indices
+/// into `ShadingPatch.points`. The first 12 run around the boundary, starting
+/// with the edge shared with the previous patch, and the last 4 are the
+/// interior points of tensor-product patches.
+static const int shading_patch_order[16][2] = {
+    {0, 0},
+    {0, 1},
+    {0, 2},
+    {0, 3},
+    {1, 3},
+    {2, 3},
+    {3, 3},
+    {3, 2},
+    {3, 1},
+    {3, 0},
+    {2, 0},
+    {1, 0},
+    {1, 1},
+    {1, 2},
+    {2, 2},
+    {2, 1}
+};
+
+/// Places the interior control points of a Coons patch so the
+/// tensor-product patch they form is the same surface.
+static void shading_patch_coons_interior(ShadingPatch* patch) {
+    GeomVec2(*p)[4] = patch->points;
+    GeomVec2 interior[4];
+    int corners[4][2] = {{0, 0}, {0, 3}, {3, 3}, {3, 0}};
+
+    for (int corner = 0; corner < 4; corner++) {
+        // Each interior point is taken relative to its nearest corner, using
+        // the boundary points around it
+        int i = corners[corner][0];
+        int j = corners[corner][1];
+        int di = i == 0 ? 1 : -1;
+        int dj = j == 0 ? 1 : -1;
+        int far_i = 3 - i;
+        int far_j = 3 - j;
+
+        GeomVec2 sum = geom_vec2_scale(p[i][j], -4.0);
+        sum = geom_vec2_add(
+            sum,
+            geom_vec2_scale(geom_vec2_add(p[i][j + dj], p[i + di][j]), 6.0)
+        );
+        sum = geom_vec2_add(
+            sum,
+            geom_vec2_scale(geom_vec2_add(p[i][far_j], p[far_i][j]), -2.0)
+        );
+        sum = geom_vec2_add(
+            sum,
+            geom_vec2_scale(
+                geom_vec2_add(p[far_i][j + dj], p[i + di][far_j]),
+                3.0
+            )
+        );
+        sum = geom_vec2_sub(sum, p[far_i][far_j]);
+        interior[corner] = geom_vec2_scale(sum, 1.0 / 9.0);
+    }
+
+    p[1][1] = interior[0];
+    p[1][2] = interior[1];
+    p[2][2] = interior[2];
+    p[2][1] = interior[3];
+}
+
+/// Decodes a Coons or tensor-product patch mesh. A patch's flag either starts
+/// it afresh, or takes its first edge and the colors at its ends from one of
+/// the other edges of the previous patch.
+static Error* shading_decode_patches(
+    ShadingMeshReader* reader,
+    bool is_tensor,
+    ShadingPatchVec* patches
+) {
+    size_t point_count = is_tensor ? 16 : 12;
+    ShadingPatch prev;
+    bool has_prev = false;
+
+    while (true) {
+        uint32_t flag;
+        if (!shading_mesh_read_bits(
+                reader,
+                reader->mesh->bits_per_flag.value,
+                &flag
+            )) {
+            break;
+        }
+        flag &= 3;
+        if (flag != 0 && !has_prev) {
+            return ERROR(
+                PDF_ERR_INCORRECT_TYPE,
+                "The first patch of a mesh can't share an edge"
+            );
+        }
+
+        ShadingPatch patch;
+        size_t first_point = 0;
+        size_t first_value = 0;
+        if (flag != 0) {
+            // The shared edge runs along the boundary from the corner at
+            // index 3 * flag of the previous patch
+            for (size_t idx = 0; idx < 4; idx++) {
+                const int* from = shading_patch_order[(3 * flag + idx) % 12];
+                const int* to = shading_patch_order[idx];
+                patch.points[to[0]][to[1]] = prev.points[from[0]][from[1]];
+            }
+            patch.values[0] = prev.values[flag];
+            patch.values[1] = prev.values[(flag + 1) % 4];
+            first_point = 4;
+            first_value = 2;
+        }
+
+        for (size_t idx = first_point; idx < point_count; idx++) {
+            const int* to = shading_patch_order[idx];
+            if (!shading_mesh_read_point(reader, &patch.points[to[0]][to[1]])) {
+                return NULL;
+            }
+        }
+        for (size_t idx = first_value; idx < 4; idx++) {
+            bool is_read = false;
+            TRY(shading_mesh_read_value(reader, &patch.values[idx], &is_read));
+            if (!is_read) {
+                return NULL;
+            }
+        }
+        if (!is_tensor) {
+            shading_patch_coons_interior(&patch);
+        }
+
+        shading_patch_vec_push(patches, patch);
+        prev = patch;
+        has_prev = true;
+    }
+
+    return NULL;
+}
+
+/// Renders a triangle or patch mesh shading. The mesh is decoded into device
+/// pixels first, so only the pixels its vertices reach are drawn.
+static Error* render_mesh_shading(
+    const PdfShadingDict* shading_dict,
+    Arena* arena,
+    GeomMat3 ctm,
+    Canvas* canvas
+) {
+    const PdfShadingDictMesh* mesh = &shading_dict->data.mesh;
+
+    GeomRect area;
+    if (!shading_area(shading_dict, ctm, canvas, &area)) {
+        return NULL;
+    }
+
+    size_t decode_len = pdf_number_vec_len(mesh->decode);
+    ShadingMeshReader reader = {
+        .shading_dict = shading_dict,
+        .mesh = mesh,
+        .data = mesh->stream_bytes,
+        .data_len = mesh->stream_len,
+        .bit_offset = 0,
+        .decode = arena_alloc(arena, decode_len * sizeof(double)),
+        .component_count =
+            mesh->function.is_some ? 1 : (decode_len - 4) / 2,
+        .has_bounds = false
+    };
+    if (reader.component_count > SHADING_MAX_COMPONENTS) {
+        return ERROR(
+            PDF_ERR_INCORRECT_TYPE,
+            "Mesh shading has too many color components"
+        );
+    }
+    for (size_t idx = 0; idx < decode_len; idx++) {
+        PdfNumber number;
+        RELEASE_ASSERT(pdf_number_vec_get(mesh->decode, idx, &number));
+        reader.decode[idx] = pdf_number_as_real(number);
+    }
+
+    double res = canvas_raster_res(canvas);
+    reader.to_pixels = geom_mat3_mul(
+        ctm,
+        geom_mat3_new_pdf(1.0 / res, 0.0, 0.0, 1.0 / res, 0.0, 0.0)
+    );
+
+    ShadingTriangleVec* triangles = shading_triangle_vec_new(arena);
+    ShadingPatchVec* patches = shading_patch_vec_new(arena);
+    switch (shading_dict->shading_type) {
+        case 4: {
+            TRY(shading_decode_free_form(&reader, triangles));
+            break;
+        }
+        case 5: {
+            TRY(shading_decode_lattice(&reader, arena, triangles));
+            break;
+        }
+        case 6:
+        case 7: {
+            TRY(shading_decode_patches(
+                &reader,
+                shading_dict->shading_type == 7,
+                patches
+            ));
+            break;
+        }
+        default: {
+            LOG_PANIC("Unreachable");
+        }
+    }
+    if (!reader.has_bounds) {
+        return NULL;
+    }
+
+    ShadingLut lut;
+    if (mesh->function.is_some) {
+        PdfNumber domain[2];
+        RELEASE_ASSERT(pdf_number_vec_get(mesh->decode, 4, &domain[0]));
+        RELEASE_ASSERT(pdf_number_vec_get(mesh->decode, 5, &domain[1]));
+        TRY(shading_lut_new(
+            arena,
+            shading_dict,
+            mesh->function.value,
+            domain,
+            &lut
+        ));
+    }
+
+    // Pixel bounds are widened by a pixel so those touched by an edge are
+    // kept
+    GeomRect mesh_area = geom_rect_new(
+        geom_vec2_new(
+            (reader.bounds.min.x - 1.0) * res,
+            (reader.bounds.min.y - 1.0) * res
+        ),
+        geom_vec2_new(
+            (reader.bounds.max.x + 1.0) * res,
+            (reader.bounds.max.y + 1.0) * res
+        )
+    );
+    area = geom_rect_intersection(area, mesh_area);
+
+    ShadingSurface surface;
+    shading_push_bbox_clip(shading_dict, arena, ctm, canvas);
+    if (shading_surface_begin(arena, canvas, area, &surface)) {
+        ShadingRaster raster = {
+            .surface = &surface,
+            .lut = mesh->function.is_some ? &lut : NULL,
+            .pixels = arena_alloc(
+                arena,
+                (size_t)(surface.max_x - surface.min_x) * 4
+            )
+        };
+
+        for (size_t idx = 0; idx < shading_triangle_vec_len(triangles);
+             idx++) {
+            ShadingTriangle* triangle = NULL;
+            RELEASE_ASSERT(
+                shading_triangle_vec_get_ptr(triangles, idx, &triangle)
+            );
+            shading_draw_triangle(
+                &raster,
+                triangle->vertices[0],
+                triangle->vertices[1],
+                triangle->vertices[2]
+            );
+        }
+
+        ShadingVertex* row_scratch = arena_alloc(
+            arena,
+            2 * (((size_t)1 << SHADING_SUBDIVISION_MAX_DEPTH) + 1)
+                * sizeof(ShadingVertex)
+        );
+        for (size_t idx = 0; idx < shading_patch_vec_len(patches); idx++) {
+            ShadingPatch* patch = NULL;
+            RELEASE_ASSERT(shading_patch_vec_get_ptr(patches, idx, &patch));
+            shading_draw_patch(&raster, patch, row_scratch);
+        }
+
+        shading_surface_end(&surface);
+    }
+    shading_pop_bbox_clip(shading_dict, canvas);
+
+    return NULL;
+}
+
+/// A function-based shading being subdivided.
+typedef struct {
+    const PdfShadingDict* shading_dict;
+
+    /// Maps the shading's domain onto device pixels.
+    GeomMat3 to_pixels;
+    int max_depth;
+    ShadingRaster* raster;
+} ShadingFunctionGrid;
+
+/// Evaluates a function-based shading's functions at a point of its domain.
+static Error* shading_function_color(
+    ShadingFunctionGrid* grid,
+    GeomVec2 point,
+    GeomVec3* rgb_out
+) {
+    PdfReal inputs[2] = {point.x, point.y};
+    double components[SHADING_MAX_COMPONENTS];
+    size_t n_components;
+    TRY(eval_shading_function(
+        grid->shading_dict->data.type1.function,
+        inputs,
+        2,
+        components,
+        &n_components
+    ));
+
+    GeomVec3 rgb;
+    shading_components_to_rgb(
+        grid->shading_dict,
+        components,
+        n_components,
+        &rgb
+    );
+    *rgb_out = geom_vec3_new(clamp01(rgb.x), clamp01(rgb.y), clamp01(rgb.z));
+    return NULL;
+}
+
+/// Draws a rectangle of a function-based shading's domain, given the colors
+/// at its corners (min.x, min.y), (max.x, min.y), (max.x, max.y) and
+/// (min.x, max.y). It's split into quarters until its center is within
+/// tolerance of the average of its corners, or it's about a pixel in size,
+/// and then drawn as two triangles.
+static Error* shading_function_quad(
+    ShadingFunctionGrid* grid,
+    GeomVec2 min,
+    GeomVec2 max,
+    const GeomVec3 colors[4],
+    int depth
+) {
+    GeomVec2 mid = geom_vec2_scale(geom_vec2_add(min, max), 0.5);
+
+    if (depth < grid->max_depth) {
+        GeomVec3 center;
+        TRY(shading_function_color(grid, mid, &center));
+
+        GeomVec3 average = geom_vec3_mul(
+            geom_vec3_add(
+                geom_vec3_add(colors[0], colors[1]),
+                geom_vec3_add(colors[2], colors[3])
+            ),
+            geom_vec3_scalar(0.25)
+        );
+        bool is_flat = fabs(center.x - average.x) <= SHADING_LUT_TOLERANCE
+                    && fabs(center.y - average.y) <= SHADING_LUT_TOLERANCE
+                    && fabs(center.z - average.z) <= SHADING_LUT_TOLERANCE;
+
+        if (depth < SHADING_FUNCTION_MIN_DEPTH || !is_flat) {
+            GeomVec3 bottom;
+            GeomVec3 right;
+            GeomVec3 top;
+            GeomVec3 left;
+            TRY(shading_function_color(
+                grid,
+                geom_vec2_new(mid.x, min.y),
+                &bottom
+            ));
+            TRY(shading_function_color(
+                grid,
+                geom_vec2_new(max.x, mid.y),
+                &right
+            ));
+            TRY(shading_function_color(grid, geom_vec2_new(mid.x, max.y), &top)
+            );
+            TRY(shading_function_color(
+                grid,
+                geom_vec2_new(min.x, mid.y),
+                &left
+            ));
+
+            GeomVec3 quarters[4][4] = {
+                {colors[0], bottom, center, left},
+                {bottom, colors[1], right, center},
+                {center, right, colors[2], top},
+                {left, center, top, colors[3]}
+            };
+            TRY(shading_function_quad(grid, min, mid, quarters[0], depth + 1)
+            );
+            TRY(shading_function_quad(
+                grid,
+                geom_vec2_new(mid.x, min.y),
+                geom_vec2_new(max.x, mid.y),
+                quarters[1],
+                depth + 1
+            ));
+            TRY(shading_function_quad(grid, mid, max, quarters[2], depth + 1)
+            );
+            TRY(shading_function_quad(
+                grid,
+                geom_vec2_new(min.x, mid.y),
+                geom_vec2_new(mid.x, max.y),
+                quarters[3],
+                depth + 1
+            ));
+            return NULL;
+        }
+    }
+
+    GeomVec2 corners[4] = {
+        min,
+        geom_vec2_new(max.x, min.y),
+        max,
+        geom_vec2_new(min.x, max.y)
+    };
+    ShadingVertex vertices[4];
+    for (int idx = 0; idx < 4; idx++) {
+        vertices[idx] = (ShadingVertex) {
+            .position = geom_vec2_transform(corners[idx], grid->to_pixels),
+            .value = colors[idx]
+        };
+    }
+    shading_draw_triangle(grid->raster, vertices[0], vertices[1], vertices[2]);
+    shading_draw_triangle(grid->raster, vertices[0], vertices[2], vertices[3]);
+
+    return NULL;
+}
+
+/// Renders a function-based shading by adaptively subdividing its domain.
+/// How deep it may be subdivided follows the domain's size in device space.
+static Error* render_function_shading(
+    const PdfShadingDict* shading_dict,
+    Arena* arena,
+    GeomMat3 ctm,
+    Canvas* canvas
+) {
+    const PdfShadingDictType1* type1 = &shading_dict->data.type1;
+
+    GeomRect area;
+    if (!shading_area(shading_dict, ctm, canvas, &area)) {
+        return NULL;
+    }
+
+    GeomVec2 min = geom_vec2_new(
+        pdf_number_as_real(type1->domain[0]),
+        pdf_number_as_real(type1->domain[2])
+    );
+    GeomVec2 max = geom_vec2_new(
+        pdf_number_as_real(type1->domain[1]),
+        pdf_number_as_real(type1->domain[3])
+    );
+
+    double res = canvas_raster_res(canvas);
+    GeomMat3 to_device = type1->matrix.is_some
+                           ? geom_mat3_mul(type1->matrix.value, ctm)
+                           : ctm;
+    GeomMat3 to_pixels = geom_mat3_mul(
+        to_device,
+        geom_mat3_new_pdf(1.0 / res, 0.0, 0.0, 1.0 / res, 0.0, 0.0)
+    );
+
+    GeomVec2 origin = geom_vec2_transform(min, to_pixels);
+    double width = sqrt(geom_vec2_len_sq(geom_vec2_sub(
+        geom_vec2_transform(geom_vec2_new(max.x, min.y), to_pixels),
+        origin
+    )));
+    double height = sqrt(geom_vec2_len_sq(geom_vec2_sub(
+        geom_vec2_transform(geom_vec2_new(min.x, max.y), to_pixels),
+        origin
+    )));
+
+    area = geom_rect_intersection(
+        area,
+        geom_rect_transform(geom_rect_new(min, max), to_device)
+    );
+
+    ShadingFunctionGrid grid = {
+        .shading_dict = shading_dict,
+        .to_pixels = to_pixels,
+        .max_depth = shading_subdivision_depth(fmax(width, height)),
+        .raster = NULL
+    };
+
+    GeomVec3 colors[4];
+    TRY(shading_function_color(&grid, min, &colors[0]));
+    TRY(shading_function_color(&grid, geom_vec2_new(max.x, min.y), &colors[1])
+    );
+    TRY(shading_function_color(&grid, max, &colors[2]));
+    TRY(shading_function_color(&grid, geom_vec2_new(min.x, max.y), &colors[3])
+    );
+
+    ShadingSurface surface;
+    Error* error = NULL;
+    shading_push_bbox_clip(shading_dict, arena, ctm, canvas);
+    if (shading_surface_begin(arena, canvas, area, &surface)) {
+        ShadingRaster raster = {
+            .surface = &surface,
+            .lut = NULL,
+            .pixels = arena_alloc(
+                arena,
+                (size_t)(surface.max_x - surface.min_x) * 4
+            )
+        };
+        grid.raster = &raster;
+
+        error = shading_function_quad(&grid, min, max, colors, 0);
+        shading_surface_end(&surface);
+    }
+    shading_pop_bbox_clip(shading_dict, canvas);
+
+    return error;
+}
+
+void render_shading(
+    PdfShadingDict* shading_dict,
+    Arena* arena,
+    GeomMat3 ctm,
+    Canvas* canvas
+) {
+    RELEASE_ASSERT(shading_dict);
+    RELEASE_ASSERT(arena);
+    RELEASE_ASSERT(canvas);
+
+    switch (shading_dict->shading_type) {
+        case 2: {
+            PdfShadingDictType2 type2 = shading_dict->data.type2;
+
+            GeomVec2 start = geom_vec2_new(
+                pdf_number_as_real(type2.coords[0]),
+                pdf_number_as_real(type2.coords[1])
+            );
+            GeomVec2 end = geom_vec2_new(
+                pdf_number_as_real(type2.coords[2]),
+                pdf_number_as_real(type2.coords[3])
+            );
+            GeomVec2 axis = geom_vec2_sub(end, start);
+            double axis_len_sq = geom_vec2_len_sq(axis);
+            if (axis_len_sq < 1e-12) {
+                break;
+            }
+
+            ShadingAxial axial = {
+                .start = start,
+                .axis = axis,
+                .inv_axis_len_sq = 1.0 / axis_len_sq,
+                .extend = {type2.extend[0], type2.extend[1]}
+            };
+            CanvasGradient gradient = {
+                .type = CANVAS_GRADIENT_LINEAR,
+                .start = start,
+                .end = end,
+                .extend_start = type2.extend[0],
+                .extend_end = type2.extend[1]
+            };
+            render_parametric_shading(
+                shading_dict,
+                type2.function,
+                type2.domain,
+                shading_axial_row,
+                &axial,
+                NULL,
+                &gradient,
+                ctm,
+                canvas
+            );
+            break;
+        }
+        case 3: {
+            PdfShadingDictType3 type3 = shading_dict->data.type3;
+
+            GeomVec2 c0 = geom_vec2_new(
+                pdf_number_as_real(type3.coords[0]),
+                pdf_number_as_real(type3.coords[1])
+            );
+            PdfReal r0 = pdf_number_as_real(type3.coords[2]);
+            GeomVec2 c1 = geom_vec2_new(
+                pdf_number_as_real(type3.coords[3]),
+                pdf_number_as_real(type3.coords[4])
+            );
+            PdfReal r1 = pdf_number_as_real(type3.coords[5]);
+            if (r0 <= 0.0 && r1 <= 0.0) {
+                break;
+            }
+
+            ShadingRadial radial = {
+                .start_center = c0,
+                .start_radius = r0,
+                .center_delta = geom_vec2_sub(c1, c0),
+                .radius_delta = r1 - r0,
+                .extend = {type3.extend[0], type3.extend[1]}
+            };
+
+            // Without extension, everything painted lies within the circles'
+            // bounds
+            GeomRect circle_bounds = geom_rect_union(
+                geom_rect_new_centered(c0, geom_vec2_new(r0, r0)),
+                geom_rect_new_centered(c1, geom_vec2_new(r1, r1))
+            );
+            bool is_extended = type3.extend[0] || type3.extend[1];
+            CanvasGradient gradient = {
+                .type = CANVAS_GRADIENT_RADIAL,
+                .start = c0,
+                .end = c1,
+                .start_radius = r0,
+                .end_radius = r1,
+                .extend_start = type3.extend[0],
+                .extend_end = type3.extend[1]
+            };
+
+            render_parametric_shading(
+                shading_dict,
+                type3.function,
+                type3.domain,
+                shading_radial_row,
+                &radial,
+                is_extended ? NULL : &circle_bounds,
+                &gradient,
+                ctm,
+                canvas
+            );
+            break;
+        }
+        case 1: {
+            Error* error =
+                render_function_shading(shading_dict, arena, ctm, canvas);
+            if (error) {
+                error_print(error);
+                error_free(error);
+            }
+            break;
+        }
+        case 4:
+        case 5:
+        case 6:
+        case 7: {
+            Error* error =
+                render_mesh_shading(shading_dict, arena, ctm, canvas);
+            if (error) {
+                error_print(error);
+                error_free(error);
+            }
+            break;
+        }
+        default: {
+            LOG_TODO("Render shading type %d", shading_dict->shading_type);
+        }
+    }
+}
+
+typedef struct {
+    PdfShadingDict shading_dict;
+    GeomMat3 ctm;
+} RenderDeferredShading;
+
+static void render_deferred_shading_draw(
+    const void* data,
+    GeomMat3 transform,
+    Canvas* canvas
+) {
+    const RenderDeferredShading* deferred = data;
+    RELEASE_ASSERT(deferred);
+
+    PdfShadingDict shading_dict = deferred->shading_dict;
+    Arena* arena = arena_new(1024);
+    render_shading(
+        &shading_dict,
+        arena,
+        geom_mat3_mul(deferred->ctm, transform),
+        canvas
+    );
+    arena_free(arena);
+}
+
+void render_shading_deferred(
+    const PdfShadingDict* shading_dict,
+    GeomMat3 ctm,
+    Canvas* canvas
+) {
+    RELEASE_ASSERT(shading_dict);
+    RELEASE_ASSERT(canvas);
+
+    RenderDeferredShading deferred = {
+        .shading_dict = *shading_dict,
+        .ctm = ctm
+    };
+    canvas_draw_deferred(
+        canvas,
+        render_deferred_shading_draw,
+        &deferred,
+        sizeof(RenderDeferredShading)
+    );
 }
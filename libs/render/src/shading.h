@@ -11,3 +11,11 @@ void render_shading(
     GeomMat3 ctm,
     Canvas* canvas
 );
+
+/// Submits a shading to `canvas` as deferred content, so vector recordings
+/// sample it only once the final device transform is known.
+void render_shading_deferred(
+    const PdfShadingDict* shading_dict,
+    GeomMat3 ctm,
+    Canvas* canvas
+);
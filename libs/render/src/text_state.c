@@ -47,15 +47,28 @@ Error* text_state_render(
         return ERROR(RENDER_ERR_FONT_NOT_SET);
     }
 
+    RenderFont* font = state->text_font;
+    RELEASE_ASSERT(font);
+
+    if (!font->has_font_matrix) {
+        TRY(get_font_matrix(
+            arena,
+            cache,
+            resolver,
+            &font->glyph_font,
+            &font->font_matrix
+        ));
+        font->has_font_matrix = true;
+    }
+    GeomMat3 font_matrix = font->font_matrix;
+
     size_t offset = 0;
 
     while (true) {
         // Get CID
         bool finished = false;
         uint32_t cid;
-        TRY(
-            next_cid(&state->text_font, cache, &text, &offset, &finished, &cid)
-        );
+        TRY(next_cid(&font->font, cache, &text, &offset, &finished, &cid));
 
         if (finished) {
             break;
@@ -63,11 +76,15 @@ Error* text_state_render(
 
         // Get GID
         uint32_t gid;
-        TRY(cid_to_gid(arena, &state->text_font, cache, resolver, cid, &gid));
-
-        // Get font matrix
-        GeomMat3 font_matrix;
-        TRY(get_font_matrix(arena, resolver, &state->text_font, &font_matrix));
+        TRY(cid_to_gid(
+            arena,
+            &font->glyph_font,
+            &font->to_unicode,
+            cache,
+            resolver,
+            cid,
+            &gid
+        ));
 
         // Render
         GeomMat3 render_matrix = geom_mat3_mul(
@@ -93,7 +110,8 @@ Error* text_state_render(
 
         TRY(render_glyph(
             arena,
-            &state->text_font,
+            &font->glyph_font,
+            cache,
             resolver,
             gid,
             canvas,
@@ -102,7 +120,15 @@ Error* text_state_render(
         ));
 
         PdfNumber glyph_width;
-        TRY(cid_to_width(&state->text_font, resolver, cid, &glyph_width));
+        if (cid < 256 && font->has_code_width[cid]) {
+            glyph_width = font->code_widths[cid];
+        } else {
+            TRY(cid_to_width(&font->glyph_font, resolver, cid, &glyph_width));
+            if (cid < 256) {
+                font->code_widths[cid] = glyph_width;
+                font->has_code_width[cid] = true;
+            }
+        }
 
         double tx =
             (pdf_number_as_real(glyph_width) * 0.001 * state->text_font_size
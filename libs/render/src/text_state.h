@@ -26,7 +26,7 @@ typedef struct {
     PdfReal word_spacing;        // T_w
     PdfReal horizontal_scaling;  // T_h
     PdfReal leading;             // T_l
-    PdfFont text_font;           // T_f
+    RenderFont* text_font;       // T_f
     PdfReal text_font_size;      // T_fs
     TextRenderingMode text_mode; // T_mode
     PdfReal text_rise;           // T_rise
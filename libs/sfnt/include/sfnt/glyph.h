@@ -3,6 +3,7 @@
 #include <stdint.h>
 
 #include "canvas/canvas.h"
+#include "canvas/path_builder.h"
 #include "geom/mat3.h"
 #include "parse_ctx/ctx.h"
 #include "types.h"
@@ -75,6 +76,13 @@ typedef struct {
     } data;
 } SfntGlyph;
 
+/// Appends the outline of a glyph, transformed by `transform`, to `path`.
+void sfnt_glyph_outline(
+    const SfntGlyph* glyph,
+    GeomMat3 transform,
+    PathBuilder* path
+);
+
 void sfnt_glyph_render(
     Canvas* canvas,
     const SfntGlyph* glyph,
@@ -50,6 +50,12 @@ typedef struct {
 
 Error* sfnt_font_new(Arena* arena, ParseCtx ctx, SfntFont* out);
 
+/// Copies `font` into `out`, sharing its parsed tables. Reading glyphs seeks
+/// the font's cursors and allocates on its arena, so `out` gets cursors of its
+/// own and allocates on `arena`, and may be used on a different thread from
+/// `font`.
+void sfnt_font_copy(Arena* arena, const SfntFont* font, SfntFont* out);
+
 SfntHead sfnt_font_head(SfntFont* font);
 
 Error*
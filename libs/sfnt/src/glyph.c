@@ -216,26 +216,18 @@ Error* sfnt_parse_glyph(Arena* arena, ParseCtx ctx, SfntGlyph* glyph) {
 }
 
 // TODO: Fully translate this to using the geometry helper lib
-void sfnt_glyph_render(
-    Canvas* canvas,
+void sfnt_glyph_outline(
     const SfntGlyph* glyph,
     GeomMat3 transform,
-    CanvasBrush brush
+    PathBuilder* path
 ) {
-    RELEASE_ASSERT(canvas);
     RELEASE_ASSERT(glyph);
+    RELEASE_ASSERT(path);
 
     if (glyph->num_contours == 0) {
         return;
     }
 
-    Arena* temp_arena = arena_new(4096);
-    PathBuilderOptions path_options = path_builder_options_default();
-    if (canvas_is_raster(canvas)) {
-        path_options = path_builder_options_flattened();
-    }
-    PathBuilder* path = path_builder_new_with_options(temp_arena, path_options);
-
     if (glyph->glyph_type != SFNT_GLYPH_TYPE_SIMPLE) {
         LOG_TODO("Only simple glyphs are supported");
     }
@@ -341,6 +333,29 @@ void sfnt_glyph_render(
         x_coord = contour_end_x;
         y_coord = contour_end_y;
     }
+}
+
+void sfnt_glyph_render(
+    Canvas* canvas,
+    const SfntGlyph* glyph,
+    GeomMat3 transform,
+    CanvasBrush brush
+) {
+    RELEASE_ASSERT(canvas);
+    RELEASE_ASSERT(glyph);
+
+    if (glyph->num_contours == 0) {
+        return;
+    }
+
+    Arena* temp_arena = arena_new(4096);
+    PathBuilderOptions path_options = path_builder_options_default();
+    if (canvas_is_raster(canvas)) {
+        path_options = path_builder_options_flattened();
+    }
+    PathBuilder* path = path_builder_new_with_options(temp_arena, path_options);
+
+    sfnt_glyph_outline(glyph, transform, path);
 
     canvas_draw_path(canvas, path, brush);
     arena_free(temp_arena);
@@ -77,6 +77,15 @@ Error* sfnt_font_new(Arena* arena, ParseCtx ctx, SfntFont* out) {
     return NULL;
 }
 
+void sfnt_font_copy(Arena* arena, const SfntFont* font, SfntFont* out) {
+    RELEASE_ASSERT(arena);
+    RELEASE_ASSERT(font);
+    RELEASE_ASSERT(out);
+
+    *out = *font;
+    out->arena = arena;
+}
+
 SfntHead sfnt_font_head(SfntFont* font) {
     RELEASE_ASSERT(font);
     return font->head;